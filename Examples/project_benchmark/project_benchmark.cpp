@@ -0,0 +1,127 @@
+#include <iostream>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRegExp>
+#include <QString>
+#include "Required/Project/FileCategory.h"
+#include "Required/Project/Project.h"
+#include "Required/Project/ProjectException.h"
+#include "Required/Project/ProjectSerializer.h"
+
+
+/**
+ * Prints the throughput of writing a number of bytes in some time.
+ */
+void report(const char* label, qint64 bytes, qint64 msecs)
+{
+    double megabytes = bytes / (1024.0 * 1024.0);
+    double seconds = qMax<qint64>(msecs, 1) / 1000.0;
+    std::cout << label << ": " << megabytes << " MB in " << msecs << " ms, "
+              << megabytes / seconds << " MB/s" << std::endl;
+}
+
+/**
+ * Serializes the project with given options and returns the elapsed time.
+ */
+qint64 serialize(const Required::Project& project, QString filename,
+                 Required::ProjectSerializer::Options options, qint64* bytes)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        throw Required::ProjectException(file.errorString());
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    Required::ProjectSerializer serializer(&file);
+    serializer.setOptions(options);
+    serializer.serialize(project);
+    file.flush();
+    qint64 elapsed = timer.elapsed();
+
+    *bytes = file.size();
+    file.close();
+    return elapsed;
+}
+
+/**
+ * Writes the same amount of data in large blocks, as the disk baseline.
+ */
+qint64 writeRaw(QString filename, qint64 bytes)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        throw Required::ProjectException(file.errorString());
+    }
+
+    QByteArray block(4 * 1024 * 1024, 'x');
+    QElapsedTimer timer;
+    timer.start();
+    for (qint64 written = 0; written < bytes; written += block.size())
+    {
+        file.write(block.constData(), qMin<qint64>(block.size(), bytes - written));
+    }
+    file.flush();
+    qint64 elapsed = timer.elapsed();
+
+    file.close();
+    return elapsed;
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: project_benchmark <FILENAME> [FILE_COUNT]" << std::endl;
+        return 1;
+    }
+    QString filename = argv[1];
+    int fileCount = argc > 2 ? QString(argv[2]).toInt() : 1000000;
+
+    Required::FileCategory::registerCategory("src", "Source files", QRegExp("\\.cpp$"));
+    Required::FileCategory::registerCategory("hdr", "Header files", QRegExp("\\.h$"));
+    Required::FileCategory::registerCategory("", "Other");
+
+    // files don't have to exist, insertFiles() trusts its input
+    Required::Project project;
+    project.setName("Benchmark");
+    Required::CategorizedFileList files;
+    for (int i = 0; i < fileCount; ++i)
+    {
+        QString path = QString("/home/user/projects/benchmark/module%1/file%2")
+            .arg(i / 1000).arg(i);
+        files.append(qMakePair(path + (i % 2 ? ".cpp" : ".h"), QString(i % 2 ? "src" : "hdr")));
+    }
+    project.insertFiles(files);
+    std::cout << "Project with " << fileCount << " files" << std::endl;
+
+    try
+    {
+        qint64 bytes = 0;
+        qint64 elapsed = serialize(project, filename, Required::ProjectSerializer::NoOptions, &bytes);
+        report("QXmlStreamWriter", bytes, elapsed);
+
+        elapsed = serialize(project, filename, Required::ProjectSerializer::FastWriter, &bytes);
+        report("Fast writer", bytes, elapsed);
+
+        elapsed = serialize(project, filename,
+                            Required::ProjectSerializer::FastWriter |
+                            Required::ProjectSerializer::GroupFilesByCategory,
+                            &bytes);
+        report("Fast writer, grouped", bytes, elapsed);
+
+        elapsed = writeRaw(filename, bytes);
+        report("Raw write", bytes, elapsed);
+    }
+    catch (Required::ProjectException& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
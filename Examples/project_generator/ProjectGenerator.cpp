@@ -0,0 +1,224 @@
+#include "ProjectGenerator.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegExp>
+#include "Required/Project/FileCategory.h"
+#include "Required/Project/ProjectException.h"
+
+namespace
+{
+    /**
+     * Characters used in generated names.
+     */
+    const char NameCharacters[] = "abcdefghijklmnopqrstuvwxyz0123456789_";
+
+    /**
+     * Modification times of listed files are spread over a year before this.
+     */
+    const qint64 ListingEpoch = Q_INT64_C(1356998400000);
+
+    /**
+     * Mixes bits of a key, so that neighbouring keys give unrelated names.
+     */
+    quint32 mix(quint32 key)
+    {
+        key ^= key >> 16;
+        key *= 0x7feb352d;
+        key ^= key >> 15;
+        key *= 0x846ca68b;
+        key ^= key >> 16;
+        return key;
+    }
+}
+
+ProjectGenerator::ProjectGenerator():
+    m_rootPath(QDir::tempPath() + "/required_generated"), m_fileCount(10000),
+    m_depth(3), m_fanOut(16), m_minNameLength(6), m_maxNameLength(16),
+    m_seed(1), m_state(1), m_totalWeight(0)
+{
+}
+
+/**
+ * Sets the range of lengths of file and directory names.
+ */
+void ProjectGenerator::setNameLength(int minLength, int maxLength)
+{
+    m_minNameLength = qMax(1, minLength);
+    m_maxNameLength = qMax(m_minNameLength, maxLength);
+}
+
+/**
+ * Adds a category; files are assigned to categories in proportion to weights.
+ *
+ * Files created on disk begin with the magic bytes, if any.
+ */
+void ProjectGenerator::addCategory(QString shortName, QString extension, int weight,
+                                   QByteArray magic)
+{
+    Category category;
+    category.shortName = shortName;
+    category.extension = extension;
+    category.weight = qMax(1, weight);
+    category.magic = magic;
+    m_categories.append(category);
+    m_totalWeight += category.weight;
+}
+
+/**
+ * Registers all categories with their extensions and magic numbers.
+ */
+void ProjectGenerator::registerCategories() const
+{
+    foreach (const Category& category, m_categories)
+    {
+        Required::FileCategory::registerCategory(category.shortName, category.shortName,
+                                                 QRegExp(".*\\." + QRegExp::escape(category.extension)));
+        if (!category.magic.isEmpty())
+        {
+            Required::FileCategory::registerContentSignature(category.shortName, category.magic);
+        }
+    }
+}
+
+/**
+ * Generates file paths and records without touching the disk.
+ */
+Required::RecordedFileList ProjectGenerator::generateListing()
+{
+    return generate(false);
+}
+
+/**
+ * Creates the tree on disk and returns records of the created files.
+ */
+Required::RecordedFileList ProjectGenerator::generateOnDisk()
+{
+    return generate(true);
+}
+
+/**
+ * Returns the next pseudo-random number (xorshift32).
+ */
+quint32 ProjectGenerator::next()
+{
+    m_state ^= m_state << 13;
+    m_state ^= m_state >> 17;
+    m_state ^= m_state << 5;
+    return m_state;
+}
+
+/**
+ * Returns a name derived from a key, so that it is the same every time.
+ */
+QString ProjectGenerator::name(quint32 key, int length) const
+{
+    QString result;
+    result.reserve(length);
+    int alphabetSize = int(sizeof(NameCharacters)) - 1;
+    for (int i = 0; i < length; ++i)
+    {
+        key = mix(key + i);
+        result.append(QChar(NameCharacters[key % alphabetSize]));
+    }
+
+    return result;
+}
+
+/**
+ * Picks a random directory of the tree, relative to the root.
+ *
+ * Directory names depend only on the position in the tree.
+ */
+QString ProjectGenerator::directoryFor()
+{
+    QString directory;
+    quint32 nodeKey = m_seed;
+    int span = m_maxNameLength - m_minNameLength + 1;
+    for (int level = 0; level < m_depth; ++level)
+    {
+        quint32 child = next() % m_fanOut;
+        nodeKey = mix(nodeKey * 31 + child + 1);
+        directory += name(nodeKey, m_minNameLength + nodeKey % span) + '/';
+    }
+
+    return directory;
+}
+
+/**
+ * Picks a category according to the weights.
+ */
+const ProjectGenerator::Category& ProjectGenerator::pickCategory()
+{
+    int ticket = next() % m_totalWeight;
+    for (int i = 0; i < m_categories.size(); ++i)
+    {
+        ticket -= m_categories.at(i).weight;
+        if (ticket < 0)
+        {
+            return m_categories.at(i);
+        }
+    }
+
+    return m_categories.last();
+}
+
+/**
+ * Generates the tree; falls back to a default category mix if none was added.
+ */
+Required::RecordedFileList ProjectGenerator::generate(bool onDisk)
+{
+    if (m_categories.isEmpty())
+    {
+        addCategory("src", "cpp", 6);
+        addCategory("hdr", "h", 3);
+        addCategory("img", "png", 1, QByteArray("\x89PNG\r\n\x1a\n", 8));
+    }
+
+    m_state = m_seed;
+    QSet<QString> createdDirectories;
+    Required::RecordedFileList files;
+    files.reserve(m_fileCount);
+    int span = m_maxNameLength - m_minNameLength + 1;
+    for (int i = 0; i < m_fileCount; ++i)
+    {
+        QString directory = m_rootPath + '/' + directoryFor();
+        const Category& category = pickCategory();
+
+        // the index keeps names unique within the whole tree
+        quint32 nameKey = next();
+        int nameLength = m_minNameLength + next() % span;
+        QString filename = directory + name(nameKey, nameLength) +
+                           '_' + QString::number(i) + '.' + category.extension;
+
+        if (!onDisk)
+        {
+            Required::FileRecord record(category.shortName, next() % (1024 * 1024),
+                                        ListingEpoch - qint64(next() % (365 * 24 * 3600)) * 1000);
+            files.append(qMakePair(filename, record));
+            continue;
+        }
+
+        if (!createdDirectories.contains(directory))
+        {
+            if (!QDir().mkpath(directory))
+            {
+                throw Required::ProjectException(QString("Cannot create %1").arg(directory));
+            }
+            createdDirectories.insert(directory);
+        }
+
+        QFile file(filename);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            throw Required::ProjectException(file.errorString());
+        }
+        file.write(category.magic);
+        file.write(QByteArray(next() % 4096, 'x'));
+        file.close();
+        files.append(qMakePair(filename, Required::FileRecord(category.shortName,
+                                                              QFileInfo(filename))));
+    }
+
+    return files;
+}
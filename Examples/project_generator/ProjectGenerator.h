@@ -0,0 +1,67 @@
+#ifndef PROJECTGENERATOR_H
+#define PROJECTGENERATOR_H
+
+#include <QByteArray>
+#include <QList>
+#include <QSet>
+#include <QString>
+#include "Required/Project/Project.h"
+
+/**
+ * Generates synthetic project trees for testing at scale.
+ *
+ * Files are spread over a tree of directories of configurable depth and
+ * fan-out, and assigned to categories according to their weights. The
+ * same seed always produces the same tree. A tree may be generated only
+ * as a listing (with made-up sizes and times) or created on disk.
+ */
+class ProjectGenerator
+{
+public:
+    ProjectGenerator();
+
+    void setRootPath(QString rootPath) { m_rootPath = rootPath; }
+    void setFileCount(int fileCount) { m_fileCount = fileCount; }
+    void setDepth(int depth) { m_depth = qMax(0, depth); }
+    void setFanOut(int fanOut) { m_fanOut = qMax(1, fanOut); }
+    void setNameLength(int minLength, int maxLength);
+    void setSeed(quint32 seed) { m_seed = seed ? seed : 1; }
+
+    QString getRootPath() const { return m_rootPath; }
+    int getFileCount() const { return m_fileCount; }
+
+    void addCategory(QString shortName, QString extension, int weight,
+                     QByteArray magic = QByteArray());
+    void registerCategories() const;
+
+    Required::RecordedFileList generateListing();
+    Required::RecordedFileList generateOnDisk();
+
+private:
+    struct Category
+    {
+        QString shortName;
+        QString extension;
+        int weight;
+        QByteArray magic;
+    };
+
+    QString m_rootPath;
+    int m_fileCount;
+    int m_depth;
+    int m_fanOut;
+    int m_minNameLength;
+    int m_maxNameLength;
+    quint32 m_seed;
+    quint32 m_state;
+    QList<Category> m_categories;
+    int m_totalWeight;
+
+    quint32 next();
+    QString name(quint32 key, int length) const;
+    QString directoryFor();
+    const Category& pickCategory();
+    Required::RecordedFileList generate(bool onDisk);
+};
+
+#endif // PROJECTGENERATOR_H
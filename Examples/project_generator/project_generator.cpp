@@ -0,0 +1,127 @@
+#include <iostream>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include "ProjectGenerator.h"
+#include "Required/Project/Project.h"
+#include "Required/Project/ProjectException.h"
+#include "Required/Project/ProjectSerializer.h"
+
+
+void usage()
+{
+    std::cerr << "Usage: project_generator <PROJECT_FILE> [OPTIONS]" << std::endl
+              << "  --root DIR          root directory of the tree" << std::endl
+              << "  --files N           number of files (default 10000)" << std::endl
+              << "  --depth N           directory levels (default 3)" << std::endl
+              << "  --fan-out N         subdirectories per directory (default 16)" << std::endl
+              << "  --name-length A:B   length range of names (default 6:16)" << std::endl
+              << "  --category S:E:W    category short name, extension and weight;" << std::endl
+              << "                      may be repeated (default src:cpp:6 hdr:h:3 img:png:1)" << std::endl
+              << "  --seed N            seed of the generator (default 1)" << std::endl
+              << "  --on-disk           create the tree on disk instead of a listing" << std::endl;
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        usage();
+        return 1;
+    }
+    QString filename = argv[1];
+
+    ProjectGenerator generator;
+    bool onDisk = false;
+    for (int i = 2; i < argc; ++i)
+    {
+        QString option = argv[i];
+        QString value = i + 1 < argc ? QString(argv[i + 1]) : QString();
+        if (option == "--on-disk")
+        {
+            onDisk = true;
+            continue;
+        }
+        if (value.isEmpty())
+        {
+            usage();
+            return 1;
+        }
+
+        ++i;
+        if (option == "--root")
+        {
+            generator.setRootPath(value);
+        }
+        else if (option == "--files")
+        {
+            generator.setFileCount(value.toInt());
+        }
+        else if (option == "--depth")
+        {
+            generator.setDepth(value.toInt());
+        }
+        else if (option == "--fan-out")
+        {
+            generator.setFanOut(value.toInt());
+        }
+        else if (option == "--name-length")
+        {
+            generator.setNameLength(value.section(':', 0, 0).toInt(),
+                                    value.section(':', 1, 1).toInt());
+        }
+        else if (option == "--category")
+        {
+            QStringList parts = value.split(':');
+            generator.addCategory(parts.value(0), parts.value(1), parts.value(2, "1").toInt());
+        }
+        else if (option == "--seed")
+        {
+            generator.setSeed(value.toUInt());
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    try
+    {
+        Required::RecordedFileList files = onDisk ? generator.generateOnDisk()
+                                                  : generator.generateListing();
+        generator.registerCategories();
+
+        Required::Project project;
+        project.setName("Generated");
+        project.setRootPath(generator.getRootPath());
+        project.insertFiles(files);
+        std::cout << "Generated " << project.getFiles().size() << " files under "
+                  << generator.getRootPath().toStdString() << std::endl;
+
+        // *.gz files are stored compressed
+        QFile file(filename);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            throw Required::ProjectException(file.errorString());
+        }
+        Required::ProjectSerializer serializer(&file);
+        Required::ProjectSerializer::Options options = Required::ProjectSerializer::FastWriter |
+            Required::ProjectSerializer::GroupFilesByCategory;
+        if (filename.endsWith(".gz"))
+        {
+            options |= Required::ProjectSerializer::Compressed;
+        }
+        serializer.setOptions(options);
+        serializer.serialize(project);
+        file.close();
+    }
+    catch (Required::ProjectException& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
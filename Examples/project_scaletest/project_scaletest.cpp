@@ -0,0 +1,250 @@
+#include <iostream>
+#include <QApplication>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QRegExp>
+#include <QString>
+#include <QStringList>
+#include "Examples/project_generator/ProjectGenerator.h"
+#include "Required/Project/ContentSearch.h"
+#include "Required/Project/Project.h"
+#include "Required/Project/ProjectException.h"
+#include "Required/Project/ProjectQuery.h"
+#include "Required/Project/ProjectSerializer.h"
+#include "Required/Project/ProjectWidget.h"
+
+
+/**
+ * Counts failed checks.
+ */
+int failures = 0;
+
+/**
+ * Multiplier of all ceilings, for slower machines.
+ */
+double tolerance = 1.0;
+
+/**
+ * Returns the resident memory of the process in bytes, -1 if unknown.
+ */
+qint64 residentMemory()
+{
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        return -1;
+    }
+
+    foreach (QByteArray line, status.readAll().split('\n'))
+    {
+        if (line.startsWith("VmRSS:"))
+        {
+            return line.mid(6).trimmed().split(' ').value(0).toLongLong() * 1024;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Compares a measurement with its ceiling and prints the outcome.
+ */
+void check(const char* label, double measured, double ceiling, const char* unit)
+{
+    ceiling *= tolerance;
+    bool passed = measured <= ceiling;
+    if (!passed)
+    {
+        ++failures;
+    }
+    std::cout << (passed ? "  PASS " : "  FAIL ") << label << ": " << measured << " " << unit
+              << " (ceiling " << ceiling << " " << unit << ")" << std::endl;
+}
+
+/**
+ * Compares the literal a pattern is known to require with the expected one.
+ *
+ * A literal which isn't really required makes searches and the trigram
+ * index skip matching lines, so these are correctness checks, not timings.
+ */
+void checkLiteral(const char* pattern, QRegExp::PatternSyntax syntax, const char* expected)
+{
+    QString literal = Required::ContentSearch::getRequiredLiteral(QRegExp(pattern, Qt::CaseSensitive, syntax));
+    bool passed = literal == expected;
+    if (!passed)
+    {
+        ++failures;
+    }
+    std::cout << (passed ? "  PASS " : "  FAIL ") << "required literal of " << pattern << ": \""
+              << literal.toStdString() << "\" (expected \"" << expected << "\")" << std::endl;
+}
+
+/**
+ * Runs the checks of required literals.
+ */
+void runLiteralChecks()
+{
+    std::cout << "required literals" << std::endl;
+    checkLiteral("(foo)?bar", QRegExp::RegExp2, "bar");
+    checkLiteral("(foo)*bar", QRegExp::RegExp2, "bar");
+    checkLiteral("(foo){0,3}bar", QRegExp::RegExp2, "bar");
+    checkLiteral("(foo){,3}bar", QRegExp::RegExp2, "bar");
+    checkLiteral("(x)*", QRegExp::RegExp2, "");
+    checkLiteral("(a(longer)?)b", QRegExp::RegExp2, "a");
+    checkLiteral("(foo)+bar", QRegExp::RegExp2, "foo");
+    checkLiteral("(foo){2}b", QRegExp::RegExp2, "foo");
+    checkLiteral("*.[ch]", QRegExp::Wildcard, ".");
+    checkLiteral("a[0-9].cpp", QRegExp::WildcardUnix, ".cpp");
+}
+
+/**
+ * Runs all checks for one project size.
+ */
+void runScale(int fileCount, bool onDisk, bool withWidget)
+{
+    std::cout << fileCount << " files" << std::endl;
+
+    ProjectGenerator generator;
+    generator.setFileCount(fileCount);
+    generator.setDepth(fileCount >= 1000000 ? 4 : 3);
+    Required::RecordedFileList files = onDisk ? generator.generateOnDisk()
+                                              : generator.generateListing();
+    generator.registerCategories();
+
+    QElapsedTimer timer;
+    qint64 memoryBefore = residentMemory();
+    // on the heap, since the widget takes ownership of it
+    Required::Project* project = new Required::Project();
+    project->setRootPath(generator.getRootPath());
+    timer.start();
+    project->insertFiles(files);
+    double elapsed = timer.nsecsElapsed();
+    qint64 memoryAfter = residentMemory();
+    files.clear();
+
+    check("insert", elapsed / fileCount / 1000.0, 5.0, "us/file");
+    if (memoryBefore >= 0 && memoryAfter >= 0)
+    {
+        check("memory", double(memoryAfter - memoryBefore) / fileCount, 512.0, "bytes/file");
+    }
+    else
+    {
+        std::cout << "  SKIP memory: not available on this platform" << std::endl;
+    }
+
+    timer.restart();
+    project->getFileHandlesInCategory("src", 0, 1000);
+    check("first page of a category", timer.nsecsElapsed() / 1000000.0, 50.0, "ms");
+
+    timer.restart();
+    project->getCategoryStatistics("src");
+    check("category statistics", timer.nsecsElapsed() / 1000000.0, 1.0, "ms");
+
+    timer.restart();
+    Required::ProjectQuery().inCategory("img").largerThan(512 * 1024).run(*project);
+    check("category query", timer.nsecsElapsed() / double(fileCount) / 1000.0, 2.0, "us/file");
+
+    // serialization has to go through a device, a buffer keeps the disk out
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    Required::ProjectSerializer serializer(&buffer);
+    serializer.setOptions(Required::ProjectSerializer::FastWriter |
+                          Required::ProjectSerializer::GroupFilesByCategory);
+    timer.restart();
+    serializer.serialize(*project);
+    check("serialize", timer.nsecsElapsed() / double(fileCount) / 1000.0, 3.0, "us/file");
+    buffer.close();
+
+    // loading checks that every file exists
+    if (onDisk)
+    {
+        buffer.open(QIODevice::ReadOnly);
+        Required::ProjectSerializer deserializer(&buffer);
+        timer.restart();
+        Required::Project* loaded = deserializer.deserializeParallel();
+        check("deserialize", timer.nsecsElapsed() / double(fileCount) / 1000.0, 20.0, "us/file");
+        delete loaded;
+        buffer.close();
+    }
+
+    if (withWidget)
+    {
+        Required::ProjectWidget widget;
+        timer.restart();
+        widget.setProject(project);
+        check("widget setProject", timer.nsecsElapsed() / 1000000.0, 100.0, "ms");
+        widget.closeProject();
+
+        // the closed project is deleted later, there is no event loop
+        QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+    }
+    else
+    {
+        delete project;
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    QList<int> scales;
+    bool onDisk = false;
+    bool withWidget = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        QString option = argv[i];
+        if (option == "--on-disk")
+        {
+            onDisk = true;
+        }
+        else if (option == "--widget")
+        {
+            withWidget = true;
+        }
+        else if (option == "--tolerance" && i + 1 < argc)
+        {
+            tolerance = QString(argv[++i]).toDouble();
+        }
+        else if (option.toInt() > 0)
+        {
+            scales.append(option.toInt());
+        }
+        else
+        {
+            std::cerr << "Usage: project_scaletest [--on-disk] [--widget] [--tolerance X] "
+                         "[FILE_COUNT...]" << std::endl
+                      << "Default file counts are 10000, 1000000 and 10000000. "
+                         "Set QT_QPA_PLATFORM=offscreen to run --widget headless." << std::endl;
+            return 1;
+        }
+    }
+    if (scales.isEmpty())
+    {
+        scales << 10000 << 1000000 << 10000000;
+    }
+
+    // the widget needs an application object, even if it's never shown
+    QApplication application(argc, argv);
+
+    runLiteralChecks();
+
+    try
+    {
+        foreach (int fileCount, scales)
+        {
+            runScale(fileCount, onDisk, withWidget);
+        }
+    }
+    catch (Required::ProjectException& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << (failures ? "FAILED: " : "OK: ") << failures << " check(s) failed"
+              << std::endl;
+    return failures ? 1 : 0;
+}
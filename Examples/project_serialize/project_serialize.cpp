@@ -24,10 +24,22 @@ int main(int argc, char *argv[])
             std::cerr << "Usage: project_serialize <FILENAME>" << std::endl;
             return 1;
         }
-        QFile file(argv[1]);
-        if (file.open(QIODevice::WriteOnly | QIODevice::Text))
+        // *.gz files are stored compressed, which requires binary mode
+        QString filename = argv[1];
+        bool compressed = filename.endsWith(".gz");
+        QFile file(filename);
+        QIODevice::OpenMode mode = QIODevice::WriteOnly;
+        if (!compressed)
+        {
+            mode |= QIODevice::Text;
+        }
+        if (file.open(mode))
         {
             Required::ProjectSerializer serializer(&file);
+            if (compressed)
+            {
+                serializer.setOptions(Required::ProjectSerializer::Compressed);
+            }
             serializer.serialize(project);
             file.close();
         }
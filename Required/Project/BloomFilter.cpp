@@ -0,0 +1,140 @@
+/**
+ * @file BloomFilter.cpp
+ *
+ * A cache-friendly probabilistic set of hashes.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "BloomFilter.h"
+
+namespace Required
+{
+    namespace
+    {
+        /**
+         * Number of 64-bit words in a block.
+         */
+        const int WordsPerBlock = 8;
+
+        /**
+         * Bits reserved per hash; with a 512-bit block and six bits per hash
+         * this gives about one percent of false positives.
+         */
+        const int BitsPerHash = 10;
+
+        /**
+         * Number of bits set per hash.
+         */
+        const int BitsSet = 6;
+
+        /**
+         * Scrambles all bits of a 64-bit value (the MurmurHash3 finalizer).
+         */
+        inline quint64 mix(quint64 value)
+        {
+            value ^= value >> 33;
+            value *= Q_UINT64_C(0xff51afd7ed558ccd);
+            value ^= value >> 33;
+            value *= Q_UINT64_C(0xc4ceb9fe1a85ec53);
+            value ^= value >> 33;
+            return value;
+        }
+    }
+
+    /**
+     * Creates an empty filter.
+     *
+     * @param capacity expected number of hashes
+     */
+    BloomFilter::BloomFilter(int capacity):
+        m_blockMask(0), m_capacity(0), m_count(0)
+    {
+        reset(capacity);
+    }
+
+    /**
+     * Removes all hashes and resizes the filter.
+     *
+     * @param capacity expected number of hashes
+     */
+    void BloomFilter::reset(int capacity)
+    {
+        m_capacity = qMax(capacity, 64);
+        quint64 blockCount = 1;
+        while (blockCount * WordsPerBlock * 64 < quint64(m_capacity) * BitsPerHash)
+        {
+            blockCount *= 2;
+        }
+        m_blockMask = blockCount - 1;
+        m_words.fill(0, int(blockCount * WordsPerBlock));
+        m_count = 0;
+    }
+
+    /**
+     * Adds a hash to the filter.
+     *
+     * @param hash 64-bit hash, e.g. from BloomFilter::hash()
+     */
+    void BloomFilter::insert(quint64 hash)
+    {
+        quint64* block = m_words.data() + (mix(hash) & m_blockMask) * WordsPerBlock;
+        for (int i = 0; i < BitsSet; ++i)
+        {
+            // nine bits pick one of the 512 bits of the block
+            uint bit = (hash >> (i * 9)) & 511;
+            block[bit >> 6] |= Q_UINT64_C(1) << (bit & 63);
+        }
+        ++m_count;
+    }
+
+    /**
+     * Checks whether a hash may have been added.
+     *
+     * @param hash 64-bit hash
+     * @return false if the hash was certainly not added
+     */
+    bool BloomFilter::mightContain(quint64 hash) const
+    {
+        const quint64* block = m_words.constData() + (mix(hash) & m_blockMask) * WordsPerBlock;
+        for (int i = 0; i < BitsSet; ++i)
+        {
+            uint bit = (hash >> (i * 9)) & 511;
+            if (!(block[bit >> 6] & (Q_UINT64_C(1) << (bit & 63))))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Computes a 64-bit hash of a string.
+     *
+     * The input is read once (FNV-1a over UTF-16 code units) and the result
+     * is mixed, so that all bits are usable for block and bit selection.
+     *
+     * @param data characters of the string
+     * @param size number of characters
+     * @return 64-bit hash
+     */
+    quint64 BloomFilter::hash(const QChar* data, int size)
+    {
+        quint64 hash = Q_UINT64_C(0xcbf29ce484222325);
+        for (int i = 0; i < size; ++i)
+        {
+            hash ^= data[i].unicode();
+            hash *= Q_UINT64_C(0x100000001b3);
+        }
+        return mix(hash);
+    }
+}
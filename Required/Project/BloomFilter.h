@@ -0,0 +1,93 @@
+/**
+ * @file BloomFilter.h
+ *
+ * A cache-friendly probabilistic set of hashes.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include "../global.h"
+#include <QChar>
+#include <QVector>
+
+namespace Required
+{
+    /**
+     * A cache-friendly probabilistic set of hashes.
+     *
+     * mightContain() never returns false for an inserted hash, and returns
+     * true for other hashes with a probability of about one percent as long
+     * as no more hashes than the capacity were inserted. Unlike a classic
+     * Bloom filter, all bits of one hash lie in a single 64-byte block, so a
+     * lookup touches one cache line.
+     *
+     * Hashes can't be removed; owners rebuild the filter from scratch once
+     * enough of its hashes are stale.
+     */
+    class REQUIRED_EXPORT BloomFilter
+    {
+    public:
+        explicit BloomFilter(int capacity = 0);
+
+        /**
+         * Returns the number of hashes the filter was sized for.
+         *
+         * @return capacity
+         */
+        int getCapacity() const
+        {
+            return m_capacity;
+        }
+
+        /**
+         * Returns the number of hashes inserted since the last reset.
+         *
+         * @return insertion count
+         */
+        int getCount() const
+        {
+            return m_count;
+        }
+
+        void reset(int capacity);
+        void insert(quint64 hash);
+        bool mightContain(quint64 hash) const;
+
+        static quint64 hash(const QChar* data, int size);
+
+    private:
+        /**
+         * Bit blocks, eight words (one cache line) per block.
+         */
+        QVector<quint64> m_words;
+
+        /**
+         * Number of blocks minus one; the number is a power of two.
+         */
+        quint64 m_blockMask;
+
+        /**
+         * Number of hashes the filter was sized for.
+         */
+        int m_capacity;
+
+        /**
+         * Number of hashes inserted since the last reset.
+         */
+        int m_count;
+    };
+}
+
+#endif // BLOOMFILTER_H
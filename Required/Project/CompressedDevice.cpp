@@ -0,0 +1,452 @@
+/**
+ * @file CompressedDevice.cpp
+ *
+ * A QIODevice adapter compressing or decompressing a gzip stream on the fly.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "CompressedDevice.h"
+#include <QMutexLocker>
+#include <QThread>
+#include <cstring>
+#include <zlib.h>
+
+namespace Required
+{
+    namespace
+    {
+        /**
+         * Size of chunks passed between the threads.
+         */
+        const int ChunkSize = 256 * 1024;
+
+        /**
+         * Maximum number of chunks waiting in the queue.
+         */
+        const int MaxQueuedChunks = 8;
+    }
+
+    /**
+     * The thread running zlib for one open device.
+     */
+    class CompressedDevice::Pipeline : public QThread
+    {
+    public:
+        Pipeline(CompressedDevice* owner, bool compressing):
+            m_owner(owner), m_compressing(compressing)
+        {
+        }
+
+    protected:
+        void run()
+        {
+            if (m_compressing)
+            {
+                compress();
+            }
+            else
+            {
+                decompress();
+            }
+        }
+
+    private:
+        /**
+         * Takes uncompressed chunks from the queue and writes them deflated.
+         */
+        void compress()
+        {
+            z_stream stream;
+            stream.zalloc = Z_NULL;
+            stream.zfree = Z_NULL;
+            stream.opaque = Z_NULL;
+            // 16 added to window bits selects the gzip container
+            if (deflateInit2(&stream, m_owner->m_compressionLevel, Z_DEFLATED,
+                             MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            {
+                m_owner->abortConsuming(QObject::tr("Cannot initialize compression"));
+                return;
+            }
+
+            QByteArray output(ChunkSize, Qt::Uninitialized);
+            QByteArray chunk;
+            bool finished = false;
+            while (!finished)
+            {
+                finished = !m_owner->dequeue(chunk, true);
+                stream.next_in = reinterpret_cast<Bytef*>(chunk.data());
+                stream.avail_in = finished ? 0 : chunk.size();
+                do
+                {
+                    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+                    stream.avail_out = output.size();
+                    deflate(&stream, finished ? Z_FINISH : Z_NO_FLUSH);
+                    qint64 produced = output.size() - stream.avail_out;
+                    if (produced > 0 && m_owner->m_device->write(output.constData(), produced) != produced)
+                    {
+                        m_owner->abortConsuming(m_owner->m_device->errorString());
+                        deflateEnd(&stream);
+                        return;
+                    }
+                } while (stream.avail_out == 0);
+            }
+
+            deflateEnd(&stream);
+        }
+
+        /**
+         * Reads compressed data and queues inflated chunks.
+         */
+        void decompress()
+        {
+            z_stream stream;
+            stream.zalloc = Z_NULL;
+            stream.zfree = Z_NULL;
+            stream.opaque = Z_NULL;
+            stream.next_in = Z_NULL;
+            stream.avail_in = 0;
+            // 32 added to window bits enables gzip and zlib header detection
+            if (inflateInit2(&stream, MAX_WBITS + 32) != Z_OK)
+            {
+                m_owner->finishProducing(QObject::tr("Cannot initialize decompression"));
+                return;
+            }
+
+            QByteArray input(ChunkSize, Qt::Uninitialized);
+            QString error;
+            int result = Z_OK;
+            while (result != Z_STREAM_END && error.isEmpty())
+            {
+                qint64 count = m_owner->m_device->read(input.data(), input.size());
+                if (count <= 0)
+                {
+                    error = QObject::tr("Unexpected end of compressed data");
+                    break;
+                }
+
+                stream.next_in = reinterpret_cast<Bytef*>(input.data());
+                stream.avail_in = count;
+                do
+                {
+                    QByteArray output(ChunkSize, Qt::Uninitialized);
+                    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+                    stream.avail_out = output.size();
+                    result = inflate(&stream, Z_NO_FLUSH);
+                    if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+                    {
+                        error = QObject::tr("Corrupted compressed data");
+                        break;
+                    }
+
+                    output.resize(output.size() - stream.avail_out);
+                    if (!output.isEmpty() && !m_owner->enqueue(output))
+                    {
+                        // the reader went away
+                        inflateEnd(&stream);
+                        return;
+                    }
+                } while (stream.avail_out == 0 && result != Z_STREAM_END);
+            }
+
+            inflateEnd(&stream);
+            m_owner->finishProducing(error);
+        }
+
+        CompressedDevice* m_owner;
+        bool m_compressing;
+    };
+
+    /**
+     * Creates the adapter.
+     *
+     * @param device the device holding (or receiving) compressed data
+     * @param parent parent object
+     */
+    CompressedDevice::CompressedDevice(QIODevice* device, QObject* parent):
+        QIODevice(parent), m_device(device), m_pipeline(0),
+        m_compressionLevel(Z_DEFAULT_COMPRESSION), m_bufferPosition(0),
+        m_producerFinished(false), m_consumerAborted(false)
+    {
+    }
+
+    /**
+     * Destroys the adapter, closing it first.
+     */
+    CompressedDevice::~CompressedDevice()
+    {
+        close();
+    }
+
+    /**
+     * Opens the adapter and starts the pipeline thread.
+     *
+     * Only one of ReadOnly and WriteOnly is supported at a time.
+     *
+     * @param mode open mode
+     * @return true on success
+     */
+    bool CompressedDevice::open(OpenMode mode)
+    {
+        bool reading = mode & ReadOnly;
+        bool writing = mode & WriteOnly;
+        if (reading == writing || !m_device || !m_device->isOpen())
+        {
+            setErrorString(tr("Compressed streams can be opened either for reading or for writing"));
+            return false;
+        }
+
+        m_buffer.clear();
+        m_bufferPosition = 0;
+        m_queue.clear();
+        m_producerFinished = false;
+        m_consumerAborted = false;
+        m_pipelineError.clear();
+
+        // data is buffered in chunks already
+        QIODevice::open(mode | Unbuffered);
+        m_pipeline = new Pipeline(this, writing);
+        m_pipeline->start();
+        return true;
+    }
+
+    /**
+     * Flushes all pending data and stops the pipeline thread.
+     */
+    void CompressedDevice::close()
+    {
+        if (!isOpen())
+        {
+            return;
+        }
+
+        if (openMode() & WriteOnly)
+        {
+            if (!m_buffer.isEmpty())
+            {
+                enqueue(m_buffer);
+                m_buffer.clear();
+            }
+            finishProducing();
+        }
+        else
+        {
+            abortConsuming();
+        }
+
+        m_pipeline->wait();
+        delete m_pipeline;
+        m_pipeline = 0;
+
+        if (!getPipelineError().isEmpty())
+        {
+            setErrorString(getPipelineError());
+        }
+        QIODevice::close();
+    }
+
+    /**
+     * Compressed streams can't be seeked.
+     */
+    bool CompressedDevice::isSequential() const
+    {
+        return true;
+    }
+
+    /**
+     * Checks whether the whole stream has been read.
+     */
+    bool CompressedDevice::atEnd() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_bufferPosition >= m_buffer.size() && m_queue.isEmpty() &&
+               m_producerFinished;
+    }
+
+    /**
+     * Returns the number of decompressed bytes ready to be read.
+     */
+    qint64 CompressedDevice::bytesAvailable() const
+    {
+        QMutexLocker locker(&m_mutex);
+        qint64 available = m_buffer.size() - m_bufferPosition;
+        foreach (const QByteArray& chunk, m_queue)
+        {
+            available += chunk.size();
+        }
+
+        return available + QIODevice::bytesAvailable();
+    }
+
+    /**
+     * Checks whether the device starts with a gzip header.
+     *
+     * The device position is left untouched.
+     *
+     * @param device any readable device
+     * @return true for gzip streams
+     */
+    bool CompressedDevice::isCompressed(QIODevice* device)
+    {
+        return device->peek(2) == QByteArray("\x1f\x8b");
+    }
+
+    /**
+     * Copies decompressed data to the caller.
+     *
+     * Blocks only until at least one byte is available or the stream ends.
+     */
+    qint64 CompressedDevice::readData(char* data, qint64 maxSize)
+    {
+        qint64 total = 0;
+        while (total < maxSize)
+        {
+            if (m_bufferPosition >= m_buffer.size())
+            {
+                m_bufferPosition = 0;
+                if (!dequeue(m_buffer, total == 0))
+                {
+                    m_buffer.clear();
+                    break;
+                }
+            }
+
+            qint64 count = qMin<qint64>(maxSize - total, m_buffer.size() - m_bufferPosition);
+            memcpy(data + total, m_buffer.constData() + m_bufferPosition, count);
+            m_bufferPosition += count;
+            total += count;
+        }
+
+        if (total == 0 && !getPipelineError().isEmpty())
+        {
+            setErrorString(getPipelineError());
+            return -1;
+        }
+
+        return total;
+    }
+
+    /**
+     * Collects data into chunks and hands them over to the pipeline.
+     */
+    qint64 CompressedDevice::writeData(const char* data, qint64 size)
+    {
+        if (!getPipelineError().isEmpty())
+        {
+            setErrorString(getPipelineError());
+            return -1;
+        }
+
+        m_buffer.append(data, size);
+        if (m_buffer.size() >= ChunkSize)
+        {
+            enqueue(m_buffer);
+            m_buffer.clear();
+            m_buffer.reserve(ChunkSize);
+        }
+
+        return size;
+    }
+
+    /**
+     * Adds a chunk to the queue, waiting while the queue is full.
+     *
+     * @param chunk data to pass
+     * @return false if the consumer has stopped taking chunks
+     */
+    bool CompressedDevice::enqueue(const QByteArray& chunk)
+    {
+        QMutexLocker locker(&m_mutex);
+        while (m_queue.size() >= MaxQueuedChunks && !m_consumerAborted)
+        {
+            m_chunkTaken.wait(&m_mutex);
+        }
+        if (m_consumerAborted)
+        {
+            return false;
+        }
+
+        m_queue.enqueue(chunk);
+        m_chunkQueued.wakeOne();
+        return true;
+    }
+
+    /**
+     * Takes a chunk from the queue.
+     *
+     * @param chunk receives the data
+     * @param wait whether to wait for a chunk to be queued
+     * @return false if no chunk is available
+     */
+    bool CompressedDevice::dequeue(QByteArray& chunk, bool wait)
+    {
+        QMutexLocker locker(&m_mutex);
+        while (wait && m_queue.isEmpty() && !m_producerFinished)
+        {
+            m_chunkQueued.wait(&m_mutex);
+        }
+        if (m_queue.isEmpty())
+        {
+            return false;
+        }
+
+        chunk = m_queue.dequeue();
+        m_chunkTaken.wakeOne();
+        return true;
+    }
+
+    /**
+     * Marks the end of the stream on the producing side.
+     *
+     * @param error reason of the early end, empty if not an error
+     */
+    void CompressedDevice::finishProducing(QString error)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_producerFinished = true;
+        if (!error.isEmpty())
+        {
+            m_pipelineError = error;
+        }
+        m_chunkQueued.wakeAll();
+    }
+
+    /**
+     * Stops the consuming side, releasing a waiting producer.
+     *
+     * @param error reason of the abort, empty if not an error
+     */
+    void CompressedDevice::abortConsuming(QString error)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_consumerAborted = true;
+        if (!error.isEmpty())
+        {
+            m_pipelineError = error;
+        }
+        m_chunkTaken.wakeAll();
+    }
+
+    /**
+     * Returns the error reported by the pipeline thread.
+     *
+     * Writing is only known to have succeeded if this is empty after
+     * close(), since the last chunks are compressed and written then.
+     *
+     * @return error message, empty if there was no error
+     */
+    QString CompressedDevice::getPipelineError() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_pipelineError;
+    }
+}
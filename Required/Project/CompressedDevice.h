@@ -0,0 +1,157 @@
+/**
+ * @file CompressedDevice.h
+ *
+ * A QIODevice adapter compressing or decompressing a gzip stream on the fly.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef COMPRESSEDDEVICE_H
+#define COMPRESSEDDEVICE_H
+
+#include "../global.h"
+#include <QByteArray>
+#include <QIODevice>
+#include <QMutex>
+#include <QQueue>
+#include <QString>
+#include <QWaitCondition>
+
+namespace Required
+{
+    /**
+     * A QIODevice adapter compressing or decompressing a gzip stream on the fly.
+     *
+     * Data is processed in chunks on a separate pipeline thread, so the
+     * caller (e.g. an XML parser) and zlib work concurrently, and the whole
+     * stream is never held in memory. Only a bounded number of chunks is
+     * queued between the two threads.
+     *
+     * While the adapter is open, the underlying device is accessed from the
+     * pipeline thread and must not be used by anyone else. The underlying
+     * device should be opened in binary mode (without QIODevice::Text).
+     */
+    class REQUIRED_EXPORT CompressedDevice : public QIODevice
+    {
+        Q_OBJECT
+
+    public:
+        explicit CompressedDevice(QIODevice* device, QObject* parent = 0);
+        ~CompressedDevice();
+
+        bool open(OpenMode mode);
+        void close();
+        bool isSequential() const;
+        bool atEnd() const;
+        qint64 bytesAvailable() const;
+
+        /**
+         * Returns the zlib compression level used for writing.
+         *
+         * @return compression level (0-9)
+         */
+        int getCompressionLevel() const
+        {
+            return m_compressionLevel;
+        }
+
+        /**
+         * Sets the zlib compression level used for writing.
+         *
+         * Must be called before open().
+         *
+         * @param level compression level (0-9)
+         */
+        void setCompressionLevel(int level)
+        {
+            m_compressionLevel = level;
+        }
+
+        QString getPipelineError() const;
+
+        static bool isCompressed(QIODevice* device);
+
+    protected:
+        qint64 readData(char* data, qint64 maxSize);
+        qint64 writeData(const char* data, qint64 size);
+
+    private:
+        class Pipeline;
+
+        /**
+         * Non-owning pointer to the device holding compressed data.
+         */
+        QIODevice* m_device;
+
+        /**
+         * The thread running zlib.
+         */
+        Pipeline* m_pipeline;
+
+        /**
+         * Compression level used for writing.
+         */
+        int m_compressionLevel;
+
+        /**
+         * Chunk being filled (writing) or consumed (reading).
+         */
+        QByteArray m_buffer;
+
+        /**
+         * Read position in m_buffer.
+         */
+        int m_bufferPosition;
+
+        /**
+         * Chunks passed between the caller and the pipeline thread.
+         */
+        QQueue<QByteArray> m_queue;
+
+        /**
+         * Guards m_queue and the flags below.
+         */
+        mutable QMutex m_mutex;
+
+        /**
+         * Signalled when a chunk is queued or the producer finishes.
+         */
+        QWaitCondition m_chunkQueued;
+
+        /**
+         * Signalled when a chunk is taken or the consumer aborts.
+         */
+        QWaitCondition m_chunkTaken;
+
+        /**
+         * Set when the producing side won't queue any more chunks.
+         */
+        bool m_producerFinished;
+
+        /**
+         * Set when the consuming side won't take any more chunks.
+         */
+        bool m_consumerAborted;
+
+        /**
+         * Error reported by the pipeline thread.
+         */
+        QString m_pipelineError;
+
+        bool enqueue(const QByteArray& chunk);
+        bool dequeue(QByteArray& chunk, bool wait);
+        void finishProducing(QString error = QString());
+        void abortConsuming(QString error = QString());
+    };
+}
+
+#endif // COMPRESSEDDEVICE_H
@@ -0,0 +1,450 @@
+/**
+ * @file ContentClassifier.cpp
+ *
+ * Category detection based on magic numbers in file contents.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "ContentClassifier.h"
+#include "FileCategory.h"
+#include <QDataStream>
+#include <QList>
+#include <QMutexLocker>
+#include <QPair>
+
+namespace Required
+{
+    namespace
+    {
+        /**
+         * Default number of files probed by a single task.
+         */
+        const int DefaultBatchSize = 256;
+
+        /**
+         * Estimated memory taken by a cache entry besides its strings:
+         * the hash and map nodes and the string headers.
+         */
+        const qint64 EntryOverhead = 128;
+
+        /**
+         * Estimates the memory taken by a cache entry.
+         */
+        inline qint64 entryCost(const QString& filename, const QString& category)
+        {
+            return EntryOverhead + (filename.size() + category.size()) * qint64(sizeof(QChar));
+        }
+    }
+
+    /**
+     * Probes a batch of files on a worker thread.
+     *
+     * The files are looked up with a single batched call, and one read
+     * buffer is reused for the whole batch.
+     */
+    class ContentClassifier::Batch : public ScheduledTask
+    {
+    public:
+        Batch(ContentClassifier* classifier, QStringList filenames, QString device,
+              const QAtomicInt* cancelled):
+            ScheduledTask(TaskScheduler::Normal, device),
+            m_classifier(classifier), m_filenames(filenames), m_cancelled(cancelled)
+        {
+            setAutoDelete(false);
+        }
+
+        void run()
+        {
+            QByteArray buffer;
+            FileStatusList statuses = m_classifier->m_fileSystem->statFiles(m_filenames);
+            m_categories.reserve(m_filenames.size());
+            for (int i = 0; i < m_filenames.size(); ++i)
+            {
+                if (m_cancelled && m_cancelled->load())
+                {
+                    return;
+                }
+                m_categories.append(m_classifier->probe(m_filenames.at(i), statuses.at(i), buffer));
+            }
+        }
+
+        const QStringList& getFilenames() const
+        {
+            return m_filenames;
+        }
+
+        const QStringList& getCategories() const
+        {
+            return m_categories;
+        }
+
+    private:
+        ContentClassifier* m_classifier;
+        QStringList m_filenames;
+        const QAtomicInt* m_cancelled;
+        QStringList m_categories;
+    };
+
+    /**
+     * Creates a classifier with an empty cache, charged to the default
+     * memory budget.
+     */
+    ContentClassifier::ContentClassifier():
+        BudgetedCache("ContentClassifier"), m_scheduler(TaskScheduler::getDefault()),
+        m_batchSize(DefaultBatchSize), m_fileSystem(FileSystem::getDefault()),
+        m_nextSequence(0), m_clearCount(0)
+    {
+    }
+
+    /**
+     * Detaches the cache from its memory budget.
+     */
+    ContentClassifier::~ContentClassifier()
+    {
+        detachFromBudget();
+    }
+
+    /**
+     * Determines the category of a single file.
+     *
+     * The file is probed on the calling thread.
+     *
+     * @param filename path to the file
+     * @return category short name, empty for the default category
+     */
+    QString ContentClassifier::classify(QString filename)
+    {
+        QByteArray buffer;
+        QString category = probe(filename, m_fileSystem->stat(filename), buffer);
+        return category.isEmpty() ? FileCategory::getCategoryForFilename(filename).getShortName()
+                                  : category;
+    }
+
+    /**
+     * Determines categories of many files in parallel.
+     *
+     * Blocks until all files are probed. The batches of local files are
+     * attributed to the device of their first file.
+     *
+     * @param filenames paths to the files
+     * @param cancelled flag checked before every file is probed; once it's
+     *        set, the remaining files are left out of the result. 0 if
+     *        classification can't be cancelled
+     * @return mapping of paths to category short names
+     */
+    QMap<QString, QString> ContentClassifier::classifyFiles(QStringList filenames,
+                                                            const QAtomicInt* cancelled)
+    {
+        TaskScheduler* scheduler = m_scheduler ? m_scheduler.data() : TaskScheduler::getDefault();
+        bool local = m_fileSystem->isLocal();
+        QList<Batch*> batches;
+        QList<int> ids;
+        for (int i = 0; i < filenames.size(); i += m_batchSize)
+        {
+            QString device = local ? TaskScheduler::getDevice(filenames.at(i)) : QString();
+            Batch* batch = new Batch(this, filenames.mid(i, m_batchSize), device, cancelled);
+            batches.append(batch);
+            ids.append(scheduler->schedule(batch));
+        }
+        foreach (int id, ids)
+        {
+            scheduler->waitFor(id);
+        }
+
+        QMap<QString, QString> categories;
+        foreach (Batch* batch, batches)
+        {
+            const QStringList& batchFilenames = batch->getFilenames();
+            const QStringList& batchCategories = batch->getCategories();
+            for (int i = 0; i < batchCategories.size(); ++i)
+            {
+                QString category = batchCategories.at(i);
+                if (category.isEmpty())
+                {
+                    category = FileCategory::getCategoryForFilename(batchFilenames.at(i)).getShortName();
+                }
+                categories.insert(batchFilenames.at(i), category);
+            }
+        }
+        qDeleteAll(batches);
+
+        return categories;
+    }
+
+    /**
+     * Returns the number of files with cached probe results.
+     *
+     * @return cache size
+     */
+    int ContentClassifier::getCacheSize() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_cache.size();
+    }
+
+    /**
+     * Forgets all probe results, including spilled ones.
+     *
+     * This should be called after registering new content signatures.
+     */
+    void ContentClassifier::clearCache()
+    {
+        QMutexLocker locker(&m_mutex);
+        qint64 freed = 0;
+        QHash<QString, CacheEntry>::const_iterator it;
+        for (it = m_cache.constBegin(); it != m_cache.constEnd(); ++it)
+        {
+            freed += entryCost(it.key(), it->category);
+        }
+        m_cache.clear();
+        m_usage.clear();
+        m_spillMutex.lock();
+        m_spill.clear();
+        ++m_clearCount;
+        m_spillMutex.unlock();
+        release(freed);
+    }
+
+    /**
+     * Checks whether evicted probe results are kept on disk.
+     *
+     * @return true if spilling is enabled
+     */
+    bool ContentClassifier::isSpillEnabled() const
+    {
+        QMutexLocker locker(&m_spillMutex);
+        return m_spill.isOpen();
+    }
+
+    /**
+     * Sets whether evicted probe results are kept on disk.
+     *
+     * Reading a spilled result back is much cheaper than probing the file
+     * again on slow or remote disks. Results are spilled to a temporary
+     * file, removed when spilling is disabled.
+     *
+     * @param enabled true to enable spilling
+     * @return false if the spill file couldn't be created
+     */
+    bool ContentClassifier::setSpillEnabled(bool enabled)
+    {
+        QMutexLocker locker(&m_spillMutex);
+        if (!enabled)
+        {
+            m_spill.close();
+            return true;
+        }
+
+        return m_spill.isOpen() || m_spill.open();
+    }
+
+    /**
+     * Drops least recently used probe results, called by the memory budget.
+     *
+     * The victims are taken out of memory under the lock and spilled after
+     * releasing it, so lookups don't wait for the disk. Until then, a
+     * lookup of a victim misses and the file is probed again.
+     *
+     * @param bytes number of bytes to free
+     * @return number of bytes freed
+     */
+    qint64 ContentClassifier::evict(qint64 bytes)
+    {
+        QList<QPair<QString, CacheEntry> > victims;
+        qint64 freed = 0;
+        m_mutex.lock();
+        int clearCount = m_clearCount;
+        while (freed < bytes && !m_usage.isEmpty())
+        {
+            QMap<quint64, QString>::iterator oldest = m_usage.begin();
+            QString filename = oldest.value();
+            m_usage.erase(oldest);
+            CacheEntry entry = m_cache.take(filename);
+            freed += entryCost(filename, entry.category);
+            victims.append(qMakePair(filename, entry));
+        }
+        release(freed, victims.size());
+        m_mutex.unlock();
+
+        QMutexLocker locker(&m_spillMutex);
+        // results cleared in the meantime were outdated
+        if (m_spill.isOpen() && clearCount == m_clearCount)
+        {
+            for (int i = 0; i < victims.size(); ++i)
+            {
+                const CacheEntry& entry = victims.at(i).second;
+                QByteArray data;
+                QDataStream stream(&data, QIODevice::WriteOnly);
+                stream << entry.size << entry.lastModified << entry.category;
+                m_spill.write(victims.at(i).first, data);
+            }
+        }
+
+        return freed;
+    }
+
+    /**
+     * Fills in the entry counts of the cache.
+     *
+     * @param statistics statistics to complete
+     */
+    void ContentClassifier::fillStatistics(CacheStatistics& statistics) const
+    {
+        m_mutex.lock();
+        statistics.entryCount = m_cache.size();
+        m_mutex.unlock();
+
+        QMutexLocker locker(&m_spillMutex);
+        statistics.spilledCount = m_spill.getCount();
+        statistics.spilledBytes = m_spill.getSize();
+    }
+
+    /**
+     * Matches the leading bytes of a file against content signatures.
+     *
+     * Only the probe size is read, not the whole file.
+     *
+     * @param filename path to the file
+     * @param status status of the file in the file system
+     * @param buffer reusable read buffer
+     * @return category short name, empty if no signature matched
+     */
+    QString ContentClassifier::probe(const QString& filename, const FileStatus& status,
+                                     QByteArray& buffer)
+    {
+        int probeSize = FileCategory::getContentProbeSize();
+        // reading a FIFO or a device may block forever
+        if (probeSize == 0 || !status.isRegularFile)
+        {
+            return QString();
+        }
+
+        qint64 size = status.size;
+        qint64 lastModified = status.lastModified;
+        QString category;
+        if (findCached(filename, size, lastModified, category))
+        {
+            recordHit();
+            return category;
+        }
+        recordMiss();
+
+        // unreadable files are not cached, they may become readable
+        if (!m_fileSystem->read(filename, buffer, probeSize))
+        {
+            return QString();
+        }
+
+        if (!buffer.isEmpty())
+        {
+            category = FileCategory::getCategoryForContent(buffer).getShortName();
+        }
+        store(filename, size, lastModified, category);
+
+        return category;
+    }
+
+    /**
+     * Looks up a probe result in memory, then in the spill file.
+     *
+     * A result found in the spill file moves back to memory.
+     *
+     * @param filename path to the file
+     * @param size current size of the file
+     * @param lastModified current modification time of the file
+     * @param category receives the cached category
+     * @return true if a result for the unchanged file was found
+     */
+    bool ContentClassifier::findCached(const QString& filename, qint64 size,
+                                       qint64 lastModified, QString& category)
+    {
+        QMutexLocker locker(&m_mutex);
+        QHash<QString, CacheEntry>::iterator cached = m_cache.find(filename);
+        if (cached != m_cache.end())
+        {
+            if (cached->size != size || cached->lastModified != lastModified)
+            {
+                return false;
+            }
+
+            // most recently used now
+            m_usage.remove(cached->sequence);
+            cached->sequence = m_nextSequence++;
+            m_usage.insert(cached->sequence, filename);
+            category = cached->category;
+            return true;
+        }
+        locker.unlock();
+
+        QByteArray data;
+        m_spillMutex.lock();
+        bool spilled = m_spill.take(filename, data);
+        m_spillMutex.unlock();
+        if (!spilled)
+        {
+            return false;
+        }
+        qint64 spilledSize;
+        qint64 spilledModified;
+        QString spilledCategory;
+        QDataStream stream(data);
+        stream >> spilledSize >> spilledModified >> spilledCategory;
+        if (stream.status() != QDataStream::Ok || spilledSize != size ||
+            spilledModified != lastModified)
+        {
+            return false;
+        }
+
+        store(filename, size, lastModified, spilledCategory);
+        category = spilledCategory;
+        return true;
+    }
+
+    /**
+     * Caches a probe result, replacing an older one.
+     *
+     * @param filename path to the file
+     * @param size size of the probed file
+     * @param lastModified modification time of the probed file
+     * @param category category short name, empty if no signature matched
+     */
+    void ContentClassifier::store(const QString& filename, qint64 size,
+                                  qint64 lastModified, const QString& category)
+    {
+        CacheEntry entry;
+        entry.size = size;
+        entry.lastModified = lastModified;
+        entry.category = category;
+
+        qint64 replaced = 0;
+        m_mutex.lock();
+        QHash<QString, CacheEntry>::iterator old = m_cache.find(filename);
+        if (old != m_cache.end())
+        {
+            replaced = entryCost(filename, old->category);
+            m_usage.remove(old->sequence);
+            m_cache.erase(old);
+        }
+        entry.sequence = m_nextSequence++;
+        m_usage.insert(entry.sequence, filename);
+        m_cache.insert(filename, entry);
+        m_mutex.unlock();
+
+        // charging may evict, which takes the lock again
+        if (replaced > 0)
+        {
+            release(replaced);
+        }
+        charge(entryCost(filename, category));
+    }
+}
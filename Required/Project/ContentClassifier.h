@@ -0,0 +1,220 @@
+/**
+ * @file ContentClassifier.h
+ *
+ * Category detection based on magic numbers in file contents.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef CONTENTCLASSIFIER_H
+#define CONTENTCLASSIFIER_H
+
+#include "../global.h"
+#include "FileSystem.h"
+#include "MemoryBudget.h"
+#include "SpillFile.h"
+#include "TaskScheduler.h"
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QPointer>
+#include <QString>
+#include <QStringList>
+
+namespace Required
+{
+    /**
+     * Category detection based on magic numbers in file contents.
+     *
+     * The leading bytes of a file are compared against the signatures
+     * registered with FileCategory::registerContentSignature(). A matching
+     * signature wins over the filename, so files without an extension or
+     * with a wrong one are still categorized properly. Files matching no
+     * signature fall back to FileCategory::getCategoryForFilename().
+     *
+     * Many files are probed in parallel, in batches, run as normal priority
+     * tasks of a TaskScheduler, each limited by the device of its files. A
+     * batch looks up all its files in the file system
+     * at once, and every probe reads just the bytes needed by the
+     * signatures. Results are cached by path, file size and modification
+     * time, so classifying the same unchanged files again doesn't read them.
+     * The cache is charged to a MemoryBudget; least recently used results
+     * are evicted under pressure, or spilled to disk if enabled.
+     *
+     * All methods may be called from multiple threads.
+     */
+    class REQUIRED_EXPORT ContentClassifier : public BudgetedCache
+    {
+    public:
+        ContentClassifier();
+        ~ContentClassifier();
+
+        /**
+         * Returns the scheduler running the probing tasks.
+         *
+         * @return task scheduler
+         */
+        TaskScheduler* getScheduler() const
+        {
+            return m_scheduler;
+        }
+
+        /**
+         * Sets the scheduler running the probing tasks.
+         *
+         * The classifier doesn't take ownership of the scheduler.
+         *
+         * @param scheduler task scheduler, 0 for the default one
+         */
+        void setScheduler(TaskScheduler* scheduler)
+        {
+            m_scheduler = scheduler ? scheduler : TaskScheduler::getDefault();
+        }
+
+        /**
+         * Returns the number of files probed by a single task.
+         *
+         * @return batch size
+         */
+        int getBatchSize() const
+        {
+            return m_batchSize;
+        }
+
+        /**
+         * Sets the number of files probed by a single task.
+         *
+         * @param batchSize batch size
+         */
+        void setBatchSize(int batchSize)
+        {
+            m_batchSize = qMax(1, batchSize);
+        }
+
+        /**
+         * Returns the file system the files are read from.
+         *
+         * @return file system, the local disk by default
+         */
+        FileSystem* getFileSystem() const
+        {
+            return m_fileSystem;
+        }
+
+        /**
+         * Sets the file system the files are read from.
+         *
+         * The classifier doesn't take ownership of the file system.
+         *
+         * @param fileSystem file system, 0 for the local disk
+         */
+        void setFileSystem(FileSystem* fileSystem)
+        {
+            m_fileSystem = fileSystem ? fileSystem : FileSystem::getDefault();
+        }
+
+        QString classify(QString filename);
+        QMap<QString, QString> classifyFiles(QStringList filenames,
+                                             const QAtomicInt* cancelled = 0);
+
+        int getCacheSize() const;
+        void clearCache();
+        bool isSpillEnabled() const;
+        bool setSpillEnabled(bool enabled);
+        qint64 evict(qint64 bytes);
+
+    protected:
+        void fillStatistics(CacheStatistics& statistics) const;
+
+    private:
+        Q_DISABLE_COPY(ContentClassifier)
+
+        class Batch;
+
+        /**
+         * A cached probe result, valid while the file is unchanged.
+         */
+        struct CacheEntry
+        {
+            qint64 size;
+            qint64 lastModified;
+            QString category;
+
+            /**
+             * Position in the least recently used order.
+             */
+            quint64 sequence;
+        };
+
+        /**
+         * Scheduler running the probing tasks.
+         */
+        QPointer<TaskScheduler> m_scheduler;
+
+        /**
+         * Number of files probed by a single task.
+         */
+        int m_batchSize;
+
+        /**
+         * Non-owning pointer to the file system the files are read from.
+         */
+        FileSystem* m_fileSystem;
+
+        /**
+         * Probe results by path; empty category if no signature matched.
+         */
+        QHash<QString, CacheEntry> m_cache;
+
+        /**
+         * Cached paths, least recently used first.
+         */
+        QMap<quint64, QString> m_usage;
+
+        /**
+         * Next position in the least recently used order.
+         */
+        quint64 m_nextSequence;
+
+        /**
+         * Number of times the cache was cleared, so results evicted before
+         * are not spilled after. Written with both mutexes locked.
+         */
+        int m_clearCount;
+
+        /**
+         * Results evicted from memory, if spilling is enabled.
+         */
+        SpillFile m_spill;
+
+        /**
+         * Guards m_cache, m_usage and m_nextSequence.
+         */
+        mutable QMutex m_mutex;
+
+        /**
+         * Guards m_spill; locked after m_mutex if both are needed, so disk
+         * writes don't hold up lookups in memory.
+         */
+        mutable QMutex m_spillMutex;
+
+        QString probe(const QString& filename, const FileStatus& status, QByteArray& buffer);
+        bool findCached(const QString& filename, qint64 size, qint64 lastModified,
+                        QString& category);
+        void store(const QString& filename, qint64 size, qint64 lastModified,
+                   const QString& category);
+    };
+}
+
+#endif // CONTENTCLASSIFIER_H
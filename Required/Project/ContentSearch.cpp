@@ -0,0 +1,727 @@
+/**
+ * @file ContentSearch.cpp
+ *
+ * Parallel full-text search in contents of project files.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "ContentSearch.h"
+#include <QByteArray>
+#include <QFile>
+#include <QMetaObject>
+#include <QSet>
+#include <QStringList>
+#include <algorithm>
+#include <cstring>
+
+#if defined(Q_OS_UNIX)
+#  include <cerrno>
+#  include <fcntl.h>
+#  include <sys/stat.h>
+#  include <sys/types.h>
+#  include <unistd.h>
+#endif
+
+namespace Required
+{
+    namespace
+    {
+        /**
+         * Default number of files searched by a single task.
+         */
+        const int DefaultBatchSize = 64;
+
+        /**
+         * Number of leading bytes checked for a NUL byte to detect binary files.
+         */
+        const int BinaryProbeSize = 8192;
+
+        /**
+         * Number of bytes read from a local file at once.
+         */
+        const int ReadChunkSize = 1024 * 1024;
+
+        /**
+         * Longest line text reported with a match; minified files would
+         * otherwise produce megabytes per match.
+         */
+        const int MaxLineLength = 1024;
+
+        /**
+         * Returns the other case of an ASCII letter, or the byte itself.
+         */
+        char otherCase(char c)
+        {
+            if (c >= 'a' && c <= 'z')
+            {
+                return c - 'a' + 'A';
+            }
+            if (c >= 'A' && c <= 'Z')
+            {
+                return c - 'A' + 'a';
+            }
+            return c;
+        }
+
+        /**
+         * Finds occurrences of a literal in a buffer.
+         *
+         * Candidates are located with memchr() on the first byte of the
+         * literal, which the C library implements with vector instructions.
+         * Without case sensitivity both cases of the first byte are tracked,
+         * and each is rescanned only after it has been passed.
+         */
+        class LiteralScanner
+        {
+        public:
+            LiteralScanner(const QByteArray& literal, Qt::CaseSensitivity cs,
+                           const char* end):
+                m_literal(literal), m_cs(cs), m_end(end), m_nextFirst(0), m_nextOther(0)
+            {
+                m_first = literal.isEmpty() ? '\0' : literal.at(0);
+                m_other = cs == Qt::CaseSensitive ? m_first : otherCase(m_first);
+            }
+
+            /**
+             * Returns the first occurrence at or after a position, 0 if none.
+             */
+            const char* find(const char* from)
+            {
+                int length = m_literal.size();
+                while (m_end - from >= length)
+                {
+                    const char* last = m_end - length + 1;
+                    if (m_nextFirst != last && m_nextFirst < from)
+                    {
+                        m_nextFirst = scan(from, last, m_first);
+                    }
+                    const char* hit = m_nextFirst;
+                    if (m_other != m_first)
+                    {
+                        if (m_nextOther != last && m_nextOther < from)
+                        {
+                            m_nextOther = scan(from, last, m_other);
+                        }
+                        hit = qMin(hit, m_nextOther);
+                    }
+                    if (hit == last)
+                    {
+                        return 0;
+                    }
+                    if (matchesAt(hit))
+                    {
+                        return hit;
+                    }
+                    from = hit + 1;
+                }
+                return 0;
+            }
+
+        private:
+            QByteArray m_literal;
+            Qt::CaseSensitivity m_cs;
+            const char* m_end;
+            char m_first;
+            char m_other;
+            const char* m_nextFirst;
+            const char* m_nextOther;
+
+            /**
+             * Returns the first occurrence of a byte, or the end of the range.
+             */
+            static const char* scan(const char* from, const char* last, char c)
+            {
+                const void* hit = std::memchr(from, c, last - from);
+                return hit ? static_cast<const char*>(hit) : last;
+            }
+
+            bool matchesAt(const char* position) const
+            {
+                if (m_cs == Qt::CaseSensitive)
+                {
+                    return std::memcmp(position, m_literal.constData(), m_literal.size()) == 0;
+                }
+                for (int i = 0; i < m_literal.size(); ++i)
+                {
+                    char c = position[i];
+                    if (c != m_literal.at(i) && otherCase(c) != m_literal.at(i))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+        };
+
+        /**
+         * Searches a batch of files on a worker thread.
+         *
+         * Every task owns its copy of the pattern, since QRegExp keeps match
+         * state and can't be shared between threads.
+         */
+        class SearchTask : public ScheduledTask
+        {
+        public:
+            SearchTask(QObject* receiver, int searchId, QSharedPointer<QAtomicInt> cancelled,
+                       const QRegExp& pattern, QStringList filenames, FileSystem* fileSystem,
+                       QString device):
+                ScheduledTask(TaskScheduler::Normal, device),
+                m_receiver(receiver), m_searchId(searchId), m_cancelled(cancelled),
+                m_pattern(pattern.pattern(), pattern.caseSensitivity(), pattern.patternSyntax()),
+                m_literal(ContentSearch::getRequiredLiteral(pattern).toUtf8()),
+                m_filenames(filenames), m_fileSystem(fileSystem)
+            {
+                // non-ASCII bytes have no simple other case
+                if (m_pattern.caseSensitivity() == Qt::CaseInsensitive)
+                {
+                    for (int i = 0; i < m_literal.size(); ++i)
+                    {
+                        if (static_cast<unsigned char>(m_literal.at(i)) >= 0x80)
+                        {
+                            m_literal.clear();
+                            break;
+                        }
+                    }
+                }
+            }
+
+            void run()
+            {
+                int searchedCount = 0;
+                foreach (const QString& filename, m_filenames)
+                {
+                    if (m_cancelled->load())
+                    {
+                        return;
+                    }
+                    searchFile(filename);
+                    ++searchedCount;
+                }
+
+                QMetaObject::invokeMethod(m_receiver, "onBatchDone",
+                                          Qt::QueuedConnection,
+                                          Q_ARG(int, m_searchId),
+                                          Q_ARG(Required::SearchMatchList, m_matches),
+                                          Q_ARG(int, searchedCount));
+            }
+
+        private:
+            QObject* m_receiver;
+            int m_searchId;
+            QSharedPointer<QAtomicInt> m_cancelled;
+            QRegExp m_pattern;
+            QByteArray m_literal;
+            QStringList m_filenames;
+            FileSystem* m_fileSystem;
+            SearchMatchList m_matches;
+
+            /**
+             * Read buffer, reused for all files of the batch.
+             */
+            QByteArray m_buffer;
+
+            /**
+             * Reads a file and searches its contents.
+             *
+             * Local files are read in chunks, each searched up to its last
+             * complete line; the unfinished line is carried over to the
+             * next chunk. They are deliberately not memory mapped: a mapped
+             * file truncated by another process raises SIGBUS on access,
+             * while a read just ends early. Files of other file systems
+             * are read through them as a whole.
+             */
+            void searchFile(const QString& filename)
+            {
+                if (!m_fileSystem->isLocal())
+                {
+                    if (m_fileSystem->read(filename, m_buffer) &&
+                        !isBinary(m_buffer.constData(), m_buffer.size()))
+                    {
+                        searchLines(filename, m_buffer.constData(), m_buffer.size(), 1);
+                    }
+                    return;
+                }
+
+#if defined(Q_OS_UNIX)
+                int fd = ::open(QFile::encodeName(filename).constData(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0)
+                {
+                    return;
+                }
+                struct stat info;
+                if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+                {
+                    ::close(fd);
+                    return;
+                }
+#  if defined(POSIX_FADV_SEQUENTIAL)
+                ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#  endif
+#else
+                QFile file(filename);
+                if (!file.open(QIODevice::ReadOnly) || file.size() == 0)
+                {
+                    return;
+                }
+#endif
+
+                qint64 offset = 0;
+                int carry = 0;
+                int lineNumber = 1;
+                while (!m_cancelled->load())
+                {
+                    if (m_buffer.size() < carry + ReadChunkSize)
+                    {
+                        m_buffer.resize(carry + ReadChunkSize);
+                    }
+#if defined(Q_OS_UNIX)
+                    qint64 count = ::pread(fd, m_buffer.data() + carry, ReadChunkSize, offset);
+                    if (count < 0 && errno == EINTR)
+                    {
+                        continue;
+                    }
+#else
+                    qint64 count = file.read(m_buffer.data() + carry, ReadChunkSize);
+#endif
+                    if (count <= 0)
+                    {
+                        // the last line has no terminator
+                        if (carry > 0)
+                        {
+                            searchLines(filename, m_buffer.constData(), carry, lineNumber);
+                        }
+                        break;
+                    }
+                    if (offset == 0 && isBinary(m_buffer.constData(), int(count)))
+                    {
+                        break;
+                    }
+                    offset += count;
+
+                    const char* data = m_buffer.constData();
+                    int filled = carry + int(count);
+                    int complete = filled;
+                    while (complete > 0 && data[complete - 1] != '\n')
+                    {
+                        --complete;
+                    }
+                    if (complete > 0)
+                    {
+                        lineNumber = searchLines(filename, data, complete, lineNumber);
+                    }
+                    carry = filled - complete;
+                    std::memmove(m_buffer.data(), data + complete, size_t(carry));
+                }
+
+#if defined(Q_OS_UNIX)
+                ::close(fd);
+#endif
+            }
+
+            /**
+             * Checks for a NUL byte near the start of a file.
+             */
+            static bool isBinary(const char* data, int size)
+            {
+                return std::memchr(data, '\0', size_t(qMin(size, BinaryProbeSize))) != 0;
+            }
+
+            /**
+             * Finds matching lines in a run of complete lines.
+             *
+             * With a required literal, only lines containing it are matched
+             * against the pattern; lines are counted with memchr() on the
+             * way to each candidate, and all at once past the last one.
+             *
+             * @return number of the line following the run
+             */
+            int searchLines(const QString& filename, const char* data, qint64 size, int lineNumber)
+            {
+                const char* end = data + size;
+                LiteralScanner scanner(m_literal, m_pattern.caseSensitivity(), end);
+                const char* lineStart = data;
+                while (lineStart < end)
+                {
+                    if (m_cancelled->load())
+                    {
+                        break;
+                    }
+
+                    const char* hit = lineStart;
+                    if (!m_literal.isEmpty())
+                    {
+                        hit = scanner.find(lineStart);
+                        if (!hit)
+                        {
+                            lineNumber += int(std::count(lineStart, end, '\n'));
+                            break;
+                        }
+                        // move to the line containing the candidate
+                        while (const void* newline = std::memchr(lineStart, '\n', hit - lineStart))
+                        {
+                            lineStart = static_cast<const char*>(newline) + 1;
+                            ++lineNumber;
+                        }
+                    }
+
+                    const void* newline = std::memchr(hit, '\n', end - hit);
+                    const char* lineEnd = newline ? static_cast<const char*>(newline) : end;
+                    const char* textEnd = lineEnd;
+                    if (textEnd > lineStart && textEnd[-1] == '\r')
+                    {
+                        --textEnd;
+                    }
+
+                    QString line = QString::fromUtf8(lineStart, int(textEnd - lineStart));
+                    int column = m_pattern.indexIn(line);
+                    if (column >= 0)
+                    {
+                        SearchMatch match;
+                        match.filename = filename;
+                        match.lineNumber = lineNumber;
+                        match.column = column + 1;
+                        match.line = line.left(MaxLineLength);
+                        m_matches.append(match);
+                    }
+
+                    lineStart = lineEnd + 1;
+                    ++lineNumber;
+                }
+
+                return lineNumber;
+            }
+        };
+
+        /**
+         * Appends a literal run to the candidates, keeping the longest one.
+         */
+        void takeRun(QString& run, QString& longest)
+        {
+            if (run.size() > longest.size())
+            {
+                longest = run;
+            }
+            run.clear();
+        }
+    }
+
+    /**
+     * Creates the search service.
+     *
+     * The tasks run on the default scheduler; searching is bound by memory
+     * bandwidth once files are cached, and by the disk otherwise.
+     *
+     * @param project the project to search in
+     * @param parent parent object
+     */
+    ContentSearch::ContentSearch(Project* project, QObject* parent):
+        QObject(parent), m_project(project), m_scheduler(TaskScheduler::getDefault()),
+        m_batchSize(DefaultBatchSize), m_searchId(0), m_fileCount(0), m_searchedCount(0)
+    {
+        qRegisterMetaType<SearchMatchList>("Required::SearchMatchList");
+    }
+
+    /**
+     * Cancels the running search and waits for its tasks to stop, since
+     * they report to this object.
+     */
+    ContentSearch::~ContentSearch()
+    {
+        cancel();
+        waitForFinished();
+    }
+
+    /**
+     * Starts searching project files for a pattern.
+     *
+     * A running search is cancelled first. If there is an index, only the
+     * candidate files it returns are searched. progress() is emitted after
+     * every batch, and finished() once all files were searched.
+     *
+     * @param pattern pattern to look for, matched line by line
+     * @param categoryShortNames categories to search in, all if empty
+     */
+    void ContentSearch::start(QRegExp pattern, QStringList categoryShortNames)
+    {
+        cancel();
+
+        QStringList filenames;
+        if (m_project)
+        {
+            if (categoryShortNames.isEmpty())
+            {
+                filenames = m_project->getFiles();
+            }
+            foreach (QString shortName, categoryShortNames)
+            {
+                filenames += m_project->getFilesInCategory(shortName);
+            }
+        }
+        if (m_index && m_index->isSelective(pattern))
+        {
+            QSet<QString> candidates = m_index->getCandidates(pattern);
+            QStringList narrowed;
+            foreach (const QString& filename, filenames)
+            {
+                if (candidates.contains(filename))
+                {
+                    narrowed.append(filename);
+                }
+            }
+            filenames = narrowed;
+        }
+
+        m_searchId++;
+        m_cancelled = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+        m_fileCount = filenames.size();
+        m_searchedCount = 0;
+
+        TaskScheduler* taskScheduler = scheduler();
+        QList<int>::iterator it = m_taskIds.begin();
+        while (it != m_taskIds.end())
+        {
+            it = taskScheduler->isFinished(*it) ? m_taskIds.erase(it) : it + 1;
+        }
+
+        FileSystem* fileSystem = m_project ? m_project->getFileSystem() : FileSystem::getDefault();
+        bool local = fileSystem->isLocal();
+        for (int i = 0; i < filenames.size(); i += m_batchSize)
+        {
+            // a batch is attributed to the device of its first file
+            QString device = local ? TaskScheduler::getDevice(filenames.at(i)) : QString();
+            m_taskIds.append(taskScheduler->schedule(
+                new SearchTask(this, m_searchId, m_cancelled, pattern,
+                               filenames.mid(i, m_batchSize), fileSystem, device)));
+        }
+        if (filenames.isEmpty())
+        {
+            // finish asynchronously, like any other search
+            QMetaObject::invokeMethod(this, "onBatchDone", Qt::QueuedConnection,
+                                      Q_ARG(int, m_searchId),
+                                      Q_ARG(Required::SearchMatchList, SearchMatchList()),
+                                      Q_ARG(int, 0));
+        }
+    }
+
+    /**
+     * Cancels the running search.
+     *
+     * Tasks stop at the next file or line; matches they found are dropped.
+     * finished() is emitted right away.
+     */
+    void ContentSearch::cancel()
+    {
+        if (!isRunning())
+        {
+            return;
+        }
+
+        m_cancelled->store(1);
+        m_cancelled.clear();
+        // a destroyed scheduler has finished all its tasks
+        if (m_scheduler)
+        {
+            foreach (int id, m_taskIds)
+            {
+                m_scheduler->cancel(id);
+            }
+        }
+        emit finished(true);
+    }
+
+    /**
+     * Blocks until the tasks of the running search, and of cancelled ones,
+     * are done.
+     *
+     * Results are still delivered through the event loop.
+     */
+    void ContentSearch::waitForFinished()
+    {
+        if (m_scheduler)
+        {
+            foreach (int id, m_taskIds)
+            {
+                m_scheduler->waitFor(id);
+            }
+        }
+        m_taskIds.clear();
+    }
+
+    /**
+     * Returns a literal which every match of a pattern contains.
+     *
+     * The longest run of plain characters outside of groups with
+     * alternatives is taken. Characters made optional by a quantifier are
+     * not part of any run, and neither are runs inside a group made
+     * optional by ?, * or {0,n}. Bracket expressions never contribute.
+     * An empty string means no literal could be proven required, e.g. for
+     * patterns with alternatives.
+     *
+     * @param pattern regular expression, wildcard or fixed string
+     * @return required literal, possibly empty
+     */
+    QString ContentSearch::getRequiredLiteral(const QRegExp& pattern)
+    {
+        QString source = pattern.pattern();
+        QRegExp::PatternSyntax syntax = pattern.patternSyntax();
+        if (syntax == QRegExp::FixedString)
+        {
+            return source;
+        }
+
+        QString longest;
+        QString run;
+        if (syntax == QRegExp::Wildcard || syntax == QRegExp::WildcardUnix)
+        {
+            for (int i = 0; i < source.size(); ++i)
+            {
+                QChar c = source.at(i);
+                if (c == '[')
+                {
+                    takeRun(run, longest);
+                    // any one of the characters matches, none is required
+                    int close = source.indexOf(']', i + 2);
+                    i = close < 0 ? source.size() : close;
+                }
+                else if (c == '*' || c == '?' || c == ']' || c == '\\')
+                {
+                    takeRun(run, longest);
+                }
+                else
+                {
+                    run += c;
+                }
+            }
+            takeRun(run, longest);
+            return longest;
+        }
+
+        // any alternative or negative lookahead makes every run optional
+        if (source.contains('|') || source.contains("(?!"))
+        {
+            return QString();
+        }
+
+        // longest runs of the enclosing groups, while a group is scanned
+        QStringList enclosing;
+        for (int i = 0; i < source.size(); ++i)
+        {
+            QChar c = source.at(i);
+            if (c == '\\')
+            {
+                // escaped punctuation is literal, escaped letters are classes
+                if (i + 1 < source.size() && !source.at(i + 1).isLetterOrNumber())
+                {
+                    run += source.at(++i);
+                }
+                else
+                {
+                    takeRun(run, longest);
+                    ++i;
+                }
+            }
+            else if (c == '[')
+            {
+                takeRun(run, longest);
+                // a closing bracket right after the opening one is literal
+                int close = source.indexOf(']', i + 2);
+                i = close < 0 ? source.size() : close;
+            }
+            else if (c == '(')
+            {
+                takeRun(run, longest);
+                enclosing.append(longest);
+                longest.clear();
+                if (i + 2 < source.size() && source.at(i + 1) == '?')
+                {
+                    i += 2;
+                }
+            }
+            else if (c == ')')
+            {
+                takeRun(run, longest);
+                QString group = longest;
+                longest = enclosing.isEmpty() ? QString() : enclosing.takeLast();
+                // a group which may match zero times requires nothing
+                QChar next = i + 1 < source.size() ? source.at(i + 1) : QChar();
+                bool optional = next == '?' || next == '*' ||
+                                (next == '{' && i + 2 < source.size() &&
+                                 (source.at(i + 2) == '0' || source.at(i + 2) == ','));
+                if (!optional)
+                {
+                    takeRun(group, longest);
+                }
+            }
+            else if (c == '?' || c == '*' || c == '{')
+            {
+                // the preceding character is optional
+                run.chop(1);
+                takeRun(run, longest);
+                if (c == '{')
+                {
+                    int close = source.indexOf('}', i);
+                    i = close < 0 ? source.size() : close;
+                }
+            }
+            else if (c == '+' || c == '.' || c == '^' || c == '$')
+            {
+                takeRun(run, longest);
+            }
+            else
+            {
+                run += c;
+            }
+        }
+        takeRun(run, longest);
+
+        return longest;
+    }
+
+    /**
+     * Returns the scheduler running the search tasks.
+     *
+     * @return the scheduler set, or the default one if it was destroyed
+     */
+    TaskScheduler* ContentSearch::scheduler() const
+    {
+        return m_scheduler ? m_scheduler.data() : TaskScheduler::getDefault();
+    }
+
+    /**
+     * Collects the results of a batch.
+     *
+     * @param searchId identifier of the search the batch belongs to
+     * @param matches matching lines found in the batch
+     * @param fileCount number of files searched in the batch
+     */
+    void ContentSearch::onBatchDone(int searchId, SearchMatchList matches, int fileCount)
+    {
+        if (searchId != m_searchId || !isRunning())
+        {
+            return;
+        }
+
+        m_searchedCount += fileCount;
+        if (!matches.isEmpty())
+        {
+            emit matchesFound(matches);
+        }
+        emit progress(m_searchedCount, m_fileCount);
+
+        if (m_searchedCount == m_fileCount)
+        {
+            m_cancelled.clear();
+            emit finished(false);
+        }
+    }
+}
@@ -0,0 +1,251 @@
+/**
+ * @file ContentSearch.h
+ *
+ * Parallel full-text search in contents of project files.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef CONTENTSEARCH_H
+#define CONTENTSEARCH_H
+
+#include "../global.h"
+#include "Project.h"
+#include "TaskScheduler.h"
+#include "TrigramIndex.h"
+#include <QAtomicInt>
+#include <QList>
+#include <QMetaType>
+#include <QObject>
+#include <QPointer>
+#include <QRegExp>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+
+namespace Required
+{
+    /**
+     * A line of a file matching the searched pattern.
+     */
+    struct REQUIRED_EXPORT SearchMatch
+    {
+        SearchMatch():
+            lineNumber(0), column(0)
+        {
+        }
+
+        /**
+         * Full path to the file.
+         */
+        QString filename;
+
+        /**
+         * Line number, starting from 1.
+         */
+        int lineNumber;
+
+        /**
+         * Column of the first match in the line, starting from 1.
+         */
+        int column;
+
+        /**
+         * Text of the line, without the line terminator.
+         */
+        QString line;
+    };
+
+    /**
+     * A typedef to ease typing.
+     */
+    typedef QList<SearchMatch> SearchMatchList;
+
+    /**
+     * Parallel full-text search in contents of project files.
+     *
+     * Files are split into batches searched by normal priority tasks of a
+     * TaskScheduler, each limited by the device of its files. Local files
+     * are read in chunks into a buffer reused by the task; files of
+     * projects on another file system are read through it. Binary files,
+     * recognized by a NUL byte near the start, are skipped.
+     *
+     * Before any regular expression matching, a file is scanned with
+     * memchr() for a literal which every match must contain, extracted from
+     * the pattern. Only lines containing the literal are decoded and matched
+     * against the pattern, so most of the data is never touched by QRegExp.
+     *
+     * With a TrigramIndex set, files which can't contain the literal are
+     * ruled out before any of them is opened.
+     *
+     * Matches are delivered in batches as they are found, in the thread
+     * which owns the search (usually the GUI thread). Starting a new search
+     * cancels the previous one.
+     */
+    class REQUIRED_EXPORT ContentSearch : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        explicit ContentSearch(Project* project, QObject* parent = 0);
+        ~ContentSearch();
+
+        /**
+         * Returns the scheduler running the search tasks.
+         *
+         * @return task scheduler
+         */
+        TaskScheduler* getScheduler() const
+        {
+            return m_scheduler;
+        }
+
+        /**
+         * Sets the scheduler running the search tasks.
+         *
+         * The search doesn't take ownership of the scheduler. Should not be
+         * changed while tasks of an earlier search may still be running.
+         *
+         * @param scheduler task scheduler, 0 for the default one
+         */
+        void setScheduler(TaskScheduler* scheduler)
+        {
+            m_scheduler = scheduler ? scheduler : TaskScheduler::getDefault();
+        }
+
+        /**
+         * Returns the number of files searched by a single task.
+         *
+         * @return batch size
+         */
+        int getBatchSize() const
+        {
+            return m_batchSize;
+        }
+
+        /**
+         * Sets the number of files searched by a single task.
+         *
+         * Smaller batches deliver first results sooner, larger ones have
+         * less overhead.
+         *
+         * @param batchSize batch size
+         */
+        void setBatchSize(int batchSize)
+        {
+            m_batchSize = qMax(1, batchSize);
+        }
+
+        /**
+         * Returns the index used to narrow down the searched files.
+         *
+         * @return trigram index, 0 if there is none
+         */
+        TrigramIndex* getIndex() const
+        {
+            return m_index;
+        }
+
+        /**
+         * Sets the index used to narrow down the searched files.
+         *
+         * The search doesn't take ownership of the index. The index should
+         * be up to date, see TrigramIndex::update() and
+         * TrigramIndex::refresh(); outdated entries may hide matches.
+         *
+         * @param index trigram index of the project, 0 to search all files
+         */
+        void setIndex(TrigramIndex* index)
+        {
+            m_index = index;
+        }
+
+        /**
+         * Checks whether a search is in progress.
+         *
+         * @return true until finished() is emitted
+         */
+        bool isRunning() const
+        {
+            return !m_cancelled.isNull();
+        }
+
+        void start(QRegExp pattern, QStringList categoryShortNames = QStringList());
+        void cancel();
+        void waitForFinished();
+
+        static QString getRequiredLiteral(const QRegExp& pattern);
+
+    signals:
+        void matchesFound(const Required::SearchMatchList& matches);
+        void progress(int searchedCount, int fileCount);
+        void finished(bool cancelled);
+
+    private slots:
+        void onBatchDone(int searchId, Required::SearchMatchList matches, int fileCount);
+
+    private:
+        Q_DISABLE_COPY(ContentSearch)
+
+        /**
+         * Non-owning pointer to the searched project.
+         */
+        QPointer<Project> m_project;
+
+        /**
+         * Non-owning pointer to the index narrowing down the searched files.
+         */
+        QPointer<TrigramIndex> m_index;
+
+        /**
+         * Scheduler running the search tasks.
+         */
+        QPointer<TaskScheduler> m_scheduler;
+
+        /**
+         * Tasks of this and earlier searches which may not have finished.
+         */
+        QList<int> m_taskIds;
+
+        /**
+         * Number of files searched by a single task.
+         */
+        int m_batchSize;
+
+        /**
+         * Identifier of the current search; results of older ones are dropped.
+         */
+        int m_searchId;
+
+        /**
+         * Cancellation flag shared with the tasks of the current search,
+         * null when no search is running.
+         */
+        QSharedPointer<QAtomicInt> m_cancelled;
+
+        /**
+         * Number of files in the current search.
+         */
+        int m_fileCount;
+
+        /**
+         * Number of files searched so far.
+         */
+        int m_searchedCount;
+
+        TaskScheduler* scheduler() const;
+    };
+}
+
+Q_DECLARE_METATYPE(Required::SearchMatch)
+
+#endif // CONTENTSEARCH_H
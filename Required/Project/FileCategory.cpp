@@ -16,10 +16,12 @@
  */
 
 #include "FileCategory.h"
+#include <cstring>
 
 namespace Required
 {
     QMap<QString, FileCategory> FileCategory::s_nameMap;
+    int FileCategory::s_contentProbeSize = 0;
 
     /**
      * Creates the category object.
@@ -64,9 +66,117 @@ namespace Required
                                         QRegExp filenameRegexp)
     {
         FileCategory category(shortName, displayedName, filenameRegexp);
+        // signatures registered earlier survive re-registration
+        category.m_contentSignatures = s_nameMap.value(shortName).m_contentSignatures;
         s_nameMap[shortName] = category;
     }
 
+    /**
+     * Checks whether the beginning of a file matches any of the signatures.
+     *
+     * @param header leading bytes of the file, possibly fewer than needed
+     * @return true if a signature matches
+     */
+    bool FileCategory::matchesContent(const QByteArray& header) const
+    {
+        return getContentMatchLength(header) > 0;
+    }
+
+    /**
+     * Returns the length of the longest signature matching a file.
+     *
+     * A longer magic number is more specific, e.g. a signature of a format
+     * based on ZIP beats the signature of ZIP itself.
+     *
+     * @param header leading bytes of the file, possibly fewer than needed
+     * @return length of the magic number in bytes, 0 if none matches
+     */
+    int FileCategory::getContentMatchLength(const QByteArray& header) const
+    {
+        int longest = 0;
+        foreach (const ContentSignature& signature, m_contentSignatures)
+        {
+            int end = signature.offset + signature.magic.size();
+            if (signature.magic.size() > longest && end <= header.size() &&
+                std::memcmp(header.constData() + signature.offset, signature.magic.constData(),
+                            signature.magic.size()) == 0)
+            {
+                longest = signature.magic.size();
+            }
+        }
+
+        return longest;
+    }
+
+    /**
+     * Registers a magic number identifying files of a category.
+     *
+     * Categories may have any number of signatures. If the category wasn't
+     * registered yet, it is registered with default names and no filename
+     * pattern.
+     *
+     * Like registerCategory(), this should be called before categories are
+     * looked up from other threads.
+     *
+     * @param shortName category identifier
+     * @param magic bytes expected in the file
+     * @param offset position of the bytes from the beginning of the file
+     */
+    void FileCategory::registerContentSignature(QString shortName, QByteArray magic,
+                                                int offset)
+    {
+        if (magic.isEmpty() || offset < 0)
+        {
+            return;
+        }
+
+        if (!s_nameMap.contains(shortName))
+        {
+            registerCategory(shortName);
+        }
+        s_nameMap[shortName].m_contentSignatures.append(ContentSignature(magic, offset));
+        s_contentProbeSize = qMax(s_contentProbeSize, offset + magic.size());
+    }
+
+    /**
+     * Tries to match a category for the leading bytes of a file.
+     *
+     * If signatures of several categories match, the category with the
+     * longest matching signature wins; among equally long ones, the first
+     * category by short name.
+     *
+     * @param header at least getContentProbeSize() bytes of the file, or
+     *               the whole file if it is shorter
+     * @return associated category, or the default one
+     */
+    FileCategory FileCategory::getCategoryForContent(const QByteArray& header)
+    {
+        QMap<QString, FileCategory>::const_iterator best = s_nameMap.constEnd();
+        int bestLength = 0;
+        QMap<QString, FileCategory>::const_iterator it;
+        for (it = s_nameMap.constBegin(); it != s_nameMap.constEnd(); ++it)
+        {
+            int length = it->getContentMatchLength(header);
+            if (length > bestLength)
+            {
+                best = it;
+                bestLength = length;
+            }
+        }
+
+        return best != s_nameMap.constEnd() ? best.value() : FileCategory();
+    }
+
+    /**
+     * Returns how many leading bytes are needed to check all signatures.
+     *
+     * @return probe size in bytes, 0 if there are no signatures
+     */
+    int FileCategory::getContentProbeSize()
+    {
+        return s_contentProbeSize;
+    }
+
     /**
      * Looks up a category by it's short name and returns it as an object.
      *
@@ -19,6 +19,7 @@
 #define FILECATEGORY_H
 
 #include "../global.h"
+#include <QByteArray>
 #include <QList>
 #include <QMap>
 #include <QObject>
@@ -27,6 +28,27 @@
 
 namespace Required
 {
+    /**
+     * A magic number identifying the format of file contents.
+     */
+    struct REQUIRED_EXPORT ContentSignature
+    {
+        ContentSignature(QByteArray magic = QByteArray(), int offset = 0):
+            magic(magic), offset(offset)
+        {
+        }
+
+        /**
+         * Bytes expected at the offset.
+         */
+        QByteArray magic;
+
+        /**
+         * Position of the magic number from the beginning of the file.
+         */
+        int offset;
+    };
+
     /**
      * Managing categories of files in the project.
      */
@@ -75,10 +97,27 @@ namespace Required
             return m_filenameRegexp.exactMatch(filename);
         }
 
+        /**
+         * Returns the magic numbers of files in this category.
+         *
+         * @return content signatures
+         */
+        QList<ContentSignature> getContentSignatures() const
+        {
+            return m_contentSignatures;
+        }
+
+        bool matchesContent(const QByteArray& header) const;
+        int getContentMatchLength(const QByteArray& header) const;
+
         static void registerCategory(QString shortName, QString displayedName = "",
                                      QRegExp filenameRegexp = QRegExp());
         static FileCategory getCategory(QString shortName);
         static FileCategory getCategoryForFilename(QString filename);
+        static void registerContentSignature(QString shortName, QByteArray magic,
+                                             int offset = 0);
+        static FileCategory getCategoryForContent(const QByteArray& header);
+        static int getContentProbeSize();
 
     private:
         /**
@@ -96,10 +135,20 @@ namespace Required
          */
         QRegExp m_filenameRegexp;
 
+        /**
+         * Magic numbers of files which will be associated with the category.
+         */
+        QList<ContentSignature> m_contentSignatures;
+
         /**
          * A mapping of category short names to category objects.
          */
         static QMap<QString, FileCategory> s_nameMap;
+
+        /**
+         * Number of leading bytes covering all registered signatures.
+         */
+        static int s_contentProbeSize;
     };
 
     /**
@@ -0,0 +1,98 @@
+/**
+ * @file FileSystem.cpp
+ *
+ * An interface to the file system holding project files.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "FileSystem.h"
+#include "PosixFileSystem.h"
+#include <limits>
+
+namespace Required
+{
+    FileSystem::~FileSystem()
+    {
+    }
+
+    /**
+     * Returns information about many paths at once.
+     *
+     * The default implementation calls stat() for every path; backends
+     * override it when a batch can be served more cheaply.
+     *
+     * @param paths absolute paths
+     * @return statuses in the same order as the paths
+     */
+    FileStatusList FileSystem::statFiles(const QStringList& paths)
+    {
+        FileStatusList statuses;
+        statuses.reserve(paths.size());
+        foreach (const QString& path, paths)
+        {
+            statuses.append(stat(path));
+        }
+
+        return statuses;
+    }
+
+    /**
+     * Checks whether anything exists at a path.
+     *
+     * @param path absolute path
+     * @return true if the path exists
+     */
+    bool FileSystem::exists(const QString& path)
+    {
+        return stat(path).exists;
+    }
+
+    /**
+     * Checks whether paths name files on a local disk.
+     *
+     * Only then may callers bypass the interface, e.g. to read a file in
+     * chunks with system calls or to find out its device for
+     * TaskScheduler. The default implementation returns false.
+     *
+     * @return true if the files can be accessed directly
+     */
+    bool FileSystem::isLocal() const
+    {
+        return false;
+    }
+
+    /**
+     * Returns the largest number of bytes a single read() may return.
+     *
+     * A QByteArray is limited to less than 2 GiB, including its header.
+     *
+     * @return maximum read size in bytes
+     */
+    qint64 FileSystem::getMaxReadSize()
+    {
+        return qint64(std::numeric_limits<int>::max()) - 1024;
+    }
+
+    /**
+     * Returns the file system of the local disk.
+     *
+     * The instance is shared and lives until the program exits.
+     *
+     * @return the default file system
+     */
+    FileSystem* FileSystem::getDefault()
+    {
+        static PosixFileSystem fileSystem;
+        return &fileSystem;
+    }
+}
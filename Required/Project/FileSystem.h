@@ -0,0 +1,150 @@
+/**
+ * @file FileSystem.h
+ *
+ * An interface to the file system holding project files.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef FILESYSTEM_H
+#define FILESYSTEM_H
+
+#include "../global.h"
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+namespace Required
+{
+    /**
+     * Information about a single path.
+     */
+    struct REQUIRED_EXPORT FileStatus
+    {
+        FileStatus():
+            exists(false), isDirectory(false), isRegularFile(false), size(-1),
+            lastModified(-1)
+        {
+        }
+
+        /**
+         * Whether anything exists at the path.
+         */
+        bool exists;
+
+        /**
+         * Whether the path is a directory.
+         */
+        bool isDirectory;
+
+        /**
+         * Whether the path is a regular file, i.e. not a directory, a FIFO,
+         * a socket or a device.
+         */
+        bool isRegularFile;
+
+        /**
+         * File size in bytes, -1 if the path doesn't exist.
+         */
+        qint64 size;
+
+        /**
+         * Modification time in milliseconds since the epoch, -1 if the path
+         * doesn't exist.
+         */
+        qint64 lastModified;
+    };
+
+    /**
+     * A typedef to ease typing.
+     */
+    typedef QList<FileStatus> FileStatusList;
+
+    /**
+     * An interface to the file system holding project files.
+     *
+     * Project, ProjectSerializer and ProjectWidget access files only through
+     * this interface, so a project may live on the real disk (the default,
+     * see getDefault()) or entirely in memory (MemoryFileSystem), e.g. for
+     * tests and benchmarks free of system call noise.
+     *
+     * Paths are absolute. Implementations must allow concurrent calls from
+     * multiple threads.
+     */
+    class REQUIRED_EXPORT FileSystem
+    {
+    public:
+        virtual ~FileSystem();
+
+        /**
+         * Returns information about a path.
+         *
+         * @param path absolute path
+         * @return status of the path
+         */
+        virtual FileStatus stat(const QString& path) = 0;
+
+        virtual FileStatusList statFiles(const QStringList& paths);
+        virtual bool exists(const QString& path);
+        virtual bool isLocal() const;
+
+        /**
+         * Returns the regular files directly inside a directory.
+         *
+         * @param directory absolute path to the directory
+         * @return absolute paths of the files sorted by name, empty if the
+         *         directory doesn't exist
+         */
+        virtual QStringList list(const QString& directory) = 0;
+
+        /**
+         * Returns the regular files and the subdirectories directly inside
+         * a directory, reading the directory once.
+         *
+         * Subdirectories are only reported, not entered, so a caller
+         * walking a tree decides which subtrees are worth listing.
+         *
+         * @param directory absolute path to the directory
+         * @param files receives absolute paths of the files sorted by name
+         * @param directories receives absolute paths of the subdirectories
+         *        sorted by name
+         */
+        virtual void listEntries(const QString& directory, QStringList& files,
+                                 QStringList& directories) = 0;
+
+        /**
+         * Removes a file.
+         *
+         * @param path absolute path to the file
+         * @return true if the file was removed
+         */
+        virtual bool remove(const QString& path) = 0;
+
+        /**
+         * Reads the contents of a file.
+         *
+         * Reading fails if more than getMaxReadSize() bytes would be read.
+         *
+         * @param path absolute path to the file
+         * @param data receives the contents
+         * @param maxSize maximum number of bytes to read, -1 for the whole file
+         * @return true if the file could be read
+         */
+        virtual bool read(const QString& path, QByteArray& data, qint64 maxSize = -1) = 0;
+
+        static qint64 getMaxReadSize();
+        static FileSystem* getDefault();
+    };
+}
+
+#endif // FILESYSTEM_H
@@ -0,0 +1,500 @@
+/**
+ * @file IgnoreRules.cpp
+ *
+ * Gitignore-style rules excluding files from directory imports.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "IgnoreRules.h"
+#include <QByteArray>
+#include <algorithm>
+
+namespace Required
+{
+    namespace
+    {
+        /**
+         * Checks whether a character starts a wildcard or an escape.
+         */
+        inline bool isSpecial(QChar c)
+        {
+            return c == '*' || c == '?' || c == '[' || c == '\\';
+        }
+
+        /**
+         * Checks whether a string contains no wildcards or escapes.
+         */
+        bool isLiteral(const QString& pattern)
+        {
+            for (int i = 0; i < pattern.size(); ++i)
+            {
+                if (isSpecial(pattern[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Matches a character against a bracket expression such as "[a-z]"
+         * or "[!0-9]".
+         *
+         * @param p points at the opening bracket; moved past the closing one
+         * @param end end of the pattern
+         * @param c matched character
+         * @param matched receives the result
+         * @return false if the bracket is not closed
+         */
+        bool matchBracket(const QChar*& p, const QChar* end, QChar c, bool& matched)
+        {
+            const QChar* q = p + 1;
+            bool negated = q < end && (*q == '!' || *q == '^');
+            if (negated)
+            {
+                ++q;
+            }
+
+            matched = false;
+            bool first = true;
+            while (q < end && (*q != ']' || first))
+            {
+                first = false;
+                QChar low = *q;
+                if (low == '\\' && q + 1 < end)
+                {
+                    low = *++q;
+                }
+                QChar high = low;
+                if (q + 2 < end && q[1] == '-' && q[2] != ']')
+                {
+                    q += 2;
+                    high = *q;
+                    if (high == '\\' && q + 1 < end)
+                    {
+                        high = *++q;
+                    }
+                }
+                if (c >= low && c <= high)
+                {
+                    matched = true;
+                }
+                ++q;
+            }
+            if (q >= end)
+            {
+                return false;
+            }
+
+            p = q + 1;
+            matched = matched != negated && c != '/';
+            return true;
+        }
+
+        /**
+         * Matches a path against a glob pattern.
+         *
+         * "*", "?" and brackets stop at slashes, "**" doesn't, and "**"
+         * followed by a slash also matches no directories at all.
+         */
+        bool matchGlob(const QChar* p, const QChar* pEnd, const QChar* t, const QChar* tEnd)
+        {
+            while (p < pEnd)
+            {
+                QChar c = *p;
+                if (c == '*')
+                {
+                    bool crossesDirectories = p + 1 < pEnd && p[1] == '*';
+                    if (crossesDirectories)
+                    {
+                        p += 2;
+                        if (p < pEnd && *p == '/' && matchGlob(p + 1, pEnd, t, tEnd))
+                        {
+                            return true;
+                        }
+                    }
+                    else
+                    {
+                        ++p;
+                    }
+
+                    // try every length of the wildcard, shortest first
+                    for (const QChar* s = t; ; ++s)
+                    {
+                        if (matchGlob(p, pEnd, s, tEnd))
+                        {
+                            return true;
+                        }
+                        if (s == tEnd || (!crossesDirectories && *s == '/'))
+                        {
+                            return false;
+                        }
+                    }
+                }
+
+                if (t == tEnd)
+                {
+                    return false;
+                }
+                if (c == '?')
+                {
+                    if (*t == '/')
+                    {
+                        return false;
+                    }
+                    ++p;
+                    ++t;
+                    continue;
+                }
+                if (c == '[')
+                {
+                    bool matched;
+                    if (matchBracket(p, pEnd, *t, matched))
+                    {
+                        if (!matched)
+                        {
+                            return false;
+                        }
+                        ++t;
+                        continue;
+                    }
+                    // an unclosed bracket is an ordinary character
+                }
+                if (c == '\\' && p + 1 < pEnd)
+                {
+                    c = *++p;
+                }
+                if (*t != c)
+                {
+                    return false;
+                }
+                ++p;
+                ++t;
+            }
+
+            return t == tEnd;
+        }
+
+        /**
+         * Removes escaping backslashes from a literal pattern.
+         */
+        QString unescape(const QString& pattern)
+        {
+            QString result;
+            result.reserve(pattern.size());
+            for (int i = 0; i < pattern.size(); ++i)
+            {
+                if (pattern[i] == '\\' && i + 1 < pattern.size())
+                {
+                    ++i;
+                }
+                result.append(pattern[i]);
+            }
+            return result;
+        }
+
+        /**
+         * Checks whether a wildcard-free pattern has escapes only in front
+         * of ordinary characters, i.e. whether unescape() makes it a literal.
+         */
+        bool isEscapedLiteral(const QString& pattern)
+        {
+            for (int i = 0; i < pattern.size(); ++i)
+            {
+                if (pattern[i] == '\\')
+                {
+                    ++i;
+                }
+                else if (isSpecial(pattern[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    /**
+     * Creates an empty rule set reading ".gitignore" files.
+     */
+    IgnoreRules::IgnoreRules():
+        m_ruleFileName(".gitignore")
+    {
+    }
+
+    /**
+     * Compiles a single pattern and adds it after the existing ones.
+     *
+     * Empty patterns and comments (starting with "#") are skipped.
+     *
+     * @param pattern a line of a .gitignore file
+     * @param baseDirectory directory the pattern applies to, relative to the
+     *        walked root; empty for the root itself
+     */
+    void IgnoreRules::addPattern(QString pattern, QString baseDirectory)
+    {
+        if (pattern.endsWith('\r'))
+        {
+            pattern.chop(1);
+        }
+        // trailing spaces are ignored unless escaped
+        while (pattern.endsWith(' ') && !pattern.endsWith("\\ "))
+        {
+            pattern.chop(1);
+        }
+        if (pattern.isEmpty() || pattern.startsWith('#'))
+        {
+            return;
+        }
+
+        Rule rule;
+        rule.negated = pattern.startsWith('!');
+        if (rule.negated)
+        {
+            pattern.remove(0, 1);
+        }
+        else if (pattern.startsWith("\\!") || pattern.startsWith("\\#"))
+        {
+            pattern.remove(0, 1);
+        }
+
+        rule.directoryOnly = pattern.endsWith('/');
+        while (pattern.endsWith('/'))
+        {
+            pattern.chop(1);
+        }
+        rule.matchesName = !pattern.contains('/');
+        while (pattern.startsWith('/'))
+        {
+            pattern.remove(0, 1);
+        }
+        if (pattern.isEmpty())
+        {
+            return;
+        }
+
+        if (!baseDirectory.isEmpty() && !baseDirectory.endsWith('/'))
+        {
+            baseDirectory.append('/');
+        }
+        rule.baseDirectory = baseDirectory;
+
+        if (isEscapedLiteral(pattern))
+        {
+            rule.kind = Rule::Exact;
+            rule.pattern = unescape(pattern);
+        }
+        else if (rule.matchesName && pattern.size() > 1 && pattern.startsWith('*') &&
+                 isLiteral(pattern.mid(1)))
+        {
+            rule.kind = Rule::Suffix;
+            rule.pattern = pattern.mid(1);
+        }
+        else if (rule.matchesName && pattern.size() > 1 && pattern.endsWith('*') &&
+                 isLiteral(pattern.left(pattern.size() - 1)))
+        {
+            rule.kind = Rule::Prefix;
+            rule.pattern = pattern.left(pattern.size() - 1);
+        }
+        else
+        {
+            rule.kind = Rule::Glob;
+            rule.pattern = pattern;
+        }
+
+        m_rules.append(rule);
+    }
+
+    /**
+     * Adds all patterns of a rule file.
+     *
+     * @param text contents of a .gitignore file
+     * @param baseDirectory directory holding the file, relative to the
+     *        walked root; empty for the root itself
+     */
+    void IgnoreRules::addRules(QString text, QString baseDirectory)
+    {
+        foreach (const QString& line, text.split('\n'))
+        {
+            addPattern(line, baseDirectory);
+        }
+    }
+
+    /**
+     * Adds patterns excluding metadata directories of version control
+     * systems, which never hold project files.
+     */
+    void IgnoreRules::addDefaultPatterns()
+    {
+        addPattern(".git/");
+        addPattern(".svn/");
+        addPattern(".hg/");
+        addPattern(".bzr/");
+        addPattern("CVS/");
+    }
+
+    /**
+     * Checks whether a path is excluded by the rules.
+     *
+     * Only the path itself is matched; a file inside an ignored directory
+     * is not reported as ignored unless a pattern matches the file too.
+     * listFiles() doesn't need that, as it never enters such directories.
+     *
+     * @param relativePath path relative to the walked root, without a
+     *        leading or trailing slash
+     * @param isDirectory whether the path is a directory
+     * @return true if the last matching pattern excludes the path
+     */
+    bool IgnoreRules::isIgnored(const QString& relativePath, bool isDirectory) const
+    {
+        int nameStart = relativePath.lastIndexOf('/') + 1;
+
+        // walking backwards, the first match is the last one in order
+        for (int i = m_rules.size() - 1; i >= 0; --i)
+        {
+            const Rule& rule = m_rules[i];
+            if (rule.directoryOnly && !isDirectory)
+            {
+                continue;
+            }
+
+            int start = rule.baseDirectory.size();
+            if (start > 0 && !relativePath.startsWith(rule.baseDirectory))
+            {
+                continue;
+            }
+            if (rule.matchesName)
+            {
+                start = qMax(start, nameStart);
+            }
+
+            const QChar* subject = relativePath.constData() + start;
+            int length = relativePath.size() - start;
+            bool matched = false;
+            switch (rule.kind)
+            {
+            case Rule::Exact:
+                matched = length == rule.pattern.size() &&
+                          relativePath.midRef(start) == rule.pattern;
+                break;
+            case Rule::Prefix:
+                matched = length >= rule.pattern.size() &&
+                          relativePath.midRef(start, rule.pattern.size()) == rule.pattern;
+                break;
+            case Rule::Suffix:
+                matched = length >= rule.pattern.size() &&
+                          relativePath.endsWith(rule.pattern);
+                break;
+            case Rule::Glob:
+                matched = matchGlob(rule.pattern.constData(),
+                                    rule.pattern.constData() + rule.pattern.size(),
+                                    subject, subject + length);
+                break;
+            }
+
+            if (matched)
+            {
+                return !rule.negated;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Lists all files of a directory tree which are not ignored.
+     *
+     * Rule files found on the way are applied to their directory and
+     * everything below it. Each directory is listed once, and directories
+     * excluded by the rules are never listed at all.
+     *
+     * @param fileSystem file system holding the tree
+     * @param directory absolute path to the root of the tree
+     * @param cancelled flag checked before every directory is listed; once
+     *        it's set, the walk stops and the files found so far are
+     *        returned. 0 if the walk can't be cancelled
+     * @return absolute paths of the files, in directory order
+     */
+    QStringList IgnoreRules::listFiles(FileSystem* fileSystem, QString directory,
+                                       const QAtomicInt* cancelled) const
+    {
+        QStringList files;
+        while (directory.size() > 1 && directory.endsWith('/'))
+        {
+            directory.chop(1);
+        }
+
+        // rule files only extend the copy
+        IgnoreRules rules(*this);
+        rules.walk(fileSystem, directory, "", files, cancelled);
+
+        return files;
+    }
+
+    /**
+     * Collects files of a directory and of its subdirectories.
+     *
+     * @param fileSystem file system holding the tree
+     * @param directory absolute path to the directory
+     * @param relativeDirectory the directory relative to the walked root,
+     *        ending with a slash; empty for the root
+     * @param files receives absolute paths of the files
+     * @param cancelled flag stopping the walk, 0 if there is none
+     */
+    void IgnoreRules::walk(FileSystem* fileSystem, const QString& directory,
+                           const QString& relativeDirectory, QStringList& files,
+                           const QAtomicInt* cancelled)
+    {
+        if (cancelled && cancelled->load())
+        {
+            return;
+        }
+
+        QStringList entries;
+        QStringList directories;
+        fileSystem->listEntries(directory, entries, directories);
+
+        QString prefix = directory.endsWith('/') ? directory : directory + '/';
+        int ruleCount = m_rules.size();
+        if (!m_ruleFileName.isEmpty())
+        {
+            // only read the rule file if the listing has it, saving an open()
+            QString ruleFile = prefix + m_ruleFileName;
+            QByteArray data;
+            if (std::binary_search(entries.constBegin(), entries.constEnd(), ruleFile) &&
+                fileSystem->read(ruleFile, data))
+            {
+                addRules(QString::fromUtf8(data), relativeDirectory);
+            }
+        }
+
+        foreach (const QString& file, entries)
+        {
+            if (!isIgnored(relativeDirectory + file.mid(prefix.size()), false))
+            {
+                files.append(file);
+            }
+        }
+        foreach (const QString& subdirectory, directories)
+        {
+            QString relativePath = relativeDirectory + subdirectory.mid(prefix.size());
+            if (!isIgnored(relativePath, true))
+            {
+                walk(fileSystem, subdirectory, relativePath + '/', files, cancelled);
+            }
+        }
+
+        // rules of this directory don't apply to its siblings
+        m_rules.resize(ruleCount);
+    }
+}
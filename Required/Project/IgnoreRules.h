@@ -0,0 +1,160 @@
+/**
+ * @file IgnoreRules.h
+ *
+ * Gitignore-style rules excluding files from directory imports.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef IGNORERULES_H
+#define IGNORERULES_H
+
+#include "../global.h"
+#include "FileSystem.h"
+#include <QAtomicInt>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+namespace Required
+{
+    /**
+     * Gitignore-style rules excluding files from directory imports.
+     *
+     * Patterns follow the syntax of .gitignore files: "*", "?" and "[...]"
+     * don't match a slash, "**" does, a trailing slash restricts a pattern
+     * to directories, a pattern containing a slash is anchored to the
+     * directory it was given for, and a leading "!" re-includes what an
+     * earlier pattern excluded. The last matching pattern wins.
+     *
+     * Patterns are compiled when added. Most real-world patterns are plain
+     * names ("build/"), extensions ("*.o") or name prefixes ("core.*"),
+     * which are then matched by a single string comparison; only the rest
+     * goes through the generic glob matcher.
+     *
+     * listFiles() walks a directory tree, reading a rule file (".gitignore"
+     * by default) in every directory it enters. Ignored directories are
+     * decided from their parent's listing, so they are never opened.
+     */
+    class REQUIRED_EXPORT IgnoreRules
+    {
+    public:
+        IgnoreRules();
+
+        /**
+         * Returns the name of the per-directory rule files.
+         *
+         * @return file name, empty if rule files are not read
+         */
+        QString getRuleFileName() const
+        {
+            return m_ruleFileName;
+        }
+
+        /**
+         * Sets the name of the per-directory rule files.
+         *
+         * @param ruleFileName file name, empty to read no rule files
+         */
+        void setRuleFileName(QString ruleFileName)
+        {
+            m_ruleFileName = ruleFileName;
+        }
+
+        /**
+         * Returns the number of compiled patterns.
+         *
+         * @return rule count
+         */
+        int getRuleCount() const
+        {
+            return m_rules.size();
+        }
+
+        /**
+         * Removes all patterns.
+         */
+        void clear()
+        {
+            m_rules.clear();
+        }
+
+        void addPattern(QString pattern, QString baseDirectory = "");
+        void addRules(QString text, QString baseDirectory = "");
+        void addDefaultPatterns();
+        bool isIgnored(const QString& relativePath, bool isDirectory) const;
+        QStringList listFiles(FileSystem* fileSystem, QString directory,
+                              const QAtomicInt* cancelled = 0) const;
+
+    private:
+        /**
+         * A single compiled pattern.
+         */
+        struct Rule
+        {
+            /**
+             * How the pattern is matched.
+             */
+            enum Kind
+            {
+                Exact,
+                Prefix,
+                Suffix,
+                Glob
+            };
+
+            Kind kind;
+
+            /**
+             * The pattern, or its literal part for prefix and suffix rules.
+             */
+            QString pattern;
+
+            /**
+             * Directory the pattern was given for, relative to the walked
+             * root and ending with a slash; empty for the root.
+             */
+            QString baseDirectory;
+
+            /**
+             * Whether the pattern matches the last path component only.
+             */
+            bool matchesName;
+
+            /**
+             * Whether the pattern matches directories only.
+             */
+            bool directoryOnly;
+
+            /**
+             * Whether the pattern re-includes matching paths.
+             */
+            bool negated;
+        };
+
+        /**
+         * Compiled patterns, in the order they were added.
+         */
+        QVector<Rule> m_rules;
+
+        /**
+         * Name of the per-directory rule files.
+         */
+        QString m_ruleFileName;
+
+        void walk(FileSystem* fileSystem, const QString& directory,
+                  const QString& relativeDirectory, QStringList& files,
+                  const QAtomicInt* cancelled);
+    };
+}
+
+#endif // IGNORERULES_H
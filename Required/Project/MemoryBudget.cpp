@@ -0,0 +1,374 @@
+/**
+ * @file MemoryBudget.cpp
+ *
+ * A memory limit shared by caches, with per-cache statistics.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "MemoryBudget.h"
+#include <QMutexLocker>
+
+namespace Required
+{
+    namespace
+    {
+        /**
+         * Limit of the default budget.
+         */
+        const qint64 DefaultLimit = 256 * 1024 * 1024;
+
+        /**
+         * Eviction frees memory down to this many sixteenths of the limit.
+         */
+        const int TrimTarget = 15;
+    }
+
+    /**
+     * Creates a budget without caches.
+     *
+     * @param limit maximum memory used by all caches together in bytes,
+     *        0 for no limit
+     */
+    MemoryBudget::MemoryBudget(qint64 limit):
+        m_limit(qMax<qint64>(0, limit)), m_bytesUsed(0)
+    {
+    }
+
+    /**
+     * Destroys the budget; caches still charged to it become unlimited.
+     */
+    MemoryBudget::~MemoryBudget()
+    {
+        QMutexLocker trimLocker(&m_trimMutex);
+        QMutexLocker locker(&m_mutex);
+        foreach (BudgetedCache* cache, m_caches)
+        {
+            cache->m_budget = 0;
+        }
+    }
+
+    /**
+     * Returns the maximum memory used by all caches together.
+     *
+     * @return limit in bytes, 0 if there is no limit
+     */
+    qint64 MemoryBudget::getLimit() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_limit;
+    }
+
+    /**
+     * Sets the maximum memory used by all caches together.
+     *
+     * Lowering the limit evicts entries right away.
+     *
+     * @param limit limit in bytes, 0 for no limit
+     */
+    void MemoryBudget::setLimit(qint64 limit)
+    {
+        m_mutex.lock();
+        m_limit = qMax<qint64>(0, limit);
+        m_mutex.unlock();
+
+        trim();
+    }
+
+    /**
+     * Returns the memory used by all caches together.
+     *
+     * @return estimated size in bytes
+     */
+    qint64 MemoryBudget::getBytesUsed() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_bytesUsed;
+    }
+
+    /**
+     * Returns statistics of all caches charged to the budget.
+     *
+     * This is meant for tuning the limit of a deployment: a cache with a
+     * low hit rate gains little from its memory, while many evictions of a
+     * cache with a high hit rate suggest the limit is too low.
+     *
+     * @return statistics, one entry per cache
+     */
+    CacheStatisticsList MemoryBudget::getStatistics() const
+    {
+        // caches can't leave while their statistics are collected
+        QMutexLocker trimLocker(&m_trimMutex);
+        m_mutex.lock();
+        QList<BudgetedCache*> caches = m_caches;
+        m_mutex.unlock();
+
+        CacheStatisticsList statistics;
+        foreach (BudgetedCache* cache, caches)
+        {
+            statistics.append(cache->getStatistics());
+        }
+
+        return statistics;
+    }
+
+    /**
+     * Evicts entries until the caches fit in the limit.
+     *
+     * The largest cache gives up its least recently used entries first.
+     * Eviction goes a bit below the limit, so that caches filling up don't
+     * evict on every insertion.
+     */
+    void MemoryBudget::trim()
+    {
+        // one thread evicting is enough
+        if (!m_trimMutex.tryLock())
+        {
+            return;
+        }
+
+        QList<BudgetedCache*> exhausted;
+        forever
+        {
+            m_mutex.lock();
+            if (m_limit == 0 || m_bytesUsed <= m_limit)
+            {
+                m_mutex.unlock();
+                break;
+            }
+            qint64 excess = m_bytesUsed - m_limit / 16 * TrimTarget;
+            QList<BudgetedCache*> caches = m_caches;
+            m_mutex.unlock();
+
+            BudgetedCache* largest = 0;
+            qint64 largestSize = 0;
+            foreach (BudgetedCache* cache, caches)
+            {
+                qint64 size = cache->getBytesUsed();
+                if (size > largestSize && !exhausted.contains(cache))
+                {
+                    largest = cache;
+                    largestSize = size;
+                }
+            }
+            if (!largest)
+            {
+                break;
+            }
+
+            if (largest->evict(qMin(excess, largestSize)) <= 0)
+            {
+                // e.g. all entries are in use
+                exhausted.append(largest);
+            }
+        }
+
+        m_trimMutex.unlock();
+    }
+
+    /**
+     * Returns the budget shared by caches of the library by default.
+     *
+     * Its limit is 256 MiB.
+     *
+     * @return the default budget
+     */
+    MemoryBudget* MemoryBudget::getDefault()
+    {
+        static MemoryBudget budget(DefaultLimit);
+        return &budget;
+    }
+
+    /**
+     * Starts charging a cache to the budget.
+     *
+     * @param cache the cache
+     */
+    void MemoryBudget::attach(BudgetedCache* cache)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_caches.append(cache);
+        m_bytesUsed += cache->getBytesUsed();
+    }
+
+    /**
+     * Stops charging a cache to the budget.
+     *
+     * Waits for a running eviction, which might be using the cache.
+     *
+     * @param cache the cache
+     */
+    void MemoryBudget::detach(BudgetedCache* cache)
+    {
+        QMutexLocker trimLocker(&m_trimMutex);
+        QMutexLocker locker(&m_mutex);
+        if (m_caches.removeOne(cache))
+        {
+            m_bytesUsed -= cache->getBytesUsed();
+        }
+    }
+
+    /**
+     * Accounts for memory taken or freed by a cache.
+     *
+     * @param bytes change in bytes, negative when freed
+     * @return true if the budget is exceeded
+     */
+    bool MemoryBudget::charge(qint64 bytes)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_bytesUsed += bytes;
+        return m_limit > 0 && m_bytesUsed > m_limit;
+    }
+
+    /**
+     * Creates an empty cache charged to the default budget.
+     *
+     * @param name name of the cache, used in statistics
+     */
+    BudgetedCache::BudgetedCache(QString name):
+        m_name(name), m_budget(0), m_bytesUsed(0), m_hits(0), m_misses(0), m_evictions(0)
+    {
+        setMemoryBudget(MemoryBudget::getDefault());
+    }
+
+    /**
+     * Stops charging the cache, if the subclass hasn't done so already.
+     */
+    BudgetedCache::~BudgetedCache()
+    {
+        detachFromBudget();
+    }
+
+    /**
+     * Moves the cache to another budget.
+     *
+     * @param budget memory budget, 0 to leave the cache unlimited
+     */
+    void BudgetedCache::setMemoryBudget(MemoryBudget* budget)
+    {
+        detachFromBudget();
+        m_budget = budget;
+        if (m_budget)
+        {
+            m_budget->attach(this);
+            m_budget->trim();
+        }
+    }
+
+    /**
+     * Returns the memory used by the entries of the cache.
+     *
+     * @return estimated size in bytes
+     */
+    qint64 BudgetedCache::getBytesUsed() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_bytesUsed;
+    }
+
+    /**
+     * Returns a snapshot of the usage of the cache.
+     *
+     * @return cache statistics
+     */
+    CacheStatistics BudgetedCache::getStatistics() const
+    {
+        CacheStatistics statistics;
+        statistics.name = m_name;
+        m_mutex.lock();
+        statistics.bytesUsed = m_bytesUsed;
+        statistics.hits = m_hits;
+        statistics.misses = m_misses;
+        statistics.evictions = m_evictions;
+        m_mutex.unlock();
+
+        // the subclass lock is taken after ours is released, see evict()
+        fillStatistics(statistics);
+
+        return statistics;
+    }
+
+    /**
+     * Accounts for memory taken by new entries, evicting entries of any
+     * cache if the budget is exceeded.
+     *
+     * Must not be called with the lock of the cache held.
+     *
+     * @param bytes size of the entries
+     */
+    void BudgetedCache::charge(qint64 bytes)
+    {
+        m_mutex.lock();
+        m_bytesUsed += bytes;
+        m_mutex.unlock();
+
+        if (m_budget && m_budget->charge(bytes))
+        {
+            m_budget->trim();
+        }
+    }
+
+    /**
+     * Accounts for memory freed by dropped entries.
+     *
+     * May be called with the lock of the cache held.
+     *
+     * @param bytes size of the entries
+     * @param evictions number of entries dropped by eviction
+     */
+    void BudgetedCache::release(qint64 bytes, int evictions)
+    {
+        m_mutex.lock();
+        m_bytesUsed -= bytes;
+        m_evictions += evictions;
+        m_mutex.unlock();
+
+        if (m_budget)
+        {
+            m_budget->charge(-bytes);
+        }
+    }
+
+    /**
+     * Counts a lookup answered by the cache.
+     */
+    void BudgetedCache::recordHit()
+    {
+        QMutexLocker locker(&m_mutex);
+        ++m_hits;
+    }
+
+    /**
+     * Counts a lookup the cache couldn't answer.
+     */
+    void BudgetedCache::recordMiss()
+    {
+        QMutexLocker locker(&m_mutex);
+        ++m_misses;
+    }
+
+    /**
+     * Stops charging the cache to its budget.
+     *
+     * Subclasses call this in their destructor, so that the budget doesn't
+     * evict from a cache which is being destroyed.
+     */
+    void BudgetedCache::detachFromBudget()
+    {
+        if (m_budget)
+        {
+            m_budget->detach(this);
+            m_budget = 0;
+        }
+    }
+}
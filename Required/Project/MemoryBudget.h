@@ -0,0 +1,256 @@
+/**
+ * @file MemoryBudget.h
+ *
+ * A memory limit shared by caches, with per-cache statistics.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include "../global.h"
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+namespace Required
+{
+    class BudgetedCache;
+
+    /**
+     * A snapshot of the usage of a single cache.
+     */
+    struct REQUIRED_EXPORT CacheStatistics
+    {
+        CacheStatistics():
+            entryCount(0), bytesUsed(0), hits(0), misses(0), evictions(0),
+            spilledCount(0), spilledBytes(0)
+        {
+        }
+
+        /**
+         * Returns the fraction of lookups answered by the cache.
+         *
+         * @return hit rate between 0 and 1, 0 if there were no lookups
+         */
+        double getHitRate() const
+        {
+            quint64 lookups = hits + misses;
+            return lookups > 0 ? double(hits) / lookups : 0.0;
+        }
+
+        /**
+         * Name of the cache.
+         */
+        QString name;
+
+        /**
+         * Number of entries held in memory.
+         */
+        int entryCount;
+
+        /**
+         * Estimated memory used by the entries.
+         */
+        qint64 bytesUsed;
+
+        /**
+         * Number of lookups answered by the cache, from memory or disk.
+         */
+        quint64 hits;
+
+        /**
+         * Number of lookups the cache couldn't answer.
+         */
+        quint64 misses;
+
+        /**
+         * Number of entries evicted from memory.
+         */
+        quint64 evictions;
+
+        /**
+         * Number of entries spilled to disk and not read back yet.
+         */
+        int spilledCount;
+
+        /**
+         * Size of the spill file on disk.
+         */
+        qint64 spilledBytes;
+    };
+
+    /**
+     * A typedef to ease typing.
+     */
+    typedef QList<CacheStatistics> CacheStatisticsList;
+
+    /**
+     * A memory limit shared by caches, with per-cache statistics.
+     *
+     * Caches (see BudgetedCache) charge the budget for the memory their
+     * entries take. When the total exceeds the limit, entries are evicted
+     * from the largest cache, least recently used first, until the total
+     * drops a little below the limit, so that the next insertions don't
+     * trigger another eviction right away.
+     *
+     * All methods may be called from multiple threads.
+     */
+    class REQUIRED_EXPORT MemoryBudget
+    {
+    public:
+        explicit MemoryBudget(qint64 limit = 0);
+        ~MemoryBudget();
+
+        qint64 getLimit() const;
+        void setLimit(qint64 limit);
+        qint64 getBytesUsed() const;
+        CacheStatisticsList getStatistics() const;
+        void trim();
+
+        static MemoryBudget* getDefault();
+
+    private:
+        Q_DISABLE_COPY(MemoryBudget)
+
+        friend class BudgetedCache;
+
+        /**
+         * Maximum memory used by all caches together, in bytes.
+         */
+        qint64 m_limit;
+
+        /**
+         * Memory used by all caches together, in bytes.
+         */
+        qint64 m_bytesUsed;
+
+        /**
+         * Non-owning pointers to the caches sharing the budget.
+         */
+        QList<BudgetedCache*> m_caches;
+
+        /**
+         * Guards the members above.
+         */
+        mutable QMutex m_mutex;
+
+        /**
+         * Held while evicting, so that no cache leaves in the meantime.
+         */
+        mutable QMutex m_trimMutex;
+
+        void attach(BudgetedCache* cache);
+        void detach(BudgetedCache* cache);
+        bool charge(qint64 bytes);
+    };
+
+    /**
+     * A cache whose memory is limited by a MemoryBudget.
+     *
+     * Subclasses report the size of every entry they add or drop with
+     * charge() and release(), count lookups with recordHit() and
+     * recordMiss(), and implement evict(). A cache must not hold its own
+     * lock while charging, as the budget may call back into evict(), and
+     * must call detachFromBudget() in its destructor, before its entries
+     * are gone.
+     */
+    class REQUIRED_EXPORT BudgetedCache
+    {
+    public:
+        explicit BudgetedCache(QString name);
+        virtual ~BudgetedCache();
+
+        /**
+         * Returns the name of the cache, used in statistics.
+         *
+         * @return cache name
+         */
+        QString getCacheName() const
+        {
+            return m_name;
+        }
+
+        /**
+         * Returns the budget the cache is charged to.
+         *
+         * @return memory budget, 0 if the cache is unlimited
+         */
+        MemoryBudget* getMemoryBudget() const
+        {
+            return m_budget;
+        }
+
+        void setMemoryBudget(MemoryBudget* budget);
+        qint64 getBytesUsed() const;
+        CacheStatistics getStatistics() const;
+
+        /**
+         * Drops least recently used entries, called by the budget.
+         *
+         * Dropped entries must be passed to release().
+         *
+         * @param bytes number of bytes to free
+         * @return number of bytes freed
+         */
+        virtual qint64 evict(qint64 bytes) = 0;
+
+    protected:
+        void charge(qint64 bytes);
+        void release(qint64 bytes, int evictions = 0);
+        void recordHit();
+        void recordMiss();
+        void detachFromBudget();
+
+        /**
+         * Fills in counts the cache keeps itself, for getStatistics().
+         *
+         * @param statistics statistics to complete
+         */
+        virtual void fillStatistics(CacheStatistics& statistics) const = 0;
+
+    private:
+        Q_DISABLE_COPY(BudgetedCache)
+
+        friend class MemoryBudget;
+
+        /**
+         * Name of the cache.
+         */
+        QString m_name;
+
+        /**
+         * Non-owning pointer to the budget the cache is charged to.
+         */
+        MemoryBudget* m_budget;
+
+        /**
+         * Estimated memory used by the entries.
+         */
+        qint64 m_bytesUsed;
+
+        /**
+         * Lookup and eviction counters.
+         */
+        quint64 m_hits;
+        quint64 m_misses;
+        quint64 m_evictions;
+
+        /**
+         * Guards the members above.
+         */
+        mutable QMutex m_mutex;
+    };
+}
+
+#endif // MEMORYBUDGET_H
@@ -0,0 +1,216 @@
+/**
+ * @file MemoryFileSystem.cpp
+ *
+ * A file system living entirely in memory.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "MemoryFileSystem.h"
+#include <QReadLocker>
+#include <QWriteLocker>
+
+namespace Required
+{
+    /**
+     * Creates an empty file system.
+     */
+    MemoryFileSystem::MemoryFileSystem()
+    {
+    }
+
+    /**
+     * Creates or replaces a file with given contents.
+     *
+     * @param path absolute path to the file
+     * @param data file contents
+     * @param lastModified modification time in ms since the epoch
+     */
+    void MemoryFileSystem::writeFile(QString path, QByteArray data, qint64 lastModified)
+    {
+        Entry entry;
+        entry.data = data;
+        entry.size = data.size();
+        entry.lastModified = lastModified;
+        entry.hasData = true;
+        QWriteLocker locker(&m_lock);
+        m_files.insert(path, entry);
+    }
+
+    /**
+     * Creates or replaces a file filled with zeros.
+     *
+     * The contents are not stored, so even huge trees take little memory.
+     *
+     * @param path absolute path to the file
+     * @param size file size in bytes
+     * @param lastModified modification time in ms since the epoch
+     */
+    void MemoryFileSystem::addFile(QString path, qint64 size, qint64 lastModified)
+    {
+        Entry entry;
+        entry.size = qMax<qint64>(0, size);
+        entry.lastModified = lastModified;
+        entry.hasData = false;
+        QWriteLocker locker(&m_lock);
+        m_files.insert(path, entry);
+    }
+
+    /**
+     * Returns the number of files.
+     *
+     * @return file count
+     */
+    int MemoryFileSystem::getFileCount() const
+    {
+        QReadLocker locker(&m_lock);
+        return m_files.size();
+    }
+
+    /**
+     * Removes all files.
+     */
+    void MemoryFileSystem::clear()
+    {
+        QWriteLocker locker(&m_lock);
+        m_files.clear();
+    }
+
+    /**
+     * Returns information about a path.
+     *
+     * A path is a directory if any file lies below it.
+     *
+     * @param path absolute path
+     * @return status of the path
+     */
+    FileStatus MemoryFileSystem::stat(const QString& path)
+    {
+        FileStatus status;
+        QReadLocker locker(&m_lock);
+        QMap<QString, Entry>::const_iterator it = m_files.constFind(path);
+        if (it != m_files.constEnd())
+        {
+            status.exists = true;
+            status.isRegularFile = true;
+            status.size = it->size;
+            status.lastModified = it->lastModified;
+            return status;
+        }
+
+        QString prefix = path.endsWith('/') ? path : path + '/';
+        it = m_files.lowerBound(prefix);
+        if (it != m_files.constEnd() && it.key().startsWith(prefix))
+        {
+            status.exists = true;
+            status.isDirectory = true;
+            status.size = 0;
+            status.lastModified = 0;
+        }
+
+        return status;
+    }
+
+    /**
+     * Returns the files directly inside a directory.
+     *
+     * @param directory absolute path to the directory
+     * @return absolute paths of the files sorted by name
+     */
+    QStringList MemoryFileSystem::list(const QString& directory)
+    {
+        QStringList files;
+        QStringList directories;
+        listEntries(directory, files, directories);
+
+        return files;
+    }
+
+    /**
+     * Returns the files and the subdirectories directly inside a directory.
+     *
+     * Subdirectories are skipped as a whole, so the cost depends on the
+     * number of entries of the directory, not on the size of its subtree.
+     *
+     * @param directory absolute path to the directory
+     * @param files receives absolute paths of the files sorted by name
+     * @param directories receives absolute paths of the subdirectories
+     *        sorted by name
+     */
+    void MemoryFileSystem::listEntries(const QString& directory, QStringList& files,
+                                       QStringList& directories)
+    {
+        files.clear();
+        directories.clear();
+        QString prefix = directory.endsWith('/') ? directory : directory + '/';
+        QReadLocker locker(&m_lock);
+        QMap<QString, Entry>::const_iterator it = m_files.lowerBound(prefix);
+        while (it != m_files.constEnd() && it.key().startsWith(prefix))
+        {
+            int separator = it.key().indexOf('/', prefix.size());
+            if (separator < 0)
+            {
+                files.append(it.key());
+                ++it;
+            }
+            else
+            {
+                QString subdirectory = it.key().left(separator);
+                directories.append(subdirectory);
+                // '0' follows '/', so this is the first key past the subdirectory
+                it = m_files.lowerBound(subdirectory + '0');
+            }
+        }
+        // keys order "a-b/x" before "a/x", names order "a" first
+        directories.sort();
+    }
+
+    /**
+     * Removes a file.
+     *
+     * @param path absolute path to the file
+     * @return true if the file was removed
+     */
+    bool MemoryFileSystem::remove(const QString& path)
+    {
+        QWriteLocker locker(&m_lock);
+        return m_files.remove(path) > 0;
+    }
+
+    /**
+     * Reads the contents of a file.
+     *
+     * @param path absolute path to the file
+     * @param data receives the contents
+     * @param maxSize maximum number of bytes to read, -1 for the whole file
+     * @return true if the file exists and fits into getMaxReadSize()
+     */
+    bool MemoryFileSystem::read(const QString& path, QByteArray& data, qint64 maxSize)
+    {
+        QReadLocker locker(&m_lock);
+        QMap<QString, Entry>::const_iterator it = m_files.constFind(path);
+        if (it == m_files.constEnd())
+        {
+            data.clear();
+            return false;
+        }
+
+        qint64 size = maxSize < 0 ? it->size : qMin(maxSize, it->size);
+        if (size > getMaxReadSize())
+        {
+            data.clear();
+            return false;
+        }
+        data = it->hasData ? it->data.left(int(size)) : QByteArray(int(size), '\0');
+        return true;
+    }
+}
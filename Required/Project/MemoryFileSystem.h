@@ -0,0 +1,81 @@
+/**
+ * @file MemoryFileSystem.h
+ *
+ * A file system living entirely in memory.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef MEMORYFILESYSTEM_H
+#define MEMORYFILESYSTEM_H
+
+#include "../global.h"
+#include "FileSystem.h"
+#include <QMap>
+#include <QReadWriteLock>
+
+namespace Required
+{
+    /**
+     * A file system living entirely in memory.
+     *
+     * Results don't depend on the disk, caches or other processes, which
+     * makes it suitable for deterministic tests and for benchmarks of the
+     * project data structures at large scale. Files may be added with their
+     * contents, or just with a size, in which case reading them returns
+     * zeros and costs no memory up front.
+     *
+     * Directories exist implicitly, as long as there are files inside them.
+     */
+    class REQUIRED_EXPORT MemoryFileSystem : public FileSystem
+    {
+    public:
+        MemoryFileSystem();
+
+        void writeFile(QString path, QByteArray data, qint64 lastModified = 0);
+        void addFile(QString path, qint64 size = 0, qint64 lastModified = 0);
+        int getFileCount() const;
+        void clear();
+
+        FileStatus stat(const QString& path);
+        QStringList list(const QString& directory);
+        void listEntries(const QString& directory, QStringList& files, QStringList& directories);
+        bool remove(const QString& path);
+        bool read(const QString& path, QByteArray& data, qint64 maxSize = -1);
+
+    private:
+        Q_DISABLE_COPY(MemoryFileSystem)
+
+        /**
+         * A single file.
+         */
+        struct Entry
+        {
+            QByteArray data;
+            qint64 size;
+            qint64 lastModified;
+            bool hasData;
+        };
+
+        /**
+         * Files by absolute path; sorted, so a directory is a contiguous range.
+         */
+        QMap<QString, Entry> m_files;
+
+        /**
+         * Guards m_files.
+         */
+        mutable QReadWriteLock m_lock;
+    };
+}
+
+#endif // MEMORYFILESYSTEM_H
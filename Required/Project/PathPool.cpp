@@ -0,0 +1,249 @@
+/**
+ * @file PathPool.cpp
+ *
+ * Deduplicated storage of project paths in large memory blocks.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "PathPool.h"
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <cstring>
+
+namespace Required
+{
+    namespace
+    {
+        /**
+         * Size of a regular memory block.
+         */
+        const int BlockSize = 256 * 1024;
+
+        /**
+         * Initial number of hash table slots.
+         */
+        const int InitialTableSize = 1024;
+
+        /**
+         * Number of bytes needed for an entry with given number of characters,
+         * rounded up to keep entries aligned.
+         */
+        int entrySize(int size)
+        {
+            int bytes = int(sizeof(PathEntry)) + (size - 1) * int(sizeof(ushort));
+            return (bytes + 7) & ~7;
+        }
+    }
+
+    /**
+     * Compares the paths of two handles.
+     *
+     * Null handles sort before all others.
+     *
+     * @param other another handle, possibly from another pool
+     * @return negative, zero or positive, like QString::compare()
+     */
+    int PathHandle::compare(const PathHandle& other) const
+    {
+        if (m_entry == other.m_entry)
+        {
+            return 0;
+        }
+        if (!m_entry || !other.m_entry)
+        {
+            return m_entry ? 1 : -1;
+        }
+
+        int length = qMin(m_entry->size, other.m_entry->size);
+        const ushort* left = m_entry->data;
+        const ushort* right = other.m_entry->data;
+        for (int i = 0; i < length; ++i)
+        {
+            if (left[i] != right[i])
+            {
+                return left[i] < right[i] ? -1 : 1;
+            }
+        }
+
+        return m_entry->size - other.m_entry->size;
+    }
+
+    /**
+     * Creates an empty pool.
+     */
+    PathPool::PathPool():
+        m_blockUsed(0), m_blockSize(0), m_memoryUsage(0),
+        m_table(InitialTableSize, 0), m_count(0)
+    {
+    }
+
+    /**
+     * Destroys the pool; all its handles become invalid.
+     */
+    PathPool::~PathPool()
+    {
+        foreach (char* block, m_blocks)
+        {
+            delete[] block;
+        }
+    }
+
+    /**
+     * Returns the handle of a path, storing the path if it is new.
+     *
+     * @param path any string
+     * @return handle of the stored path
+     */
+    PathHandle PathPool::intern(const QString& path)
+    {
+        uint hash = qHash(path);
+        {
+            // most paths are already stored, so try without blocking others
+            QReadLocker locker(&m_lock);
+            if (const PathEntry* entry = m_table[findSlot(path, hash)])
+            {
+                return PathHandle(entry);
+            }
+        }
+
+        // another thread may have stored the path in the meantime
+        QWriteLocker locker(&m_lock);
+        int slot = findSlot(path, hash);
+        if (m_table[slot])
+        {
+            return PathHandle(m_table[slot]);
+        }
+
+        PathEntry* entry = allocate(path.size());
+        entry->size = path.size();
+        entry->hash = hash;
+        std::memcpy(entry->data, path.utf16(), path.size() * sizeof(ushort));
+        m_table[slot] = entry;
+        ++m_count;
+
+        // keep the load factor at most 1/2
+        if (m_count * 2 > m_table.size())
+        {
+            rehash(m_table.size() * 2);
+        }
+
+        return PathHandle(entry);
+    }
+
+    /**
+     * Returns the handle of a path without storing it.
+     *
+     * @param path any string
+     * @return handle of the path, null if the path is not in the pool
+     */
+    PathHandle PathPool::find(const QString& path) const
+    {
+        QReadLocker locker(&m_lock);
+        return PathHandle(m_table[findSlot(path, qHash(path))]);
+    }
+
+    /**
+     * Returns the number of distinct paths in the pool.
+     *
+     * @return path count
+     */
+    int PathPool::size() const
+    {
+        QReadLocker locker(&m_lock);
+        return m_count;
+    }
+
+    /**
+     * Returns the memory taken by stored paths.
+     *
+     * @return total size of memory blocks in bytes
+     */
+    qint64 PathPool::getMemoryUsage() const
+    {
+        QReadLocker locker(&m_lock);
+        return m_memoryUsage;
+    }
+
+    /**
+     * Finds the slot holding a path, or the empty slot where it belongs.
+     *
+     * @param path any string
+     * @param hash hash of the path
+     * @return index in m_table
+     */
+    int PathPool::findSlot(const QString& path, uint hash) const
+    {
+        int mask = m_table.size() - 1;
+        int slot = hash & mask;
+        const ushort* chars = path.utf16();
+        while (const PathEntry* entry = m_table[slot])
+        {
+            if (entry->hash == hash && entry->size == path.size() &&
+                std::memcmp(entry->data, chars, path.size() * sizeof(ushort)) == 0)
+            {
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+
+        return slot;
+    }
+
+    /**
+     * Reserves memory for a new entry.
+     *
+     * Paths too long to share a block get a block of their own.
+     *
+     * @param size number of characters
+     * @return uninitialized entry
+     */
+    PathEntry* PathPool::allocate(int size)
+    {
+        int bytes = entrySize(size);
+        if (m_blocks.isEmpty() || m_blockUsed + bytes > m_blockSize)
+        {
+            m_blockSize = qMax(BlockSize, bytes);
+            m_blocks.append(new char[m_blockSize]);
+            m_blockUsed = 0;
+            m_memoryUsage += m_blockSize;
+        }
+
+        PathEntry* entry = reinterpret_cast<PathEntry*>(m_blocks.last() + m_blockUsed);
+        m_blockUsed += bytes;
+        return entry;
+    }
+
+    /**
+     * Rebuilds the hash table with a new size.
+     *
+     * @param tableSize number of slots, a power of two
+     */
+    void PathPool::rehash(int tableSize)
+    {
+        QVector<const PathEntry*> table(tableSize, 0);
+        int mask = tableSize - 1;
+        foreach (const PathEntry* entry, m_table)
+        {
+            if (entry)
+            {
+                int slot = entry->hash & mask;
+                while (table[slot])
+                {
+                    slot = (slot + 1) & mask;
+                }
+                table[slot] = entry;
+            }
+        }
+        m_table.swap(table);
+    }
+}
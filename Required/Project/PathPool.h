@@ -0,0 +1,204 @@
+/**
+ * @file PathPool.h
+ *
+ * Deduplicated storage of project paths in large memory blocks.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef PATHPOOL_H
+#define PATHPOOL_H
+
+#include "../global.h"
+#include <QChar>
+#include <QHash>
+#include <QList>
+#include <QMetaType>
+#include <QReadWriteLock>
+#include <QString>
+#include <QVector>
+
+namespace Required
+{
+    /**
+     * A path as laid out in the pool memory.
+     *
+     * Entries are allocated with room for all characters, not just one.
+     */
+    struct PathEntry
+    {
+        int size;
+        uint hash;
+        ushort data[1];
+    };
+
+    /**
+     * A lightweight reference to a path stored in a PathPool.
+     *
+     * A handle is as cheap to copy as a pointer and stays valid as long as
+     * the pool exists. Since the pool stores every distinct path once, two
+     * handles from the same pool are equal exactly when their paths are.
+     * Ordering compares the paths themselves, so handles may be used as
+     * keys of sorted containers.
+     */
+    class REQUIRED_EXPORT PathHandle
+    {
+    public:
+        PathHandle():
+            m_entry(0)
+        {
+        }
+
+        explicit PathHandle(const PathEntry* entry):
+            m_entry(entry)
+        {
+        }
+
+        /**
+         * Checks whether the handle refers to no path.
+         */
+        bool isNull() const
+        {
+            return m_entry == 0;
+        }
+
+        /**
+         * Returns the number of characters of the path.
+         */
+        int size() const
+        {
+            return m_entry ? m_entry->size : 0;
+        }
+
+        /**
+         * Returns the characters of the path (not null-terminated).
+         */
+        const QChar* constData() const
+        {
+            return m_entry ? reinterpret_cast<const QChar*>(m_entry->data) : 0;
+        }
+
+        /**
+         * Returns a copy of the path.
+         */
+        QString toString() const
+        {
+            return m_entry ? QString(constData(), m_entry->size) : QString();
+        }
+
+        int compare(const PathHandle& other) const;
+
+        /**
+         * Identity comparison, valid for handles from the same pool.
+         */
+        bool operator==(const PathHandle& other) const
+        {
+            return m_entry == other.m_entry;
+        }
+
+        bool operator!=(const PathHandle& other) const
+        {
+            return m_entry != other.m_entry;
+        }
+
+        bool operator<(const PathHandle& other) const
+        {
+            return compare(other) < 0;
+        }
+
+    private:
+        /**
+         * The entry in pool memory.
+         */
+        const PathEntry* m_entry;
+    };
+
+    /**
+     * Hashes the identity of a handle.
+     */
+    inline uint qHash(const PathHandle& handle, uint seed = 0)
+    {
+        return ::qHash(reinterpret_cast<quintptr>(handle.constData()), seed);
+    }
+
+    /**
+     * Deduplicated storage of paths in large memory blocks.
+     *
+     * Characters of all paths are stored one after another in blocks of
+     * a few hundred kilobytes, so interning many paths needs a number of
+     * allocations proportional to the number of blocks, not paths. Paths
+     * are never freed individually; their memory is released together with
+     * the pool. Owners drop paths which are no longer used by moving the
+     * live ones to a fresh pool, see Project.
+     *
+     * Interning and lookups may be called from multiple threads. Lookups,
+     * including interning of paths already stored, only share a read lock.
+     * Reading through a handle needs no locking, since entries never change.
+     */
+    class REQUIRED_EXPORT PathPool
+    {
+    public:
+        PathPool();
+        ~PathPool();
+
+        PathHandle intern(const QString& path);
+        PathHandle find(const QString& path) const;
+        int size() const;
+        qint64 getMemoryUsage() const;
+
+    private:
+        Q_DISABLE_COPY(PathPool)
+
+        /**
+         * Memory blocks holding the entries.
+         */
+        QList<char*> m_blocks;
+
+        /**
+         * Number of bytes used in the last block.
+         */
+        int m_blockUsed;
+
+        /**
+         * Size of the last block.
+         */
+        int m_blockSize;
+
+        /**
+         * Total size of all blocks.
+         */
+        qint64 m_memoryUsage;
+
+        /**
+         * Open-addressing hash table of entries; its size is a power of two.
+         */
+        QVector<const PathEntry*> m_table;
+
+        /**
+         * Number of entries.
+         */
+        int m_count;
+
+        /**
+         * Guards everything above.
+         */
+        mutable QReadWriteLock m_lock;
+
+        int findSlot(const QString& path, uint hash) const;
+        PathEntry* allocate(int size);
+        void rehash(int tableSize);
+    };
+}
+
+Q_DECLARE_METATYPE(Required::PathHandle)
+
+#endif // PATHPOOL_H
@@ -0,0 +1,446 @@
+/**
+ * @file PersistentMap.h
+ *
+ * A sorted associative container with O(1) copies and structural sharing.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef PERSISTENTMAP_H
+#define PERSISTENTMAP_H
+
+#include "../global.h"
+#include <QExplicitlySharedDataPointer>
+#include <QList>
+#include <QSharedData>
+#include <QVarLengthArray>
+
+namespace Required
+{
+    /**
+     * A sorted associative container with O(1) copies and structural sharing.
+     *
+     * The map is an AVL tree whose nodes are reference counted. Copying the
+     * map only copies the root pointer. A modification copies the nodes on
+     * the path from the root to the modified node, but only those which are
+     * shared with another copy - nodes owned exclusively by this map are
+     * changed in place. As a result, a map which is never copied behaves
+     * like an ordinary balanced tree, and a copy costs memory proportional
+     * to the modifications made after it was taken.
+     *
+     * Like Qt containers, the map is reentrant but not thread-safe; distinct
+     * copies may however be used from different threads.
+     */
+    template <typename Key, typename T>
+    class PersistentMap
+    {
+        struct Node;
+        typedef QExplicitlySharedDataPointer<Node> NodePointer;
+
+        /**
+         * A single tree node.
+         */
+        struct Node : public QSharedData
+        {
+            Node(const Key& key, const T& value):
+                key(key), value(value), height(1)
+            {
+            }
+
+            Node(const Node& other):
+                QSharedData(), key(other.key), value(other.value),
+                left(other.left), right(other.right), height(other.height)
+            {
+            }
+
+            Key key;
+            T value;
+            NodePointer left;
+            NodePointer right;
+            int height;
+        };
+
+    public:
+        /**
+         * In-order iterator over the map.
+         *
+         * The iterator keeps a path to the current node, so it stays valid
+         * only as long as the map it was taken from is not modified. Iterate
+         * over a copy of the map to modify the original meanwhile.
+         */
+        class const_iterator
+        {
+        public:
+            const_iterator()
+            {
+            }
+
+            const Key& key() const
+            {
+                return m_path.last()->key;
+            }
+
+            const T& value() const
+            {
+                return m_path.last()->value;
+            }
+
+            const_iterator& operator++()
+            {
+                const Node* node = m_path.last();
+                m_path.removeLast();
+                pushLeftSpine(node->right.data());
+                return *this;
+            }
+
+            bool operator==(const const_iterator& other) const
+            {
+                if (m_path.isEmpty() || other.m_path.isEmpty())
+                {
+                    return m_path.isEmpty() == other.m_path.isEmpty();
+                }
+                return m_path.last() == other.m_path.last();
+            }
+
+            bool operator!=(const const_iterator& other) const
+            {
+                return !(*this == other);
+            }
+
+        private:
+            void pushLeftSpine(const Node* node)
+            {
+                for (; node; node = node->left.data())
+                {
+                    m_path.append(node);
+                }
+            }
+
+            /**
+             * Nodes on the path to the current one, which still have to be
+             * visited; the current node is the last one.
+             */
+            QVarLengthArray<const Node*, 64> m_path;
+
+            friend class PersistentMap;
+        };
+
+        PersistentMap():
+            m_size(0)
+        {
+        }
+
+        /**
+         * Returns the number of items in the map.
+         */
+        int size() const
+        {
+            return m_size;
+        }
+
+        /**
+         * Checks whether the map has no items.
+         */
+        bool isEmpty() const
+        {
+            return m_size == 0;
+        }
+
+        /**
+         * Checks whether two maps share the whole tree (a cheap identity test).
+         */
+        bool isSharedWith(const PersistentMap& other) const
+        {
+            return m_root == other.m_root;
+        }
+
+        /**
+         * Checks whether the key is present in the map.
+         */
+        bool contains(const Key& key) const
+        {
+            return findNode(key) != 0;
+        }
+
+        /**
+         * Returns the value associated with a key, or the default value.
+         */
+        T value(const Key& key, const T& defaultValue = T()) const
+        {
+            const Node* node = findNode(key);
+            return node ? node->value : defaultValue;
+        }
+
+        /**
+         * Inserts a new item or replaces the value of an existing one.
+         */
+        void insert(const Key& key, const T& value)
+        {
+            bool added = false;
+            insertNode(m_root, key, value, added);
+            if (added)
+            {
+                ++m_size;
+            }
+        }
+
+        /**
+         * Removes an item.
+         *
+         * @return number of removed items (0 or 1)
+         */
+        int remove(const Key& key)
+        {
+            // check first, so that a missing key doesn't copy the path
+            if (!contains(key))
+            {
+                return 0;
+            }
+
+            removeNode(m_root, key);
+            --m_size;
+            return 1;
+        }
+
+        /**
+         * Removes all items.
+         */
+        void clear()
+        {
+            m_root.reset();
+            m_size = 0;
+        }
+
+        /**
+         * Returns a list of all keys in ascending order.
+         */
+        QList<Key> keys() const
+        {
+            QList<Key> result;
+            result.reserve(m_size);
+            for (const_iterator it = constBegin(); it != constEnd(); ++it)
+            {
+                result.append(it.key());
+            }
+
+            return result;
+        }
+
+        const_iterator constBegin() const
+        {
+            const_iterator it;
+            it.pushLeftSpine(m_root.data());
+            return it;
+        }
+
+        const_iterator constEnd() const
+        {
+            return const_iterator();
+        }
+
+        /**
+         * Returns an iterator to the first item not less than the key.
+         */
+        const_iterator lowerBound(const Key& key) const
+        {
+            const_iterator it;
+            const Node* node = m_root.data();
+            while (node)
+            {
+                if (node->key < key)
+                {
+                    node = node->right.data();
+                }
+                else
+                {
+                    it.m_path.append(node);
+                    node = node->left.data();
+                }
+            }
+
+            return it;
+        }
+
+    private:
+        /**
+         * Root of the tree, shared between copies of the map.
+         */
+        NodePointer m_root;
+
+        /**
+         * Number of items.
+         */
+        int m_size;
+
+        const Node* findNode(const Key& key) const
+        {
+            const Node* node = m_root.data();
+            while (node)
+            {
+                if (key < node->key)
+                {
+                    node = node->left.data();
+                }
+                else if (node->key < key)
+                {
+                    node = node->right.data();
+                }
+                else
+                {
+                    return node;
+                }
+            }
+
+            return 0;
+        }
+
+        static int height(const NodePointer& node)
+        {
+            return node ? node->height : 0;
+        }
+
+        static void updateHeight(Node* node)
+        {
+            node->height = 1 + qMax(height(node->left), height(node->right));
+        }
+
+        // Rotations and rebalancing expect the node passed by reference to be
+        // already detached (owned exclusively by this path). Pointers are
+        // moved around with swap() so that reference counts - and therefore
+        // the "exclusively owned" test done by detach() - stay accurate.
+
+        static void rotateRight(NodePointer& node)
+        {
+            node->left.detach();
+            NodePointer pivot;
+            pivot.swap(node->left);
+            node->left.swap(pivot->right);
+            updateHeight(node.data());
+            pivot->right.swap(node);
+            updateHeight(pivot.data());
+            node.swap(pivot);
+        }
+
+        static void rotateLeft(NodePointer& node)
+        {
+            node->right.detach();
+            NodePointer pivot;
+            pivot.swap(node->right);
+            node->right.swap(pivot->left);
+            updateHeight(node.data());
+            pivot->left.swap(node);
+            updateHeight(pivot.data());
+            node.swap(pivot);
+        }
+
+        static void rebalance(NodePointer& node)
+        {
+            int balance = height(node->left) - height(node->right);
+            if (balance > 1)
+            {
+                if (height(node->left->left) < height(node->left->right))
+                {
+                    node->left.detach();
+                    rotateLeft(node->left);
+                }
+                rotateRight(node);
+            }
+            else if (balance < -1)
+            {
+                if (height(node->right->right) < height(node->right->left))
+                {
+                    node->right.detach();
+                    rotateRight(node->right);
+                }
+                rotateLeft(node);
+            }
+            else
+            {
+                updateHeight(node.data());
+            }
+        }
+
+        static void insertNode(NodePointer& node, const Key& key,
+                               const T& value, bool& added)
+        {
+            if (!node)
+            {
+                node = NodePointer(new Node(key, value));
+                added = true;
+                return;
+            }
+
+            node.detach();
+            if (key < node->key)
+            {
+                insertNode(node->left, key, value, added);
+            }
+            else if (node->key < key)
+            {
+                insertNode(node->right, key, value, added);
+            }
+            else
+            {
+                node->value = value;
+                return;
+            }
+
+            rebalance(node);
+        }
+
+        static void takeMinimum(NodePointer& node, Key& key, T& value)
+        {
+            node.detach();
+            if (!node->left)
+            {
+                key = node->key;
+                value = node->value;
+                NodePointer right;
+                right.swap(node->right);
+                node.swap(right);
+                return;
+            }
+
+            takeMinimum(node->left, key, value);
+            rebalance(node);
+        }
+
+        static void removeNode(NodePointer& node, const Key& key)
+        {
+            node.detach();
+            if (key < node->key)
+            {
+                removeNode(node->left, key);
+            }
+            else if (node->key < key)
+            {
+                removeNode(node->right, key);
+            }
+            else if (!node->left || !node->right)
+            {
+                // replace the node with its only child (or nothing)
+                NodePointer child;
+                child.swap(node->left ? node->left : node->right);
+                node.swap(child);
+                return;
+            }
+            else
+            {
+                takeMinimum(node->right, node->key, node->value);
+            }
+
+            rebalance(node);
+        }
+    };
+}
+
+#endif // PERSISTENTMAP_H
@@ -0,0 +1,348 @@
+/**
+ * @file PosixFileSystem.cpp
+ *
+ * Access to the local disk with batched system calls.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "PosixFileSystem.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#if defined(Q_OS_UNIX)
+#  include <cerrno>
+#  include <dirent.h>
+#  include <fcntl.h>
+#  include <sys/stat.h>
+#  include <sys/types.h>
+#  include <unistd.h>
+#endif
+
+namespace Required
+{
+    namespace
+    {
+#if defined(Q_OS_UNIX)
+        /**
+         * Converts the result of a stat() call.
+         */
+        FileStatus toFileStatus(const struct stat& info)
+        {
+            FileStatus status;
+            status.exists = true;
+            status.isDirectory = S_ISDIR(info.st_mode);
+            status.isRegularFile = S_ISREG(info.st_mode);
+            status.size = info.st_size;
+#if defined(Q_OS_LINUX)
+            status.lastModified = qint64(info.st_mtim.tv_sec) * 1000 +
+                                  info.st_mtim.tv_nsec / 1000000;
+#else
+            status.lastModified = qint64(info.st_mtime) * 1000;
+#endif
+            return status;
+        }
+
+        /**
+         * Returns the length of the directory part of a path, including
+         * the separator; 0 if there is none.
+         */
+        int directoryLength(const QString& path)
+        {
+            return path.lastIndexOf('/') + 1;
+        }
+#else
+        /**
+         * Converts file information obtained by Qt.
+         */
+        FileStatus toFileStatus(const QFileInfo& info)
+        {
+            FileStatus status;
+            if (info.exists())
+            {
+                status.exists = true;
+                status.isDirectory = info.isDir();
+                status.isRegularFile = info.isFile();
+                status.size = info.size();
+                status.lastModified = info.lastModified().toMSecsSinceEpoch();
+            }
+            return status;
+        }
+#endif
+    }
+
+    /**
+     * Returns information about a path.
+     *
+     * @param path absolute path
+     * @return status of the path
+     */
+    FileStatus PosixFileSystem::stat(const QString& path)
+    {
+#if defined(Q_OS_UNIX)
+        struct stat info;
+        if (::stat(QFile::encodeName(path).constData(), &info) != 0)
+        {
+            return FileStatus();
+        }
+        return toFileStatus(info);
+#else
+        return toFileStatus(QFileInfo(path));
+#endif
+    }
+
+    /**
+     * Returns information about many paths at once.
+     *
+     * The directory of a run of paths sharing it is opened once and the
+     * files are looked up relative to it, so the kernel resolves the
+     * directory part only once per run. Project files come sorted by path,
+     * which makes such runs long.
+     *
+     * @param paths absolute paths
+     * @return statuses in the same order as the paths
+     */
+    FileStatusList PosixFileSystem::statFiles(const QStringList& paths)
+    {
+#if defined(Q_OS_UNIX)
+        FileStatusList statuses;
+        statuses.reserve(paths.size());
+        QString currentDirectory;
+        int directoryFd = -1;
+        foreach (const QString& path, paths)
+        {
+            int length = directoryLength(path);
+            if (length == 0)
+            {
+                statuses.append(stat(path));
+                continue;
+            }
+
+            if (directoryFd < 0 || length != currentDirectory.size() ||
+                !path.startsWith(currentDirectory))
+            {
+                if (directoryFd >= 0)
+                {
+                    ::close(directoryFd);
+                }
+                currentDirectory = path.left(length);
+                directoryFd = ::open(QFile::encodeName(currentDirectory).constData(),
+                                     O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            }
+
+            struct stat info;
+            if (directoryFd >= 0 &&
+                ::fstatat(directoryFd, QFile::encodeName(path.mid(length)).constData(),
+                          &info, 0) == 0)
+            {
+                statuses.append(toFileStatus(info));
+            }
+            else
+            {
+                statuses.append(FileStatus());
+            }
+        }
+        if (directoryFd >= 0)
+        {
+            ::close(directoryFd);
+        }
+
+        return statuses;
+#else
+        return FileSystem::statFiles(paths);
+#endif
+    }
+
+    /**
+     * Returns the regular files directly inside a directory.
+     *
+     * @param directory absolute path to the directory
+     * @return absolute paths of the files sorted by name
+     */
+    QStringList PosixFileSystem::list(const QString& directory)
+    {
+        QStringList files;
+        QStringList directories;
+        listEntries(directory, files, directories);
+
+        return files;
+    }
+
+    /**
+     * Returns the regular files and the subdirectories directly inside
+     * a directory.
+     *
+     * Only entries of unknown type (some file systems don't report types)
+     * and symbolic links are stat()ed. Symbolic links to directories are
+     * not reported, so walking the tree can't loop.
+     *
+     * @param directory absolute path to the directory
+     * @param files receives absolute paths of the files sorted by name
+     * @param directories receives absolute paths of the subdirectories
+     *        sorted by name
+     */
+    void PosixFileSystem::listEntries(const QString& directory, QStringList& files,
+                                      QStringList& directories)
+    {
+        files.clear();
+        directories.clear();
+        QString prefix = directory.endsWith('/') ? directory : directory + '/';
+#if defined(Q_OS_UNIX)
+        DIR* dir = ::opendir(QFile::encodeName(directory).constData());
+        if (!dir)
+        {
+            return;
+        }
+
+        while (struct dirent* entry = ::readdir(dir))
+        {
+            int type = entry->d_type;
+            if (type == DT_UNKNOWN)
+            {
+                struct stat info;
+                if (::fstatat(::dirfd(dir), entry->d_name, &info, AT_SYMLINK_NOFOLLOW) == 0)
+                {
+                    type = IFTODT(info.st_mode);
+                }
+            }
+            bool isFile = type == DT_REG;
+            bool isDirectory = type == DT_DIR;
+            if (type == DT_LNK)
+            {
+                struct stat info;
+                isFile = ::fstatat(::dirfd(dir), entry->d_name, &info, 0) == 0 &&
+                         S_ISREG(info.st_mode);
+            }
+            if (isFile)
+            {
+                files.append(prefix + QFile::decodeName(entry->d_name));
+            }
+            else if (isDirectory && qstrcmp(entry->d_name, ".") != 0 &&
+                     qstrcmp(entry->d_name, "..") != 0)
+            {
+                directories.append(prefix + QFile::decodeName(entry->d_name));
+            }
+        }
+        ::closedir(dir);
+#else
+        foreach (QString name, QDir(directory).entryList(QDir::Files))
+        {
+            files.append(prefix + name);
+        }
+        foreach (QString name, QDir(directory).entryList(QDir::Dirs | QDir::NoDotAndDotDot |
+                                                         QDir::NoSymLinks))
+        {
+            directories.append(prefix + name);
+        }
+#endif
+        files.sort();
+        directories.sort();
+    }
+
+    /**
+     * Removes a file.
+     *
+     * @param path absolute path to the file
+     * @return true if the file was removed
+     */
+    bool PosixFileSystem::remove(const QString& path)
+    {
+#if defined(Q_OS_UNIX)
+        return ::unlink(QFile::encodeName(path).constData()) == 0;
+#else
+        return QFile::remove(path);
+#endif
+    }
+
+    /**
+     * Reads the contents of a file.
+     *
+     * @param path absolute path to the file
+     * @param data receives the contents
+     * @param maxSize maximum number of bytes to read, -1 for the whole file
+     * @return true if the file could be read
+     */
+    bool PosixFileSystem::read(const QString& path, QByteArray& data, qint64 maxSize)
+    {
+        data.clear();
+#if defined(Q_OS_UNIX)
+        int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        qint64 size = maxSize < 0 ? qint64(info.st_size) : qMin<qint64>(maxSize, info.st_size);
+        if (size > getMaxReadSize())
+        {
+            ::close(fd);
+            return false;
+        }
+        data.resize(int(size));
+
+        qint64 total = 0;
+        while (total < size)
+        {
+            ssize_t bytesRead = ::read(fd, data.data() + total, size_t(size - total));
+            if (bytesRead < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytesRead < 0)
+            {
+                ::close(fd);
+                data.clear();
+                return false;
+            }
+            if (bytesRead == 0)
+            {
+                break;
+            }
+            total += bytesRead;
+        }
+        ::close(fd);
+        data.resize(int(total));
+        return true;
+#else
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            return false;
+        }
+        qint64 size = maxSize < 0 ? file.size() : qMin(maxSize, file.size());
+        if (size > getMaxReadSize())
+        {
+            return false;
+        }
+        data = file.read(size);
+        return true;
+#endif
+    }
+
+    /**
+     * Checks whether paths name files on a local disk.
+     *
+     * @return always true
+     */
+    bool PosixFileSystem::isLocal() const
+    {
+        return true;
+    }
+}
@@ -0,0 +1,50 @@
+/**
+ * @file PosixFileSystem.h
+ *
+ * Access to the local disk with batched system calls.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef POSIXFILESYSTEM_H
+#define POSIXFILESYSTEM_H
+
+#include "../global.h"
+#include "FileSystem.h"
+
+namespace Required
+{
+    /**
+     * Access to the local disk with batched system calls.
+     *
+     * System calls are used directly instead of QFileInfo and QDir, which
+     * issue several calls per file and build objects that are thrown away
+     * right after. Batched lookups resolve the directory of consecutive
+     * paths only once, and listings use the entry types reported by the
+     * directory itself, so most files are never stat()ed.
+     *
+     * On platforms other than Unix, Qt classes are used instead.
+     */
+    class REQUIRED_EXPORT PosixFileSystem : public FileSystem
+    {
+    public:
+        FileStatus stat(const QString& path);
+        FileStatusList statFiles(const QStringList& paths);
+        QStringList list(const QString& directory);
+        void listEntries(const QString& directory, QStringList& files, QStringList& directories);
+        bool remove(const QString& path);
+        bool read(const QString& path, QByteArray& data, qint64 maxSize = -1);
+        bool isLocal() const;
+    };
+}
+
+#endif // POSIXFILESYSTEM_H
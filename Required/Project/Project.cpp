@@ -16,16 +16,62 @@
  */
 
 #include "Project.h"
+#include "ContentClassifier.h"
+#include "ProjectDiff.h"
 #include "ProjectException.h"
-#include <QFile>
+#include "ProjectSnapshot.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QMapIterator>
 
 namespace Required
 {
+    namespace
+    {
+        /**
+         * The smallest capacity of the file filter, so that small projects
+         * don't rebuild it on every few added files.
+         */
+        const int MinFileFilterCapacity = 1024;
+
+        /**
+         * The smallest number of pooled paths worth compacting.
+         */
+        const int MinCompactedPoolSize = 4096;
+    }
+
     Project::Project(QObject* parent):
-        QObject(parent)
+        QObject(parent), m_pathPool(new PathPool), m_categoriesVersion(0),
+        m_contentClassifier(0), m_fileSystem(FileSystem::getDefault()),
+        m_fileFilterEnabled(false), m_fileFilterStaleCount(0)
     {
     }
 
+    /**
+     * Enables or disables the Bloom filter in front of the file index.
+     *
+     * With the filter enabled, looking up a file which is not in the project
+     * usually ends after touching a single cache line, without hashing into
+     * the path pool or walking the file index. This pays off when most
+     * lookups miss, e.g. when filtering a directory listing against the
+     * project. The filter costs about ten bits per file.
+     *
+     * @param enabled true to enable the filter
+     */
+    void Project::setFileFilterEnabled(bool enabled)
+    {
+        m_fileFilterEnabled = enabled;
+        if (enabled)
+        {
+            rebuildFileFilter();
+        }
+        else
+        {
+            m_fileFilter.reset(0);
+            m_fileFilterStaleCount = 0;
+        }
+    }
+
     /**
      * Checks whether given file is already included in the project.
      *
@@ -33,34 +79,131 @@ namespace Required
      */
     bool Project::hasFile(QString filename) const
     {
-        return m_fileIndex.contains(filename);
+        return !getFileHandle(filename).isNull();
+    }
+
+    /**
+     * Sets the root directory of the project.
+     *
+     * Absolute paths of files already in the project stay the same; files
+     * are re-encoded relative to the new root where possible. As stored
+     * paths and their handles change, rootPathChanged() is emitted instead
+     * of a pair of signals for every file. Use relocate() to move the files
+     * along with the root.
+     *
+     * @param rootPath path to the root directory, empty for no root
+     */
+    void Project::setRootPath(QString rootPath)
+    {
+        if (!rootPath.isEmpty())
+        {
+            rootPath = QDir::cleanPath(QFileInfo(rootPath).absoluteFilePath());
+        }
+        if (rootPath == m_rootPath)
+        {
+            return;
+        }
+
+        QString oldRootPath = m_rootPath;
+        m_rootPath = rootPath;
+        reencodePaths(oldRootPath);
+        emit rootPathChanged(m_rootPath);
+    }
+
+    /**
+     * Moves the root directory, together with all files inside it.
+     *
+     * This is meant for projects whose tree was moved or copied to another
+     * location. Files inside the root keep their relative paths, so their
+     * absolute paths change; nothing is checked on disk. Files outside the
+     * root are not affected, but those which end up inside the new root are
+     * stored relative to it from now on. Emits relocated() instead of a pair
+     * of signals for every file; if there is no root yet, this is the same
+     * as setRootPath().
+     *
+     * @param rootPath new path to the root directory
+     */
+    void Project::relocate(QString rootPath)
+    {
+        if (m_rootPath.isEmpty() || rootPath.isEmpty())
+        {
+            setRootPath(rootPath);
+            return;
+        }
+
+        m_rootPath = QDir::cleanPath(QFileInfo(rootPath).absoluteFilePath());
+
+        // relative paths move with the root, absolute ones may fall under it
+        PersistentMap<PathHandle, FileRecord>::const_iterator it;
+        for (it = m_fileIndex.constBegin(); it != m_fileIndex.constEnd(); ++it)
+        {
+            QString path = it.key().toString();
+            if (QDir::isAbsolutePath(path) && toRelativePath(m_rootPath, path) != path)
+            {
+                reencodePaths(m_rootPath);
+                break;
+            }
+        }
+
+        emit relocated(m_rootPath);
     }
 
     /**
      * Adds a file to the project, possibly associating it with a category.
      *
      * If no category short name is provided, a category lookup (based on
-     * filename is issued. If a matching category is found, it is used. Else,
-     * the default category will be associated when later accessing the file.
+     * filename, or on contents if a content classifier is set) is issued.
+     * If a matching category is found, it is used. Else, the default
+     * category will be associated when later accessing the file.
+     *
+     * A given category counts as chosen by the user, so
+     * recategorizeFiles() keeps it, unless explicitCategory is false, e.g.
+     * for files restored from a saved project.
      *
      * After a successful addition, fileAdded() signal is emitted.
      *
      * @param filename path to the file
      * @param categoryShortName an optional category identifier
+     * @param explicitCategory whether a given category was chosen by the user
+     */
+    void Project::addFile(QString filename, QString categoryShortName, bool explicitCategory)
+    {
+        if (hasFile(filename))
+        {
+            return;
+        }
+
+        // a single stat() both checks the file and fills in its record
+        addFile(filename, categoryShortName, m_fileSystem->stat(filename),
+                explicitCategory && !categoryShortName.isEmpty());
+    }
+
+    /**
+     * Adds a file whose status is already known.
+     *
+     * @param filename path to the file
+     * @param categoryShortName an optional category identifier
+     * @param status status of the file in the file system
+     * @param explicitCategory whether the category was given by the caller
      */
-    void Project::addFile(QString filename, QString categoryShortName)
+    void Project::addFile(QString filename, QString categoryShortName, const FileStatus& status,
+                          bool explicitCategory)
     {
         if (hasFile(filename))
         {
             return;
         }
 
-        if (!QFile::exists(filename))
+        if (!status.exists)
         {
             throw ProjectException(tr("File %1 does not exist!").arg(filename));
         }
 
-        if (categoryShortName.isEmpty())
+        if (categoryShortName.isEmpty() && m_contentClassifier)
+        {
+            categoryShortName = m_contentClassifier->classify(filename);
+        }
+        else if (categoryShortName.isEmpty())
         {
             // find whether a category can be associated with a given filename
             FileCategory category = FileCategory::getCategoryForFilename(filename);
@@ -68,10 +211,16 @@ namespace Required
         }
 
         // insert new file - create a new entry in the multimap
-        m_categorizedFiles.insert(categoryShortName, filename);
+        PathHandle path = storePath(filename);
+        m_categorizedFiles.insert(categoryShortName, path);
+        ++m_categoriesVersion;
 
         // update the file index so hasFile can look it up
-        m_fileIndex.insert(filename, categoryShortName);
+        FileRecord record(categoryShortName, status);
+        record.explicitCategory = explicitCategory;
+        m_fileIndex.insert(path, record);
+        addToFileFilter(path);
+        addToStatistics(record);
 
         emit fileAdded(filename, categoryShortName);
     }
@@ -80,16 +229,83 @@ namespace Required
      * Adds multiple files to the project.
      *
      * The only catch is that all files given as the first argument are
-     * supposed to be associated with one category.
+     * supposed to be associated with one category. If no category is given
+     * and a content classifier is set, all files are classified in parallel
+     * before being added.
+     *
+     * All files are looked up in the file system as one batch.
      *
      * @param filenames list of file paths
      * @param categoryShortName category identifier for all files to be added
      */
     void Project::addFiles(QStringList filenames, QString categoryShortName)
     {
-        foreach(QString filename, filenames)
+        QMap<QString, QString> categories;
+        if (categoryShortName.isEmpty() && m_contentClassifier)
+        {
+            categories = m_contentClassifier->classifyFiles(filenames);
+        }
+
+        FileStatusList statuses = m_fileSystem->statFiles(filenames);
+        for (int i = 0; i < filenames.size(); ++i)
+        {
+            addFile(filenames.at(i), categories.value(filenames.at(i), categoryShortName),
+                    statuses.at(i), !categoryShortName.isEmpty());
+        }
+    }
+
+    /**
+     * Inserts files with already known categories.
+     *
+     * Unlike addFile(), no category lookup and no existence check is made.
+     * This is meant for restoring a previously validated state, e.g. when
+     * undoing a removal. Files already in the project are skipped.
+     *
+     * Sizes and modification times of such files are unknown; use the
+     * overload taking file records to preserve them.
+     *
+     * @param files list of file paths with their category identifiers
+     */
+    void Project::insertFiles(const CategorizedFileList& files)
+    {
+        RecordedFileList records;
+        records.reserve(files.size());
+        foreach (const CategorizedFile& file, files)
+        {
+            records.append(qMakePair(file.first, FileRecord(file.second)));
+        }
+
+        insertFiles(records);
+    }
+
+    /**
+     * Inserts files with already known records.
+     *
+     * Like the other overload, but file information is taken from the
+     * records as well, e.g. after it was collected by a background loader.
+     *
+     * @param files list of file paths with their records
+     */
+    void Project::insertFiles(const RecordedFileList& files)
+    {
+        CategorizedFileList inserted;
+        foreach (const RecordedFile& file, files)
+        {
+            PathHandle path = storePath(file.first);
+            if (!m_fileIndex.contains(path))
+            {
+                m_categorizedFiles.insert(file.second.category, path);
+                ++m_categoriesVersion;
+                m_fileIndex.insert(path, file.second);
+                addToFileFilter(path);
+                addToStatistics(file.second);
+                inserted.append(qMakePair(file.first, file.second.category));
+            }
+        }
+
+        foreach (const CategorizedFile& file, inserted)
         {
-            addFile(filename, categoryShortName);
+            emit fileAdded(file.first, file.second);
         }
     }
 
@@ -112,16 +328,179 @@ namespace Required
 
         // obtain category identifier from the file index
         // the short name is neccessary for the remove() method of QMultiMap
-        QString categoryShortName = m_fileIndex[filename];
-        m_fileIndex.remove(filename);
-        m_categorizedFiles.remove(categoryShortName, filename);
+        PathHandle path = findStoredPath(filename);
+        FileRecord record = m_fileIndex.value(path);
+        QString categoryShortName = record.category;
+        m_fileIndex.remove(path);
+        removeFromFileFilter();
+        m_categorizedFiles.remove(categoryShortName, path);
+        ++m_categoriesVersion;
+        removeFromStatistics(record);
 
         if (deleteFromDisk)
         {
-            QFile::remove(filename);
+            m_fileSystem->remove(filename);
+        }
+
+        emit fileRemoved(filename, categoryShortName);
+        compactPaths();
+    }
+
+    /**
+     * Removes multiple files from the project as one batch.
+     *
+     * Each affected category is scanned only once, which makes removing
+     * large sets of files (e.g. undoing an import) linear instead of
+     * quadratic. fileRemoved() is emitted for every removed file.
+     *
+     * @param filenames list of file paths
+     * @param deleteFromDisk whether to physically delete the files from disk
+     */
+    void Project::removeFiles(QStringList filenames, bool deleteFromDisk)
+    {
+        QHash<QString, QSet<PathHandle> > detached;
+        CategorizedFileList removed;
+        foreach (QString filename, filenames)
+        {
+            PathHandle path = findStoredPath(filename);
+            if (!path.isNull() && m_fileIndex.contains(path))
+            {
+                FileRecord record = m_fileIndex.value(path);
+                detached[record.category].insert(path);
+                removed.append(qMakePair(filename, record.category));
+                m_fileIndex.remove(path);
+                removeFromFileFilter();
+                removeFromStatistics(record);
+            }
+        }
+
+        removeFromCategories(detached);
+
+        foreach (const CategorizedFile& file, removed)
+        {
+            if (deleteFromDisk)
+            {
+                m_fileSystem->remove(file.first);
+            }
+
+            emit fileRemoved(file.first, file.second);
         }
+        compactPaths();
+    }
 
+    /**
+     * Changes the path of a file in the project, keeping its category.
+     *
+     * Only the logical structure of the project is updated, the file itself
+     * is not touched. Physical moves are handled by ProjectFileOperations,
+     * which calls this method once the file is in place.
+     *
+     * Emits fileRemoved() for the old path and fileAdded() for the new one.
+     *
+     * @param filename current path to the file
+     * @param newFilename new path to the file
+     */
+    void Project::renameFile(QString filename, QString newFilename)
+    {
+        if (!hasFile(filename) || hasFile(newFilename))
+        {
+            return;
+        }
+
+        // the record moves along, so category statistics don't change
+        PathHandle path = findStoredPath(filename);
+        FileRecord record = m_fileIndex.value(path);
+        QString categoryShortName = record.category;
+        m_fileIndex.remove(path);
+        removeFromFileFilter();
+        m_categorizedFiles.remove(categoryShortName, path);
+
+        PathHandle newPath = storePath(newFilename);
+        m_categorizedFiles.insert(categoryShortName, newPath);
+        ++m_categoriesVersion;
+        m_fileIndex.insert(newPath, record);
+        addToFileFilter(newPath);
+
+        // both indexes are consistent again, receivers may look at either path
         emit fileRemoved(filename, categoryShortName);
+        emit fileAdded(newFilename, categoryShortName);
+        compactPaths();
+    }
+
+    /**
+     * Categorizes all files of the project again.
+     *
+     * Categories are looked up the same way as for new files, which is
+     * useful after registering new categories or signatures. With a content
+     * classifier, unchanged files are not read again. Every file moved to
+     * another category emits fileRemoved() and fileAdded(). Files added with
+     * an explicit category keep it.
+     */
+    void Project::recategorizeFiles()
+    {
+        QStringList filenames;
+        PersistentMap<PathHandle, FileRecord>::const_iterator it;
+        for (it = m_fileIndex.constBegin(); it != m_fileIndex.constEnd(); ++it)
+        {
+            if (!it.value().explicitCategory)
+            {
+                filenames << getFilePath(it.key());
+            }
+        }
+        QMap<QString, QString> categories;
+        if (m_contentClassifier)
+        {
+            categories = m_contentClassifier->classifyFiles(filenames);
+        }
+        else
+        {
+            foreach (QString filename, filenames)
+            {
+                categories.insert(filename,
+                                  FileCategory::getCategoryForFilename(filename).getShortName());
+            }
+        }
+
+        CategorizedFileList changes;
+        QMap<QString, QString>::const_iterator category;
+        for (category = categories.constBegin(); category != categories.constEnd(); ++category)
+        {
+            changes.append(qMakePair(category.key(), category.value()));
+        }
+
+        QHash<QString, QSet<PathHandle> > detached;
+        CategorizedFileList recategorized = changeCategories(changes, detached);
+        removeFromCategories(detached);
+
+        foreach (const CategorizedFile& file, recategorized)
+        {
+            emit fileRemoved(file.first, file.second);
+            emit fileAdded(file.first, getFileCategory(file.first));
+        }
+    }
+
+    /**
+     * Returns the category identifier of a file in the project.
+     *
+     * @param filename path to the file
+     * @return category short name, empty if the file is not in the project
+     */
+    QString Project::getFileCategory(QString filename) const
+    {
+        return getFileRecord(filename).category;
+    }
+
+    /**
+     * Returns the record of a file in the project.
+     *
+     * @param filename path to the file
+     * @return file record, with an empty category if the file is not in
+     *         the project
+     */
+    FileRecord Project::getFileRecord(QString filename) const
+    {
+        PathHandle path = findStoredPath(filename);
+        return path.isNull() ? FileRecord() : m_fileIndex.value(path);
     }
 
     /**
@@ -131,7 +510,7 @@ namespace Required
      */
     QStringList Project::getFiles() const
     {
-        return m_fileIndex.keys();
+        return getFilePaths(m_fileIndex.keys());
     }
 
     /**
@@ -158,7 +537,118 @@ namespace Required
      */
     QStringList Project::getFilesInCategory(QString categoryShortName) const
     {
-        return m_categorizedFiles.values(categoryShortName);
+        return getFilePaths(m_categorizedFiles.values(categoryShortName));
+    }
+
+    /**
+     * Returns a page of files associated with a specific category.
+     *
+     * Files are returned in the same order as getFilesInCategory() would
+     * return them, i.e. most recently added first.
+     *
+     * @param categoryShortName internal category identifier
+     * @param offset number of files to skip
+     * @param count maximum number of files to return
+     * @return files in that category
+     */
+    QStringList Project::getFilesInCategory(QString categoryShortName,
+                                            int offset, int count) const
+    {
+        return getFilePaths(getFileHandlesInCategory(categoryShortName, offset, count));
+    }
+
+    /**
+     * Returns handles of a page of files associated with a specific category.
+     *
+     * The order is the same as in getFilesInCategory(). Use getFilePath()
+     * to get the absolute path of a handle.
+     *
+     * Consecutive pages of the same category are cheap: while the project
+     * doesn't change, a page starting where the previous one ended resumes
+     * from there instead of skipping offset files again.
+     *
+     * @param categoryShortName internal category identifier
+     * @param offset number of files to skip
+     * @param count maximum number of files to return
+     * @return handles of files in that category
+     */
+    QList<PathHandle> Project::getFileHandlesInCategory(QString categoryShortName,
+                                                        int offset, int count) const
+    {
+        QList<PathHandle> files;
+        QMultiMap<QString, PathHandle>::const_iterator it;
+        int position = 0;
+        if (m_pageCursor.version == m_categoriesVersion && m_pageCursor.offset <= offset &&
+            m_pageCursor.categoryShortName == categoryShortName)
+        {
+            it = m_pageCursor.position;
+            position = m_pageCursor.offset;
+        }
+        else
+        {
+            it = m_categorizedFiles.constFind(categoryShortName);
+        }
+
+        for (; position < offset && it != m_categorizedFiles.constEnd() && it.key() == categoryShortName; ++position)
+        {
+            ++it;
+        }
+        for (; count > 0 && it != m_categorizedFiles.constEnd() && it.key() == categoryShortName; --count)
+        {
+            files.append(it.value());
+            ++it;
+            ++position;
+        }
+
+        m_pageCursor.categoryShortName = categoryShortName;
+        m_pageCursor.offset = position;
+        m_pageCursor.position = it;
+        m_pageCursor.version = m_categoriesVersion;
+
+        return files;
+    }
+
+    /**
+     * Returns the handle of a file in the project.
+     *
+     * Handles identify files cheaply: two handles of this project are equal
+     * exactly when they refer to the same file. A handle stays valid while
+     * the project keeps its path pool, even after the file is removed.
+     * compactPaths(), setRootPath() and relocate() may move the paths to a
+     * fresh pool, which makes old handles stale; callers keeping handles
+     * must look them up again on pathsCompacted(), rootPathChanged() and
+     * relocated().
+     *
+     * @param filename path to the file
+     * @return handle of the file, null if the file is not in the project
+     */
+    PathHandle Project::getFileHandle(QString filename) const
+    {
+        QString storedPath = toRelativePath(m_rootPath, filename);
+        if (m_fileFilterEnabled &&
+            !m_fileFilter.mightContain(BloomFilter::hash(storedPath.constData(), storedPath.size())))
+        {
+            return PathHandle();
+        }
+
+        PathHandle path = m_pathPool->find(storedPath);
+        if (path.isNull() || !m_fileIndex.contains(path))
+        {
+            return PathHandle();
+        }
+
+        return path;
+    }
+
+    /**
+     * Returns the absolute path of a file handle.
+     *
+     * @param handle handle obtained from this project
+     * @return absolute path to the file
+     */
+    QString Project::getFilePath(PathHandle handle) const
+    {
+        return toAbsolutePath(m_rootPath, handle);
     }
 
     /**
@@ -185,6 +675,482 @@ namespace Required
      */
     QStringList Project::getCategoryShortNames() const
     {
-        return m_categorizedFiles.uniqueKeys();
+        // only non-empty categories have statistics
+        return m_categoryStatistics.keys();
+    }
+
+    /**
+     * Returns aggregated information about files in a category.
+     *
+     * Counts and sizes are maintained on every change, so this doesn't
+     * visit any files. Only after the newest file of a category is removed,
+     * the next call scans that category once to find the new newest one.
+     *
+     * @param categoryShortName internal category identifier
+     * @return category statistics, all zero for an empty category
+     */
+    CategoryStatistics Project::getCategoryStatistics(QString categoryShortName) const
+    {
+        QMap<QString, CategoryStatistics>::iterator stats = m_categoryStatistics.find(categoryShortName);
+        if (stats == m_categoryStatistics.end())
+        {
+            return CategoryStatistics();
+        }
+
+        if (m_staleCategories.remove(categoryShortName))
+        {
+            stats->newestModified = -1;
+            QMultiMap<QString, PathHandle>::const_iterator it = m_categorizedFiles.constFind(categoryShortName);
+            for (; it != m_categorizedFiles.constEnd() && it.key() == categoryShortName; ++it)
+            {
+                stats->newestModified = qMax(stats->newestModified,
+                                             m_fileIndex.value(it.value()).lastModified);
+            }
+        }
+
+        return *stats;
+    }
+
+    /**
+     * Returns the number of files in a category.
+     *
+     * Unlike getCategoryStatistics(), this never scans the category.
+     *
+     * @param categoryShortName internal category identifier
+     * @return file count, 0 for an empty category
+     */
+    int Project::getCategoryFileCount(QString categoryShortName) const
+    {
+        return m_categoryStatistics.value(categoryShortName).fileCount;
+    }
+
+    /**
+     * Returns the sum of known sizes of files in a category.
+     *
+     * Unlike getCategoryStatistics(), this never scans the category.
+     *
+     * @param categoryShortName internal category identifier
+     * @return size in bytes, 0 for an empty category
+     */
+    qint64 Project::getCategorySize(QString categoryShortName) const
+    {
+        return m_categoryStatistics.value(categoryShortName).totalSize;
+    }
+
+    /**
+     * Applies the result of ProjectDiff::compare() as one batch.
+     *
+     * Removed files are detached first, then recategorized files are moved
+     * to their new categories and finally added files are inserted. Files
+     * coming from a diff are assumed to be valid already, so no existence
+     * checks are made. Changes which no longer apply (e.g. adding a file
+     * that is already in the project) are skipped.
+     *
+     * fileRemoved() and fileAdded() signals are emitted after the indexes
+     * are consistent again; a recategorization emits both.
+     *
+     * @param diff the changes to apply
+     */
+    void Project::applyDiff(const ProjectDiff& diff)
+    {
+        // group all detached files by their current category, so that each
+        // category in the multimap is scanned only once
+        QHash<QString, QSet<PathHandle> > detached;
+        CategorizedFileList removed;
+        foreach (const CategorizedFile& file, diff.getRemovedFiles())
+        {
+            PathHandle path = findStoredPath(file.first);
+            if (!path.isNull() && m_fileIndex.contains(path))
+            {
+                FileRecord record = m_fileIndex.value(path);
+                detached[record.category].insert(path);
+                removed.append(qMakePair(file.first, record.category));
+                m_fileIndex.remove(path);
+                removeFromFileFilter();
+                removeFromStatistics(record);
+            }
+        }
+
+        CategorizedFileList recategorized = changeCategories(diff.getRecategorizedFiles(),
+                                                             detached);
+        removeFromCategories(detached);
+
+        CategorizedFileList added;
+        foreach (const CategorizedFile& file, diff.getAddedFiles())
+        {
+            PathHandle path = storePath(file.first);
+            if (!m_fileIndex.contains(path))
+            {
+                FileRecord record(file.second);
+                m_categorizedFiles.insert(file.second, path);
+                ++m_categoriesVersion;
+                m_fileIndex.insert(path, record);
+                addToFileFilter(path);
+                addToStatistics(record);
+                added.append(file);
+            }
+        }
+
+        foreach (const CategorizedFile& file, removed)
+        {
+            emit fileRemoved(file.first, file.second);
+        }
+        foreach (const CategorizedFile& file, recategorized)
+        {
+            emit fileRemoved(file.first, file.second);
+            emit fileAdded(file.first, getFileCategory(file.first));
+        }
+        foreach (const CategorizedFile& file, added)
+        {
+            emit fileAdded(file.first, file.second);
+        }
+        compactPaths();
+    }
+
+    /**
+     * Takes an immutable snapshot of the project.
+     *
+     * This is an O(1) operation - the snapshot shares the file index with
+     * the project, and later modifications of the project copy only the
+     * parts of the index they touch.
+     *
+     * @return snapshot of the current project state
+     */
+    ProjectSnapshot Project::snapshot() const
+    {
+        return ProjectSnapshot(m_name, m_rootPath, m_pathPool, m_fileIndex);
+    }
+
+    /**
+     * Expresses a path relative to a root directory.
+     *
+     * Only paths inside the root are converted, others are returned as they
+     * are. This is a plain string operation; the path is expected to be
+     * clean and absolute, as returned by QFileInfo::absoluteFilePath().
+     *
+     * @param rootPath absolute path of the root, may be empty
+     * @param filename absolute path to the file
+     * @return relative path, or filename if it is not inside the root
+     */
+    QString Project::toRelativePath(QString rootPath, QString filename)
+    {
+        if (rootPath.isEmpty() || !filename.startsWith(rootPath))
+        {
+            return filename;
+        }
+
+        // the root itself may end with a separator (e.g. "/")
+        int prefixLength = rootPath.endsWith('/') ? rootPath.size() : rootPath.size() + 1;
+        if (filename.size() <= prefixLength || filename.at(prefixLength - 1) != '/')
+        {
+            return filename;
+        }
+
+        return filename.mid(prefixLength);
+    }
+
+    /**
+     * Reconstructs an absolute path from a path relative to a root directory.
+     *
+     * @param rootPath absolute path of the root, may be empty
+     * @param path relative or absolute path
+     * @return absolute path; absolute paths are returned as they are
+     */
+    QString Project::toAbsolutePath(QString rootPath, QString path)
+    {
+        if (rootPath.isEmpty() || QDir::isAbsolutePath(path))
+        {
+            return path;
+        }
+
+        return rootPath.endsWith('/') ? rootPath + path : rootPath + '/' + path;
+    }
+
+    /**
+     * Reconstructs an absolute path from a stored path handle.
+     *
+     * @param rootPath absolute path of the root, may be empty
+     * @param path handle of a relative or absolute path
+     * @return absolute path
+     */
+    QString Project::toAbsolutePath(QString rootPath, PathHandle path)
+    {
+        return toAbsolutePath(rootPath, path.toString());
+    }
+
+    /**
+     * Stores all files again, relative to the current root where possible.
+     *
+     * Files stay newest-first within categories. If two stored paths turn
+     * out to be the same file, e.g. its absolute path and a path relative to
+     * the new root, the file is kept once.
+     *
+     * The paths go to a fresh pool, so paths of files no longer in the
+     * project are released, unless a snapshot still holds the old pool.
+     * Old handles become invalid when this method returns.
+     *
+     * @param filesRootPath root directory the stored relative paths refer to
+     */
+    void Project::reencodePaths(QString filesRootPath)
+    {
+        // handles point into their pool, so the old one must outlive the
+        // copies of the indexes below
+        QSharedPointer<PathPool> oldPathPool = m_pathPool;
+        m_pathPool = QSharedPointer<PathPool>(new PathPool);
+
+        QMultiMap<QString, PathHandle> oldCategorizedFiles = m_categorizedFiles;
+        PersistentMap<PathHandle, FileRecord> oldFileIndex = m_fileIndex;
+        m_fileIndex.clear();
+        m_categorizedFiles.clear();
+        ++m_categoriesVersion;
+
+        // walk backwards, so that files stay newest-first within categories
+        QMapIterator<QString, PathHandle> it(oldCategorizedFiles);
+        it.toBack();
+        while (it.hasPrevious())
+        {
+            it.previous();
+            PathHandle path = storePath(toAbsolutePath(filesRootPath, it.value()));
+            FileRecord record = oldFileIndex.value(it.value());
+            if (m_fileIndex.contains(path))
+            {
+                removeFromStatistics(record);
+                continue;
+            }
+            m_fileIndex.insert(path, record);
+            m_categorizedFiles.insert(it.key(), path);
+        }
+
+        // stored paths changed
+        if (m_fileFilterEnabled)
+        {
+            rebuildFileFilter();
+        }
+    }
+
+    /**
+     * Releases paths of removed files once they outnumber the live ones.
+     *
+     * Removed files leave their paths in the pool, so a long-running
+     * project with lots of churn would grow without bound. Copying the live
+     * paths to a fresh pool costs time proportional to the project size,
+     * but happens only after as many files were removed, so it adds
+     * a constant amount of work to every removal.
+     *
+     * Emits pathsCompacted() while the old handles are still valid, so that
+     * views can map their handles to the new pool.
+     */
+    void Project::compactPaths()
+    {
+        int pooledCount = m_pathPool->size();
+        if (pooledCount < MinCompactedPoolSize || pooledCount < 2 * m_fileIndex.size())
+        {
+            return;
+        }
+
+        // keeps old handles valid until the receivers of pathsCompacted()
+        // have mapped them to the new pool
+        QSharedPointer<PathPool> oldPathPool = m_pathPool;
+        reencodePaths(m_rootPath);
+        emit pathsCompacted();
+    }
+
+    /**
+     * Converts a list of path handles to absolute paths.
+     *
+     * @param handles handles of stored paths
+     * @return absolute paths
+     */
+    QStringList Project::getFilePaths(const QList<PathHandle>& handles) const
+    {
+        QStringList files;
+        files.reserve(handles.size());
+        foreach (const PathHandle& handle, handles)
+        {
+            files.append(getFilePath(handle));
+        }
+
+        return files;
+    }
+
+    /**
+     * Accounts for a file added to the index.
+     *
+     * @param record the added file
+     */
+    void Project::addToStatistics(const FileRecord& record)
+    {
+        CategoryStatistics& stats = m_categoryStatistics[record.category];
+        ++stats.fileCount;
+        if (record.size > 0)
+        {
+            stats.totalSize += record.size;
+        }
+        stats.newestModified = qMax(stats.newestModified, record.lastModified);
+    }
+
+    /**
+     * Accounts for a file removed from the index.
+     *
+     * If the file was the newest one in its category, the category is only
+     * marked stale; finding the next newest file needs a scan, which is
+     * postponed until somebody asks for the statistics.
+     *
+     * @param record the removed file
+     */
+    void Project::removeFromStatistics(const FileRecord& record)
+    {
+        QMap<QString, CategoryStatistics>::iterator stats = m_categoryStatistics.find(record.category);
+        if (stats == m_categoryStatistics.end())
+        {
+            return;
+        }
+
+        if (--stats->fileCount <= 0)
+        {
+            m_categoryStatistics.erase(stats);
+            m_staleCategories.remove(record.category);
+            return;
+        }
+
+        if (record.size > 0)
+        {
+            stats->totalSize -= record.size;
+        }
+        if (record.lastModified >= 0 && record.lastModified >= stats->newestModified)
+        {
+            m_staleCategories.insert(record.category);
+        }
+    }
+
+    /**
+     * Moves files to new categories in the file index.
+     *
+     * Files are added to their new categories in the multimap right away,
+     * but only collected for removal from the old ones; the caller passes
+     * them to removeFromCategories() when done. Files not in the project or
+     * already in the requested category are skipped. No signals are emitted.
+     *
+     * @param files file paths with their new categories
+     * @param detached receives files to remove, grouped by their old category
+     * @return moved files with their old categories
+     */
+    CategorizedFileList Project::changeCategories(const CategorizedFileList& files,
+                                                  QHash<QString, QSet<PathHandle> >& detached)
+    {
+        CategorizedFileList moved;
+        foreach (const CategorizedFile& file, files)
+        {
+            PathHandle path = findStoredPath(file.first);
+            if (!path.isNull() && m_fileIndex.contains(path))
+            {
+                FileRecord record = m_fileIndex.value(path);
+                if (record.category != file.second)
+                {
+                    detached[record.category].insert(path);
+                    moved.append(qMakePair(file.first, record.category));
+                    removeFromStatistics(record);
+                    record.category = file.second;
+                    m_fileIndex.insert(path, record);
+                    m_categorizedFiles.insert(file.second, path);
+                    ++m_categoriesVersion;
+                    addToStatistics(record);
+                }
+            }
+        }
+
+        return moved;
+    }
+
+    /**
+     * Removes many files from the category multimap at once.
+     *
+     * QMultiMap::remove(key, value) scans all values under the key, which is
+     * quadratic when removing many files from one category. Instead, every
+     * affected category is walked once.
+     *
+     * @param filesByCategory files to remove, grouped by category
+     */
+    void Project::removeFromCategories(const QHash<QString, QSet<PathHandle> >& filesByCategory)
+    {
+        QHash<QString, QSet<PathHandle> >::const_iterator group;
+        for (group = filesByCategory.constBegin(); group != filesByCategory.constEnd(); ++group)
+        {
+            const QSet<PathHandle>& files = group.value();
+            int remaining = files.size();
+            QMultiMap<QString, PathHandle>::iterator it = m_categorizedFiles.find(group.key());
+            while (remaining > 0 && it != m_categorizedFiles.end() && it.key() == group.key())
+            {
+                if (files.contains(it.value()))
+                {
+                    it = m_categorizedFiles.erase(it);
+                    ++m_categoriesVersion;
+                    --remaining;
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    /**
+     * Adds a stored path to the Bloom filter, if enabled.
+     *
+     * A filter filled up to its capacity is rebuilt with room to grow,
+     * to keep false positives rare.
+     *
+     * @param path stored path of a file just added to the index
+     */
+    void Project::addToFileFilter(PathHandle path)
+    {
+        if (!m_fileFilterEnabled)
+        {
+            return;
+        }
+
+        if (m_fileFilter.getCount() >= m_fileFilter.getCapacity())
+        {
+            rebuildFileFilter();
+            return;
+        }
+
+        m_fileFilter.insert(BloomFilter::hash(path.constData(), path.size()));
+    }
+
+    /**
+     * Accounts for a file removed from the index.
+     *
+     * Bloom filters can't forget, so the path stays in the filter and only
+     * costs a wasted index lookup. Once such paths make up a large part of
+     * the filter, it's rebuilt from the index.
+     */
+    void Project::removeFromFileFilter()
+    {
+        if (!m_fileFilterEnabled)
+        {
+            return;
+        }
+
+        if (++m_fileFilterStaleCount > m_fileFilter.getCapacity() / 2)
+        {
+            rebuildFileFilter();
+        }
+    }
+
+    /**
+     * Refills the Bloom filter with all files of the index.
+     */
+    void Project::rebuildFileFilter()
+    {
+        m_fileFilter.reset(qMax(2 * m_fileIndex.size(), MinFileFilterCapacity));
+        PersistentMap<PathHandle, FileRecord>::const_iterator it;
+        for (it = m_fileIndex.constBegin(); it != m_fileIndex.constEnd(); ++it)
+        {
+            const PathHandle& path = it.key();
+            m_fileFilter.insert(BloomFilter::hash(path.constData(), path.size()));
+        }
+        m_fileFilterStaleCount = 0;
     }
 }
@@ -19,24 +19,147 @@
 #define PROJECT_H
 
 #include "../global.h"
+#include "BloomFilter.h"
 #include "FileCategory.h"
+#include "FileSystem.h"
+#include "PathPool.h"
+#include "PersistentMap.h"
+#include <QDateTime>
+#include <QFileInfo>
 #include <QFileInfoList>
 #include <QList>
 #include <QMap>
 #include <QMultiMap>
+#include <QHash>
 #include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QSharedPointer>
 #include <QString>
 #include <QStringList>
 
 namespace Required
 {
+    class ContentClassifier;
+    class ProjectDiff;
+    class ProjectQuery;
+    class ProjectSnapshot;
+
+    /**
+     * A file path paired with its category short name.
+     */
+    typedef QPair<QString, QString> CategorizedFile;
+
+    /**
+     * A typedef to ease typing.
+     */
+    typedef QList<CategorizedFile> CategorizedFileList;
+
+    /**
+     * Category and file system information of a file in the project.
+     *
+     * Size and modification time are recorded when the file is added and
+     * are not refreshed afterwards.
+     */
+    struct REQUIRED_EXPORT FileRecord
+    {
+        explicit FileRecord(QString category = "", qint64 size = -1,
+                            qint64 lastModified = -1):
+            category(category), size(size), lastModified(lastModified),
+            explicitCategory(false)
+        {
+        }
+
+        FileRecord(QString category, const QFileInfo& info):
+            category(category), size(info.size()),
+            lastModified(info.lastModified().toMSecsSinceEpoch()),
+            explicitCategory(false)
+        {
+        }
+
+        FileRecord(QString category, const FileStatus& status):
+            category(category), size(status.size), lastModified(status.lastModified),
+            explicitCategory(false)
+        {
+        }
+
+        /**
+         * Category short name.
+         */
+        QString category;
+
+        /**
+         * File size in bytes, -1 if unknown.
+         */
+        qint64 size;
+
+        /**
+         * Modification time in milliseconds since the epoch, -1 if unknown.
+         */
+        qint64 lastModified;
+
+        /**
+         * Whether the category was given explicitly when adding the file.
+         *
+         * Such files are left alone by Project::recategorizeFiles(). The flag
+         * is not stored in saved projects.
+         */
+        bool explicitCategory;
+    };
+
+    /**
+     * A file path paired with its record.
+     */
+    typedef QPair<QString, FileRecord> RecordedFile;
+
+    /**
+     * A typedef to ease typing.
+     */
+    typedef QList<RecordedFile> RecordedFileList;
+
+    /**
+     * Aggregated information about files in one category.
+     */
+    struct REQUIRED_EXPORT CategoryStatistics
+    {
+        CategoryStatistics():
+            fileCount(0), totalSize(0), newestModified(-1)
+        {
+        }
+
+        /**
+         * Number of files.
+         */
+        int fileCount;
+
+        /**
+         * Sum of known file sizes in bytes.
+         */
+        qint64 totalSize;
+
+        /**
+         * The latest known modification time in milliseconds since the
+         * epoch, -1 if unknown.
+         */
+        qint64 newestModified;
+    };
+
     /**
      * A class implementing basic project management functionality.
+     *
+     * A project may have a root directory. Files inside the root are kept
+     * relative to it, which saves memory for deep trees and allows moving
+     * the whole tree elsewhere with relocate(). The public interface always
+     * deals with absolute paths; they are reconstructed on demand.
+     *
+     * Paths are kept in a PathPool. Views which track many files (e.g.
+     * ProjectWidget) should use path handles instead of QString copies.
      */
     class REQUIRED_EXPORT Project : public QObject
     {
         Q_OBJECT
         Q_PROPERTY(QString name READ getName WRITE setName)
+        Q_PROPERTY(QString rootPath READ getRootPath WRITE setRootPath)
 
     public:
         explicit Project(QObject* parent = 0);
@@ -61,21 +184,143 @@ namespace Required
             m_name = name;
         }
 
+        /**
+         * Returns the root directory of the project.
+         *
+         * @return absolute path of the root, empty if there is no root
+         */
+        QString getRootPath() const
+        {
+            return m_rootPath;
+        }
+
+        void setRootPath(QString rootPath);
+        void relocate(QString rootPath);
+
+        /**
+         * Returns the classifier used to categorize new files.
+         *
+         * @return content classifier, 0 if only filenames are used
+         */
+        ContentClassifier* getContentClassifier() const
+        {
+            return m_contentClassifier;
+        }
+
+        /**
+         * Sets the classifier used to categorize new files.
+         *
+         * The project doesn't take ownership of the classifier, which may
+         * be shared between projects. Emits contentClassifierChanged(), so
+         * that work using the old classifier stops before it's deleted.
+         *
+         * @param classifier content classifier, 0 to use only filenames
+         */
+        void setContentClassifier(ContentClassifier* classifier)
+        {
+            if (classifier != m_contentClassifier)
+            {
+                m_contentClassifier = classifier;
+                emit contentClassifierChanged();
+            }
+        }
+
+        /**
+         * Returns the file system holding project files.
+         *
+         * @return file system, the local disk by default
+         */
+        FileSystem* getFileSystem() const
+        {
+            return m_fileSystem;
+        }
+
+        /**
+         * Sets the file system holding project files.
+         *
+         * The project doesn't take ownership of the file system. Files
+         * already in the project are not checked again. Emits
+         * fileSystemChanged(), so that work using the old file system stops
+         * before it's deleted.
+         *
+         * @param fileSystem file system, 0 for the local disk
+         */
+        void setFileSystem(FileSystem* fileSystem)
+        {
+            fileSystem = fileSystem ? fileSystem : FileSystem::getDefault();
+            if (fileSystem != m_fileSystem)
+            {
+                m_fileSystem = fileSystem;
+                emit fileSystemChanged();
+            }
+        }
+
+        /**
+         * Checks whether lookups of missing files are answered by a Bloom
+         * filter, see setFileFilterEnabled().
+         *
+         * @return true if the filter is enabled
+         */
+        bool isFileFilterEnabled() const
+        {
+            return m_fileFilterEnabled;
+        }
+
+        void setFileFilterEnabled(bool enabled);
+
         bool hasFile(QString filename) const;
-        void addFile(QString filename, QString categoryShortName = "");
+        void addFile(QString filename, QString categoryShortName = "",
+                     bool explicitCategory = true);
         void addFiles(QStringList filenames, QString categoryShortName = "");
+        void insertFiles(const CategorizedFileList& files);
+        void insertFiles(const RecordedFileList& files);
         void removeFile(QString filename, bool deleteFromDisk = false);
+        void removeFiles(QStringList filenames, bool deleteFromDisk = false);
+        void renameFile(QString filename, QString newFilename);
+        void recategorizeFiles();
+        QString getFileCategory(QString filename) const;
+        FileRecord getFileRecord(QString filename) const;
 
         QStringList getFiles() const;
         QFileInfoList getFileInfos() const;
         QStringList getFilesInCategory(QString categoryShortName) const;
+        QStringList getFilesInCategory(QString categoryShortName, int offset, int count) const;
         FileCategoryList getCategories() const;
         QStringList getCategoryShortNames() const;
+        CategoryStatistics getCategoryStatistics(QString categoryShortName) const;
+        int getCategoryFileCount(QString categoryShortName) const;
+        qint64 getCategorySize(QString categoryShortName) const;
+
+        /**
+         * Returns the pool holding paths of the project.
+         *
+         * @return path pool, shared with snapshots
+         */
+        QSharedPointer<PathPool> getPathPool() const
+        {
+            return m_pathPool;
+        }
+
+        PathHandle getFileHandle(QString filename) const;
+        QString getFilePath(PathHandle handle) const;
+        QList<PathHandle> getFileHandlesInCategory(QString categoryShortName,
+                                                   int offset, int count) const;
 
+        void applyDiff(const ProjectDiff& diff);
+        ProjectSnapshot snapshot() const;
+
+        static QString toRelativePath(QString rootPath, QString filename);
+        static QString toAbsolutePath(QString rootPath, QString path);
+        static QString toAbsolutePath(QString rootPath, PathHandle path);
 
     signals:
         void fileAdded(QString filename, QString categoryShortName);
         void fileRemoved(QString filename, QString categoryShortName);
+        void relocated(QString rootPath);
+        void rootPathChanged(QString rootPath);
+        void pathsCompacted();
+        void contentClassifierChanged();
+        void fileSystemChanged();
 
     public slots:
 
@@ -85,15 +330,134 @@ namespace Required
          */
         QString m_name;
 
+        /**
+         * Absolute path of the root directory, empty if there is none.
+         */
+        QString m_rootPath;
+
+        /**
+         * Storage of all paths in the indexes.
+         */
+        QSharedPointer<PathPool> m_pathPool;
+
         /**
          * A mapping of category short names and files in the project.
+         *
+         * Here and in the file index, files inside the root are stored
+         * relative to it.
+         */
+        QMultiMap<QString, PathHandle> m_categorizedFiles;
+
+        /**
+         * Incremented on every change of m_categorizedFiles.
+         */
+        quint64 m_categoriesVersion;
+
+        /**
+         * Where the last page of a category ended.
          */
-        QMultiMap<QString, QString> m_categorizedFiles;
+        struct PageCursor
+        {
+            PageCursor():
+                offset(0), version(~quint64(0))
+            {
+            }
+
+            QString categoryShortName;
+            int offset;
+            QMultiMap<QString, PathHandle>::const_iterator position;
+
+            /**
+             * Value of m_categoriesVersion the position is valid for.
+             */
+            quint64 version;
+        };
 
         /**
-         * A reverse mapping (file => category) - used for fast indexing.
+         * Lets the next page of a category resume where the last one ended.
          */
-        QMap<QString, QString> m_fileIndex;
+        mutable PageCursor m_pageCursor;
+
+        /**
+         * A reverse mapping (file => category and file information) - used
+         * for fast indexing.
+         *
+         * Persistent, so that snapshots can share it with the project.
+         */
+        PersistentMap<PathHandle, FileRecord> m_fileIndex;
+
+        /**
+         * Aggregates of all non-empty categories, updated on every change.
+         *
+         * Mutable, because the newest modification time is recomputed on
+         * access after the newest file of a category was removed.
+         */
+        mutable QMap<QString, CategoryStatistics> m_categoryStatistics;
+
+        /**
+         * Categories whose newest modification time has to be recomputed.
+         */
+        mutable QSet<QString> m_staleCategories;
+
+        /**
+         * Non-owning pointer to the classifier of new files, may be 0.
+         */
+        ContentClassifier* m_contentClassifier;
+
+        /**
+         * Non-owning pointer to the file system holding project files.
+         */
+        FileSystem* m_fileSystem;
+
+        /**
+         * Stored paths of all files, if the filter is enabled.
+         */
+        BloomFilter m_fileFilter;
+
+        /**
+         * Whether lookups consult m_fileFilter first.
+         */
+        bool m_fileFilterEnabled;
+
+        /**
+         * Number of paths in m_fileFilter which were removed from the project.
+         */
+        int m_fileFilterStaleCount;
+
+        /**
+         * Returns the handle of the stored form of an absolute path.
+         *
+         * The handle is null if the path was never stored.
+         */
+        PathHandle findStoredPath(const QString& filename) const
+        {
+            return m_pathPool->find(toRelativePath(m_rootPath, filename));
+        }
+
+        /**
+         * Stores an absolute path in the pool, in the form used by the indexes.
+         */
+        PathHandle storePath(const QString& filename)
+        {
+            return m_pathPool->intern(toRelativePath(m_rootPath, filename));
+        }
+
+        void addFile(QString filename, QString categoryShortName, const FileStatus& status,
+                     bool explicitCategory);
+        QStringList getFilePaths(const QList<PathHandle>& handles) const;
+        void reencodePaths(QString filesRootPath);
+        void compactPaths();
+        void addToStatistics(const FileRecord& record);
+        void removeFromStatistics(const FileRecord& record);
+        void removeFromCategories(const QHash<QString, QSet<PathHandle> >& filesByCategory);
+        void addToFileFilter(PathHandle path);
+        void removeFromFileFilter();
+        void rebuildFileFilter();
+        CategorizedFileList changeCategories(const CategorizedFileList& files,
+                                             QHash<QString, QSet<PathHandle> >& detached);
+
+        friend class ProjectDiff;
+        friend class ProjectQuery;
     };
 }
 
@@ -0,0 +1,160 @@
+/**
+ * @file ProjectChangeQueue.cpp
+ *
+ * Coalesced delivery of project modifications to views.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "ProjectChangeQueue.h"
+#include <QMap>
+
+namespace Required
+{
+    namespace
+    {
+        /**
+         * Default minimum time between two deliveries, about one frame.
+         */
+        const int DefaultInterval = 16;
+    }
+
+    /**
+     * Starts queueing changes of a project.
+     *
+     * @param project the project to listen to
+     * @param parent parent object
+     */
+    ProjectChangeQueue::ProjectChangeQueue(Project* project, QObject* parent):
+        QObject(parent), m_project(project), m_sequence(0)
+    {
+        qRegisterMetaType<ProjectChangeSet>();
+
+        m_timer.setSingleShot(true);
+        m_timer.setInterval(DefaultInterval);
+        connect(&m_timer, &QTimer::timeout, this, &ProjectChangeQueue::flush);
+
+        connect(project, &Project::fileAdded, this, &ProjectChangeQueue::onFileAdded);
+        connect(project, &Project::fileRemoved, this, &ProjectChangeQueue::onFileRemoved);
+        connect(project, &Project::relocated, this, &ProjectChangeQueue::clear);
+    }
+
+    /**
+     * Delivers pending changes right away.
+     *
+     * Nothing is emitted if the changes cancelled out.
+     */
+    void ProjectChangeQueue::flush()
+    {
+        m_timer.stop();
+
+        ProjectChangeSet changes;
+        QMap<quint64, CategorizedFile> added;
+        QHash<QString, PendingChange>::const_iterator it;
+        for (it = m_pending.constBegin(); it != m_pending.constEnd(); ++it)
+        {
+            const PendingChange& change = it.value();
+            if (change.wasInProject == change.isInProject &&
+                (!change.isInProject || change.before == change.after))
+            {
+                continue;
+            }
+            if (change.wasInProject)
+            {
+                changes.removed.append(qMakePair(it.key(), change.before));
+            }
+            if (change.isInProject)
+            {
+                added.insert(change.sequence, qMakePair(it.key(), change.after));
+            }
+        }
+        m_pending.clear();
+        changes.added = added.values();
+
+        if (!changes.isEmpty())
+        {
+            emit changesReady(changes);
+        }
+    }
+
+    /**
+     * Drops pending changes without delivering them.
+     */
+    void ProjectChangeQueue::clear()
+    {
+        m_timer.stop();
+        m_pending.clear();
+    }
+
+    /**
+     * Records an addition.
+     *
+     * @param filename full path to the file
+     * @param categoryShortName category identifier
+     */
+    void ProjectChangeQueue::onFileAdded(QString filename, QString categoryShortName)
+    {
+        PendingChange& change = pendingChange(filename, false, QString());
+        change.isInProject = true;
+        change.after = categoryShortName;
+        change.sequence = m_sequence++;
+    }
+
+    /**
+     * Records a removal.
+     *
+     * @param filename full path to the file
+     * @param categoryShortName category identifier
+     */
+    void ProjectChangeQueue::onFileRemoved(QString filename, QString categoryShortName)
+    {
+        PendingChange& change = pendingChange(filename, true, categoryShortName);
+        change.isInProject = false;
+        change.after.clear();
+    }
+
+    /**
+     * Returns the pending change of a file, creating it if needed.
+     *
+     * The first change of a file since the last delivery tells what the
+     * file was like back then. The delivery timer is started with the
+     * first pending change, so a steady stream of changes is still
+     * delivered once per interval.
+     *
+     * @param filename full path to the file
+     * @param wasInProject whether the file was in the project before the change
+     * @param before category of the file before the change
+     * @return pending change of the file
+     */
+    ProjectChangeQueue::PendingChange& ProjectChangeQueue::pendingChange(const QString& filename,
+                                                                         bool wasInProject,
+                                                                         const QString& before)
+    {
+        QHash<QString, PendingChange>::iterator it = m_pending.find(filename);
+        if (it == m_pending.end())
+        {
+            PendingChange change;
+            change.wasInProject = wasInProject;
+            change.before = before;
+            change.isInProject = wasInProject;
+            change.after = before;
+            change.sequence = 0;
+            it = m_pending.insert(filename, change);
+        }
+        if (!m_timer.isActive())
+        {
+            m_timer.start();
+        }
+
+        return it.value();
+    }
+}
@@ -0,0 +1,195 @@
+/**
+ * @file ProjectChangeQueue.h
+ *
+ * Coalesced delivery of project modifications to views.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef PROJECTCHANGEQUEUE_H
+#define PROJECTCHANGEQUEUE_H
+
+#include "../global.h"
+#include "Project.h"
+#include <QHash>
+#include <QMetaType>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QTimer>
+
+namespace Required
+{
+    /**
+     * Net modifications of a project over a period of time.
+     *
+     * A file moved to another category appears in both lists. Removals
+     * should be applied before additions.
+     */
+    struct REQUIRED_EXPORT ProjectChangeSet
+    {
+        /**
+         * Files no longer in the project, with their former categories.
+         */
+        CategorizedFileList removed;
+
+        /**
+         * Files new in the project, in the order they were added.
+         */
+        CategorizedFileList added;
+
+        /**
+         * Checks whether there are no changes at all.
+         *
+         * @return true if both lists are empty
+         */
+        bool isEmpty() const
+        {
+            return removed.isEmpty() && added.isEmpty();
+        }
+    };
+
+    /**
+     * Coalesced delivery of project modifications to views.
+     *
+     * Project emits a signal for every single file, which is too much for
+     * views repainting or reindexing on each of them. The queue listens to
+     * those signals instead, and delivers the accumulated changes at most
+     * once per interval, by default about once per frame. Changes which
+     * cancel out within an interval, like a file added and removed again,
+     * are not delivered at all.
+     *
+     * Changes pending when the project is relocated are dropped, since
+     * their paths are outdated; views rebuild themselves on relocation
+     * anyway.
+     */
+    class REQUIRED_EXPORT ProjectChangeQueue : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        explicit ProjectChangeQueue(Project* project, QObject* parent = 0);
+
+        /**
+         * Returns the project whose changes are queued.
+         *
+         * @return the project, 0 if it was deleted
+         */
+        Project* getProject() const
+        {
+            return m_project;
+        }
+
+        /**
+         * Returns the minimum time between two deliveries.
+         *
+         * @return interval in milliseconds
+         */
+        int getInterval() const
+        {
+            return m_timer.interval();
+        }
+
+        /**
+         * Sets the minimum time between two deliveries.
+         *
+         * With an interval of 0, changes are delivered as soon as control
+         * returns to the event loop.
+         *
+         * @param interval interval in milliseconds
+         */
+        void setInterval(int interval)
+        {
+            m_timer.setInterval(qMax(0, interval));
+        }
+
+        /**
+         * Returns the number of files with undelivered changes.
+         *
+         * @return pending file count
+         */
+        int getPendingCount() const
+        {
+            return m_pending.size();
+        }
+
+    public slots:
+        void flush();
+        void clear();
+
+    signals:
+        void changesReady(const Required::ProjectChangeSet& changes);
+
+    private slots:
+        void onFileAdded(QString filename, QString categoryShortName);
+        void onFileRemoved(QString filename, QString categoryShortName);
+
+    private:
+        /**
+         * Undelivered changes of a single file.
+         */
+        struct PendingChange
+        {
+            /**
+             * Whether the file was in the project at the last delivery.
+             */
+            bool wasInProject;
+
+            /**
+             * Category at the last delivery.
+             */
+            QString before;
+
+            /**
+             * Whether the file is in the project now.
+             */
+            bool isInProject;
+
+            /**
+             * Current category.
+             */
+            QString after;
+
+            /**
+             * Number of the last addition, to keep additions in order.
+             */
+            quint64 sequence;
+        };
+
+        /**
+         * The project whose changes are queued.
+         */
+        QPointer<Project> m_project;
+
+        /**
+         * Undelivered changes by file path.
+         */
+        QHash<QString, PendingChange> m_pending;
+
+        /**
+         * Number of the next addition.
+         */
+        quint64 m_sequence;
+
+        /**
+         * Schedules the next delivery.
+         */
+        QTimer m_timer;
+
+        PendingChange& pendingChange(const QString& filename, bool wasInProject,
+                                     const QString& before);
+    };
+}
+
+Q_DECLARE_METATYPE(Required::ProjectChangeSet)
+
+#endif // PROJECTCHANGEQUEUE_H
@@ -0,0 +1,186 @@
+/**
+ * @file ProjectCommands.cpp
+ *
+ * Undoable commands modifying a project.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "ProjectCommands.h"
+#include "ProjectException.h"
+#include <QObject>
+
+namespace Required
+{
+    /**
+     * Creates the command.
+     *
+     * @param project the project to modify
+     * @param filenames list of file paths
+     * @param categoryShortName an optional category identifier for all files
+     * @param parent parent command
+     */
+    AddFilesCommand::AddFilesCommand(Project* project, QStringList filenames,
+                                     QString categoryShortName,
+                                     QUndoCommand* parent):
+        QUndoCommand(parent), m_project(project), m_requestedFiles(filenames),
+        m_categoryShortName(categoryShortName), m_executed(false)
+    {
+        setText(QObject::tr("Add %n file(s)", 0, filenames.size()));
+    }
+
+    /**
+     * Creates the command for files already validated and categorized.
+     *
+     * No file system access happens when the command is executed, so this
+     * is cheap enough for large batches collected in the background.
+     *
+     * @param project the project to modify
+     * @param files list of file paths with their records
+     * @param parent parent command
+     */
+    AddFilesCommand::AddFilesCommand(Project* project, RecordedFileList files,
+                                     QUndoCommand* parent):
+        QUndoCommand(parent), m_project(project), m_addedFiles(files), m_executed(false)
+    {
+        setText(QObject::tr("Add %n file(s)", 0, files.size()));
+    }
+
+    /**
+     * Removes the added files from the project in one batch.
+     */
+    void AddFilesCommand::undo()
+    {
+        if (!m_project)
+        {
+            return;
+        }
+
+        QStringList filenames;
+        filenames.reserve(m_addedFiles.size());
+        foreach (const RecordedFile& file, m_addedFiles)
+        {
+            filenames.append(file.first);
+        }
+        m_project->removeFiles(filenames);
+    }
+
+    /**
+     * Adds the files to the project.
+     *
+     * On first execution files are validated and categorized by
+     * Project::addFile(); missing files are collected instead of aborting
+     * the whole batch. Files validated in advance are inserted as one batch,
+     * except those already in the project. Subsequent executions reinsert
+     * the recorded result.
+     */
+    void AddFilesCommand::redo()
+    {
+        if (!m_project)
+        {
+            return;
+        }
+
+        if (m_executed)
+        {
+            m_project->insertFiles(m_addedFiles);
+            return;
+        }
+
+        if (!m_addedFiles.isEmpty())
+        {
+            RecordedFileList validatedFiles = m_addedFiles;
+            m_addedFiles.clear();
+            foreach (const RecordedFile& file, validatedFiles)
+            {
+                if (!m_project->hasFile(file.first))
+                {
+                    m_addedFiles.append(file);
+                }
+            }
+            m_project->insertFiles(m_addedFiles);
+        }
+
+        foreach (QString filename, m_requestedFiles)
+        {
+            if (m_project->hasFile(filename))
+            {
+                continue;
+            }
+
+            try
+            {
+                m_project->addFile(filename, m_categoryShortName);
+                m_addedFiles.append(qMakePair(filename, m_project->getFileRecord(filename)));
+            }
+            catch (ProjectException&)
+            {
+                m_failedFiles.append(filename);
+            }
+        }
+
+        // the request list is no longer needed, keep the command compact
+        m_requestedFiles.clear();
+        m_executed = true;
+        setText(QObject::tr("Add %n file(s)", 0, m_addedFiles.size()));
+    }
+
+    /**
+     * Creates the command.
+     *
+     * @param project the project to modify
+     * @param filenames list of file paths
+     * @param parent parent command
+     */
+    RemoveFilesCommand::RemoveFilesCommand(Project* project, QStringList filenames,
+                                           QUndoCommand* parent):
+        QUndoCommand(parent), m_project(project), m_requestedFiles(filenames)
+    {
+        setText(QObject::tr("Remove %n file(s)", 0, filenames.size()));
+    }
+
+    /**
+     * Restores the removed files with their original categories.
+     */
+    void RemoveFilesCommand::undo()
+    {
+        if (!m_project)
+        {
+            return;
+        }
+
+        m_project->insertFiles(m_removedFiles);
+    }
+
+    /**
+     * Removes the files from the project, remembering their categories.
+     */
+    void RemoveFilesCommand::redo()
+    {
+        if (!m_project)
+        {
+            return;
+        }
+
+        m_removedFiles.clear();
+        QStringList filenames;
+        foreach (QString filename, m_requestedFiles)
+        {
+            if (m_project->hasFile(filename))
+            {
+                m_removedFiles.append(qMakePair(filename, m_project->getFileRecord(filename)));
+                filenames.append(filename);
+            }
+        }
+        m_project->removeFiles(filenames);
+    }
+}
@@ -0,0 +1,134 @@
+/**
+ * @file ProjectCommands.h
+ *
+ * Undoable commands modifying a project.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef PROJECTCOMMANDS_H
+#define PROJECTCOMMANDS_H
+
+#include "../global.h"
+#include "Project.h"
+#include <QPointer>
+#include <QString>
+#include <QStringList>
+#include <QUndoCommand>
+
+namespace Required
+{
+    /**
+     * Adds a batch of files to the project.
+     *
+     * The command stores only the files it has actually added (together with
+     * their categories), so undoing it is a single batch removal and redoing
+     * it doesn't repeat the category lookup.
+     */
+    class REQUIRED_EXPORT AddFilesCommand : public QUndoCommand
+    {
+    public:
+        AddFilesCommand(Project* project, QStringList filenames,
+                        QString categoryShortName = "",
+                        QUndoCommand* parent = 0);
+        AddFilesCommand(Project* project, RecordedFileList files,
+                        QUndoCommand* parent = 0);
+
+        void undo();
+        void redo();
+
+        /**
+         * Returns the number of files added when the command was executed.
+         *
+         * @return added file count
+         */
+        int getAddedCount() const
+        {
+            return m_addedFiles.size();
+        }
+
+        /**
+         * Returns files which couldn't be added when the command was executed.
+         *
+         * @return list of failed file paths
+         */
+        QStringList getFailedFiles() const
+        {
+            return m_failedFiles;
+        }
+
+    private:
+        /**
+         * Non-owning pointer to the modified project.
+         */
+        QPointer<Project> m_project;
+
+        /**
+         * Files requested to be added; released after the first execution.
+         */
+        QStringList m_requestedFiles;
+
+        /**
+         * Category for requested files, empty for filename-based lookup.
+         */
+        QString m_categoryShortName;
+
+        /**
+         * Files actually added by the command, with their records.
+         *
+         * Before the first execution, files validated and categorized in
+         * advance, e.g. by a background ingestion.
+         */
+        RecordedFileList m_addedFiles;
+
+        /**
+         * Files which didn't exist when the command was first executed.
+         */
+        QStringList m_failedFiles;
+
+        /**
+         * Whether redo() has been called at least once.
+         */
+        bool m_executed;
+    };
+
+    /**
+     * Removes a batch of files from the project (but not from disk).
+     */
+    class REQUIRED_EXPORT RemoveFilesCommand : public QUndoCommand
+    {
+    public:
+        RemoveFilesCommand(Project* project, QStringList filenames,
+                           QUndoCommand* parent = 0);
+
+        void undo();
+        void redo();
+
+    private:
+        /**
+         * Non-owning pointer to the modified project.
+         */
+        QPointer<Project> m_project;
+
+        /**
+         * Files requested to be removed.
+         */
+        QStringList m_requestedFiles;
+
+        /**
+         * Files actually removed by the command, with their records.
+         */
+        RecordedFileList m_removedFiles;
+    };
+}
+
+#endif // PROJECTCOMMANDS_H
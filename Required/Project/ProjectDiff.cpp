@@ -0,0 +1,138 @@
+/**
+ * @file ProjectDiff.cpp
+ *
+ * Differences between two projects.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "ProjectDiff.h"
+
+namespace Required
+{
+    /**
+     * Creates an empty diff.
+     */
+    ProjectDiff::ProjectDiff()
+    {
+    }
+
+    /**
+     * Computes the differences between two projects.
+     *
+     * Both file indexes are sorted by path, so a single linear merge of the
+     * two is enough - no lookups and no intermediate lists are needed. If
+     * the projects have different root directories, their indexes are first
+     * re-keyed by absolute paths, which costs an extra O(n log n) pass.
+     *
+     * @param base the project to compare against
+     * @param other the project with the desired file structure
+     * @return differences leading from base to other
+     */
+    ProjectDiff ProjectDiff::compare(const Project& base, const Project& other)
+    {
+        if (base.getRootPath() == other.getRootPath())
+        {
+            return merge(base.m_fileIndex, other.m_fileIndex, base.getRootPath());
+        }
+
+        // the absolute paths live only as long as this comparison
+        PathPool pathPool;
+        return merge(absoluteIndex(base, pathPool), absoluteIndex(other, pathPool), QString());
+    }
+
+    /**
+     * Merges two file indexes with paths relative to the same root.
+     *
+     * @param baseIndex file index of the base project
+     * @param otherIndex file index of the other project
+     * @param rootPath common root directory
+     * @return differences leading from base to other
+     */
+    ProjectDiff ProjectDiff::merge(const PersistentMap<PathHandle, FileRecord>& baseIndex,
+                                   const PersistentMap<PathHandle, FileRecord>& otherIndex,
+                                   QString rootPath)
+    {
+        ProjectDiff diff;
+
+        PersistentMap<PathHandle, FileRecord>::const_iterator left = baseIndex.constBegin();
+        PersistentMap<PathHandle, FileRecord>::const_iterator leftEnd = baseIndex.constEnd();
+        PersistentMap<PathHandle, FileRecord>::const_iterator right = otherIndex.constBegin();
+        PersistentMap<PathHandle, FileRecord>::const_iterator rightEnd = otherIndex.constEnd();
+
+        while (left != leftEnd && right != rightEnd)
+        {
+            int order = left.key().compare(right.key());
+            if (order < 0)
+            {
+                diff.m_removedFiles.append(qMakePair(Project::toAbsolutePath(rootPath, left.key()),
+                                                     left.value().category));
+                ++left;
+            }
+            else if (order > 0)
+            {
+                diff.m_addedFiles.append(qMakePair(Project::toAbsolutePath(rootPath, right.key()),
+                                                   right.value().category));
+                ++right;
+            }
+            else
+            {
+                if (left.value().category != right.value().category)
+                {
+                    diff.m_recategorizedFiles.append(qMakePair(Project::toAbsolutePath(rootPath, right.key()),
+                                                               right.value().category));
+                }
+                ++left;
+                ++right;
+            }
+        }
+
+        for (; left != leftEnd; ++left)
+        {
+            diff.m_removedFiles.append(qMakePair(Project::toAbsolutePath(rootPath, left.key()),
+                                                 left.value().category));
+        }
+        for (; right != rightEnd; ++right)
+        {
+            diff.m_addedFiles.append(qMakePair(Project::toAbsolutePath(rootPath, right.key()),
+                                               right.value().category));
+        }
+
+        return diff;
+    }
+
+    /**
+     * Returns a copy of the file index of a project keyed by absolute paths.
+     *
+     * @param project any project
+     * @param pathPool receives the absolute paths
+     * @return file => record index
+     */
+    PersistentMap<PathHandle, FileRecord> ProjectDiff::absoluteIndex(const Project& project,
+                                                                     PathPool& pathPool)
+    {
+        if (project.getRootPath().isEmpty())
+        {
+            return project.m_fileIndex;
+        }
+
+        PersistentMap<PathHandle, FileRecord> index;
+        PersistentMap<PathHandle, FileRecord>::const_iterator it;
+        for (it = project.m_fileIndex.constBegin(); it != project.m_fileIndex.constEnd(); ++it)
+        {
+            index.insert(pathPool.intern(Project::toAbsolutePath(project.getRootPath(), it.key())),
+                         it.value());
+        }
+
+        return index;
+    }
+}
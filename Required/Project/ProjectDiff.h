@@ -0,0 +1,105 @@
+/**
+ * @file ProjectDiff.h
+ *
+ * Differences between two projects.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef PROJECTDIFF_H
+#define PROJECTDIFF_H
+
+#include "../global.h"
+#include "Project.h"
+
+namespace Required
+{
+    /**
+     * Differences between two projects.
+     *
+     * A diff describes what has to be done to the base project to get the
+     * file structure of the other one. It can be inspected or applied to
+     * a project with Project::applyDiff().
+     */
+    class REQUIRED_EXPORT ProjectDiff
+    {
+    public:
+        ProjectDiff();
+
+        static ProjectDiff compare(const Project& base, const Project& other);
+
+        /**
+         * Returns files present only in the other project.
+         *
+         * @return added files with their categories, sorted by path
+         */
+        const CategorizedFileList& getAddedFiles() const
+        {
+            return m_addedFiles;
+        }
+
+        /**
+         * Returns files present only in the base project.
+         *
+         * @return removed files with their categories, sorted by path
+         */
+        const CategorizedFileList& getRemovedFiles() const
+        {
+            return m_removedFiles;
+        }
+
+        /**
+         * Returns files present in both projects, but in different categories.
+         *
+         * @return files with their categories in the other project, sorted by path
+         */
+        const CategorizedFileList& getRecategorizedFiles() const
+        {
+            return m_recategorizedFiles;
+        }
+
+        /**
+         * Checks whether the projects have the same files and categories.
+         *
+         * @return true if there are no differences
+         */
+        bool isEmpty() const
+        {
+            return m_addedFiles.isEmpty() && m_removedFiles.isEmpty() &&
+                   m_recategorizedFiles.isEmpty();
+        }
+
+    private:
+        /**
+         * Files present only in the other project.
+         */
+        CategorizedFileList m_addedFiles;
+
+        /**
+         * Files present only in the base project.
+         */
+        CategorizedFileList m_removedFiles;
+
+        /**
+         * Files which changed their category.
+         */
+        CategorizedFileList m_recategorizedFiles;
+
+        static ProjectDiff merge(const PersistentMap<PathHandle, FileRecord>& baseIndex,
+                                 const PersistentMap<PathHandle, FileRecord>& otherIndex,
+                                 QString rootPath);
+        static PersistentMap<PathHandle, FileRecord> absoluteIndex(const Project& project,
+                                                                   PathPool& pathPool);
+    };
+}
+
+#endif // PROJECTDIFF_H
@@ -0,0 +1,622 @@
+/**
+ * @file ProjectFileOperations.cpp
+ *
+ * Asynchronous physical operations (delete, move, copy, rename) on project files.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "ProjectFileOperations.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QEvent>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaObject>
+
+#if defined(Q_OS_UNIX)
+#  include <cerrno>
+#  include <cstdio>
+#  include <fcntl.h>
+#  include <sys/stat.h>
+#  include <sys/types.h>
+#  include <unistd.h>
+#endif
+
+#if defined(Q_OS_LINUX) && defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#  define REQUIRED_HAVE_COPY_FILE_RANGE
+#endif
+
+#if defined(Q_OS_LINUX) && defined(__GLIBC__) && defined(RENAME_NOREPLACE) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 28))
+#  define REQUIRED_HAVE_RENAMEAT2
+#endif
+
+namespace Required
+{
+    namespace
+    {
+        // These helpers call the system directly instead of going through
+        // FileSystem: that interface only reads and removes, while moving
+        // and copying here rely on an exclusive create, copy_file_range()
+        // and renames which neither cross file systems nor replace files. errno is saved right
+        // after the failing call, before anything else can change it.
+
+        /**
+         * Physically removes a file.
+         */
+        bool deletePhysically(const QString& source, QString& errorString)
+        {
+#if defined(Q_OS_UNIX)
+            if (::unlink(QFile::encodeName(source).constData()) != 0)
+            {
+                int error = errno;
+                errorString = qt_error_string(error);
+                return false;
+            }
+            return true;
+#else
+            QFile file(source);
+            if (!file.remove())
+            {
+                errorString = file.errorString();
+                return false;
+            }
+            return true;
+#endif
+        }
+
+        /**
+         * Copies file contents, preferably without a round trip through
+         * userspace buffers.
+         */
+        bool copyPhysically(const QString& source, const QString& destination,
+                            QString& errorString)
+        {
+#if defined(Q_OS_UNIX)
+            int in = ::open(QFile::encodeName(source).constData(), O_RDONLY);
+            if (in < 0)
+            {
+                int error = errno;
+                errorString = qt_error_string(error);
+                return false;
+            }
+
+            struct stat sourceStat;
+            if (::fstat(in, &sourceStat) != 0)
+            {
+                int error = errno;
+                ::close(in);
+                errorString = qt_error_string(error);
+                return false;
+            }
+
+            int out = ::open(QFile::encodeName(destination).constData(),
+                             O_WRONLY | O_CREAT | O_EXCL, sourceStat.st_mode & 0777);
+            if (out < 0)
+            {
+                int error = errno;
+                ::close(in);
+                errorString = qt_error_string(error);
+                return false;
+            }
+
+            int error = 0;
+            off_t remaining = sourceStat.st_size;
+#if defined(REQUIRED_HAVE_COPY_FILE_RANGE)
+            // in-kernel copy; may fail with EXDEV/ENOSYS/EINVAL on some
+            // filesystems, in which case we fall back to read/write below
+            while (remaining > 0)
+            {
+                ssize_t copied = ::copy_file_range(in, 0, out, 0, remaining, 0);
+                if (copied <= 0)
+                {
+                    break;
+                }
+                remaining -= copied;
+            }
+#endif
+            if (remaining > 0)
+            {
+                // copy until the end of the file, writes may be partial
+                char buffer[64 * 1024];
+                while (error == 0)
+                {
+                    ssize_t count = ::read(in, buffer, sizeof(buffer));
+                    if (count == 0)
+                    {
+                        break;
+                    }
+                    if (count < 0)
+                    {
+                        error = errno == EINTR ? 0 : errno;
+                        continue;
+                    }
+                    ssize_t written = 0;
+                    while (written < count && error == 0)
+                    {
+                        ssize_t result = ::write(out, buffer + written, count - written);
+                        if (result < 0)
+                        {
+                            error = errno == EINTR ? 0 : errno;
+                        }
+                        else if (result == 0)
+                        {
+                            error = EIO;
+                        }
+                        else
+                        {
+                            written += result;
+                        }
+                    }
+                }
+            }
+
+            ::close(in);
+            if (::close(out) != 0 && error == 0)
+            {
+                error = errno;
+            }
+            if (error != 0)
+            {
+                errorString = qt_error_string(error);
+                ::unlink(QFile::encodeName(destination).constData());
+                return false;
+            }
+            return true;
+#else
+            QFile file(source);
+            if (!file.copy(destination))
+            {
+                errorString = file.errorString();
+                return false;
+            }
+            return true;
+#endif
+        }
+
+        /**
+         * Moves a file, never replacing an existing destination.
+         *
+         * The check for the destination is atomic with the move:
+         * renameat2() with RENAME_NOREPLACE where available, otherwise a
+         * hard link, which fails with EEXIST, followed by unlinking the
+         * source. Across file systems, or where neither is supported, the
+         * file is copied with an exclusive create and then deleted.
+         */
+        bool movePhysically(const QString& source, const QString& destination,
+                            QString& errorString)
+        {
+#if defined(Q_OS_UNIX)
+            QByteArray from = QFile::encodeName(source);
+            QByteArray to = QFile::encodeName(destination);
+            int error = ENOSYS;
+#  if defined(REQUIRED_HAVE_RENAMEAT2)
+            if (::renameat2(AT_FDCWD, from.constData(), AT_FDCWD, to.constData(),
+                            RENAME_NOREPLACE) == 0)
+            {
+                return true;
+            }
+            error = errno;
+#  endif
+            // older kernels and some file systems don't support the flag
+            if (error == ENOSYS || error == EINVAL)
+            {
+                if (::link(from.constData(), to.constData()) == 0)
+                {
+                    if (::unlink(from.constData()) == 0)
+                    {
+                        return true;
+                    }
+                    error = errno;
+                    ::unlink(to.constData());
+                    errorString = qt_error_string(error);
+                    return false;
+                }
+                error = errno;
+            }
+            // file systems without hard links refuse with EPERM
+            if (error != EXDEV && error != EPERM && error != EOPNOTSUPP)
+            {
+                errorString = error == EEXIST
+                    ? QObject::tr("File %1 already exists").arg(destination)
+                    : qt_error_string(error);
+                return false;
+            }
+            return copyPhysically(source, destination, errorString) &&
+                   deletePhysically(source, errorString);
+#else
+            QFile file(source);
+            if (!file.rename(destination))
+            {
+                errorString = file.errorString();
+                return false;
+            }
+            return true;
+#endif
+        }
+
+        /**
+         * A single operation executed by the scheduler.
+         */
+        class FileOperationTask : public ScheduledTask
+        {
+        public:
+            FileOperationTask(QObject* receiver, int id,
+                              ProjectFileOperations::OperationType type,
+                              QString source, QString destination,
+                              TaskScheduler::Priority priority):
+                ScheduledTask(priority, TaskScheduler::getDevice(source)),
+                m_receiver(receiver), m_id(id), m_type(type),
+                m_source(source), m_destination(destination)
+            {
+            }
+
+            void run()
+            {
+                QString errorString;
+                bool success = false;
+                switch (m_type)
+                {
+                case ProjectFileOperations::Delete:
+                    success = deletePhysically(m_source, errorString);
+                    break;
+                case ProjectFileOperations::Move:
+                case ProjectFileOperations::Rename:
+                    success = movePhysically(m_source, m_destination, errorString);
+                    break;
+                case ProjectFileOperations::Copy:
+                    success = copyPhysically(m_source, m_destination, errorString);
+                    break;
+                }
+
+                // the receiver lives in another thread, so the result is
+                // delivered as a queued call
+                QMetaObject::invokeMethod(m_receiver, "onOperationDone",
+                                          Qt::QueuedConnection,
+                                          Q_ARG(int, m_id),
+                                          Q_ARG(bool, success),
+                                          Q_ARG(QString, errorString));
+            }
+
+        private:
+            QObject* m_receiver;
+            int m_id;
+            ProjectFileOperations::OperationType m_type;
+            QString m_source;
+            QString m_destination;
+        };
+    }
+
+    /**
+     * Creates the operations engine.
+     *
+     * Operations run on the default scheduler with normal priority; the
+     * device limit keeps metadata-heavy operations from piling up on one
+     * disk.
+     *
+     * @param project the project whose indexes will follow the operations
+     * @param parent parent object
+     */
+    ProjectFileOperations::ProjectFileOperations(Project* project, QObject* parent):
+        QObject(parent), m_project(project), m_scheduler(TaskScheduler::getDefault()),
+        m_priority(TaskScheduler::Normal), m_nextId(1)
+    {
+    }
+
+    /**
+     * Destroys the engine, waiting for the running operations to finish.
+     */
+    ProjectFileOperations::~ProjectFileOperations()
+    {
+        // running tasks post their results to this object
+        foreach (int taskId, m_tasks)
+        {
+            if (m_scheduler)
+            {
+                m_scheduler->waitFor(taskId);
+            }
+        }
+    }
+
+    /**
+     * Schedules physical removal of a project file.
+     *
+     * The file is detached from the project once it's gone from disk.
+     *
+     * @param filename path to the file
+     * @return operation identifier
+     */
+    int ProjectFileOperations::deleteFile(QString filename)
+    {
+        return enqueue(Delete, filename, QString());
+    }
+
+    /**
+     * Schedules moving a file to another path.
+     *
+     * @param filename path to the file
+     * @param destination new path to the file
+     * @return operation identifier
+     */
+    int ProjectFileOperations::moveFile(QString filename, QString destination)
+    {
+        return enqueue(Move, filename, destination);
+    }
+
+    /**
+     * Schedules copying a file to another path.
+     *
+     * If the source file belongs to the project, the copy is added to the
+     * project in the same category.
+     *
+     * @param filename path to the file
+     * @param destination path to the copy
+     * @return operation identifier
+     */
+    int ProjectFileOperations::copyFile(QString filename, QString destination)
+    {
+        return enqueue(Copy, filename, destination);
+    }
+
+    /**
+     * Schedules renaming a file within its directory.
+     *
+     * @param filename path to the file
+     * @param newName new file name (without the directory part)
+     * @return operation identifier
+     */
+    int ProjectFileOperations::renameFile(QString filename, QString newName)
+    {
+        QString destination = QFileInfo(filename).dir().filePath(newName);
+        return enqueue(Rename, filename, destination);
+    }
+
+    /**
+     * Schedules physical removal of multiple files.
+     *
+     * @param filenames list of file paths
+     * @return operation identifiers
+     */
+    QList<int> ProjectFileOperations::deleteFiles(QStringList filenames)
+    {
+        QList<int> ids;
+        foreach (QString filename, filenames)
+        {
+            ids.append(deleteFile(filename));
+        }
+
+        return ids;
+    }
+
+    /**
+     * Schedules moving multiple files into a directory.
+     *
+     * @param filenames list of file paths
+     * @param destinationDir target directory
+     * @return operation identifiers
+     */
+    QList<int> ProjectFileOperations::moveFiles(QStringList filenames,
+                                                QString destinationDir)
+    {
+        QDir dir(destinationDir);
+        QList<int> ids;
+        foreach (QString filename, filenames)
+        {
+            ids.append(moveFile(filename, dir.filePath(QFileInfo(filename).fileName())));
+        }
+
+        return ids;
+    }
+
+    /**
+     * Schedules copying multiple files into a directory.
+     *
+     * @param filenames list of file paths
+     * @param destinationDir target directory
+     * @return operation identifiers
+     */
+    QList<int> ProjectFileOperations::copyFiles(QStringList filenames,
+                                                QString destinationDir)
+    {
+        QDir dir(destinationDir);
+        QList<int> ids;
+        foreach (QString filename, filenames)
+        {
+            ids.append(copyFile(filename, dir.filePath(QFileInfo(filename).fileName())));
+        }
+
+        return ids;
+    }
+
+    /**
+     * Blocks until all scheduled operations have finished.
+     *
+     * Results are still delivered through the event loop, so this is mostly
+     * useful in tests and before shutting down.
+     */
+    void ProjectFileOperations::waitForFinished()
+    {
+        while (!m_operations.isEmpty() && m_scheduler)
+        {
+            foreach (int taskId, m_tasks)
+            {
+                m_scheduler->waitFor(taskId);
+            }
+            QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+        }
+    }
+
+    /**
+     * Receives the result of a finished operation.
+     *
+     * Runs in the thread owning the engine, so it is safe to update the
+     * project here.
+     *
+     * @param id operation identifier
+     * @param success whether the operation succeeded
+     * @param errorString description of the failure
+     */
+    void ProjectFileOperations::onOperationDone(int id, bool success,
+                                                QString errorString)
+    {
+        Operation operation = m_operations.take(id);
+        m_tasks.remove(id);
+        m_busyPaths.remove(operation.source);
+        m_busyPaths.remove(operation.destination);
+
+        if (success)
+        {
+            updateProject(operation);
+        }
+
+        emit operationFinished(id, operation.source, operation.destination,
+                               success, errorString);
+
+        startDeferred();
+        if (m_operations.isEmpty())
+        {
+            emit allFinished();
+        }
+    }
+
+    /**
+     * Registers a new operation and starts it if its paths are free.
+     *
+     * @param type operation type
+     * @param source path to the file
+     * @param destination target path (unused for deletion)
+     * @return operation identifier
+     */
+    int ProjectFileOperations::enqueue(OperationType type, QString source,
+                                       QString destination)
+    {
+        int id = m_nextId++;
+        Operation operation = {type, source, destination};
+        m_operations.insert(id, operation);
+
+        if (isBusy(operation) || !m_deferred.isEmpty())
+        {
+            // keep the request order for operations touching the same path
+            m_deferred.append(id);
+        }
+        else
+        {
+            start(id);
+        }
+
+        return id;
+    }
+
+    /**
+     * Checks whether any running operation uses the paths of another one.
+     *
+     * @param operation the operation to check
+     * @return true if it has to wait
+     */
+    bool ProjectFileOperations::isBusy(const Operation& operation) const
+    {
+        return m_busyPaths.contains(operation.source) ||
+               (!operation.destination.isEmpty() &&
+                m_busyPaths.contains(operation.destination));
+    }
+
+    /**
+     * Hands an operation over to the scheduler.
+     *
+     * @param id operation identifier
+     */
+    void ProjectFileOperations::start(int id)
+    {
+        const Operation& operation = m_operations[id];
+        m_busyPaths.insert(operation.source);
+        if (!operation.destination.isEmpty())
+        {
+            m_busyPaths.insert(operation.destination);
+        }
+
+        FileOperationTask* task = new FileOperationTask(this, id, operation.type,
+                                                        operation.source,
+                                                        operation.destination,
+                                                        m_priority);
+        m_tasks.insert(id, m_scheduler->schedule(task));
+    }
+
+    /**
+     * Starts deferred operations whose paths are no longer busy.
+     *
+     * An operation which has to keep waiting holds its paths for the rest
+     * of the scan, so that no later operation on the same path overtakes it.
+     */
+    void ProjectFileOperations::startDeferred()
+    {
+        QSet<QString> waitingPaths;
+        QList<int>::iterator it = m_deferred.begin();
+        while (it != m_deferred.end())
+        {
+            const Operation& operation = m_operations[*it];
+            if (isBusy(operation) || waitingPaths.contains(operation.source) ||
+                (!operation.destination.isEmpty() && waitingPaths.contains(operation.destination)))
+            {
+                waitingPaths.insert(operation.source);
+                if (!operation.destination.isEmpty())
+                {
+                    waitingPaths.insert(operation.destination);
+                }
+                ++it;
+            }
+            else
+            {
+                start(*it);
+                it = m_deferred.erase(it);
+            }
+        }
+    }
+
+    /**
+     * Brings project indexes in line with a successful operation.
+     *
+     * @param operation the finished operation
+     */
+    void ProjectFileOperations::updateProject(const Operation& operation)
+    {
+        if (!m_project || !m_project->hasFile(operation.source))
+        {
+            return;
+        }
+
+        switch (operation.type)
+        {
+        case Delete:
+            m_project->removeFile(operation.source);
+            break;
+        case Move:
+        case Rename:
+            // the move refuses existing destinations, so an entry for the
+            // destination was stale; the moved file takes its place
+            if (m_project->hasFile(operation.destination))
+            {
+                m_project->removeFile(operation.destination);
+            }
+            m_project->renameFile(operation.source, operation.destination);
+            break;
+        case Copy:
+        {
+            // the copy is categorized exactly like its source
+            FileRecord record = m_project->getFileRecord(operation.source);
+            m_project->addFile(operation.destination, record.category, record.explicitCategory);
+            break;
+        }
+        }
+    }
+}
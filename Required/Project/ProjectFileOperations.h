@@ -0,0 +1,198 @@
+/**
+ * @file ProjectFileOperations.h
+ *
+ * Asynchronous physical operations (delete, move, copy, rename) on project files.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef PROJECTFILEOPERATIONS_H
+#define PROJECTFILEOPERATIONS_H
+
+#include "../global.h"
+#include "Project.h"
+#include "TaskScheduler.h"
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QPointer>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+namespace Required
+{
+    /**
+     * Asynchronous physical operations on project files.
+     *
+     * Every operation runs as a task of a TaskScheduler, limited by the I/O
+     * concurrency of the device holding the file. Results are delivered
+     * back in the thread which owns the engine (usually the GUI thread),
+     * where the project indexes are updated to reflect the new state of the
+     * disk. Operations touching the same path are executed in the order
+     * they were requested.
+     */
+    class REQUIRED_EXPORT ProjectFileOperations : public QObject
+    {
+        Q_OBJECT
+        Q_ENUMS(OperationType)
+
+    public:
+        /**
+         * Kinds of supported operations.
+         */
+        enum OperationType
+        {
+            Delete,
+            Move,
+            Copy,
+            Rename
+        };
+
+        explicit ProjectFileOperations(Project* project, QObject* parent = 0);
+        ~ProjectFileOperations();
+
+        /**
+         * Returns the scheduler running the operations.
+         *
+         * @return task scheduler
+         */
+        TaskScheduler* getScheduler() const
+        {
+            return m_scheduler;
+        }
+
+        /**
+         * Sets the scheduler running the operations requested from now on.
+         *
+         * The engine doesn't take ownership of the scheduler.
+         *
+         * @param scheduler task scheduler, 0 for the default one
+         */
+        void setScheduler(TaskScheduler* scheduler)
+        {
+            m_scheduler = scheduler ? scheduler : TaskScheduler::getDefault();
+        }
+
+        /**
+         * Returns the priority class of the operations.
+         *
+         * @return priority
+         */
+        TaskScheduler::Priority getPriority() const
+        {
+            return m_priority;
+        }
+
+        /**
+         * Sets the priority class of the operations requested from now on.
+         *
+         * Operations started by the user should be interactive, so that
+         * they don't wait for background work on the same disk.
+         *
+         * @param priority priority
+         */
+        void setPriority(TaskScheduler::Priority priority)
+        {
+            m_priority = priority;
+        }
+
+        /**
+         * Returns the number of operations which haven't finished yet.
+         *
+         * @return number of queued and running operations
+         */
+        int getPendingCount() const
+        {
+            return m_operations.size();
+        }
+
+        int deleteFile(QString filename);
+        int moveFile(QString filename, QString destination);
+        int copyFile(QString filename, QString destination);
+        int renameFile(QString filename, QString newName);
+
+        QList<int> deleteFiles(QStringList filenames);
+        QList<int> moveFiles(QStringList filenames, QString destinationDir);
+        QList<int> copyFiles(QStringList filenames, QString destinationDir);
+
+        void waitForFinished();
+
+    signals:
+        void operationFinished(int id, QString filename, QString destination,
+                               bool success, QString errorString);
+        void allFinished();
+
+    private slots:
+        void onOperationDone(int id, bool success, QString errorString);
+
+    private:
+        /**
+         * A single requested operation.
+         */
+        struct Operation
+        {
+            OperationType type;
+            QString source;
+            QString destination;
+        };
+
+        /**
+         * Non-owning pointer to the project kept in sync with the disk.
+         */
+        QPointer<Project> m_project;
+
+        /**
+         * Non-owning pointer to the scheduler running the operations.
+         */
+        QPointer<TaskScheduler> m_scheduler;
+
+        /**
+         * Priority class of the operations.
+         */
+        TaskScheduler::Priority m_priority;
+
+        /**
+         * Operations which are queued or running, by identifier.
+         */
+        QMap<int, Operation> m_operations;
+
+        /**
+         * Scheduler tasks of started operations, by operation identifier.
+         */
+        QHash<int, int> m_tasks;
+
+        /**
+         * Operations waiting for another operation on the same path.
+         */
+        QList<int> m_deferred;
+
+        /**
+         * Paths touched by currently running operations.
+         */
+        QSet<QString> m_busyPaths;
+
+        /**
+         * Identifier of the next operation.
+         */
+        int m_nextId;
+
+        int enqueue(OperationType type, QString source, QString destination);
+        bool isBusy(const Operation& operation) const;
+        void start(int id);
+        void startDeferred();
+        void updateProject(const Operation& operation);
+    };
+}
+
+#endif // PROJECTFILEOPERATIONS_H
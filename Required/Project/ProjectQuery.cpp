@@ -0,0 +1,412 @@
+/**
+ * @file ProjectQuery.cpp
+ *
+ * Filtering project files by category, location and file information.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "ProjectQuery.h"
+#include "PathPool.h"
+#include "PersistentMap.h"
+#include "TaskScheduler.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QThread>
+#include <QVector>
+
+namespace Required
+{
+    namespace
+    {
+        /**
+         * Default number of candidates above which files are checked in parallel.
+         */
+        const int DefaultParallelThreshold = 8192;
+
+        /**
+         * Checks whether a stored path begins with a string.
+         */
+        bool startsWith(const PathHandle& path, const QString& prefix)
+        {
+            return path.size() >= prefix.size() &&
+                   QString::fromRawData(path.constData(), prefix.size()) == prefix;
+        }
+    }
+
+    /**
+     * Checks a range of candidates, possibly on a worker thread.
+     *
+     * The evaluator works on its own copy of the file index and of the
+     * filename patterns, so it doesn't share any mutable state.
+     */
+    class ProjectQuery::Evaluator : public ScheduledTask
+    {
+    public:
+        Evaluator(const ProjectQuery* query, const Project& project,
+                  const QVector<PathHandle>& candidates, int begin, int end, bool checkCategory):
+            ScheduledTask(TaskScheduler::Normal), m_query(query), m_fileIndex(project.m_fileIndex), m_rootPath(project.getRootPath()),
+            m_fileSystem(project.getFileSystem()),
+            m_candidates(candidates), m_begin(begin), m_end(end),
+            m_checkCategory(checkCategory), m_filenamePatterns(query->m_filenamePatterns)
+        {
+            setAutoDelete(false);
+        }
+
+        void run()
+        {
+            bool needsRecord = m_checkCategory || m_query->needsFileInfo();
+            for (int i = m_begin; i < m_end; ++i)
+            {
+                PathHandle path = m_candidates.at(i);
+                FileRecord record;
+                if (needsRecord)
+                {
+                    record = m_fileIndex.value(path);
+                    if (m_checkCategory && !m_query->m_categories.contains(record.category))
+                    {
+                        continue;
+                    }
+                }
+
+                QString filename = Project::toAbsolutePath(m_rootPath, path);
+                if (m_query->matches(filename, record, m_filenamePatterns, m_fileSystem))
+                {
+                    m_files.append(filename);
+                }
+            }
+        }
+
+        const QStringList& getFiles() const
+        {
+            return m_files;
+        }
+
+    private:
+        const ProjectQuery* m_query;
+        PersistentMap<PathHandle, FileRecord> m_fileIndex;
+        QString m_rootPath;
+        FileSystem* m_fileSystem;
+        const QVector<PathHandle>& m_candidates;
+        int m_begin;
+        int m_end;
+        bool m_checkCategory;
+        QList<QRegExp> m_filenamePatterns;
+        QStringList m_files;
+    };
+
+    /**
+     * Creates a query matching all files.
+     */
+    ProjectQuery::ProjectQuery():
+        m_minSize(-1), m_maxSize(-1), m_minModified(-1), m_maxModified(-1),
+        m_unsatisfiable(false), m_parallelThreshold(DefaultParallelThreshold)
+    {
+    }
+
+    /**
+     * Accepts files in a category.
+     *
+     * Unlike other conditions, categories add up: a query with several
+     * categories matches files in any of them.
+     *
+     * @param categoryShortName category identifier
+     * @return this query
+     */
+    ProjectQuery& ProjectQuery::inCategory(QString categoryShortName)
+    {
+        m_categories.insert(categoryShortName);
+        return *this;
+    }
+
+    /**
+     * Accepts only files inside a directory or its subdirectories.
+     *
+     * If the query is already limited to a directory, the deeper one of the
+     * two is kept; unrelated directories make the query unsatisfiable.
+     *
+     * @param path path to the directory
+     * @return this query
+     */
+    ProjectQuery& ProjectQuery::underDirectory(QString path)
+    {
+        QString directory = QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+        if (!directory.endsWith('/'))
+        {
+            directory.append('/');
+        }
+
+        if (m_directory.isEmpty() || directory.startsWith(m_directory))
+        {
+            m_directory = directory;
+        }
+        else if (!m_directory.startsWith(directory))
+        {
+            m_unsatisfiable = true;
+        }
+
+        return *this;
+    }
+
+    /**
+     * Accepts only files whose absolute paths match a pattern.
+     *
+     * The whole path has to match, like in FileCategory::matchesFilename().
+     *
+     * @param filenameRegexp pattern for file paths
+     * @return this query
+     */
+    ProjectQuery& ProjectQuery::matchingFilename(QRegExp filenameRegexp)
+    {
+        m_filenamePatterns.append(filenameRegexp);
+        return *this;
+    }
+
+    /**
+     * Accepts only files larger than the given size.
+     *
+     * @param size size in bytes
+     * @return this query
+     */
+    ProjectQuery& ProjectQuery::largerThan(qint64 size)
+    {
+        m_minSize = qMax(m_minSize, size + 1);
+        updateUnsatisfiable();
+        return *this;
+    }
+
+    /**
+     * Accepts only files smaller than the given size.
+     *
+     * @param size size in bytes
+     * @return this query
+     */
+    ProjectQuery& ProjectQuery::smallerThan(qint64 size)
+    {
+        if (size <= 0)
+        {
+            m_unsatisfiable = true;
+            return *this;
+        }
+
+        m_maxSize = m_maxSize < 0 ? size - 1 : qMin(m_maxSize, size - 1);
+        updateUnsatisfiable();
+        return *this;
+    }
+
+    /**
+     * Accepts only files modified after the given time.
+     *
+     * @param time modification time
+     * @return this query
+     */
+    ProjectQuery& ProjectQuery::modifiedAfter(QDateTime time)
+    {
+        m_minModified = qMax(m_minModified, time.toMSecsSinceEpoch() + 1);
+        updateUnsatisfiable();
+        return *this;
+    }
+
+    /**
+     * Accepts only files modified before the given time.
+     *
+     * @param time modification time
+     * @return this query
+     */
+    ProjectQuery& ProjectQuery::modifiedBefore(QDateTime time)
+    {
+        qint64 maxModified = time.toMSecsSinceEpoch() - 1;
+        if (maxModified < 0)
+        {
+            m_unsatisfiable = true;
+            return *this;
+        }
+
+        m_maxModified = m_maxModified < 0 ? maxModified : qMin(m_maxModified, maxModified);
+        updateUnsatisfiable();
+        return *this;
+    }
+
+    /**
+     * Finds all files of a project matching the query.
+     *
+     * Candidates are taken from the narrowest available index: the range of
+     * the file index covering the directory, or the groups of the requested
+     * categories. Files are returned in index order, i.e. sorted by path
+     * within a directory, and newest first within a category.
+     *
+     * Blocks until all candidates are checked; the project must not be
+     * modified meanwhile.
+     *
+     * @param project the project to search
+     * @return absolute paths of matching files
+     */
+    QStringList ProjectQuery::run(const Project& project) const
+    {
+        if (m_unsatisfiable)
+        {
+            return QStringList();
+        }
+
+        // the file index is persistent, so workers get cheap private copies
+        const PersistentMap<PathHandle, FileRecord>& fileIndex = project.m_fileIndex;
+        QString rootPath = project.getRootPath();
+        QVector<PathHandle> candidates;
+        bool checkCategory = !m_categories.isEmpty();
+
+        // files inside the root are stored relative to it, so only a
+        // directory not containing the root maps to a single range
+        QString rootDirectory = rootPath.endsWith('/') ? rootPath : rootPath + '/';
+        bool containsRoot = !rootPath.isEmpty() && rootDirectory.startsWith(m_directory);
+        if (!m_directory.isEmpty() && !containsRoot)
+        {
+            QString prefix = Project::toRelativePath(rootPath, m_directory + "x");
+            prefix.chop(1);
+            PathPool scratch;
+            PersistentMap<PathHandle, FileRecord>::const_iterator it = fileIndex.lowerBound(scratch.intern(prefix));
+            for (; it != fileIndex.constEnd() && startsWith(it.key(), prefix); ++it)
+            {
+                candidates.append(it.key());
+            }
+        }
+        else if (checkCategory)
+        {
+            foreach (QString categoryShortName, m_categories)
+            {
+                QMultiMap<QString, PathHandle>::const_iterator it = project.m_categorizedFiles.constFind(categoryShortName);
+                for (; it != project.m_categorizedFiles.constEnd() && it.key() == categoryShortName; ++it)
+                {
+                    candidates.append(it.value());
+                }
+            }
+            checkCategory = false;
+        }
+        else
+        {
+            candidates.reserve(fileIndex.size());
+            PersistentMap<PathHandle, FileRecord>::const_iterator it;
+            for (it = fileIndex.constBegin(); it != fileIndex.constEnd(); ++it)
+            {
+                candidates.append(it.key());
+            }
+        }
+
+        if (candidates.size() < m_parallelThreshold)
+        {
+            Evaluator evaluator(this, project, candidates, 0, candidates.size(), checkCategory);
+            evaluator.run();
+            return evaluator.getFiles();
+        }
+
+        // a few chunks per thread even out differences in stat() costs
+        int chunkCount = qMax(1, QThread::idealThreadCount()) * 4;
+        int chunkSize = (candidates.size() + chunkCount - 1) / chunkCount;
+        QList<Evaluator*> evaluators;
+        for (int begin = 0; begin < candidates.size(); begin += chunkSize)
+        {
+            evaluators.append(new Evaluator(this, project, candidates, begin,
+                                            qMin(begin + chunkSize, candidates.size()),
+                                            checkCategory));
+        }
+
+        TaskScheduler* scheduler = TaskScheduler::getDefault();
+        QList<int> ids;
+        foreach (Evaluator* evaluator, evaluators)
+        {
+            ids.append(scheduler->schedule(evaluator));
+        }
+        foreach (int id, ids)
+        {
+            scheduler->waitFor(id);
+        }
+
+        QStringList files;
+        foreach (Evaluator* evaluator, evaluators)
+        {
+            files.append(evaluator->getFiles());
+        }
+        qDeleteAll(evaluators);
+
+        return files;
+    }
+
+    /**
+     * Checks whether the query needs sizes or modification times.
+     *
+     * @return true if there is a size or time condition
+     */
+    bool ProjectQuery::needsFileInfo() const
+    {
+        return m_minSize >= 0 || m_maxSize >= 0 || m_minModified >= 0 || m_maxModified >= 0;
+    }
+
+    /**
+     * Checks the conditions not covered by the indexes.
+     *
+     * Cheap conditions are checked first. If the record lacks the file
+     * information needed, the file is looked up in the file system.
+     *
+     * @param filename absolute path to the file
+     * @param record record of the file, if file information is needed
+     * @param filenamePatterns patterns to match, owned by the calling thread
+     * @param fileSystem file system of the project
+     * @return true if the file matches
+     */
+    bool ProjectQuery::matches(const QString& filename, FileRecord record,
+                               QList<QRegExp>& filenamePatterns, FileSystem* fileSystem) const
+    {
+        if (!m_directory.isEmpty() && !filename.startsWith(m_directory))
+        {
+            return false;
+        }
+
+        for (int i = 0; i < filenamePatterns.size(); ++i)
+        {
+            if (!filenamePatterns[i].exactMatch(filename))
+            {
+                return false;
+            }
+        }
+
+        if (!needsFileInfo())
+        {
+            return true;
+        }
+
+        if (record.size < 0 || record.lastModified < 0)
+        {
+            FileStatus status = fileSystem->stat(filename);
+            if (!status.exists)
+            {
+                return false;
+            }
+            record = FileRecord(record.category, status);
+        }
+
+        return (m_minSize < 0 || record.size >= m_minSize) &&
+               (m_maxSize < 0 || record.size <= m_maxSize) &&
+               (m_minModified < 0 || record.lastModified >= m_minModified) &&
+               (m_maxModified < 0 || record.lastModified <= m_maxModified);
+    }
+
+    /**
+     * Marks the query unsatisfiable if a size or time range is empty.
+     */
+    void ProjectQuery::updateUnsatisfiable()
+    {
+        if ((m_minSize >= 0 && m_maxSize >= 0 && m_minSize > m_maxSize) ||
+            (m_minModified >= 0 && m_maxModified >= 0 && m_minModified > m_maxModified))
+        {
+            m_unsatisfiable = true;
+        }
+    }
+}
@@ -0,0 +1,162 @@
+/**
+ * @file ProjectQuery.h
+ *
+ * Filtering project files by category, location and file information.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef PROJECTQUERY_H
+#define PROJECTQUERY_H
+
+#include "../global.h"
+#include "Project.h"
+#include <QDateTime>
+#include <QList>
+#include <QRegExp>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+namespace Required
+{
+    /**
+     * Filtering project files by category, location and file information.
+     *
+     * A query is built by chaining conditions, all of which must hold:
+     *
+     * @code
+     * QStringList files = ProjectQuery().inCategory("images")
+     *                                   .underDirectory("/data/textures")
+     *                                   .largerThan(1024 * 1024)
+     *                                   .modifiedAfter(lastBuild)
+     *                                   .run(project);
+     * @endcode
+     *
+     * Conditions are merged as they are added, e.g. two size limits become
+     * one range, so a query is checked against every file only once and
+     * contradicting conditions are detected before any file is visited.
+     *
+     * Instead of visiting all files, the query starts from the project
+     * indexes: a directory is a contiguous range of the path-sorted file
+     * index, and a category is a single group of the category index.
+     * Sizes and modification times come from the file records kept by the
+     * project; only files added without them are stat()ed. Large sets of
+     * candidates are checked in parallel, by normal priority tasks of the
+     * default TaskScheduler.
+     */
+    class REQUIRED_EXPORT ProjectQuery
+    {
+    public:
+        ProjectQuery();
+
+        ProjectQuery& inCategory(QString categoryShortName);
+        ProjectQuery& underDirectory(QString path);
+        ProjectQuery& matchingFilename(QRegExp filenameRegexp);
+        ProjectQuery& largerThan(qint64 size);
+        ProjectQuery& smallerThan(qint64 size);
+        ProjectQuery& modifiedAfter(QDateTime time);
+        ProjectQuery& modifiedBefore(QDateTime time);
+
+        /**
+         * Checks whether the conditions contradict each other.
+         *
+         * @return true if no file can match the query
+         */
+        bool isUnsatisfiable() const
+        {
+            return m_unsatisfiable;
+        }
+
+        /**
+         * Returns the number of candidates above which files are checked in
+         * parallel.
+         *
+         * @return candidate count
+         */
+        int getParallelThreshold() const
+        {
+            return m_parallelThreshold;
+        }
+
+        /**
+         * Sets the number of candidates above which files are checked in
+         * parallel.
+         *
+         * @param threshold candidate count
+         */
+        void setParallelThreshold(int threshold)
+        {
+            m_parallelThreshold = qMax(1, threshold);
+        }
+
+        QStringList run(const Project& project) const;
+
+    private:
+        class Evaluator;
+
+        /**
+         * Accepted categories; empty if any category is accepted.
+         */
+        QSet<QString> m_categories;
+
+        /**
+         * Absolute path of the directory files must be in, with a trailing
+         * separator; empty if files may be anywhere.
+         */
+        QString m_directory;
+
+        /**
+         * Patterns all absolute file paths must match.
+         */
+        QList<QRegExp> m_filenamePatterns;
+
+        /**
+         * Smallest accepted file size in bytes, -1 if there is no limit.
+         */
+        qint64 m_minSize;
+
+        /**
+         * Largest accepted file size in bytes, -1 if there is no limit.
+         */
+        qint64 m_maxSize;
+
+        /**
+         * Earliest accepted modification time in ms since the epoch, -1 if
+         * there is no limit.
+         */
+        qint64 m_minModified;
+
+        /**
+         * Latest accepted modification time in ms since the epoch, -1 if
+         * there is no limit.
+         */
+        qint64 m_maxModified;
+
+        /**
+         * Set when the conditions contradict each other.
+         */
+        bool m_unsatisfiable;
+
+        /**
+         * Number of candidates above which files are checked in parallel.
+         */
+        int m_parallelThreshold;
+
+        bool needsFileInfo() const;
+        bool matches(const QString& filename, FileRecord record,
+                     QList<QRegExp>& filenamePatterns, FileSystem* fileSystem) const;
+        void updateUnsatisfiable();
+    };
+}
+
+#endif // PROJECTQUERY_H
@@ -16,23 +16,421 @@
  */
 
 #include "ProjectSerializer.h"
+#include "CompressedDevice.h"
 #include "FileCategory.h"
 #include "ProjectException.h"
+#include "TaskScheduler.h"
+#include <QBuffer>
 #include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
 #include <QRegExp>
 #include <QStringList>
+#include <QThread>
+#include <QUrl>
 #include <QXmlStreamAttributes>
+#include <cstring>
 
 namespace Required
 {
+    namespace
+    {
+        /**
+         * Size of the output buffer used by the fast writer.
+         */
+        const int FastWriterBufferSize = 4 * 1024 * 1024;
+
+        /**
+         * Maximum number of files written in a row with shared path prefixes.
+         *
+         * Every run starts with a full path, so that a document can be
+         * split into independently parsable chunks.
+         */
+        const int DeltaRestartInterval = 1024;
+
+        /**
+         * Returns the length of the common prefix of two paths.
+         *
+         * The prefix never ends in the middle of a surrogate pair, so that
+         * the rest of the path is valid text on its own.
+         */
+        int sharedPrefixLength(const PathHandle& previousPath, const PathHandle& path)
+        {
+            int length = qMin(previousPath.size(), path.size());
+            const QChar* left = previousPath.constData();
+            const QChar* right = path.constData();
+            int i = 0;
+            while (i < length && left[i] == right[i])
+            {
+                ++i;
+            }
+            if (i > 0 && left[i - 1].isHighSurrogate())
+            {
+                --i;
+            }
+
+            return i;
+        }
+
+        /**
+         * Reconstructs the stored path of a <file> element.
+         *
+         * @param attributes attributes of the element
+         * @param previousPath path of the preceding file, receives this path
+         * @return path relative to the project root (or absolute)
+         */
+        QString decodeFilePath(const QXmlStreamAttributes& attributes, QString& previousPath)
+        {
+            QString path = attributes.value("path").toString();
+            if (attributes.hasAttribute("shared"))
+            {
+                int shared = attributes.value("shared").toString().toInt();
+                path.prepend(previousPath.left(shared));
+            }
+            previousPath = path;
+
+            return path;
+        }
+
+        /**
+         * Groups stored paths of all files by their categories.
+         *
+         * @param snapshot the project snapshot
+         * @return mapping of category short names to sorted stored paths
+         */
+        QMap<QString, QList<PathHandle> > groupStoredPaths(const ProjectSnapshot& snapshot)
+        {
+            QMap<QString, QList<PathHandle> > files;
+            const PersistentMap<PathHandle, FileRecord>& index = snapshot.getFileIndex();
+            PersistentMap<PathHandle, FileRecord>::const_iterator it;
+            for (it = index.constBegin(); it != index.constEnd(); ++it)
+            {
+                files[it.value().category].append(it.key());
+            }
+
+            return files;
+        }
+
+        /**
+         * Escapes text for use in XML character data or attribute values.
+         *
+         * @param text unescaped text
+         * @return escaped text encoded in UTF-8
+         */
+        QByteArray escapeXml(const QString& text)
+        {
+            QString escaped;
+            escaped.reserve(text.size() + 16);
+            foreach (QChar c, text)
+            {
+                switch (c.unicode())
+                {
+                case '<':
+                    escaped += "&lt;";
+                    break;
+                case '>':
+                    escaped += "&gt;";
+                    break;
+                case '&':
+                    escaped += "&amp;";
+                    break;
+                case '"':
+                    escaped += "&quot;";
+                    break;
+                case '\t':
+                    escaped += "&#9;";
+                    break;
+                case '\n':
+                    escaped += "&#10;";
+                    break;
+                case '\r':
+                    escaped += "&#13;";
+                    break;
+                default:
+                    escaped += c;
+                }
+            }
+
+            return escaped.toUtf8();
+        }
+
+        /**
+         * A minimal buffered XML writer.
+         *
+         * The caller is responsible for the document structure; this class
+         * only buffers output and escapes text. Text made of plain ASCII
+         * without any markup characters - which is what nearly all paths
+         * look like - is copied straight into the buffer.
+         */
+        class FastXmlWriter
+        {
+        public:
+            explicit FastXmlWriter(QIODevice* device):
+                m_device(device), m_buffer(FastWriterBufferSize, Qt::Uninitialized),
+                m_used(0), m_flushed(device->isSequential() ? 0 : device->pos()),
+                m_failed(false)
+            {
+            }
+
+            ~FastXmlWriter()
+            {
+                flush();
+            }
+
+            /**
+             * Returns the device position the next byte will be written at.
+             */
+            qint64 position() const
+            {
+                return m_flushed + m_used;
+            }
+
+            /**
+             * Checks whether writing to the device failed.
+             */
+            bool hasError() const
+            {
+                return m_failed;
+            }
+
+            void write(const char* data, int size)
+            {
+                if (m_used + size > m_buffer.size())
+                {
+                    flush();
+                    if (size > m_buffer.size())
+                    {
+                        m_failed = m_failed || m_device->write(data, size) != size;
+                        m_flushed += size;
+                        return;
+                    }
+                }
+                std::memcpy(m_buffer.data() + m_used, data, size);
+                m_used += size;
+            }
+
+            void write(const char* text)
+            {
+                write(text, qstrlen(text));
+            }
+
+            void write(const QByteArray& data)
+            {
+                write(data.constData(), data.size());
+            }
+
+            void writeNumber(int number)
+            {
+                char digits[16];
+                int start = sizeof(digits);
+                do
+                {
+                    digits[--start] = '0' + number % 10;
+                    number /= 10;
+                }
+                while (number > 0);
+                write(digits + start, sizeof(digits) - start);
+            }
+
+            void writeEscaped(const QString& text)
+            {
+                writeEscaped(text.constData(), text.size());
+            }
+
+            void writeEscaped(const QChar* text, int size)
+            {
+                // try the fast path first, each character becomes one byte
+                if (m_used + size > m_buffer.size())
+                {
+                    flush();
+                }
+                if (size <= m_buffer.size())
+                {
+                    const ushort* chars = reinterpret_cast<const ushort*>(text);
+                    char* out = m_buffer.data() + m_used;
+                    int i = 0;
+                    for (; i < size; ++i)
+                    {
+                        ushort c = chars[i];
+                        if (c >= 0x80 || c < 0x20 || c == '<' || c == '>' ||
+                            c == '&' || c == '"')
+                        {
+                            break;
+                        }
+                        out[i] = char(c);
+                    }
+                    if (i == size)
+                    {
+                        m_used += size;
+                        return;
+                    }
+                }
+
+                write(escapeXml(QString::fromRawData(text, size)));
+            }
+
+            void flush()
+            {
+                if (m_used > 0)
+                {
+                    m_failed = m_failed || m_device->write(m_buffer.constData(), m_used) != m_used;
+                    m_flushed += m_used;
+                    m_used = 0;
+                }
+            }
+
+        private:
+            QIODevice* m_device;
+            QByteArray m_buffer;
+            int m_used;
+            qint64 m_flushed;
+            bool m_failed;
+        };
+
+        /**
+         * Parses a chunk of <file> elements on a worker thread.
+         *
+         * The chunk is validated the same way Project::addFile() would do it;
+         * any problem just marks the chunk as failed, since the caller falls
+         * back to sequential parsing to report errors. All files of the chunk
+         * are looked up in the file system as one batch after parsing.
+         */
+        class FileChunkParser : public ScheduledTask
+        {
+        public:
+            FileChunkParser(const char* data, int size, QString rootPath,
+                            FileSystem* fileSystem):
+                ScheduledTask(TaskScheduler::Normal), m_data(data), m_size(size), m_rootPath(rootPath),
+                m_fileSystem(fileSystem), m_failed(false)
+            {
+                setAutoDelete(false);
+            }
+
+            void run()
+            {
+                QByteArray document;
+                document.reserve(m_size + 16);
+                document.append("<files>");
+                document.append(m_data, m_size);
+                document.append("</files>");
+
+                // files are direct children of the wrapper or of a <category>
+                // group, anything nested in unknown elements is skipped like
+                // in readFilesElement
+                QXmlStreamReader reader(document);
+                int depth = 0;
+                bool inGroup = false;
+                QString groupCategory;
+                QString previousPath;
+                while (!reader.atEnd())
+                {
+                    reader.readNext();
+                    if (reader.isStartElement())
+                    {
+                        ++depth;
+                        if (depth == 2 && reader.name() == "category")
+                        {
+                            inGroup = true;
+                            groupCategory = reader.attributes().value("short-name").toString();
+                        }
+                        else if (depth == 2)
+                        {
+                            inGroup = false;
+                        }
+
+                        bool isFile = reader.name() == "file" &&
+                            (depth == 2 || (depth == 3 && inGroup));
+                        if (isFile && !readFile(reader, depth == 3 ? groupCategory : QString(),
+                                                previousPath))
+                        {
+                            m_failed = true;
+                            return;
+                        }
+                    }
+                    else if (reader.isEndElement())
+                    {
+                        --depth;
+                    }
+                }
+                if (reader.hasError())
+                {
+                    m_failed = true;
+                    return;
+                }
+
+                // stat() on the worker, so the project doesn't have to
+                FileStatusList statuses = m_fileSystem->statFiles(m_paths);
+                m_files.reserve(m_paths.size());
+                for (int i = 0; i < m_paths.size(); ++i)
+                {
+                    if (!statuses.at(i).exists)
+                    {
+                        m_failed = true;
+                        return;
+                    }
+                    m_files.append(qMakePair(m_paths.at(i),
+                                             FileRecord(m_categories.at(i), statuses.at(i))));
+                }
+            }
+
+            bool hasFailed() const
+            {
+                return m_failed;
+            }
+
+            const RecordedFileList& getFiles() const
+            {
+                return m_files;
+            }
+
+        private:
+            bool readFile(QXmlStreamReader& reader, const QString& groupCategory,
+                          QString& previousPath)
+            {
+                QXmlStreamAttributes attributes = reader.attributes();
+                if (!attributes.hasAttribute("path"))
+                {
+                    return false;
+                }
+
+                QString path = Project::toAbsolutePath(m_rootPath,
+                                                       decodeFilePath(attributes, previousPath));
+                QString categoryShortName = attributes.hasAttribute("category") ?
+                    attributes.value("category").toString() : groupCategory;
+                if (categoryShortName.isEmpty())
+                {
+                    categoryShortName = FileCategory::getCategoryForFilename(path).getShortName();
+                }
+                m_paths.append(path);
+                m_categories.append(categoryShortName);
+                return true;
+            }
+
+            const char* m_data;
+            int m_size;
+            QString m_rootPath;
+            FileSystem* m_fileSystem;
+            bool m_failed;
+            QStringList m_paths;
+            QStringList m_categories;
+            RecordedFileList m_files;
+        };
+    }
+
     /**
      * Creates the serializer.
      *
      * @param device the device which will receive project data
      */
     ProjectSerializer::ProjectSerializer(QIODevice *device):
-        m_device(device)
+        m_device(device), m_options(NoOptions), m_fileSystem(FileSystem::getDefault())
     {
+        QFile* file = qobject_cast<QFile*>(device);
+        if (file && !file->fileName().isEmpty())
+        {
+            m_documentDirectory = QFileInfo(*file).absolutePath();
+        }
     }
 
     /**
@@ -42,6 +440,60 @@ namespace Required
     {
     }
 
+    /**
+     * Creates a serializer for a device wrapping or buffering this one.
+     *
+     * The document directory and the file system are inherited, so that
+     * the project root and files are resolved the same way.
+     *
+     * @param device the wrapping device
+     * @return serializer with no options set
+     */
+    ProjectSerializer ProjectSerializer::nested(QIODevice* device) const
+    {
+        ProjectSerializer serializer(device);
+        serializer.m_documentDirectory = m_documentDirectory;
+        serializer.m_fileSystem = m_fileSystem;
+        return serializer;
+    }
+
+    /**
+     * Converts the project root to the form stored in the document.
+     *
+     * @param rootPath absolute path of the root, may be empty
+     * @return the root relative to the document directory, if known
+     */
+    QString ProjectSerializer::encodeRootPath(QString rootPath) const
+    {
+        if (rootPath.isEmpty() || m_documentDirectory.isEmpty())
+        {
+            return rootPath;
+        }
+
+        QString relativePath = QDir(m_documentDirectory).relativeFilePath(rootPath);
+        return relativePath.isEmpty() ? QString(".") : relativePath;
+    }
+
+    /**
+     * Converts the project root stored in the document to an absolute path.
+     *
+     * A relative root is resolved against the document directory, or the
+     * current directory if the device is not a file.
+     *
+     * @param rootPath root as stored in the document, may be empty
+     * @return absolute path of the root
+     */
+    QString ProjectSerializer::decodeRootPath(QString rootPath) const
+    {
+        if (rootPath.isEmpty() || QDir::isAbsolutePath(rootPath))
+        {
+            return rootPath.isEmpty() ? rootPath : QDir::cleanPath(rootPath);
+        }
+
+        QString base = m_documentDirectory.isEmpty() ? QDir::currentPath() : m_documentDirectory;
+        return QDir::cleanPath(base + "/" + rootPath);
+    }
+
     /**
      * Handles the serialization.
      *
@@ -49,17 +501,77 @@ namespace Required
      */
     void ProjectSerializer::serialize(const Project &project)
     {
+        serialize(project.snapshot());
+    }
+
+    /**
+     * Serializes a project snapshot.
+     *
+     * Since a snapshot is unaffected by later changes to the project, this
+     * may run in a background thread while the project is being modified.
+     * A ProjectException is thrown if the document can't be written,
+     * including errors the compression pipeline reports when it's closed.
+     *
+     * @param snapshot the snapshot to serialize
+     */
+    void ProjectSerializer::serialize(const ProjectSnapshot &snapshot)
+    {
+        if (m_options & Compressed)
+        {
+            // write the plain document through a compressing adapter
+            CompressedDevice compressed(m_device);
+            if (!compressed.open(QIODevice::WriteOnly))
+            {
+                throw ProjectException(compressed.errorString());
+            }
+            Options options = m_options;
+            options &= ~Compressed;
+            ProjectSerializer serializer = nested(&compressed);
+            serializer.setOptions(options);
+            serializer.serialize(snapshot);
+            // the last chunks are only compressed and written by close()
+            compressed.close();
+            if (!compressed.getPipelineError().isEmpty())
+            {
+                throw ProjectException(compressed.getPipelineError());
+            }
+            return;
+        }
+        if (m_options & FastWriter)
+        {
+            serializeFast(snapshot);
+            return;
+        }
+
         QXmlStreamWriter writer(m_device);
         writer.setAutoFormatting(true);
         writer.writeStartDocument();
         writer.writeStartElement("project");
-        writer.writeAttribute("name", project.getName());
+        writer.writeAttribute("name", snapshot.getName());
 
-        serializeMetadata(project, writer);
-        serializeFiles(project, writer);
+        SectionIndex index;
+        index.name = snapshot.getName();
+        index.rootPath = encodeRootPath(snapshot.getRootPath());
+        if (!index.rootPath.isEmpty())
+        {
+            writer.writeAttribute("root", index.rootPath);
+        }
+
+        serializeMetadata(snapshot, writer, index);
+        serializeFiles(snapshot, writer, index);
 
         writer.writeEndElement();
         writer.writeEndDocument();
+        if (writer.hasError())
+        {
+            throw ProjectException(m_device->errorString());
+        }
+
+        // offsets are meaningless if the device can't be read back with seek()
+        if (!m_device->isSequential())
+        {
+            writeSectionIndex(index);
+        }
     }
 
     /**
@@ -72,6 +584,13 @@ namespace Required
      */
     Project* ProjectSerializer::deserialize()
     {
+        if (CompressedDevice::isCompressed(m_device))
+        {
+            CompressedDevice compressed(m_device);
+            compressed.open(QIODevice::ReadOnly);
+            return nested(&compressed).deserialize();
+        }
+
         Project* project = 0;
 
         QXmlStreamReader reader(m_device);
@@ -83,6 +602,7 @@ namespace Required
                 if (reader.name() == "project")
                 {
                     project = new Project();
+                    project->setFileSystem(m_fileSystem);
                     readProjectElement(*project, reader);
                 }
                 else
@@ -97,30 +617,369 @@ namespace Required
         }
         if (reader.hasError())
         {
-            QString msg = QObject::tr("Parse error at line %1, column %2: %3")
-                          .arg(reader.lineNumber())
-                          .arg(reader.columnNumber())
-                          .arg(reader.errorString());
-            throw ProjectException(msg);
+            throwParseError(reader);
         }
 
         return project;
     }
 
+    /**
+     * Deserializes project from XML, parsing files on multiple threads.
+     *
+     * The document is read into memory and the contents of <files> are cut
+     * into chunks at element boundaries. The rest of the document is parsed
+     * as usual, the chunks are parsed in parallel by normal priority tasks
+     * of the default TaskScheduler, and their files are then inserted into
+     * the project in one batch.
+     *
+     * Whenever something goes wrong - a parse error, a missing file, or
+     * content that can't be split safely (comments, CDATA, nested elements)
+     * - the whole document is parsed again sequentially, so errors are
+     * reported exactly like deserialize() reports them.
+     *
+     * @param threadCount number of chunks parsed in parallel, 0 for one per core
+     * @return a properly set up project instance
+     */
+    Project* ProjectSerializer::deserializeParallel(int threadCount)
+    {
+        if (threadCount <= 0)
+        {
+            threadCount = QThread::idealThreadCount();
+        }
+
+        if (CompressedDevice::isCompressed(m_device))
+        {
+            // decompression overlaps with reading the data into memory
+            CompressedDevice compressed(m_device);
+            compressed.open(QIODevice::ReadOnly);
+            return nested(&compressed).deserializeParallel(threadCount);
+        }
+
+        QByteArray data = m_device->readAll();
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+        ProjectSerializer sequential = nested(&buffer);
+
+        // locate the contents of the <files> element
+        int filesStart = data.indexOf("<files>");
+        int contentStart = filesStart + 7;
+        int contentEnd = data.lastIndexOf("</files>");
+        if (threadCount < 2 || filesStart < 0 || contentEnd < contentStart)
+        {
+            return sequential.deserialize();
+        }
+
+        // '<' can't appear unescaped in attribute values or text, so outside
+        // of comments, CDATA and processing instructions every '<' starts
+        // a tag; with those excluded, chunks can be found by plain search
+        QByteArray content = QByteArray::fromRawData(data.constData() + contentStart,
+                                                     contentEnd - contentStart);
+        if (content.contains("<!--") || content.contains("<![CDATA[") ||
+            content.contains("<?") || content.contains("</file>"))
+        {
+            return sequential.deserialize();
+        }
+
+        // parse everything except the files first; this registers the
+        // categories which the workers need for filename-based lookup
+        Project* project = 0;
+        try
+        {
+            QByteArray skeleton = data.left(contentStart) + data.mid(contentEnd);
+            QBuffer skeletonBuffer(&skeleton);
+            skeletonBuffer.open(QIODevice::ReadOnly);
+            project = nested(&skeletonBuffer).deserialize();
+        }
+        catch (ProjectException&)
+        {
+            project = 0;
+        }
+        if (!project)
+        {
+            return sequential.deserialize();
+        }
+
+        // grouped documents can only be split between groups, since every
+        // chunk must know the category of its files
+        const char* chunkTag = content.contains("<category") ? "<category" : "<file";
+        QList<int> boundaries = findChunkBoundaries(data, contentStart, contentEnd,
+                                                    threadCount, chunkTag);
+        QList<FileChunkParser*> parsers;
+        for (int i = 0; i + 1 < boundaries.size(); ++i)
+        {
+            parsers.append(new FileChunkParser(data.constData() + boundaries[i],
+                                               boundaries[i + 1] - boundaries[i],
+                                               project->getRootPath(), m_fileSystem));
+        }
+
+        TaskScheduler* scheduler = TaskScheduler::getDefault();
+        QList<int> ids;
+        foreach (FileChunkParser* parser, parsers)
+        {
+            ids.append(scheduler->schedule(parser));
+        }
+        foreach (int id, ids)
+        {
+            scheduler->waitFor(id);
+        }
+
+        bool failed = false;
+        foreach (FileChunkParser* parser, parsers)
+        {
+            failed = failed || parser->hasFailed();
+        }
+        if (!failed)
+        {
+            int fileCount = 0;
+            foreach (FileChunkParser* parser, parsers)
+            {
+                fileCount += parser->getFiles().size();
+            }
+            RecordedFileList files;
+            files.reserve(fileCount);
+            foreach (FileChunkParser* parser, parsers)
+            {
+                files.append(parser->getFiles());
+            }
+            project->insertFiles(files);
+        }
+        qDeleteAll(parsers);
+
+        if (failed)
+        {
+            delete project;
+            return sequential.deserialize();
+        }
+
+        return project;
+    }
+
+    /**
+     * Reads project name and categories without loading any files.
+     *
+     * If the document has a section index, only the metadata section is
+     * read. Otherwise the document is parsed from the beginning up to the
+     * end of the metadata. Categories are registered just like when
+     * deserializing the whole project.
+     *
+     * @return project metadata
+     */
+    ProjectMetadata ProjectSerializer::readMetadataOnly()
+    {
+        if (!m_device->isSequential())
+        {
+            m_device->seek(0);
+        }
+        if (CompressedDevice::isCompressed(m_device))
+        {
+            CompressedDevice compressed(m_device);
+            compressed.open(QIODevice::ReadOnly);
+            return nested(&compressed).readMetadataOnly();
+        }
+
+        ProjectMetadata metadata;
+        SectionIndex index;
+        if (!readSectionIndex(index))
+        {
+            scanDocument(&metadata, QString(), 0);
+            return metadata;
+        }
+
+        metadata.name = index.name;
+        metadata.rootPath = decodeRootPath(index.rootPath);
+        QXmlStreamReader reader(readSection(index.metadata));
+        readCategoryList(reader, metadata.categories);
+        if (reader.hasError())
+        {
+            throwParseError(reader);
+        }
+
+        return metadata;
+    }
+
+    /**
+     * Reads paths of all files in one category.
+     *
+     * If the document has a section index, only the files of that category
+     * are read. Otherwise the whole document has to be parsed. Files are not
+     * checked for existence.
+     *
+     * @param categoryShortName internal category identifier
+     * @return files in that category
+     */
+    QStringList ProjectSerializer::loadCategory(QString categoryShortName)
+    {
+        if (!m_device->isSequential())
+        {
+            m_device->seek(0);
+        }
+        if (CompressedDevice::isCompressed(m_device))
+        {
+            CompressedDevice compressed(m_device);
+            compressed.open(QIODevice::ReadOnly);
+            return nested(&compressed).loadCategory(categoryShortName);
+        }
+
+        QStringList files;
+        SectionIndex index;
+        if (!readSectionIndex(index))
+        {
+            scanDocument(0, categoryShortName, &files);
+            return files;
+        }
+
+        if (!index.categories.contains(categoryShortName))
+        {
+            return files;
+        }
+
+        // the section is a sequence of <file> elements or a single group of
+        // them, wrap it to get a well-formed document
+        QByteArray section = readSection(index.categories[categoryShortName]);
+        QXmlStreamReader reader("<files>" + section + "</files>");
+        QString rootPath = decodeRootPath(index.rootPath);
+        QString previousPath;
+        while (!reader.atEnd())
+        {
+            reader.readNext();
+            if (reader.isStartElement() && reader.name() == "file")
+            {
+                if (!hasRequiredAttribute(reader, "path"))
+                {
+                    break;
+                }
+                QString path = decodeFilePath(reader.attributes(), previousPath);
+                files.append(Project::toAbsolutePath(rootPath, path));
+            }
+        }
+        if (reader.hasError())
+        {
+            throwParseError(reader);
+        }
+
+        return files;
+    }
+
+    /**
+     * Serializes a project snapshot with the buffered writer.
+     *
+     * Produces the same document as QXmlStreamWriter with auto-formatting.
+     * Output is collected in a large buffer and written in few big blocks,
+     * and the category part of <file> elements is escaped only once per
+     * category.
+     *
+     * @param snapshot the snapshot to serialize
+     */
+    void ProjectSerializer::serializeFast(const ProjectSnapshot &snapshot)
+    {
+        SectionIndex index;
+        index.name = snapshot.getName();
+        index.rootPath = encodeRootPath(snapshot.getRootPath());
+        bool grouped = m_options & GroupFilesByCategory;
+
+        FastXmlWriter writer(m_device);
+        writer.write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<project name=\"");
+        writer.writeEscaped(snapshot.getName());
+        if (!index.rootPath.isEmpty())
+        {
+            writer.write("\" root=\"");
+            writer.writeEscaped(index.rootPath);
+        }
+        writer.write("\">\n");
+
+        index.metadata.first = writer.position();
+        writer.write("    <metadata>\n        <categories>\n");
+        FileCategoryList categories = snapshot.getCategories();
+        for (int i = 0; i < categories.size(); ++i)
+        {
+            const FileCategory& category = categories.at(i);
+            writer.write("            <category short-name=\"");
+            writer.writeEscaped(category.getShortName());
+            writer.write("\" filename-regexp=\"");
+            writer.writeEscaped(category.getFilenameRegexp().pattern());
+            writer.write("\">");
+            writer.writeEscaped(category.getDisplayedName());
+            writer.write("</category>\n");
+        }
+        writer.write("        </categories>\n    </metadata>\n");
+        index.metadata.second = writer.position();
+
+        writer.write("    <files>\n");
+        QMap<QString, QList<PathHandle> > filesByCategory = groupStoredPaths(snapshot);
+        QMap<QString, QList<PathHandle> >::const_iterator it;
+        for (it = filesByCategory.constBegin(); it != filesByCategory.constEnd(); ++it)
+        {
+            qint64 start = writer.position();
+            QByteArray filePrefix;
+            if (grouped)
+            {
+                writer.write("        <category short-name=\"" + escapeXml(it.key()) + "\">\n");
+                filePrefix = "            <file ";
+            }
+            else
+            {
+                filePrefix = "        <file category=\"" + escapeXml(it.key()) + "\" ";
+            }
+
+            const QList<PathHandle>& files = it.value();
+            for (int i = 0; i < files.size(); ++i)
+            {
+                int shared = 0;
+                if (i % DeltaRestartInterval != 0)
+                {
+                    shared = sharedPrefixLength(files.at(i - 1), files.at(i));
+                }
+
+                writer.write(filePrefix);
+                if (shared > 0)
+                {
+                    writer.write("shared=\"");
+                    writer.writeNumber(shared);
+                    writer.write("\" ");
+                }
+                writer.write("path=\"");
+                writer.writeEscaped(files.at(i).constData() + shared, files.at(i).size() - shared);
+                writer.write("\"/>\n");
+            }
+
+            if (grouped)
+            {
+                writer.write("        </category>\n");
+            }
+            index.categories.insert(it.key(), qMakePair(start, writer.position()));
+        }
+        writer.write("    </files>\n</project>\n");
+        writer.flush();
+        if (writer.hasError())
+        {
+            throw ProjectException(m_device->errorString());
+        }
+
+        if (!m_device->isSequential())
+        {
+            writeSectionIndex(index);
+        }
+    }
+
     /**
      * Serializes only the project metadata.
      *
-     * @param project the project to serialize
+     * @param snapshot the project snapshot to serialize
      * @param writer XML stream writer
+     * @param index receives the offsets of the metadata section
      */
-    void ProjectSerializer::serializeMetadata(const Project &project,
-                                              QXmlStreamWriter &writer)
+    void ProjectSerializer::serializeMetadata(const ProjectSnapshot &snapshot,
+                                              QXmlStreamWriter &writer,
+                                              SectionIndex &index)
     {
+        // QXmlStreamWriter writes straight through to the device, so its
+        // position marks the section boundaries
+        index.metadata.first = m_device->pos();
         writer.writeStartElement("metadata");
 
         writer.writeStartElement("categories");
-        FileCategoryList categories = project.getCategories();
-        foreach (FileCategory category, categories)
+        FileCategoryList categories = snapshot.getCategories();
+        foreach (const FileCategory& category, categories)
         {
             writer.writeStartElement("category");
             writer.writeAttribute("short-name", category.getShortName());
@@ -132,30 +991,61 @@ namespace Required
         writer.writeEndElement();
 
         writer.writeEndElement();
+        index.metadata.second = m_device->pos();
     }
 
     /**
      * Serializes only project files to the writer.
      *
-     * @param project the project to serialize
+     * @param snapshot the project snapshot to serialize
      * @param writer XML stream writer
+     * @param index receives the offsets of files of every category
      */
-    void ProjectSerializer::serializeFiles(const Project &project,
-                                           QXmlStreamWriter &writer)
+    void ProjectSerializer::serializeFiles(const ProjectSnapshot &snapshot,
+                                           QXmlStreamWriter &writer,
+                                           SectionIndex &index)
     {
         writer.writeStartElement("files");
+        bool grouped = m_options & GroupFilesByCategory;
 
-        QStringList categoryShortNames = project.getCategoryShortNames();
-        foreach (QString shortName, categoryShortNames)
+        // one pass over the snapshot instead of a scan per category
+        QMap<QString, QList<PathHandle> > filesByCategory = groupStoredPaths(snapshot);
+        QMap<QString, QList<PathHandle> >::const_iterator it;
+        for (it = filesByCategory.constBegin(); it != filesByCategory.constEnd(); ++it)
         {
-            QStringList files = project.getFilesInCategory(shortName);
-            foreach (QString filename, files)
+            qint64 start = m_device->pos();
+            if (grouped)
             {
+                writer.writeStartElement("category");
+                writer.writeAttribute("short-name", it.key());
+            }
+            const QList<PathHandle>& files = it.value();
+            for (int i = 0; i < files.size(); ++i)
+            {
+                int shared = 0;
+                if (i % DeltaRestartInterval != 0)
+                {
+                    shared = sharedPrefixLength(files.at(i - 1), files.at(i));
+                }
+
                 writer.writeStartElement("file");
-                writer.writeAttribute("category", shortName);
-                writer.writeAttribute("path", filename);
+                if (!grouped)
+                {
+                    writer.writeAttribute("category", it.key());
+                }
+                if (shared > 0)
+                {
+                    writer.writeAttribute("shared", QString::number(shared));
+                }
+                writer.writeAttribute("path", QString(files.at(i).constData() + shared,
+                                                      files.at(i).size() - shared));
+                writer.writeEndElement();
+            }
+            if (grouped)
+            {
                 writer.writeEndElement();
             }
+            index.categories.insert(it.key(), qMakePair(start, m_device->pos()));
         }
 
         writer.writeEndElement();
@@ -174,6 +1064,7 @@ namespace Required
             return;
 
         project.setName(reader.attributes().value("name").toString());
+        project.setRootPath(decodeRootPath(reader.attributes().value("root").toString()));
 
         reader.readNext();
         while (!reader.atEnd())
@@ -311,6 +1202,53 @@ namespace Required
     void ProjectSerializer::readFilesElement(Project &project,
                                              QXmlStreamReader &reader)
     {
+        QString previousPath;
+        reader.readNext();
+        while (!reader.atEnd())
+        {
+            if (reader.isEndElement())
+            {
+                reader.readNext();
+                break;
+            }
+            if (reader.isStartElement())
+            {
+                if (reader.name() == "file")
+                {
+                    readFileElement(project, reader, previousPath);
+                }
+                else if (reader.name() == "category")
+                {
+                    readFileGroupElement(project, reader, previousPath);
+                }
+                else
+                {
+                    skipUnknownElement(reader);
+                }
+            }
+            else
+            {
+                reader.readNext();
+            }
+        }
+    }
+
+    /**
+     * Reads the contents of a <category> tag grouping files in <files>.
+     *
+     * @param project the project to deserialize
+     * @param reader XML stream reader
+     * @param previousPath path of the preceding file
+     */
+    void ProjectSerializer::readFileGroupElement(Project &project,
+                                                 QXmlStreamReader &reader,
+                                                 QString &previousPath)
+    {
+        if (!hasRequiredAttribute(reader, "short-name"))
+            return;
+
+        QString categoryShortName = reader.attributes().value("short-name").toString();
+
         reader.readNext();
         while (!reader.atEnd())
         {
@@ -323,7 +1261,7 @@ namespace Required
             {
                 if (reader.name() == "file")
                 {
-                    readFileElement(project, reader);
+                    readFileElement(project, reader, previousPath, categoryShortName);
                 }
                 else
                 {
@@ -342,16 +1280,24 @@ namespace Required
      *
      * @param project the project to deserialize
      * @param reader XML stream reader
+     * @param previousPath path of the preceding file, receives this path
+     * @param groupCategory category of the enclosing group, if any; an
+     *        explicit category attribute takes precedence
      */
     void ProjectSerializer::readFileElement(Project &project,
-                                            QXmlStreamReader &reader)
+                                            QXmlStreamReader &reader,
+                                            QString &previousPath,
+                                            QString groupCategory)
     {
         if (!hasRequiredAttribute(reader, "path"))
             return;
 
-        QString path = reader.attributes().value("path").toString();
-        QString categoryShortName = reader.attributes().value("category").toString();
-        project.addFile(path, categoryShortName);
+        QString path = Project::toAbsolutePath(project.getRootPath(),
+                                               decodeFilePath(reader.attributes(), previousPath));
+        QString categoryShortName = reader.attributes().hasAttribute("category") ?
+            reader.attributes().value("category").toString() : groupCategory;
+        // stored categories were chosen by the lookup as often as by the user
+        project.addFile(path, categoryShortName, false);
 
         reader.readNext();
 
@@ -406,4 +1352,302 @@ namespace Required
 
         return true;
     }
+
+    /**
+     * Writes the section index after the end of the document.
+     *
+     * The index is an XML comment with offsets of all sections, followed by
+     * a fixed-size comment holding the offset of the index itself, so that
+     * readers can find it by looking only at the end of the device.
+     *
+     * @param index offsets collected during serialization
+     */
+    void ProjectSerializer::writeSectionIndex(const SectionIndex &index)
+    {
+        // percent-encode names so that they never contain spaces, colons or
+        // dashes, which would break the comment syntax
+        QByteArray entries = "<!-- required-index name:" +
+            QUrl::toPercentEncoding(index.name, QByteArray(), "-");
+        if (!index.rootPath.isEmpty())
+        {
+            entries += " root:" + QUrl::toPercentEncoding(index.rootPath, QByteArray(), "-");
+        }
+        entries += " metadata:" + QByteArray::number(index.metadata.first) +
+            ":" + QByteArray::number(index.metadata.second);
+
+        QMap<QString, QPair<qint64, qint64> >::const_iterator it;
+        for (it = index.categories.constBegin(); it != index.categories.constEnd(); ++it)
+        {
+            entries += " category:" + QUrl::toPercentEncoding(it.key(), QByteArray(), "-") +
+                ":" + QByteArray::number(it.value().first) +
+                ":" + QByteArray::number(it.value().second);
+        }
+        entries += " -->\n";
+
+        qint64 indexOffset = m_device->pos();
+        m_device->write(entries);
+        m_device->write(QString("<!-- required-index-offset:%1 -->\n")
+                        .arg(indexOffset, 20, 10, QChar('0')).toLatin1());
+    }
+
+    /**
+     * Locates and reads the section index.
+     *
+     * @param index receives the offsets
+     * @return false if the device has no (usable) index
+     */
+    bool ProjectSerializer::readSectionIndex(SectionIndex &index)
+    {
+        if (m_device->isSequential())
+        {
+            return false;
+        }
+
+        qint64 size = m_device->size();
+        qint64 tailStart = qMax<qint64>(0, size - 128);
+        if (!m_device->seek(tailStart))
+        {
+            return false;
+        }
+
+        QRegExp trailer("<!-- required-index-offset:(\\d+) -->\\s*$");
+        if (trailer.indexIn(QString::fromLatin1(m_device->read(size - tailStart))) < 0)
+        {
+            return false;
+        }
+        if (!m_device->seek(trailer.cap(1).toLongLong()))
+        {
+            return false;
+        }
+
+        QByteArray line = m_device->readLine().trimmed();
+        if (!line.startsWith("<!-- required-index ") || !line.endsWith("-->"))
+        {
+            return false;
+        }
+
+        foreach (QByteArray entry, line.split(' '))
+        {
+            QList<QByteArray> fields = entry.split(':');
+            if (fields[0] == "name" && fields.size() == 2)
+            {
+                index.name = QUrl::fromPercentEncoding(fields[1]);
+            }
+            else if (fields[0] == "root" && fields.size() == 2)
+            {
+                index.rootPath = QUrl::fromPercentEncoding(fields[1]);
+            }
+            else if (fields[0] == "metadata" && fields.size() == 3)
+            {
+                index.metadata = qMakePair(fields[1].toLongLong(), fields[2].toLongLong());
+            }
+            else if (fields[0] == "category" && fields.size() == 4)
+            {
+                index.categories.insert(QUrl::fromPercentEncoding(fields[1]),
+                                        qMakePair(fields[2].toLongLong(), fields[3].toLongLong()));
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Reads a byte range of the device, starting at the first tag.
+     *
+     * Section boundaries may include formatting whitespace or the closing
+     * bracket of the preceding start tag; those are skipped.
+     *
+     * @param range start and end offset
+     * @return section contents
+     */
+    QByteArray ProjectSerializer::readSection(QPair<qint64, qint64> range)
+    {
+        if (!m_device->seek(range.first))
+        {
+            throw ProjectException(QObject::tr("Cannot seek to offset %1").arg(range.first));
+        }
+
+        QByteArray section = m_device->read(range.second - range.first);
+        int start = section.indexOf('<');
+        if (start < 0)
+        {
+            return QByteArray();
+        }
+
+        return section.mid(start);
+    }
+
+    /**
+     * Parses the document from the beginning, without an index.
+     *
+     * Used when the document has no section index. Stops after the metadata
+     * when no files are requested.
+     *
+     * @param metadata receives project metadata, may be 0
+     * @param categoryShortName category of files to collect
+     * @param files receives files in the category, may be 0
+     */
+    void ProjectSerializer::scanDocument(ProjectMetadata* metadata,
+                                         QString categoryShortName,
+                                         QStringList* files)
+    {
+        if (!m_device->isSequential())
+        {
+            m_device->seek(0);
+        }
+
+        QXmlStreamReader reader(m_device);
+        bool inFiles = false;
+        QString groupCategory;
+        QString rootPath;
+        QString previousPath;
+        while (!reader.atEnd())
+        {
+            reader.readNext();
+            if (!reader.isStartElement())
+            {
+                continue;
+            }
+
+            if (reader.name() == "files")
+            {
+                inFiles = true;
+            }
+            else if (reader.name() == "category" && inFiles)
+            {
+                groupCategory = reader.attributes().value("short-name").toString();
+            }
+            else if (reader.name() == "project")
+            {
+                rootPath = decodeRootPath(reader.attributes().value("root").toString());
+                if (metadata)
+                {
+                    metadata->name = reader.attributes().value("name").toString();
+                    metadata->rootPath = rootPath;
+                }
+            }
+            else if (reader.name() == "metadata" && metadata)
+            {
+                readCategoryList(reader, metadata->categories);
+                if (!files && !reader.hasError())
+                {
+                    return;
+                }
+            }
+            else if (reader.name() == "file" && files)
+            {
+                // every path has to be decoded, the next one may depend on it
+                QXmlStreamAttributes attributes = reader.attributes();
+                QString path = decodeFilePath(attributes, previousPath);
+                QString category = attributes.hasAttribute("category") ?
+                    attributes.value("category").toString() : groupCategory;
+                if (category == categoryShortName)
+                {
+                    files->append(Project::toAbsolutePath(rootPath, path));
+                }
+            }
+        }
+        if (reader.hasError())
+        {
+            throwParseError(reader);
+        }
+    }
+
+    /**
+     * Reads <category> elements up to the end of <metadata>.
+     *
+     * Every category is registered and appended to the list.
+     *
+     * @param reader XML stream reader positioned inside <metadata>
+     * @param categories receives the categories
+     */
+    void ProjectSerializer::readCategoryList(QXmlStreamReader &reader,
+                                             FileCategoryList &categories)
+    {
+        while (!reader.atEnd())
+        {
+            reader.readNext();
+            if (reader.isEndElement() && reader.name() == "metadata")
+            {
+                break;
+            }
+            if (reader.isStartElement() && reader.name() == "category")
+            {
+                if (!hasRequiredAttribute(reader, "short-name"))
+                {
+                    break;
+                }
+
+                QString shortName = reader.attributes().value("short-name").toString();
+                QString regexpPattern = reader.attributes().value("filename-regexp").toString();
+                QString displayedName = reader.readElementText();
+                FileCategory::registerCategory(shortName, displayedName, QRegExp(regexpPattern));
+                categories.append(FileCategory::getCategory(shortName));
+            }
+        }
+    }
+
+    /**
+     * Throws an exception describing the reader's error.
+     *
+     * @param reader XML stream reader in an error state
+     */
+    void ProjectSerializer::throwParseError(QXmlStreamReader &reader)
+    {
+        QString msg = QObject::tr("Parse error at line %1, column %2: %3")
+                      .arg(reader.lineNumber())
+                      .arg(reader.columnNumber())
+                      .arg(reader.errorString());
+        throw ProjectException(msg);
+    }
+
+    /**
+     * Splits the range of <files> contents into chunks of similar size.
+     *
+     * Every boundary lies right before a start tag, so each chunk consists
+     * of whole elements. A <file> element whose path depends on the
+     * preceding one (see the "shared" attribute) never starts a chunk.
+     *
+     * @param data the whole document
+     * @param start offset of the contents of <files>
+     * @param end offset of </files>
+     * @param chunkCount desired number of chunks
+     * @param startTag beginning of the elements to split between
+     * @return chunk boundaries, including start and end
+     */
+    QList<int> ProjectSerializer::findChunkBoundaries(const QByteArray& data,
+                                                      int start, int end,
+                                                      int chunkCount,
+                                                      const char* startTag)
+    {
+        QList<int> boundaries;
+        boundaries.append(start);
+
+        int chunkSize = (end - start) / chunkCount + 1;
+        for (int i = 1; i < chunkCount; ++i)
+        {
+            int boundary = data.indexOf(startTag, qMax(start + i * chunkSize, boundaries.last() + 1));
+            while (boundary >= 0 && boundary < end)
+            {
+                int tagEnd = data.indexOf('>', boundary);
+                if (tagEnd < 0 ||
+                    !QByteArray::fromRawData(data.constData() + boundary, tagEnd - boundary).contains(" shared="))
+                {
+                    break;
+                }
+                boundary = data.indexOf(startTag, tagEnd);
+            }
+            if (boundary < 0 || boundary >= end)
+            {
+                break;
+            }
+            if (boundary > boundaries.last())
+            {
+                boundaries.append(boundary);
+            }
+        }
+
+        boundaries.append(end);
+        return boundaries;
+    }
 }
@@ -20,23 +20,130 @@
 
 #include "../global.h"
 #include "Project.h"
+#include "ProjectSnapshot.h"
 #include <QIODevice>
+#include <QMap>
+#include <QPair>
+#include <QString>
+#include <QStringList>
 #include <QXmlStreamReader>
 #include <QXmlStreamWriter>
 
 namespace Required
 {
+    /**
+     * Project name and categories, without the list of files.
+     */
+    struct REQUIRED_EXPORT ProjectMetadata
+    {
+        /**
+         * Project name.
+         */
+        QString name;
+
+        /**
+         * Absolute path of the project root, empty if there is none.
+         */
+        QString rootPath;
+
+        /**
+         * Categories used in the project.
+         */
+        FileCategoryList categories;
+    };
+
     /**
      * A class that allows serializing Project objects to XML.
+     *
+     * Serialized projects end with an index (stored in XML comments, so the
+     * document stays valid for any XML reader) which holds byte offsets of
+     * the metadata section and of the files of every category. This allows
+     * readMetadataOnly() and loadCategory() to seek straight to the data
+     * they need instead of parsing the whole document.
+     *
+     * Projects may also be stored gzip-compressed. Compressed documents are
+     * detected automatically when reading; they have no section index.
+     *
+     * With the GroupFilesByCategory option, <file> elements are nested in
+     * a <category> element inside <files> instead of carrying their own
+     * category attribute. Both layouts are understood when reading. The
+     * FastWriter option writes the same document through a large buffer
+     * instead of QXmlStreamWriter, which is considerably faster for big
+     * projects.
+     *
+     * Files are written sorted within every category, with paths relative
+     * to the project root. A <file> element may carry a "shared" attribute,
+     * meaning that its path starts with that many characters of the path
+     * of the preceding file; "path" then holds only the rest. The root is
+     * stored relative to the directory of the document when the device is
+     * a file, so the project tree can be moved together with the document.
      */
     class REQUIRED_EXPORT ProjectSerializer
     {
     public:
+        /**
+         * Serialization options.
+         */
+        enum Option
+        {
+            NoOptions = 0x0,
+            Compressed = 0x1,
+            FastWriter = 0x2,
+            GroupFilesByCategory = 0x4
+        };
+        Q_DECLARE_FLAGS(Options, Option)
+
         explicit ProjectSerializer(QIODevice* device);
         virtual ~ProjectSerializer();
 
+        /**
+         * Returns serialization options.
+         *
+         * @return options
+         */
+        Options getOptions() const
+        {
+            return m_options;
+        }
+
+        /**
+         * Sets serialization options.
+         *
+         * @param options options used by subsequent serialize() calls
+         */
+        void setOptions(Options options)
+        {
+            m_options = options;
+        }
+
+        /**
+         * Returns the file system in which loaded files are looked up.
+         *
+         * @return file system, the local disk by default
+         */
+        FileSystem* getFileSystem() const
+        {
+            return m_fileSystem;
+        }
+
+        /**
+         * Sets the file system in which loaded files are looked up.
+         *
+         * Deserialized projects use this file system as well.
+         *
+         * @param fileSystem file system, 0 for the local disk
+         */
+        void setFileSystem(FileSystem* fileSystem)
+        {
+            m_fileSystem = fileSystem ? fileSystem : FileSystem::getDefault();
+        }
+
         void serialize(const Project& project);
+        void serialize(const ProjectSnapshot& snapshot);
         Project* deserialize();
+        Project* deserializeParallel(int threadCount = 0);
+        ProjectMetadata readMetadataOnly();
+        QStringList loadCategory(QString categoryShortName);
 
     private:
         /**
@@ -44,18 +151,65 @@ namespace Required
          */
         QIODevice* m_device;
 
-        void serializeMetadata(const Project& project, QXmlStreamWriter& writer);
-        void serializeFiles(const Project& project, QXmlStreamWriter& writer);
+        /**
+         * Serialization options.
+         */
+        Options m_options;
+
+        /**
+         * Non-owning pointer to the file system holding project files.
+         */
+        FileSystem* m_fileSystem;
+
+        /**
+         * Directory of the document, if the device is a file.
+         */
+        QString m_documentDirectory;
+
+        /**
+         * Byte offsets of document sections, as stored in the saved index.
+         */
+        struct SectionIndex
+        {
+            QString name;
+            QString rootPath;
+            QPair<qint64, qint64> metadata;
+            QMap<QString, QPair<qint64, qint64> > categories;
+        };
+
+        ProjectSerializer nested(QIODevice* device) const;
+        QString encodeRootPath(QString rootPath) const;
+        QString decodeRootPath(QString rootPath) const;
+        void serializeFast(const ProjectSnapshot& snapshot);
+        void serializeMetadata(const ProjectSnapshot& snapshot, QXmlStreamWriter& writer,
+                               SectionIndex& index);
+        void serializeFiles(const ProjectSnapshot& snapshot, QXmlStreamWriter& writer,
+                            SectionIndex& index);
+        void writeSectionIndex(const SectionIndex& index);
+        bool readSectionIndex(SectionIndex& index);
+        QByteArray readSection(QPair<qint64, qint64> range);
+        void scanDocument(ProjectMetadata* metadata, QString categoryShortName,
+                          QStringList* files);
+        void readCategoryList(QXmlStreamReader& reader, FileCategoryList& categories);
+        static QList<int> findChunkBoundaries(const QByteArray& data, int start,
+                                              int end, int chunkCount,
+                                              const char* startTag);
+        void throwParseError(QXmlStreamReader& reader);
 
         void readProjectElement(Project& project, QXmlStreamReader& reader);
         void readMetadataElement(Project& project, QXmlStreamReader& reader);
         void readCategoriesElement(Project& project, QXmlStreamReader& reader);
         void readCategoryElement(Project& project, QXmlStreamReader& reader);
         void readFilesElement(Project& project, QXmlStreamReader& reader);
-        void readFileElement(Project& project, QXmlStreamReader& reader);
+        void readFileGroupElement(Project& project, QXmlStreamReader& reader,
+                                  QString& previousPath);
+        void readFileElement(Project& project, QXmlStreamReader& reader,
+                             QString& previousPath, QString groupCategory = "");
         void skipUnknownElement(QXmlStreamReader &reader);
         bool hasRequiredAttribute(QXmlStreamReader &reader, QString attributeName);
     };
+
+    Q_DECLARE_OPERATORS_FOR_FLAGS(ProjectSerializer::Options)
 }
 
 #endif // PROJECTSERIALIZER_H
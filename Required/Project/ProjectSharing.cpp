@@ -0,0 +1,1043 @@
+/**
+ * @file ProjectSharing.cpp
+ *
+ * Sharing a project with other local processes through shared memory.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "ProjectSharing.h"
+#include "ProjectSnapshot.h"
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QStandardPaths>
+#include <QUrl>
+#include <cstring>
+
+#if defined(Q_OS_UNIX)
+#  include <cerrno>
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <sys/mman.h>
+#  include <sys/socket.h>
+#  include <sys/stat.h>
+#  include <sys/types.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+#endif
+
+namespace Required
+{
+    namespace
+    {
+        /**
+         * Identifies project images, "RQPI" in little endian byte order.
+         */
+        const quint32 ImageMagic = 0x49505152;
+
+        /**
+         * Version of the image layout.
+         */
+        const quint32 ImageVersion = 1;
+
+        /**
+         * Default minimum time between two published images.
+         */
+        const int DefaultPublishInterval = 250;
+
+        /**
+         * Encodes a server name for use in file and shared memory names.
+         *
+         * Everything but letters, digits and "-._~" is percent-encoded, so
+         * a name can't reach outside of its directory and two different
+         * names never share a socket or an image.
+         */
+        QString encodeServerName(const QString& name)
+        {
+            return QString::fromLatin1(QUrl::toPercentEncoding(name));
+        }
+
+        /**
+         * A string in the image, stored as UTF-16 so that clients can wrap
+         * it in a QString without conversion.
+         */
+        struct ImageString
+        {
+            quint64 offset;
+            quint32 length;
+            quint32 reserved;
+        };
+
+        /**
+         * Image layout: the header, category short names, files sorted by
+         * stored path, and the characters of all strings.
+         */
+        struct ImageHeader
+        {
+            quint32 magic;
+            quint32 version;
+            quint64 generation;
+            quint32 fileCount;
+            quint32 categoryCount;
+            quint64 categoriesOffset;
+            quint64 filesOffset;
+            quint64 stringsOffset;
+            quint64 size;
+            ImageString name;
+            ImageString rootPath;
+        };
+
+        /**
+         * A file in the image.
+         */
+        struct ImageFile
+        {
+            ImageString path;
+            quint32 category;
+            quint32 reserved;
+            qint64 size;
+            qint64 lastModified;
+        };
+
+        const ImageHeader* getHeader(const uchar* image)
+        {
+            return reinterpret_cast<const ImageHeader*>(image);
+        }
+
+        const ImageString* getCategories(const uchar* image)
+        {
+            return reinterpret_cast<const ImageString*>(image + getHeader(image)->categoriesOffset);
+        }
+
+        const ImageFile* getFiles(const uchar* image)
+        {
+            return reinterpret_cast<const ImageFile*>(image + getHeader(image)->filesOffset);
+        }
+
+        /**
+         * Wraps a string of the image without copying it; the result is
+         * valid as long as the image is mapped.
+         */
+        QString rawString(const uchar* image, const ImageString& string)
+        {
+            return QString::fromRawData(reinterpret_cast<const QChar*>(image + string.offset),
+                                        int(string.length));
+        }
+
+        /**
+         * Copies a string of the image, for use after it's unmapped.
+         */
+        QString copyString(const uchar* image, const ImageString& string)
+        {
+            return QString(reinterpret_cast<const QChar*>(image + string.offset), int(string.length));
+        }
+
+        /**
+         * Checks that a string lies within the string area of the image.
+         */
+        bool isValidString(const ImageHeader* header, const ImageString& string)
+        {
+            return string.offset >= header->stringsOffset && string.offset % 2 == 0 &&
+                   string.offset + quint64(string.length) * 2 <= header->size;
+        }
+
+#if defined(Q_OS_UNIX)
+        /**
+         * Fills the address of a local socket; false if the path is too long.
+         */
+        bool toSocketAddress(const QString& path, struct sockaddr_un& address)
+        {
+            QByteArray encodedPath = QFile::encodeName(path);
+            std::memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            if (encodedPath.size() >= int(sizeof(address.sun_path)))
+            {
+                return false;
+            }
+            std::memcpy(address.sun_path, encodedPath.constData(), encodedPath.size());
+            return true;
+        }
+
+        /**
+         * Switches a descriptor to non-blocking mode.
+         */
+        void setNonBlocking(int fd)
+        {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+
+        /**
+         * Checks whether a server answers on a socket address.
+         */
+        bool isServerRunning(const struct sockaddr_un& address)
+        {
+            int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0)
+            {
+                return false;
+            }
+            bool running = ::connect(fd, reinterpret_cast<const struct sockaddr*>(&address),
+                                     sizeof(address)) == 0;
+            ::close(fd);
+            return running;
+        }
+#endif
+    }
+
+    /**
+     * Creates a server for a project.
+     *
+     * Nothing is published until listen() is called.
+     *
+     * @param project the project to publish
+     * @param parent parent object
+     */
+    ProjectServer::ProjectServer(Project* project, QObject* parent):
+        QObject(parent), m_project(project), m_changeQueue(new ProjectChangeQueue(project, this)),
+        m_listenFd(-1), m_listenNotifier(0), m_generation(0)
+    {
+        m_changeQueue->setInterval(DefaultPublishInterval);
+        connect(m_changeQueue, &ProjectChangeQueue::changesReady, this, &ProjectServer::publish);
+        // the change queue drops changes on relocation, every path changes anyway
+        connect(project, &Project::relocated, this, &ProjectServer::publish);
+        connect(project, &Project::rootPathChanged, this, &ProjectServer::publish);
+    }
+
+    /**
+     * Stops the server and removes its images.
+     */
+    ProjectServer::~ProjectServer()
+    {
+        close();
+    }
+
+    /**
+     * Starts accepting clients and publishes the first image.
+     *
+     * A socket left behind by a crashed server of the same name is
+     * replaced, but one a server still answers on is not.
+     *
+     * @param name server name, unique among servers of the user
+     * @return true on success, see getErrorString() otherwise
+     */
+    bool ProjectServer::listen(QString name)
+    {
+        close();
+        m_name = name;
+#if defined(Q_OS_UNIX)
+        struct sockaddr_un address;
+        QString socketPath = getSocketPath(name);
+        if (!toSocketAddress(socketPath, address))
+        {
+            m_errorString = tr("Socket path is too long: %1").arg(socketPath);
+            return false;
+        }
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            m_errorString = qt_error_string(errno);
+            return false;
+        }
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        if (isServerRunning(address))
+        {
+            m_errorString = tr("Server %1 is already running").arg(name);
+            ::close(fd);
+            return false;
+        }
+        ::unlink(address.sun_path);
+        if (::bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(fd, SOMAXCONN) != 0)
+        {
+            m_errorString = qt_error_string(errno);
+            ::close(fd);
+            return false;
+        }
+        setNonBlocking(fd);
+
+        m_listenFd = fd;
+        m_listenNotifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+        connect(m_listenNotifier, &QSocketNotifier::activated, this, &ProjectServer::onNewConnection);
+
+        if (!publish())
+        {
+            close();
+            return false;
+        }
+        return true;
+#else
+        m_errorString = tr("Project sharing is not supported on this platform");
+        return false;
+#endif
+    }
+
+    /**
+     * Disconnects all clients, stops accepting new ones and removes
+     * published images.
+     */
+    void ProjectServer::close()
+    {
+#if defined(Q_OS_UNIX)
+        foreach (int fd, m_clients.keys())
+        {
+            dropClient(fd);
+        }
+        if (m_listenFd >= 0)
+        {
+            delete m_listenNotifier;
+            m_listenNotifier = 0;
+            ::close(m_listenFd);
+            m_listenFd = -1;
+            ::unlink(QFile::encodeName(getSocketPath(m_name)).constData());
+        }
+        if (m_generation > 0)
+        {
+            removeImage(m_generation);
+            removeImage(m_generation - 1);
+        }
+#endif
+        m_changeQueue->clear();
+        m_generation = 0;
+        m_publishedSnapshot = ProjectSnapshot();
+    }
+
+    /**
+     * Returns the path of the socket of a server.
+     *
+     * The socket lives in the runtime directory of the user, which only
+     * the user can access. The temporary directory is used only if there
+     * is no runtime directory.
+     *
+     * @param name server name
+     * @return path to the socket
+     */
+    QString ProjectServer::getSocketPath(QString name)
+    {
+        QString directory = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+        if (directory.isEmpty())
+        {
+            directory = QDir::tempPath();
+        }
+        return directory + "/required-" + encodeServerName(name) + ".sock";
+    }
+
+    /**
+     * Returns the shared memory object name of an image.
+     *
+     * @param name server name
+     * @param generation image generation
+     * @return name of the shared memory object
+     */
+    QString ProjectServer::getImageName(QString name, quint64 generation)
+    {
+        // shared memory names may contain no slash besides the leading one;
+        // they are shared by all users, hence the user identifier
+#if defined(Q_OS_UNIX)
+        quint64 user = quint64(::getuid());
+#else
+        quint64 user = 0;
+#endif
+        return QString("/required-%1-%2-%3").arg(user).arg(encodeServerName(name)).arg(generation);
+    }
+
+    /**
+     * Publishes the current state of the project as a new image.
+     *
+     * Called automatically when the project changes; clients are notified
+     * of the new generation. If the project is the same as in the latest
+     * image, e.g. a file was added and removed again, nothing is written.
+     *
+     * @return true on success, see getErrorString() otherwise
+     */
+    bool ProjectServer::publish()
+    {
+        if (!isListening() || !m_project)
+        {
+            return false;
+        }
+        m_changeQueue->clear();
+
+        // an unchanged file index shares the whole tree with the published one
+        ProjectSnapshot snapshot = m_project->snapshot();
+        if (m_generation > 0 &&
+            snapshot.getFileIndex().isSharedWith(m_publishedSnapshot.getFileIndex()) &&
+            snapshot.getName() == m_publishedSnapshot.getName() &&
+            snapshot.getRootPath() == m_publishedSnapshot.getRootPath())
+        {
+            return true;
+        }
+
+        quint64 generation = m_generation + 1;
+        if (!writeImage(snapshot, generation))
+        {
+            return false;
+        }
+        m_publishedSnapshot = snapshot;
+        if (m_generation > 0)
+        {
+            // clients may still be switching from the previous image
+            removeImage(m_generation - 1);
+        }
+        m_generation = generation;
+
+        foreach (int fd, m_clients.keys())
+        {
+            notifyClient(fd);
+        }
+        return true;
+    }
+
+    /**
+     * Accepts waiting clients and tells them the current generation.
+     */
+    void ProjectServer::onNewConnection()
+    {
+#if defined(Q_OS_UNIX)
+        int fd;
+        while ((fd = ::accept(m_listenFd, 0, 0)) >= 0)
+        {
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+            setNonBlocking(fd);
+            QSocketNotifier* notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+            connect(notifier, &QSocketNotifier::activated, this, &ProjectServer::onClientActivated);
+            m_clients.insert(fd, notifier);
+            notifyClient(fd);
+        }
+#endif
+    }
+
+    /**
+     * Drops a client which disconnected.
+     *
+     * Clients don't send anything, so readable means closed.
+     *
+     * @param fd client socket
+     */
+    void ProjectServer::onClientActivated(int fd)
+    {
+#if defined(Q_OS_UNIX)
+        char buffer[64];
+        ssize_t received = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR))
+        {
+            dropClient(fd);
+        }
+#endif
+    }
+
+    /**
+     * Writes the image of the project to a new shared memory object.
+     *
+     * The size of the image is computed first, so the project is written
+     * straight into the shared pages.
+     *
+     * @param snapshot state of the project to write
+     * @param generation generation of the image
+     * @return true on success
+     */
+    bool ProjectServer::writeImage(const ProjectSnapshot& snapshot, quint64 generation)
+    {
+#if defined(Q_OS_UNIX)
+        const PersistentMap<PathHandle, FileRecord>& fileIndex = snapshot.getFileIndex();
+
+        QStringList categories;
+        QHash<QString, quint32> categoryIds;
+        quint64 characterCount = snapshot.getName().size() + snapshot.getRootPath().size();
+        PersistentMap<PathHandle, FileRecord>::const_iterator it;
+        for (it = fileIndex.constBegin(); it != fileIndex.constEnd(); ++it)
+        {
+            characterCount += it.key().size();
+            if (!categoryIds.contains(it.value().category))
+            {
+                categoryIds.insert(it.value().category, quint32(categories.size()));
+                categories.append(it.value().category);
+                characterCount += it.value().category.size();
+            }
+        }
+
+        ImageHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = ImageMagic;
+        header.version = ImageVersion;
+        header.generation = generation;
+        header.fileCount = quint32(fileIndex.size());
+        header.categoryCount = quint32(categories.size());
+        header.categoriesOffset = sizeof(ImageHeader);
+        header.filesOffset = header.categoriesOffset + quint64(categories.size()) * sizeof(ImageString);
+        header.stringsOffset = header.filesOffset + quint64(header.fileCount) * sizeof(ImageFile);
+        header.size = header.stringsOffset + characterCount * sizeof(QChar);
+
+        QByteArray imageName = QFile::encodeName(getImageName(m_name, generation));
+        int fd = ::shm_open(imageName.constData(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno == EEXIST)
+        {
+            // left behind by a crashed server of ours, since this one owns
+            // the socket; objects of other users can't be unlinked, so the
+            // exclusive create still fails for them
+            ::shm_unlink(imageName.constData());
+            fd = ::shm_open(imageName.constData(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        }
+        if (fd < 0)
+        {
+            m_errorString = qt_error_string(errno);
+            return false;
+        }
+        void* memory = MAP_FAILED;
+        if (::ftruncate(fd, off_t(header.size)) == 0)
+        {
+            memory = ::mmap(0, size_t(header.size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (memory == MAP_FAILED)
+        {
+            m_errorString = qt_error_string(errno);
+            ::close(fd);
+            ::shm_unlink(imageName.constData());
+            return false;
+        }
+        ::close(fd);
+
+        uchar* image = static_cast<uchar*>(memory);
+        quint64 stringOffset = header.stringsOffset;
+        auto writeString = [&] (const QChar* data, int length) -> ImageString {
+            ImageString string;
+            string.offset = stringOffset;
+            string.length = quint32(length);
+            string.reserved = 0;
+            std::memcpy(image + stringOffset, data, length * sizeof(QChar));
+            stringOffset += quint64(length) * sizeof(QChar);
+            return string;
+        };
+
+        QString name = snapshot.getName();
+        QString rootPath = snapshot.getRootPath();
+        header.name = writeString(name.constData(), name.size());
+        header.rootPath = writeString(rootPath.constData(), rootPath.size());
+        std::memcpy(image, &header, sizeof(header));
+
+        ImageString* categorySlots = reinterpret_cast<ImageString*>(image + header.categoriesOffset);
+        for (int i = 0; i < categories.size(); ++i)
+        {
+            categorySlots[i] = writeString(categories.at(i).constData(), categories.at(i).size());
+        }
+
+        // the file index is sorted by stored path, so clients can bisect it
+        ImageFile* fileSlots = reinterpret_cast<ImageFile*>(image + header.filesOffset);
+        for (it = fileIndex.constBegin(); it != fileIndex.constEnd(); ++it, ++fileSlots)
+        {
+            fileSlots->path = writeString(it.key().constData(), it.key().size());
+            fileSlots->category = categoryIds.value(it.value().category);
+            fileSlots->reserved = 0;
+            fileSlots->size = it.value().size;
+            fileSlots->lastModified = it.value().lastModified;
+        }
+
+        ::munmap(memory, size_t(header.size));
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * Removes an image; clients which mapped it keep their mapping.
+     *
+     * @param generation generation of the image
+     */
+    void ProjectServer::removeImage(quint64 generation)
+    {
+#if defined(Q_OS_UNIX)
+        if (generation > 0)
+        {
+            ::shm_unlink(QFile::encodeName(getImageName(m_name, generation)).constData());
+        }
+#endif
+    }
+
+    /**
+     * Sends the current generation to a client.
+     *
+     * A client too slow to take a few bytes is dropped.
+     *
+     * @param fd client socket
+     */
+    void ProjectServer::notifyClient(int fd)
+    {
+#if defined(Q_OS_UNIX)
+        QByteArray message = QByteArray::number(m_generation) + '\n';
+        int flags = 0;
+#if defined(MSG_NOSIGNAL)
+        flags |= MSG_NOSIGNAL;
+#endif
+        if (::send(fd, message.constData(), message.size(), flags) != message.size())
+        {
+            dropClient(fd);
+        }
+#endif
+    }
+
+    /**
+     * Closes the connection to a client.
+     *
+     * @param fd client socket
+     */
+    void ProjectServer::dropClient(int fd)
+    {
+#if defined(Q_OS_UNIX)
+        QSocketNotifier* notifier = m_clients.take(fd);
+        if (notifier)
+        {
+            // the notifier may be the sender of the current signal
+            notifier->setEnabled(false);
+            notifier->deleteLater();
+            ::close(fd);
+        }
+#endif
+    }
+
+    /**
+     * Creates a client which isn't connected.
+     *
+     * @param parent parent object
+     */
+    ProjectClient::ProjectClient(QObject* parent):
+        QObject(parent), m_socketFd(-1), m_notifier(0), m_image(0), m_imageSize(0),
+        m_generation(0)
+    {
+    }
+
+    /**
+     * Disconnects and unmaps the image.
+     */
+    ProjectClient::~ProjectClient()
+    {
+        disconnectFromServer();
+    }
+
+    /**
+     * Connects to a server.
+     *
+     * The image is mapped once the server sends its generation; use
+     * waitForUpdate() to block until then. A socket not owned by the user
+     * is refused.
+     *
+     * @param name server name
+     * @return true on success, see getErrorString() otherwise
+     */
+    bool ProjectClient::connectToServer(QString name)
+    {
+        disconnectFromServer();
+        m_name = name;
+#if defined(Q_OS_UNIX)
+        struct sockaddr_un address;
+        QString socketPath = ProjectServer::getSocketPath(name);
+        if (!toSocketAddress(socketPath, address))
+        {
+            m_errorString = tr("Socket path is too long: %1").arg(socketPath);
+            return false;
+        }
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            m_errorString = qt_error_string(errno);
+            return false;
+        }
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        if (::connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            m_errorString = qt_error_string(errno);
+            ::close(fd);
+            return false;
+        }
+        // checked after connecting, so the socket can't be swapped after
+        // the check; a server of another user could otherwise feed us
+        // generations of images it controls
+        struct stat info;
+        if (::lstat(address.sun_path, &info) != 0 || !S_ISSOCK(info.st_mode) ||
+            info.st_uid != ::getuid())
+        {
+            m_errorString = tr("Socket %1 is not owned by the user").arg(socketPath);
+            ::close(fd);
+            return false;
+        }
+        setNonBlocking(fd);
+
+        m_socketFd = fd;
+        m_notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, &ProjectClient::onSocketActivated);
+        return true;
+#else
+        m_errorString = tr("Project sharing is not supported on this platform");
+        return false;
+#endif
+    }
+
+    /**
+     * Disconnects from the server and unmaps the image.
+     */
+    void ProjectClient::disconnectFromServer()
+    {
+#if defined(Q_OS_UNIX)
+        if (m_socketFd >= 0)
+        {
+            m_notifier->setEnabled(false);
+            m_notifier->deleteLater();
+            m_notifier = 0;
+            ::close(m_socketFd);
+            m_socketFd = -1;
+        }
+#endif
+        m_buffer.clear();
+        unmapImage();
+    }
+
+    /**
+     * Blocks until the server announces a new generation.
+     *
+     * @param msecs timeout in milliseconds
+     * @return true if a new image was mapped
+     */
+    bool ProjectClient::waitForUpdate(int msecs)
+    {
+#if defined(Q_OS_UNIX)
+        if (m_socketFd < 0)
+        {
+            return false;
+        }
+
+        quint64 generation = m_generation;
+        struct pollfd descriptor;
+        descriptor.fd = m_socketFd;
+        descriptor.events = POLLIN;
+        descriptor.revents = 0;
+        if (::poll(&descriptor, 1, msecs) <= 0)
+        {
+            return false;
+        }
+        onSocketActivated(m_socketFd);
+        return m_generation != generation;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * Returns the project name.
+     *
+     * @return project name, empty if no image is mapped
+     */
+    QString ProjectClient::getName() const
+    {
+        return m_image ? copyString(m_image, getHeader(m_image)->name) : QString();
+    }
+
+    /**
+     * Returns the root directory of the project.
+     *
+     * @return absolute path of the root, empty if there is none
+     */
+    QString ProjectClient::getRootPath() const
+    {
+        return m_image ? copyString(m_image, getHeader(m_image)->rootPath) : QString();
+    }
+
+    /**
+     * Returns the number of files in the project.
+     *
+     * @return file count
+     */
+    int ProjectClient::getFileCount() const
+    {
+        return m_image ? int(getHeader(m_image)->fileCount) : 0;
+    }
+
+    /**
+     * Checks whether given file is in the project.
+     *
+     * @param filename full path to the file
+     * @return true if the file is in the project
+     */
+    bool ProjectClient::hasFile(QString filename) const
+    {
+        return findFile(Project::toRelativePath(getRootPath(), filename)) >= 0;
+    }
+
+    /**
+     * Returns the category and file system information of a file.
+     *
+     * @param filename full path to the file
+     * @return file record, empty if the file is not in the project
+     */
+    FileRecord ProjectClient::getFileRecord(QString filename) const
+    {
+        int index = findFile(Project::toRelativePath(getRootPath(), filename));
+        if (index < 0)
+        {
+            return FileRecord();
+        }
+
+        const ImageFile& file = getFiles(m_image)[index];
+        return FileRecord(copyString(m_image, getCategories(m_image)[file.category]),
+                          file.size, file.lastModified);
+    }
+
+    /**
+     * Returns all files of the project.
+     *
+     * @return full paths sorted by stored path
+     */
+    QStringList ProjectClient::getFiles() const
+    {
+        QStringList files;
+        if (!m_image)
+        {
+            return files;
+        }
+
+        QString rootPath = getRootPath();
+        quint32 fileCount = getHeader(m_image)->fileCount;
+        const ImageFile* imageFiles = getFiles(m_image);
+        files.reserve(int(fileCount));
+        for (quint32 i = 0; i < fileCount; ++i)
+        {
+            files.append(Project::toAbsolutePath(rootPath, copyString(m_image, imageFiles[i].path)));
+        }
+
+        return files;
+    }
+
+    /**
+     * Returns the files of a category.
+     *
+     * @param categoryShortName category identifier
+     * @return full paths sorted by stored path
+     */
+    QStringList ProjectClient::getFilesInCategory(QString categoryShortName) const
+    {
+        QStringList files;
+        if (!m_image)
+        {
+            return files;
+        }
+
+        const ImageHeader* header = getHeader(m_image);
+        const ImageString* categories = getCategories(m_image);
+        quint32 category = 0;
+        while (category < header->categoryCount &&
+               rawString(m_image, categories[category]) != categoryShortName)
+        {
+            ++category;
+        }
+        if (category == header->categoryCount)
+        {
+            return files;
+        }
+
+        QString rootPath = getRootPath();
+        const ImageFile* imageFiles = getFiles(m_image);
+        for (quint32 i = 0; i < header->fileCount; ++i)
+        {
+            if (imageFiles[i].category == category)
+            {
+                files.append(Project::toAbsolutePath(rootPath, copyString(m_image, imageFiles[i].path)));
+            }
+        }
+
+        return files;
+    }
+
+    /**
+     * Returns identifiers of the categories having files.
+     *
+     * @return category short names
+     */
+    QStringList ProjectClient::getCategoryShortNames() const
+    {
+        QStringList shortNames;
+        if (!m_image)
+        {
+            return shortNames;
+        }
+
+        const ImageString* categories = getCategories(m_image);
+        for (quint32 i = 0; i < getHeader(m_image)->categoryCount; ++i)
+        {
+            shortNames.append(copyString(m_image, categories[i]));
+        }
+
+        return shortNames;
+    }
+
+    /**
+     * Reads generation notifications and maps the latest image.
+     *
+     * @param fd the socket
+     */
+    void ProjectClient::onSocketActivated(int fd)
+    {
+#if defined(Q_OS_UNIX)
+        char buffer[256];
+        ssize_t received;
+        while ((received = ::recv(fd, buffer, sizeof(buffer), 0)) > 0)
+        {
+            m_buffer.append(buffer, int(received));
+        }
+        bool closed = received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+
+        // only the latest complete notification matters
+        int end = m_buffer.lastIndexOf('\n');
+        if (end >= 0)
+        {
+            int start = m_buffer.lastIndexOf('\n', end - 1) + 1;
+            quint64 generation = m_buffer.mid(start, end - start).toULongLong();
+            m_buffer.remove(0, end + 1);
+            if (generation != m_generation && mapImage(generation))
+            {
+                emit updated(generation);
+            }
+        }
+
+        if (closed)
+        {
+            disconnectFromServer();
+            emit disconnected();
+        }
+#endif
+    }
+
+    /**
+     * Maps an image and checks its owner and layout.
+     *
+     * The previous image stays mapped if the new one can't be used.
+     *
+     * @param generation generation of the image
+     * @return true on success
+     */
+    bool ProjectClient::mapImage(quint64 generation)
+    {
+#if defined(Q_OS_UNIX)
+        QByteArray imageName = QFile::encodeName(ProjectServer::getImageName(m_name, generation));
+        int fd = ::shm_open(imageName.constData(), O_RDONLY, 0);
+        if (fd < 0)
+        {
+            m_errorString = qt_error_string(errno);
+            return false;
+        }
+        struct stat info;
+        void* memory = MAP_FAILED;
+        if (::fstat(fd, &info) == 0 && info.st_uid == ::getuid() &&
+            info.st_size >= off_t(sizeof(ImageHeader)))
+        {
+            memory = ::mmap(0, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (memory == MAP_FAILED)
+        {
+            m_errorString = tr("Cannot map project image %1").arg(generation);
+            return false;
+        }
+
+        const uchar* image = static_cast<const uchar*>(memory);
+        const ImageHeader* header = getHeader(image);
+        bool valid = header->magic == ImageMagic && header->version == ImageVersion &&
+                     header->generation == generation && header->size == quint64(info.st_size) &&
+                     header->categoriesOffset == sizeof(ImageHeader) &&
+                     header->filesOffset == header->categoriesOffset +
+                                            quint64(header->categoryCount) * sizeof(ImageString) &&
+                     header->stringsOffset == header->filesOffset +
+                                              quint64(header->fileCount) * sizeof(ImageFile) &&
+                     header->stringsOffset <= header->size &&
+                     isValidString(header, header->name) && isValidString(header, header->rootPath);
+        const ImageString* categories = getCategories(image);
+        for (quint32 i = 0; valid && i < header->categoryCount; ++i)
+        {
+            valid = isValidString(header, categories[i]);
+        }
+        const ImageFile* files = getFiles(image);
+        for (quint32 i = 0; valid && i < header->fileCount; ++i)
+        {
+            valid = isValidString(header, files[i].path) && files[i].category < header->categoryCount;
+        }
+        if (!valid)
+        {
+            ::munmap(memory, size_t(info.st_size));
+            m_errorString = tr("Invalid project image %1").arg(generation);
+            return false;
+        }
+
+        unmapImage();
+        m_image = image;
+        m_imageSize = quint64(info.st_size);
+        m_generation = generation;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * Unmaps the image, if there is one.
+     */
+    void ProjectClient::unmapImage()
+    {
+#if defined(Q_OS_UNIX)
+        if (m_image)
+        {
+            ::munmap(const_cast<uchar*>(m_image), size_t(m_imageSize));
+        }
+#endif
+        m_image = 0;
+        m_imageSize = 0;
+        m_generation = 0;
+    }
+
+    /**
+     * Finds a file by bisecting the files of the image.
+     *
+     * Paths are compared by UTF-16 code units, like PathHandle does.
+     *
+     * @param path stored path of the file
+     * @return index of the file, -1 if it isn't in the project
+     */
+    int ProjectClient::findFile(const QString& path) const
+    {
+        if (!m_image)
+        {
+            return -1;
+        }
+
+        const ImageFile* files = getFiles(m_image);
+        int low = 0;
+        int high = int(getHeader(m_image)->fileCount);
+        while (low < high)
+        {
+            int middle = low + (high - low) / 2;
+            int comparison = QString::compare(rawString(m_image, files[middle].path), path);
+            if (comparison == 0)
+            {
+                return middle;
+            }
+            if (comparison < 0)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+
+        return -1;
+    }
+}
@@ -0,0 +1,309 @@
+/**
+ * @file ProjectSharing.h
+ *
+ * Sharing a project with other local processes through shared memory.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef PROJECTSHARING_H
+#define PROJECTSHARING_H
+
+#include "../global.h"
+#include "Project.h"
+#include "ProjectChangeQueue.h"
+#include "ProjectSnapshot.h"
+#include <QByteArray>
+#include <QMap>
+#include <QObject>
+#include <QPointer>
+#include <QSocketNotifier>
+#include <QString>
+#include <QStringList>
+
+namespace Required
+{
+    /**
+     * Publishes a project to other local processes.
+     *
+     * The owning process keeps the Project; other processes use a
+     * ProjectClient instead of deserializing the project themselves. Every
+     * published state of the project is a read-only image in POSIX shared
+     * memory, identified by the server name and a generation number. An
+     * image is never modified after it's published: changes of the project
+     * are collected by a ProjectChangeQueue and published as a new image
+     * with the next generation. The previous image is kept until the one
+     * after, so clients have time to switch.
+     *
+     * Clients are told about new generations over a Unix domain socket in
+     * the runtime directory of the user. Socket and images are private to
+     * the user: clients refuse ones owned by anybody else.
+     *
+     * Only available on Unix systems.
+     */
+    class REQUIRED_EXPORT ProjectServer : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        explicit ProjectServer(Project* project, QObject* parent = 0);
+        ~ProjectServer();
+
+        bool listen(QString name);
+        void close();
+
+        /**
+         * Checks whether the server accepts clients.
+         *
+         * @return true after a successful listen()
+         */
+        bool isListening() const
+        {
+            return m_listenFd >= 0;
+        }
+
+        /**
+         * Returns the generation of the latest published image.
+         *
+         * @return generation, 0 if nothing was published
+         */
+        quint64 getGeneration() const
+        {
+            return m_generation;
+        }
+
+        /**
+         * Returns the number of connected clients.
+         *
+         * @return client count
+         */
+        int getClientCount() const
+        {
+            return m_clients.size();
+        }
+
+        /**
+         * Returns the minimum time between two published images.
+         *
+         * @return interval in milliseconds
+         */
+        int getPublishInterval() const
+        {
+            return m_changeQueue->getInterval();
+        }
+
+        /**
+         * Sets the minimum time between two published images.
+         *
+         * Every image holds the whole project, so publishing large
+         * projects once per frame would be wasteful. Changes which cancel
+         * out within an interval publish nothing.
+         *
+         * @param interval interval in milliseconds
+         */
+        void setPublishInterval(int interval)
+        {
+            m_changeQueue->setInterval(interval);
+        }
+
+        /**
+         * Returns a description of the last error.
+         *
+         * @return error string
+         */
+        QString getErrorString() const
+        {
+            return m_errorString;
+        }
+
+        static QString getSocketPath(QString name);
+        static QString getImageName(QString name, quint64 generation);
+
+    public slots:
+        bool publish();
+
+    private slots:
+        void onNewConnection();
+        void onClientActivated(int fd);
+
+    private:
+        Q_DISABLE_COPY(ProjectServer)
+
+        /**
+         * Non-owning pointer to the published project.
+         */
+        QPointer<Project> m_project;
+
+        /**
+         * Collects changes until the next image is published.
+         */
+        ProjectChangeQueue* m_changeQueue;
+
+        /**
+         * Server name, given to listen().
+         */
+        QString m_name;
+
+        /**
+         * The listening socket, -1 if not listening.
+         */
+        int m_listenFd;
+
+        /**
+         * Watches the listening socket for new clients.
+         */
+        QSocketNotifier* m_listenNotifier;
+
+        /**
+         * Watches client sockets for disconnection, by descriptor.
+         */
+        QMap<int, QSocketNotifier*> m_clients;
+
+        /**
+         * Generation of the latest published image.
+         */
+        quint64 m_generation;
+
+        /**
+         * State of the project in the latest published image.
+         */
+        ProjectSnapshot m_publishedSnapshot;
+
+        /**
+         * Description of the last error.
+         */
+        QString m_errorString;
+
+        bool writeImage(const ProjectSnapshot& snapshot, quint64 generation);
+        void removeImage(quint64 generation);
+        void notifyClient(int fd);
+        void dropClient(int fd);
+    };
+
+    /**
+     * Reads a project published by a ProjectServer of another process.
+     *
+     * The image of the project is mapped read-only, and lookups run on the
+     * shared pages directly, so the project is neither copied nor parsed.
+     * When the server publishes a new generation, the client maps it and
+     * emits updated().
+     *
+     * Only available on Unix systems.
+     */
+    class REQUIRED_EXPORT ProjectClient : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        explicit ProjectClient(QObject* parent = 0);
+        ~ProjectClient();
+
+        bool connectToServer(QString name);
+        void disconnectFromServer();
+        bool waitForUpdate(int msecs = 30000);
+
+        /**
+         * Checks whether the client is connected to a server.
+         *
+         * @return true if connected
+         */
+        bool isConnected() const
+        {
+            return m_socketFd >= 0;
+        }
+
+        /**
+         * Returns the generation of the mapped image.
+         *
+         * @return generation, 0 if no image is mapped yet
+         */
+        quint64 getGeneration() const
+        {
+            return m_generation;
+        }
+
+        /**
+         * Returns a description of the last error.
+         *
+         * @return error string
+         */
+        QString getErrorString() const
+        {
+            return m_errorString;
+        }
+
+        QString getName() const;
+        QString getRootPath() const;
+        int getFileCount() const;
+        bool hasFile(QString filename) const;
+        FileRecord getFileRecord(QString filename) const;
+        QStringList getFiles() const;
+        QStringList getFilesInCategory(QString categoryShortName) const;
+        QStringList getCategoryShortNames() const;
+
+    signals:
+        void updated(quint64 generation);
+        void disconnected();
+
+    private slots:
+        void onSocketActivated(int fd);
+
+    private:
+        Q_DISABLE_COPY(ProjectClient)
+
+        /**
+         * Server name, given to connectToServer().
+         */
+        QString m_name;
+
+        /**
+         * The connection to the server, -1 if not connected.
+         */
+        int m_socketFd;
+
+        /**
+         * Watches the connection for notifications.
+         */
+        QSocketNotifier* m_notifier;
+
+        /**
+         * Received bytes of an incomplete notification.
+         */
+        QByteArray m_buffer;
+
+        /**
+         * The mapped image, 0 if there is none.
+         */
+        const uchar* m_image;
+
+        /**
+         * Size of the mapped image in bytes.
+         */
+        quint64 m_imageSize;
+
+        /**
+         * Generation of the mapped image.
+         */
+        quint64 m_generation;
+
+        /**
+         * Description of the last error.
+         */
+        QString m_errorString;
+
+        bool mapImage(quint64 generation);
+        void unmapImage();
+        int findFile(const QString& path) const;
+    };
+}
+
+#endif // PROJECTSHARING_H
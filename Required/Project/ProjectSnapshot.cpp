@@ -0,0 +1,135 @@
+/**
+ * @file ProjectSnapshot.cpp
+ *
+ * An immutable view of a project at some point in time.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "ProjectSnapshot.h"
+
+namespace Required
+{
+    /**
+     * Creates an empty snapshot.
+     */
+    ProjectSnapshot::ProjectSnapshot()
+    {
+    }
+
+    /**
+     * Creates the snapshot.
+     *
+     * @param name project name
+     * @param rootPath root directory of the project
+     * @param pathPool storage of paths in the file index
+     * @param fileIndex the file index of the project
+     */
+    ProjectSnapshot::ProjectSnapshot(QString name, QString rootPath,
+                                     QSharedPointer<PathPool> pathPool,
+                                     PersistentMap<PathHandle, FileRecord> fileIndex):
+        m_name(name), m_rootPath(rootPath), m_pathPool(pathPool), m_fileIndex(fileIndex)
+    {
+    }
+
+    /**
+     * Returns a list of all files, sorted by their paths within the root.
+     *
+     * @return list of file names
+     */
+    QStringList ProjectSnapshot::getFiles() const
+    {
+        QStringList files;
+        files.reserve(m_fileIndex.size());
+        PersistentMap<PathHandle, FileRecord>::const_iterator it;
+        for (it = m_fileIndex.constBegin(); it != m_fileIndex.constEnd(); ++it)
+        {
+            files.append(Project::toAbsolutePath(m_rootPath, it.key()));
+        }
+
+        return files;
+    }
+
+    /**
+     * Returns a list of all files associated with a specific category.
+     *
+     * Snapshots keep only the file index, so this requires a full scan. Use
+     * getFilesByCategory() to get files of all categories in one pass.
+     *
+     * @param categoryShortName internal category identifier
+     * @return files in that category, sorted by path
+     */
+    QStringList ProjectSnapshot::getFilesInCategory(QString categoryShortName) const
+    {
+        QStringList files;
+        PersistentMap<PathHandle, FileRecord>::const_iterator it;
+        for (it = m_fileIndex.constBegin(); it != m_fileIndex.constEnd(); ++it)
+        {
+            if (it.value().category == categoryShortName)
+            {
+                files.append(Project::toAbsolutePath(m_rootPath, it.key()));
+            }
+        }
+
+        return files;
+    }
+
+    /**
+     * Groups all files by their categories in a single pass.
+     *
+     * @return mapping of category short names to files sorted by path
+     */
+    QMap<QString, QStringList> ProjectSnapshot::getFilesByCategory() const
+    {
+        QMap<QString, QStringList> files;
+        PersistentMap<PathHandle, FileRecord>::const_iterator it;
+        for (it = m_fileIndex.constBegin(); it != m_fileIndex.constEnd(); ++it)
+        {
+            files[it.value().category].append(Project::toAbsolutePath(m_rootPath, it.key()));
+        }
+
+        return files;
+    }
+
+    /**
+     * Returns a list of all categories used in the snapshot.
+     *
+     * @return category list
+     */
+    FileCategoryList ProjectSnapshot::getCategories() const
+    {
+        FileCategoryList categoryList;
+        foreach (QString shortName, getCategoryShortNames())
+        {
+            categoryList.append(FileCategory::getCategory(shortName));
+        }
+
+        return categoryList;
+    }
+
+    /**
+     * Returns a list of all category identifiers used in the snapshot.
+     *
+     * @return list of category short names
+     */
+    QStringList ProjectSnapshot::getCategoryShortNames() const
+    {
+        QMap<QString, bool> shortNames;
+        PersistentMap<PathHandle, FileRecord>::const_iterator it;
+        for (it = m_fileIndex.constBegin(); it != m_fileIndex.constEnd(); ++it)
+        {
+            shortNames.insert(it.value().category, true);
+        }
+
+        return shortNames.keys();
+    }
+}
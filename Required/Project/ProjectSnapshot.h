@@ -0,0 +1,164 @@
+/**
+ * @file ProjectSnapshot.h
+ *
+ * An immutable view of a project at some point in time.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef PROJECTSNAPSHOT_H
+#define PROJECTSNAPSHOT_H
+
+#include "../global.h"
+#include "FileCategory.h"
+#include "PathPool.h"
+#include "PersistentMap.h"
+#include "Project.h"
+#include <QMap>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+
+namespace Required
+{
+    /**
+     * An immutable view of a project at some point in time.
+     *
+     * Snapshots are obtained with Project::snapshot(). They are cheap to take
+     * and to copy, and unaffected by later changes to the project, so they
+     * can be handed over to background tasks (saving, indexing, exporting)
+     * while the project keeps changing. A snapshot doesn't depend on the
+     * project object and may outlive it.
+     */
+    class REQUIRED_EXPORT ProjectSnapshot
+    {
+    public:
+        ProjectSnapshot();
+        ProjectSnapshot(QString name, QString rootPath, QSharedPointer<PathPool> pathPool,
+                        PersistentMap<PathHandle, FileRecord> fileIndex);
+
+        /**
+         * Returns project name.
+         *
+         * @return project name
+         */
+        QString getName() const
+        {
+            return m_name;
+        }
+
+        /**
+         * Returns the root directory of the project.
+         *
+         * @return absolute path of the root, empty if there is no root
+         */
+        QString getRootPath() const
+        {
+            return m_rootPath;
+        }
+
+        /**
+         * Returns the number of files in the snapshot.
+         *
+         * @return file count
+         */
+        int getFileCount() const
+        {
+            return m_fileIndex.size();
+        }
+
+        /**
+         * Checks whether given file was in the project.
+         *
+         * @return true if the file is in the snapshot
+         */
+        bool hasFile(QString filename) const
+        {
+            PathHandle path = findStoredPath(filename);
+            return !path.isNull() && m_fileIndex.contains(path);
+        }
+
+        /**
+         * Returns the category identifier of a file.
+         *
+         * @param filename path to the file
+         * @return category short name, empty if the file is not in the snapshot
+         */
+        QString getFileCategory(QString filename) const
+        {
+            return getFileRecord(filename).category;
+        }
+
+        /**
+         * Returns the category and file system information of a file.
+         *
+         * @param filename path to the file
+         * @return file record, empty if the file is not in the snapshot
+         */
+        FileRecord getFileRecord(QString filename) const
+        {
+            PathHandle path = findStoredPath(filename);
+            return path.isNull() ? FileRecord() : m_fileIndex.value(path);
+        }
+
+        /**
+         * Returns the underlying file => record index.
+         *
+         * Files inside the root are stored relative to it, see
+         * Project::toAbsolutePath().
+         *
+         * @return persistent file index
+         */
+        const PersistentMap<PathHandle, FileRecord>& getFileIndex() const
+        {
+            return m_fileIndex;
+        }
+
+        QStringList getFiles() const;
+        QStringList getFilesInCategory(QString categoryShortName) const;
+        QMap<QString, QStringList> getFilesByCategory() const;
+        FileCategoryList getCategories() const;
+        QStringList getCategoryShortNames() const;
+
+    private:
+        /**
+         * Project name.
+         */
+        QString m_name;
+
+        /**
+         * Absolute path of the root directory, empty if there is none.
+         */
+        QString m_rootPath;
+
+        /**
+         * Storage of paths, shared with the project.
+         */
+        QSharedPointer<PathPool> m_pathPool;
+
+        /**
+         * A mapping of files to their records, shared with the project.
+         */
+        PersistentMap<PathHandle, FileRecord> m_fileIndex;
+
+        /**
+         * Returns the handle of the stored form of an absolute path.
+         */
+        PathHandle findStoredPath(const QString& filename) const
+        {
+            return m_pathPool ? m_pathPool->find(Project::toRelativePath(m_rootPath, filename))
+                              : PathHandle();
+        }
+    };
+}
+
+#endif // PROJECTSNAPSHOT_H
@@ -17,39 +17,218 @@
 
 #include "ProjectWidget.h"
 #include "ui_ProjectWidget.h"
+#include "ContentClassifier.h"
 #include "FileCategory.h"
+#include "ProjectCommands.h"
+#include <QAction>
+#include <QClipboard>
 #include <QDir>
 #include <QFileDialog>
+#include <QGuiApplication>
+#include <QMetaObject>
+#include <QMimeData>
+#include <QSet>
 #include <QStandardPaths>
 #include <QTreeWidget>
 #include <QTreeWidgetItem>
 
 namespace Required
 {
+    namespace
+    {
+        /**
+         * Collects files being added to the project.
+         *
+         * This is the whole pipeline between a drop (or a chosen directory)
+         * and the undo stack: directories are expanded, files are validated
+         * and categorized, and the result is posted to the widget to be
+         * inserted as one batch. A file which can't be added is recorded
+         * with the reason and the rest goes on.
+         *
+         * The user waits for the result, so the task is interactive and
+         * doesn't queue behind background work.
+         */
+        class IngestionTask : public ScheduledTask
+        {
+        public:
+            IngestionTask(QObject* receiver, FileSystem* fileSystem,
+                          ContentClassifier* classifier, IgnoreRules rules,
+                          QStringList paths, QMap<QString, QString> failures):
+                ScheduledTask(TaskScheduler::Interactive),
+                m_receiver(receiver), m_fileSystem(fileSystem), m_classifier(classifier),
+                m_rules(rules), m_paths(paths), m_failures(failures)
+            {
+            }
+
+            void run()
+            {
+                IngestionResult result;
+                result.failures = m_failures;
+
+                // expand directories, keeping the status of plain files
+                QStringList filenames;
+                FileStatusList statuses;
+                FileStatusList pathStatuses = m_fileSystem->statFiles(m_paths);
+                for (int i = 0; i < m_paths.size(); ++i)
+                {
+                    if (isCancelled())
+                    {
+                        return;
+                    }
+
+                    QString path = m_paths.at(i);
+                    const FileStatus& status = pathStatuses.at(i);
+                    if (!status.exists)
+                    {
+                        result.failures.insert(path, QObject::tr("File %1 does not exist!").arg(path));
+                    }
+                    else if (status.isDirectory)
+                    {
+                        QStringList listed = m_rules.listFiles(m_fileSystem, path,
+                                                               getCancelledFlag());
+                        if (isCancelled())
+                        {
+                            return;
+                        }
+                        filenames.append(listed);
+                        statuses.append(m_fileSystem->statFiles(listed));
+                    }
+                    else
+                    {
+                        filenames.append(path);
+                        statuses.append(status);
+                    }
+                    setProgress(i + 1, m_paths.size());
+                }
+
+                // files may vanish while the tree is walked
+                QStringList validFiles;
+                FileStatusList validStatuses;
+                QSet<QString> seen;
+                for (int i = 0; i < filenames.size(); ++i)
+                {
+                    QString filename = filenames.at(i);
+                    const FileStatus& status = statuses.at(i);
+                    if (!status.exists)
+                    {
+                        result.failures.insert(filename, QObject::tr("File %1 does not exist!").arg(filename));
+                    }
+                    else if (!seen.contains(filename))
+                    {
+                        seen.insert(filename);
+                        validFiles.append(filename);
+                        validStatuses.append(status);
+                    }
+                }
+                if (isCancelled())
+                {
+                    return;
+                }
+
+                // same lookup as Project::addFile()
+                QMap<QString, QString> categories;
+                if (m_classifier)
+                {
+                    categories = m_classifier->classifyFiles(validFiles, getCancelledFlag());
+                }
+                result.files.reserve(validFiles.size());
+                for (int i = 0; i < validFiles.size(); ++i)
+                {
+                    QString filename = validFiles.at(i);
+                    QString category = m_classifier
+                        ? categories.value(filename)
+                        : FileCategory::getCategoryForFilename(filename).getShortName();
+                    result.files.append(qMakePair(filename, FileRecord(category, validStatuses.at(i))));
+                }
+                if (isCancelled())
+                {
+                    return;
+                }
+
+                QMetaObject::invokeMethod(m_receiver, "onFilesIngested",
+                                          Qt::QueuedConnection,
+                                          Q_ARG(int, getId()),
+                                          Q_ARG(Required::IngestionResult, result));
+            }
+
+        private:
+            QObject* m_receiver;
+            FileSystem* m_fileSystem;
+            ContentClassifier* m_classifier;
+            IgnoreRules m_rules;
+            QStringList m_paths;
+            QMap<QString, QString> m_failures;
+        };
+    }
+
     /**
      * Creates the widget.
      *
      * @param parent parent object
      */
     ProjectWidget::ProjectWidget(QWidget* parent):
-        QWidget(parent), m_project(0), ui(new Ui::ProjectWidget)
+        QWidget(parent), m_project(0), m_changeQueue(0), ui(new Ui::ProjectWidget),
+        m_undoStack(new QUndoStack(this)), m_pageSize(1000)
     {
+        qRegisterMetaType<IngestionResult>("Required::IngestionResult");
+
         ui->setupUi(this);
+        m_ignoreRules.addDefaultPatterns();
+        setAcceptDrops(true);
+
+        connect(ui->btnUndo, &QPushButton::clicked, m_undoStack, &QUndoStack::undo);
+        connect(ui->btnRedo, &QPushButton::clicked, m_undoStack, &QUndoStack::redo);
+        connect(m_undoStack, &QUndoStack::canUndoChanged, ui->btnUndo, &QPushButton::setEnabled);
+        connect(m_undoStack, &QUndoStack::canRedoChanged, ui->btnRedo, &QPushButton::setEnabled);
+
+        QAction* undoAction = m_undoStack->createUndoAction(this);
+        undoAction->setShortcut(QKeySequence::Undo);
+        undoAction->setShortcutContext(Qt::WidgetWithChildrenShortcut);
+        addAction(undoAction);
+        QAction* redoAction = m_undoStack->createRedoAction(this);
+        redoAction->setShortcut(QKeySequence::Redo);
+        redoAction->setShortcutContext(Qt::WidgetWithChildrenShortcut);
+        addAction(redoAction);
+        QAction* pasteAction = new QAction(tr("Paste files"), this);
+        pasteAction->setShortcut(QKeySequence::Paste);
+        pasteAction->setShortcutContext(Qt::WidgetWithChildrenShortcut);
+        connect(pasteAction, &QAction::triggered, this, &ProjectWidget::paste);
+        addAction(pasteAction);
 
         // For the next two connect calls we make the following assumption:
         // top-level items are categories and have no parent, therefore if
-        // item->parent() is truthy, this item holds a filename
+        // item->parent() is truthy, this item holds a filename - unless it is
+        // the "load more" placeholder at the end of a partially loaded category
         connect(ui->treeWidget, &QTreeWidget::itemClicked, [&] (QTreeWidgetItem* item, int column) {
-            ui->btnOpenFile->setEnabled(static_cast<bool>(item->parent()));
+            ui->btnOpenFile->setEnabled(item->parent() && !isLoadMoreItem(item));
         });
 
         connect(ui->treeWidget, &QTreeWidget::itemDoubleClicked, [&] (QTreeWidgetItem* item, int column) {
-            if (item->parent())
+            if (isLoadMoreItem(item))
+            {
+                fetchMore(item->parent());
+            }
+            else if (item->parent())
             {
                 auto filename = item->text(column);
                 emit fileOpened(filename);
             }
         });
+
+        // category children are created on demand and released on collapse
+        connect(ui->treeWidget, &QTreeWidget::itemExpanded, [&] (QTreeWidgetItem* item) {
+            if (!item->parent() && fileChildCount(item) == 0)
+            {
+                fetchMore(item);
+            }
+        });
+
+        connect(ui->treeWidget, &QTreeWidget::itemCollapsed, [&] (QTreeWidgetItem* item) {
+            if (!item->parent())
+            {
+                releaseChildren(item);
+            }
+        });
     }
 
     /**
@@ -70,6 +249,11 @@ namespace Required
     /**
      * Loads project contents into the widget.
      *
+     * Only category items are created here; files are loaded page by page
+     * when a category is expanded, so the cost doesn't depend on the number
+     * of files in the project. Modifications of the project are displayed
+     * in batches, once per frame at most.
+     *
      * @param project the project to be displayed
      */
     void ProjectWidget::setProject(Project *project)
@@ -81,18 +265,18 @@ namespace Required
 
         m_project = project;
         m_project->setParent(this);
-        connect(m_project, &Project::fileAdded, this, &ProjectWidget::addFile);
-        connect(m_project, &Project::fileRemoved, this, &ProjectWidget::removeFile);
+        m_changeQueue = new ProjectChangeQueue(m_project, this);
+        connect(m_changeQueue, &ProjectChangeQueue::changesReady, this, &ProjectWidget::applyChanges);
+        connect(m_project, &Project::relocated, this, &ProjectWidget::onProjectRelocated);
+        connect(m_project, &Project::rootPathChanged, this, &ProjectWidget::onRootPathChanged);
+        connect(m_project, &Project::pathsCompacted, this, &ProjectWidget::onPathsCompacted);
+        connect(m_project, &Project::contentClassifierChanged, this, &ProjectWidget::cancelIngestion);
+        connect(m_project, &Project::fileSystemChanged, this, &ProjectWidget::cancelIngestion);
 
         QStringList categoryShortNames = m_project->getCategoryShortNames();
         foreach (QString shortName, categoryShortNames)
         {
-            QTreeWidgetItem* categoryItem = getCategoryItem(shortName);
-            foreach (QString filename, m_project->getFilesInCategory(shortName))
-            {
-                QTreeWidgetItem* fileItem = getFileItem(filename);
-                categoryItem->addChild(fileItem);
-            }
+            getCategoryItem(shortName);
         }
 
         setWindowTitle(tr("Project: %1").arg(m_project->getName()));
@@ -103,40 +287,219 @@ namespace Required
      */
     void ProjectWidget::closeProject()
     {
-        disconnect(m_project, &Project::fileAdded, this, &ProjectWidget::addFile);
-        disconnect(m_project, &Project::fileRemoved, this, &ProjectWidget::removeFile);
+        cancelIngestion();
+
+        // pending changes refer to the closed project, drop them
+        delete m_changeQueue;
+        m_changeQueue = 0;
+        disconnect(m_project, &Project::relocated, this, &ProjectWidget::onProjectRelocated);
+        disconnect(m_project, &Project::rootPathChanged, this, &ProjectWidget::onRootPathChanged);
+        disconnect(m_project, &Project::pathsCompacted, this, &ProjectWidget::onPathsCompacted);
+        disconnect(m_project, &Project::contentClassifierChanged, this, &ProjectWidget::cancelIngestion);
+        disconnect(m_project, &Project::fileSystemChanged, this, &ProjectWidget::cancelIngestion);
         m_project->deleteLater();
         m_project = 0;
 
+        // commands hold pointers to the project, they can't outlive it
+        m_undoStack->clear();
+
         ui->treeWidget->clear();
         m_categoryItems.clear();
         m_fileItems.clear();
+        m_loadMoreItems.clear();
     }
 
     /**
-     * Adds new file to the display.
+     * Sets the number of file items created at once when browsing a category.
      *
-     * @param filename full path to the file
-     * @param categoryShortName category identifier
+     * @param pageSize number of files per page
      */
-    void ProjectWidget::addFile(QString filename, QString categoryShortName)
+    void ProjectWidget::setPageSize(int pageSize)
     {
-        QTreeWidgetItem* fileItem = getFileItem(filename);
-        QTreeWidgetItem* categoryItem = getCategoryItem(categoryShortName);
-        categoryItem->addChild(fileItem);
+        m_pageSize = qMax(1, pageSize);
     }
 
     /**
-     * Removes a file from the display.
+     * Adds files and whole directory trees in the background.
      *
-     * @param filename full path to the file
-     * @param categoryShortName category identifier
+     * Directories are expanded according to the ignore rules. When done,
+     * the files are added as one undoable step and ingestionFinished() is
+     * emitted.
+     *
+     * @param paths full paths to files and directories
      */
-    void ProjectWidget::removeFile(QString filename, QString categoryShortName)
+    void ProjectWidget::addPaths(QStringList paths)
     {
-        QTreeWidgetItem* fileItem = getFileItem(filename);
-        QTreeWidgetItem* categoryItem = getCategoryItem(categoryShortName);
-        categoryItem->removeChild(fileItem);
+        ingest(paths);
+    }
+
+    /**
+     * Adds files and directories from the clipboard in the background.
+     *
+     * Besides URL lists copied from file managers, plain text with one path
+     * or file URL per line is accepted.
+     */
+    void ProjectWidget::paste()
+    {
+        const QMimeData* mimeData = QGuiApplication::clipboard()->mimeData();
+        if (!hasProject() || !mimeData)
+        {
+            return;
+        }
+
+        QList<QUrl> urls;
+        if (mimeData->hasUrls())
+        {
+            urls = mimeData->urls();
+        }
+        else
+        {
+            foreach (QString line, mimeData->text().split('\n', QString::SkipEmptyParts))
+            {
+                line = line.trimmed();
+                if (line.startsWith("file:"))
+                {
+                    urls.append(QUrl(line));
+                }
+                else if (!line.isEmpty())
+                {
+                    urls.append(QUrl::fromLocalFile(line));
+                }
+            }
+        }
+
+        QMap<QString, QString> failures;
+        QStringList paths = getLocalPaths(urls, failures);
+        ingest(paths, failures);
+    }
+
+    /**
+     * Accepts drags of files and directories.
+     *
+     * @param event drag event
+     */
+    void ProjectWidget::dragEnterEvent(QDragEnterEvent* event)
+    {
+        if (hasProject() && event->mimeData()->hasUrls())
+        {
+            event->acceptProposedAction();
+        }
+    }
+
+    /**
+     * Adds dropped files and directories in the background.
+     *
+     * @param event drop event
+     */
+    void ProjectWidget::dropEvent(QDropEvent* event)
+    {
+        if (!hasProject() || !event->mimeData()->hasUrls())
+        {
+            return;
+        }
+
+        QMap<QString, QString> failures;
+        QStringList paths = getLocalPaths(event->mimeData()->urls(), failures);
+        ingest(paths, failures);
+        event->acceptProposedAction();
+    }
+
+    /**
+     * Displays a batch of project modifications.
+     *
+     * The tree is repainted and every affected category label is refreshed
+     * once per batch, not once per file.
+     *
+     * @param changes modifications since the previous batch
+     */
+    void ProjectWidget::applyChanges(const ProjectChangeSet& changes)
+    {
+        QSet<QTreeWidgetItem*> categoryItems;
+        ui->treeWidget->setUpdatesEnabled(false);
+        foreach (const CategorizedFile& file, changes.removed)
+        {
+            categoryItems.insert(deleteFileItem(file.first, file.second));
+        }
+        foreach (const CategorizedFile& file, changes.added)
+        {
+            categoryItems.insert(insertFileItem(file.first, file.second));
+        }
+        categoryItems.remove(0);
+        foreach (QTreeWidgetItem* categoryItem, categoryItems)
+        {
+            updateCategoryItem(categoryItem);
+        }
+        ui->treeWidget->setUpdatesEnabled(true);
+    }
+
+    /**
+     * Rebuilds the display after the project root was moved.
+     *
+     * Every file item would show an outdated path, so all items are dropped
+     * and categories are browsed again from scratch. Undoable commands refer
+     * to the old paths as well, so the undo history is discarded.
+     *
+     * @param rootPath new root directory
+     */
+    void ProjectWidget::onProjectRelocated(QString rootPath)
+    {
+        m_undoStack->clear();
+        reloadCategories();
+    }
+
+    /**
+     * Rebuilds the display after the stored paths were re-encoded.
+     *
+     * Absolute paths stay the same, but file items are registered by path
+     * handles, which changed along with the stored paths.
+     *
+     * @param rootPath new root directory
+     */
+    void ProjectWidget::onRootPathChanged(QString rootPath)
+    {
+        reloadCategories();
+    }
+
+    /**
+     * Moves file items over to the handles of the compacted path pool.
+     *
+     * Relative paths don't change, so every live file is found in the new
+     * pool. Items of removed files whose removal is still queued are deleted
+     * right away, as their paths can no longer be looked up later.
+     */
+    void ProjectWidget::onPathsCompacted()
+    {
+        QSharedPointer<PathPool> pathPool = m_project->getPathPool();
+        QHash<PathHandle, QTreeWidgetItem*> fileItems;
+        QHash<PathHandle, QTreeWidgetItem*>::const_iterator it;
+        for (it = m_fileItems.constBegin(); it != m_fileItems.constEnd(); ++it)
+        {
+            PathHandle file = pathPool->find(it.key().toString());
+            if (file.isNull())
+            {
+                delete it.value();
+                continue;
+            }
+            it.value()->setData(0, Qt::UserRole, QVariant::fromValue(file));
+            fileItems.insert(file, it.value());
+        }
+        m_fileItems.swap(fileItems);
+    }
+
+    /**
+     * Drops all items and creates category items from scratch.
+     */
+    void ProjectWidget::reloadCategories()
+    {
+        ui->treeWidget->clear();
+        m_categoryItems.clear();
+        m_fileItems.clear();
+        m_loadMoreItems.clear();
+
+        foreach (QString shortName, m_project->getCategoryShortNames())
+        {
+            getCategoryItem(shortName);
+        }
     }
 
     /**
@@ -155,8 +518,10 @@ namespace Required
         if (!item)
         {
             // item == 0, that means we have to create one
-            FileCategory category = FileCategory::getCategory(categoryShortName);
-            item = new QTreeWidgetItem(QStringList() << category.getDisplayedName());
+            item = new QTreeWidgetItem;
+            item->setData(0, Qt::UserRole, categoryShortName);
+            item->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
+            updateCategoryItem(item);
             // store a pointer to the item in the category => item mapping
             m_categoryItems[categoryShortName] = item;
             ui->treeWidget->addTopLevelItem(item);
@@ -166,24 +531,180 @@ namespace Required
     }
 
     /**
-     * Returns an item for a filename.
+     * Refreshes the label of a category item with the current file count.
+     *
+     * The project keeps category counts and sizes up to date, so this is
+     * a constant-time lookup. Full statistics aren't used, as they may scan
+     * the category for its newest file after removals.
+     *
+     * @param categoryItem top-level category item
+     */
+    void ProjectWidget::updateCategoryItem(QTreeWidgetItem* categoryItem)
+    {
+        QString shortName = categoryItem->data(0, Qt::UserRole).toString();
+        FileCategory category = FileCategory::getCategory(shortName);
+        int fileCount = m_project->getCategoryFileCount(shortName);
+        qint64 totalSize = m_project->getCategorySize(shortName);
+        categoryItem->setText(0, tr("%1 (%2)").arg(category.getDisplayedName())
+                                              .arg(fileCount));
+        categoryItem->setToolTip(0, tr("%n file(s), %1 KiB", 0, fileCount)
+                                    .arg((totalSize + 1023) / 1024));
+    }
+
+    /**
+     * Creates an item for a new file if its category is expanded.
+     *
+     * The category label is not refreshed.
      *
      * @param filename full path to the file
+     * @param categoryShortName category identifier
+     * @return category item of the file
+     */
+    QTreeWidgetItem* ProjectWidget::insertFileItem(QString filename, QString categoryShortName)
+    {
+        QTreeWidgetItem* categoryItem = getCategoryItem(categoryShortName);
+        PathHandle file = m_project->getFileHandle(filename);
+        if (categoryItem->isExpanded() && !file.isNull())
+        {
+            // new files come first in Project's category order, so adding
+            // them right away keeps the offset of the next page valid
+            categoryItem->insertChild(0, getFileItem(file));
+        }
+
+        return categoryItem;
+    }
+
+    /**
+     * Deletes the item of a removed file, if there is one.
+     *
+     * The category label is not refreshed.
+     *
+     * @param filename full path to the file
+     * @param categoryShortName category identifier
+     * @return category item of the file, 0 if the category isn't displayed
+     */
+    QTreeWidgetItem* ProjectWidget::deleteFileItem(QString filename, QString categoryShortName)
+    {
+        // the file is gone from the project, but its path stays pooled until
+        // the pool is compacted, see onPathsCompacted()
+        PathHandle file = m_project->getPathPool()->find(
+            Project::toRelativePath(m_project->getRootPath(), filename));
+
+        // deleting the item detaches it from its category item as well
+        delete m_fileItems.take(file);
+
+        return m_categoryItems.value(categoryShortName);
+    }
+
+    /**
+     * Returns an item for a file.
+     *
+     * @param file handle of the file in the project
      * @return item for the file
      */
-    QTreeWidgetItem* ProjectWidget::getFileItem(QString filename)
+    QTreeWidgetItem* ProjectWidget::getFileItem(PathHandle file)
     {
-        QTreeWidgetItem* item = m_fileItems[filename];
+        QTreeWidgetItem* item = m_fileItems.value(file);
         if (!item)
         {
             // no item found in the mapping so we create one
-            item = new QTreeWidgetItem(QStringList() << filename);
-            m_fileItems[filename] = item;
+            item = new QTreeWidgetItem(QStringList() << m_project->getFilePath(file));
+            item->setData(0, Qt::UserRole, QVariant::fromValue(file));
+            m_fileItems.insert(file, item);
         }
 
         return item;
     }
 
+    /**
+     * Creates items for the next page of files in a category.
+     *
+     * If there are more files left, a "load more" item is kept at the end
+     * of the category; double-clicking it loads another page.
+     *
+     * @param categoryItem top-level category item
+     */
+    void ProjectWidget::fetchMore(QTreeWidgetItem* categoryItem)
+    {
+        // the offset below counts displayed items, which have to reflect
+        // the project, or queued removals would make the page skip files
+        if (m_changeQueue)
+        {
+            m_changeQueue->flush();
+        }
+
+        QString shortName = categoryItem->data(0, Qt::UserRole).toString();
+        // ask for one file more than needed to know whether to offer more
+        QList<PathHandle> files = m_project->getFileHandlesInCategory(shortName,
+                                                                      fileChildCount(categoryItem),
+                                                                      m_pageSize + 1);
+        bool hasMore = files.size() > m_pageSize;
+        if (hasMore)
+        {
+            files.removeLast();
+        }
+
+        QList<QTreeWidgetItem*> fileItems;
+        foreach (const PathHandle& file, files)
+        {
+            if (!m_fileItems.contains(file))
+            {
+                fileItems.append(getFileItem(file));
+            }
+        }
+        categoryItem->insertChildren(fileChildCount(categoryItem), fileItems);
+
+        QTreeWidgetItem* loadMoreItem = m_loadMoreItems.value(categoryItem);
+        if (hasMore && !loadMoreItem)
+        {
+            loadMoreItem = new QTreeWidgetItem(QStringList() << tr("Load more..."));
+            m_loadMoreItems.insert(categoryItem, loadMoreItem);
+            categoryItem->addChild(loadMoreItem);
+        }
+        else if (!hasMore && loadMoreItem)
+        {
+            delete m_loadMoreItems.take(categoryItem);
+        }
+    }
+
+    /**
+     * Deletes all file items of a collapsed category.
+     *
+     * @param categoryItem top-level category item
+     */
+    void ProjectWidget::releaseChildren(QTreeWidgetItem* categoryItem)
+    {
+        m_loadMoreItems.remove(categoryItem);
+        foreach (QTreeWidgetItem* item, categoryItem->takeChildren())
+        {
+            m_fileItems.remove(item->data(0, Qt::UserRole).value<PathHandle>());
+            delete item;
+        }
+    }
+
+    /**
+     * Returns the number of file items currently loaded into a category.
+     *
+     * @param categoryItem top-level category item
+     * @return number of file items, not counting the "load more" item
+     */
+    int ProjectWidget::fileChildCount(QTreeWidgetItem* categoryItem) const
+    {
+        int count = categoryItem->childCount();
+        return m_loadMoreItems.contains(categoryItem) ? count - 1 : count;
+    }
+
+    /**
+     * Checks whether the item is a "load more" placeholder.
+     *
+     * @param item any tree item
+     * @return true for placeholders
+     */
+    bool ProjectWidget::isLoadMoreItem(QTreeWidgetItem* item) const
+    {
+        return item->parent() && m_loadMoreItems.value(item->parent()) == item;
+    }
+
     void ProjectWidget::on_btnAddFile_clicked()
     {
         QString filename = QFileDialog::getOpenFileName(
@@ -191,8 +712,13 @@ namespace Required
             tr("Add file to project"),
             QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation)
         );
-        auto category = FileCategory::getCategoryForFilename(filename);
-        m_project->addFile(filename, category.getShortName());
+        if (filename.isEmpty())
+        {
+            return;
+        }
+        // validated like dropped files, so a file which is missing or already
+        // in the project doesn't leave an empty step on the undo stack
+        ingest(QStringList() << filename);
     }
 
     void ProjectWidget::on_btnAddDirectory_clicked()
@@ -202,13 +728,116 @@ namespace Required
             tr("Add all files in a directory to project"),
             QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation)
         );
-        QDir dir(dirName);
-        foreach (auto fileinfo, dir.entryInfoList(QDir::Files | QDir::NoDotAndDotDot))
+        if (dirName.isEmpty())
+        {
+            return;
+        }
+        // large trees take a while, the widget stays responsive meanwhile
+        ingest(QStringList() << dirName);
+    }
+
+    /**
+     * Converts dropped or pasted URLs to file paths.
+     *
+     * @param urls URLs of files and directories
+     * @param failures receives URLs which aren't local files
+     * @return paths of local files and directories
+     */
+    QStringList ProjectWidget::getLocalPaths(const QList<QUrl>& urls,
+                                             QMap<QString, QString>& failures) const
+    {
+        QStringList paths;
+        foreach (const QUrl& url, urls)
+        {
+            if (url.isLocalFile())
+            {
+                paths.append(QDir::cleanPath(url.toLocalFile()));
+            }
+            else
+            {
+                failures.insert(url.toDisplayString(), tr("Only local files can be added"));
+            }
+        }
+
+        return paths;
+    }
+
+    /**
+     * Starts a background ingestion of files and directories.
+     *
+     * Several ingestions may run at once, e.g. for consecutive drops.
+     *
+     * @param paths full paths to files and directories
+     * @param failures files already known to fail, reported with the result
+     */
+    void ProjectWidget::ingest(QStringList paths, QMap<QString, QString> failures)
+    {
+        if (!hasProject() || (paths.isEmpty() && failures.isEmpty()))
+        {
+            return;
+        }
+
+        m_ingestionTaskIds.insert(TaskScheduler::getDefault()->schedule(
+            new IngestionTask(this, m_project->getFileSystem(), m_project->getContentClassifier(),
+                              m_ignoreRules, paths, failures)));
+    }
+
+    /**
+     * Adds ingested files to the project as one undoable step.
+     *
+     * Files added to the project in the meantime are skipped. If no file is
+     * left, nothing is pushed to the undo stack.
+     *
+     * @param taskId identifier of the ingestion task
+     * @param result validated files and failures
+     */
+    void ProjectWidget::onFilesIngested(int taskId, Required::IngestionResult result)
+    {
+        if (!m_ingestionTaskIds.remove(taskId) || !hasProject())
+        {
+            return;
+        }
+
+        RecordedFileList newFiles;
+        foreach (const RecordedFile& file, result.files)
+        {
+            if (!m_project->hasFile(file.first))
+            {
+                newFiles.append(file);
+            }
+        }
+
+        int addedCount = 0;
+        if (!newFiles.isEmpty())
+        {
+            AddFilesCommand* command = new AddFilesCommand(m_project, newFiles);
+            m_undoStack->push(command);
+            addedCount = command->getAddedCount();
+        }
+
+        emit ingestionFinished(addedCount, result.failures);
+    }
+
+    /**
+     * Abandons all running ingestions.
+     *
+     * The tasks post their results to the widget and use the project's
+     * file system and content classifier, so they have to finish before
+     * any of these goes away. Directory walks and classification check
+     * the cancellation between directories and files, so the wait is
+     * short.
+     */
+    void ProjectWidget::cancelIngestion()
+    {
+        foreach (int taskId, m_ingestionTaskIds)
+        {
+            TaskScheduler::getDefault()->cancel(taskId);
+        }
+        foreach (int taskId, m_ingestionTaskIds)
         {
-            auto filename = fileinfo.absoluteFilePath();
-            auto category = FileCategory::getCategoryForFilename(filename);
-            m_project->addFile(filename, category.getShortName());
+            TaskScheduler::getDefault()->waitFor(taskId);
         }
+        m_ingestionTaskIds.clear();
     }
 
     void ProjectWidget::on_btnOpenFile_clicked()
@@ -19,10 +19,22 @@
 #define PROJECTWIDGET_H
 
 #include "../global.h"
+#include "IgnoreRules.h"
+#include "PathPool.h"
 #include "Project.h"
+#include "ProjectChangeQueue.h"
+#include "TaskScheduler.h"
+#include <QDragEnterEvent>
+#include <QDropEvent>
+#include <QHash>
+#include <QList>
 #include <QMap>
+#include <QSet>
+#include <QStringList>
 #include <QTreeWidget>
 #include <QTreeWidgetItem>
+#include <QUndoStack>
+#include <QUrl>
 #include <QWidget>
 
 namespace Ui
@@ -33,8 +45,31 @@ namespace Ui
 
 namespace Required
 {
+    /**
+     * Files collected by a background ingestion.
+     */
+    struct REQUIRED_EXPORT IngestionResult
+    {
+        /**
+         * Validated files with their categories, sizes and modification times.
+         */
+        RecordedFileList files;
+
+        /**
+         * Reasons why files couldn't be added, by file path.
+         */
+        QMap<QString, QString> failures;
+    };
+
     /**
      * A widget which knows how to display contents of a project.
+     *
+     * Files and directories can be dropped onto the widget or pasted from
+     * the clipboard. They are ingested in the background: directories are
+     * expanded (honouring the ignore rules), files are validated and
+     * categorized, and the result is added as one undoable batch. Files
+     * which can't be added are reported by ingestionFinished() instead of
+     * aborting the whole drop.
      */
     class REQUIRED_EXPORT ProjectWidget : public QWidget
     {
@@ -58,17 +93,73 @@ namespace Required
 
         void closeProject();
 
+        /**
+         * Returns the stack of undoable project modifications.
+         *
+         * @return undo stack of the currently loaded project
+         */
+        QUndoStack* getUndoStack() const
+        {
+            return m_undoStack;
+        }
+
+        /**
+         * Returns the number of file items created at once when browsing a category.
+         *
+         * @return number of files per page
+         */
+        int getPageSize() const
+        {
+            return m_pageSize;
+        }
+
+        void setPageSize(int pageSize);
+
+        /**
+         * Returns the rules excluding files when adding a directory.
+         *
+         * @return ignore rules
+         */
+        IgnoreRules getIgnoreRules() const
+        {
+            return m_ignoreRules;
+        }
+
+        /**
+         * Sets the rules excluding files when adding a directory.
+         *
+         * By default, only version control directories are excluded,
+         * besides what .gitignore files in the added tree say.
+         *
+         * @param rules ignore rules
+         */
+        void setIgnoreRules(const IgnoreRules& rules)
+        {
+            m_ignoreRules = rules;
+        }
+
     public slots:
-        void addFile(QString filename, QString categoryShortName = "");
-        void removeFile(QString filename, QString categoryShortName = "");
+        void addPaths(QStringList paths);
+        void paste();
+
+    protected:
+        void dragEnterEvent(QDragEnterEvent* event);
+        void dropEvent(QDropEvent* event);
 
     private slots:
         void on_btnAddFile_clicked();
         void on_btnAddDirectory_clicked();
         void on_btnOpenFile_clicked();
+        void onProjectRelocated(QString rootPath);
+        void onRootPathChanged(QString rootPath);
+        void onPathsCompacted();
+        void applyChanges(const ProjectChangeSet& changes);
+        void onFilesIngested(int taskId, Required::IngestionResult result);
+        void cancelIngestion();
 
     signals:
         void fileOpened(QString filename);
+        void ingestionFinished(int addedCount, QMap<QString, QString> failures);
 
     private:
         /**
@@ -76,24 +167,69 @@ namespace Required
          */
         Project* m_project;
 
+        /**
+         * Coalesces project modifications into one display update per frame.
+         */
+        ProjectChangeQueue* m_changeQueue;
+
         /**
          * UI class generated from Qt Designer.
          */
         Ui::ProjectWidget *ui;
 
+        /**
+         * Undoable modifications made through the widget.
+         */
+        QUndoStack* m_undoStack;
+
         /**
          * A register of top-level items corresponding to category identifiers.
          */
         QMap<QString, QTreeWidgetItem*> m_categoryItems;
 
         /**
-         * A register of leaf items corresponding to filenames.
+         * A register of leaf items corresponding to files.
+         *
+         * Only files of expanded categories have items. Files are identified
+         * by their handles in the project's path pool.
+         */
+        QHash<PathHandle, QTreeWidgetItem*> m_fileItems;
+
+        /**
+         * "Load more" placeholders of partially loaded category items.
+         */
+        QMap<QTreeWidgetItem*, QTreeWidgetItem*> m_loadMoreItems;
+
+        /**
+         * Number of file items created at once when browsing a category.
          */
-        QMap<QString, QTreeWidgetItem*> m_fileItems;
+        int m_pageSize;
+
+        /**
+         * Rules excluding files when adding a directory.
+         */
+        IgnoreRules m_ignoreRules;
+
+        /**
+         * Scheduler tasks ingesting dropped, pasted or chosen files.
+         */
+        QSet<int> m_ingestionTaskIds;
 
         QTreeWidgetItem* getCategoryItem(QString categoryShortName);
-        QTreeWidgetItem* getFileItem(QString filename);
+        QTreeWidgetItem* getFileItem(PathHandle file);
+        void updateCategoryItem(QTreeWidgetItem* categoryItem);
+        QTreeWidgetItem* insertFileItem(QString filename, QString categoryShortName);
+        QTreeWidgetItem* deleteFileItem(QString filename, QString categoryShortName);
+        void fetchMore(QTreeWidgetItem* categoryItem);
+        void releaseChildren(QTreeWidgetItem* categoryItem);
+        int fileChildCount(QTreeWidgetItem* categoryItem) const;
+        bool isLoadMoreItem(QTreeWidgetItem* item) const;
+        void reloadCategories();
+        QStringList getLocalPaths(const QList<QUrl>& urls, QMap<QString, QString>& failures) const;
+        void ingest(QStringList paths, QMap<QString, QString> failures = QMap<QString, QString>());
     };
 }
 
+Q_DECLARE_METATYPE(Required::IngestionResult)
+
 #endif // PROJECTWIDGET_H
@@ -0,0 +1,325 @@
+/**
+ * @file SpillFile.cpp
+ *
+ * A temporary file holding cache entries evicted from memory.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "SpillFile.h"
+#include "BloomFilter.h"
+#include <QDir>
+
+namespace Required
+{
+    namespace
+    {
+        /**
+         * Files smaller than this are never compacted.
+         */
+        const qint64 MinCompactionSize = 16 * 1024 * 1024;
+
+        /**
+         * Default size a file may grow to.
+         */
+        const qint64 DefaultMaxSize = Q_INT64_C(1024) * 1024 * 1024;
+
+        /**
+         * Header of an entry, followed by the UTF-16 key and the value.
+         */
+        struct EntryHeader
+        {
+            quint32 keySize;
+            quint32 valueSize;
+        };
+
+        /**
+         * Hashes a key.
+         */
+        inline quint64 hashKey(const QString& key)
+        {
+            return BloomFilter::hash(key.constData(), key.size());
+        }
+    }
+
+    /**
+     * Creates a closed spill file.
+     */
+    SpillFile::SpillFile():
+        m_file(0), m_liveSize(0), m_maxSize(DefaultMaxSize)
+    {
+    }
+
+    /**
+     * Closes and removes the file.
+     */
+    SpillFile::~SpillFile()
+    {
+        close();
+    }
+
+    /**
+     * Creates a new, empty file.
+     *
+     * @param directory directory of the file, empty for the temporary one
+     * @return true if the file could be created
+     */
+    bool SpillFile::open(QString directory)
+    {
+        close();
+        m_directory = directory.isEmpty() ? QDir::tempPath() : directory;
+        m_file = new QTemporaryFile(QDir(m_directory).filePath("required-spill-XXXXXX"));
+        if (!m_file->open())
+        {
+            delete m_file;
+            m_file = 0;
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Closes and removes the file, dropping all entries.
+     */
+    void SpillFile::close()
+    {
+        delete m_file;
+        m_file = 0;
+        m_index.clear();
+        m_liveSize = 0;
+    }
+
+    /**
+     * Returns the size of the file on disk.
+     *
+     * @return size in bytes, including entries already taken
+     */
+    qint64 SpillFile::getSize() const
+    {
+        return m_file ? m_file->size() : 0;
+    }
+
+    /**
+     * Appends an entry, replacing an entry with the same key.
+     *
+     * If the file grows past its maximum size, the oldest entries are
+     * dropped.
+     *
+     * @param key key of the entry
+     * @param value value of the entry
+     * @return false if the file is not open, the entry is larger than the
+     *         maximum size or the file couldn't be written
+     */
+    bool SpillFile::write(const QString& key, const QByteArray& value)
+    {
+        if (!m_file)
+        {
+            return false;
+        }
+
+        // a colliding key loses its entry, which is fine for a cache
+        quint64 hash = hashKey(key);
+        QHash<quint64, Slot>::iterator old = m_index.find(hash);
+        if (old != m_index.end())
+        {
+            m_liveSize -= old->size;
+            m_index.erase(old);
+        }
+
+        EntryHeader header;
+        header.keySize = quint32(key.size());
+        header.valueSize = quint32(value.size());
+        Slot slot;
+        slot.offset = m_file->size();
+        slot.size = qint64(sizeof(header)) + key.size() * sizeof(QChar) + value.size();
+        if (slot.size > m_maxSize)
+        {
+            return false;
+        }
+        if (!m_file->seek(slot.offset) ||
+            m_file->write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header) ||
+            m_file->write(reinterpret_cast<const char*>(key.constData()),
+                          key.size() * sizeof(QChar)) != qint64(key.size() * sizeof(QChar)) ||
+            m_file->write(value) != value.size())
+        {
+            return false;
+        }
+
+        m_index.insert(hash, slot);
+        m_liveSize += slot.size;
+        reclaim();
+
+        return true;
+    }
+
+    /**
+     * Reads an entry and removes it.
+     *
+     * @param key key of the entry
+     * @param value receives the value
+     * @return false if there is no such entry
+     */
+    bool SpillFile::take(const QString& key, QByteArray& value)
+    {
+        if (!m_file)
+        {
+            return false;
+        }
+
+        QHash<quint64, Slot>::iterator it = m_index.find(hashKey(key));
+        if (it == m_index.end())
+        {
+            return false;
+        }
+        Slot slot = it.value();
+
+        EntryHeader header;
+        bool found = m_file->seek(slot.offset) &&
+                     m_file->read(reinterpret_cast<char*>(&header), sizeof(header)) == sizeof(header) &&
+                     header.keySize == quint32(key.size());
+        if (found)
+        {
+            QString storedKey(key.size(), Qt::Uninitialized);
+            qint64 keyBytes = key.size() * sizeof(QChar);
+            found = m_file->read(reinterpret_cast<char*>(storedKey.data()), keyBytes) == keyBytes &&
+                    storedKey == key;
+            if (found)
+            {
+                value = m_file->read(header.valueSize);
+                found = value.size() == int(header.valueSize);
+            }
+        }
+        if (!found)
+        {
+            // another key with the same hash
+            return false;
+        }
+
+        m_index.erase(it);
+        m_liveSize -= slot.size;
+        reclaim();
+
+        return true;
+    }
+
+    /**
+     * Drops all entries.
+     */
+    void SpillFile::clear()
+    {
+        m_index.clear();
+        m_liveSize = 0;
+        if (m_file)
+        {
+            m_file->resize(0);
+        }
+    }
+
+    /**
+     * Shrinks the file once it's too large or mostly dead space.
+     *
+     * A file over its maximum size loses its oldest entries down to half of
+     * that size, so that the next few writes don't drop entries again.
+     */
+    void SpillFile::reclaim()
+    {
+        qint64 size = m_file->size();
+        if (size > m_maxSize)
+        {
+            dropOldest(m_maxSize / 2);
+        }
+
+        if (m_index.isEmpty())
+        {
+            m_file->resize(0);
+        }
+        else if (size > m_maxSize || (size > MinCompactionSize && size > 4 * m_liveSize))
+        {
+            compact();
+        }
+    }
+
+    /**
+     * Drops entries in the order they were written until few enough remain.
+     *
+     * Only the index is updated; the space is reclaimed by compact().
+     *
+     * @param liveSize total size of the entries to keep at most
+     */
+    void SpillFile::dropOldest(qint64 liveSize)
+    {
+        QMap<qint64, quint64> hashesByOffset = getHashesByOffset();
+        QMap<qint64, quint64>::const_iterator it = hashesByOffset.constBegin();
+        while (m_liveSize > liveSize && it != hashesByOffset.constEnd())
+        {
+            m_liveSize -= m_index.take(it.value()).size;
+            ++it;
+        }
+    }
+
+    /**
+     * Copies the live entries to a new file, leaving out taken ones.
+     *
+     * Entries keep the order they were written in, so that dropOldest()
+     * still finds the oldest ones first. On failure the old file is kept.
+     */
+    void SpillFile::compact()
+    {
+        QTemporaryFile* file = new QTemporaryFile(QDir(m_directory).filePath("required-spill-XXXXXX"));
+        if (!file->open())
+        {
+            delete file;
+            return;
+        }
+
+        QMap<qint64, quint64> hashesByOffset = getHashesByOffset();
+        QHash<quint64, Slot> index;
+        index.reserve(m_index.size());
+        QMap<qint64, quint64>::const_iterator it;
+        for (it = hashesByOffset.constBegin(); it != hashesByOffset.constEnd(); ++it)
+        {
+            Slot oldSlot = m_index.value(it.value());
+            Slot slot;
+            slot.offset = file->pos();
+            slot.size = oldSlot.size;
+            if (!m_file->seek(oldSlot.offset) ||
+                file->write(m_file->read(oldSlot.size)) != oldSlot.size)
+            {
+                delete file;
+                return;
+            }
+            index.insert(it.value(), slot);
+        }
+
+        delete m_file;
+        m_file = file;
+        m_index = index;
+    }
+
+    /**
+     * Returns the keys of all entries in the order they were written.
+     *
+     * @return key hashes by offset of their entries
+     */
+    QMap<qint64, quint64> SpillFile::getHashesByOffset() const
+    {
+        QMap<qint64, quint64> hashesByOffset;
+        QHash<quint64, Slot>::const_iterator it;
+        for (it = m_index.constBegin(); it != m_index.constEnd(); ++it)
+        {
+            hashesByOffset.insert(it->offset, it.key());
+        }
+
+        return hashesByOffset;
+    }
+}
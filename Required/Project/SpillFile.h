@@ -0,0 +1,144 @@
+/**
+ * @file SpillFile.h
+ *
+ * A temporary file holding cache entries evicted from memory.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef SPILLFILE_H
+#define SPILLFILE_H
+
+#include "../global.h"
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QString>
+#include <QTemporaryFile>
+
+namespace Required
+{
+    /**
+     * A temporary file holding cache entries evicted from memory.
+     *
+     * Entries are appended to the file, and only a 64-bit hash of the key
+     * with the position of the entry stays in memory. Reading an entry back
+     * with take() removes it, as it returns to the memory of the cache.
+     * Once most of the file is taken or replaced entries, the live ones are
+     * copied to a new file. The file never grows past its maximum size;
+     * when it would, the oldest entries are dropped.
+     *
+     * The file is removed when closed. Not thread-safe; caches use it under
+     * their own lock.
+     */
+    class REQUIRED_EXPORT SpillFile
+    {
+    public:
+        SpillFile();
+        ~SpillFile();
+
+        bool open(QString directory = "");
+        void close();
+
+        /**
+         * Checks whether the file is open.
+         *
+         * @return true after a successful open()
+         */
+        bool isOpen() const
+        {
+            return m_file != 0;
+        }
+
+        /**
+         * Returns the number of entries in the file.
+         *
+         * @return entry count
+         */
+        int getCount() const
+        {
+            return m_index.size();
+        }
+
+        qint64 getSize() const;
+
+        /**
+         * Returns the size the file may grow to.
+         *
+         * @return size in bytes
+         */
+        qint64 getMaxSize() const
+        {
+            return m_maxSize;
+        }
+
+        /**
+         * Sets the size the file may grow to.
+         *
+         * Takes effect with the next write.
+         *
+         * @param maxSize size in bytes
+         */
+        void setMaxSize(qint64 maxSize)
+        {
+            m_maxSize = maxSize;
+        }
+
+        bool write(const QString& key, const QByteArray& value);
+        bool take(const QString& key, QByteArray& value);
+        void clear();
+
+    private:
+        Q_DISABLE_COPY(SpillFile)
+
+        /**
+         * Position of an entry in the file.
+         */
+        struct Slot
+        {
+            qint64 offset;
+            qint64 size;
+        };
+
+        /**
+         * The file, 0 if not open.
+         */
+        QTemporaryFile* m_file;
+
+        /**
+         * Directory of the file.
+         */
+        QString m_directory;
+
+        /**
+         * Entries by hash of their key.
+         */
+        QHash<quint64, Slot> m_index;
+
+        /**
+         * Total size of the entries in the index.
+         */
+        qint64 m_liveSize;
+
+        /**
+         * Size the file may grow to.
+         */
+        qint64 m_maxSize;
+
+        void reclaim();
+        void dropOldest(qint64 liveSize);
+        void compact();
+        QMap<qint64, quint64> getHashesByOffset() const;
+    };
+}
+
+#endif // SPILLFILE_H
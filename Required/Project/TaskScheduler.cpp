@@ -0,0 +1,619 @@
+/**
+ * @file TaskScheduler.cpp
+ *
+ * A shared scheduler of background work with priorities and I/O limits.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "TaskScheduler.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+
+#if defined(Q_OS_UNIX)
+#  include <sys/stat.h>
+#  include <sys/types.h>
+#endif
+
+namespace Required
+{
+    namespace
+    {
+        /**
+         * Number of concurrent tasks per device; enough to keep the queue
+         * of a disk busy without making it seek between many files.
+         */
+        const int DefaultDeviceLimit = 2;
+
+        /**
+         * Guards defaultScheduler.
+         */
+        QMutex defaultSchedulerMutex;
+
+        /**
+         * The scheduler returned by TaskScheduler::getDefault(), 0 until
+         * it's needed.
+         */
+        TaskScheduler* defaultScheduler = 0;
+
+        /**
+         * Destroys the default scheduler along with the application.
+         */
+        void destroyDefaultScheduler()
+        {
+            defaultSchedulerMutex.lock();
+            TaskScheduler* scheduler = defaultScheduler;
+            defaultScheduler = 0;
+            defaultSchedulerMutex.unlock();
+
+            delete scheduler;
+        }
+    }
+
+    /**
+     * Runs a task on a pool thread and reports back to the scheduler.
+     */
+    class TaskScheduler::Runner : public QRunnable
+    {
+    public:
+        Runner(TaskScheduler* scheduler, ScheduledTask* task):
+            m_scheduler(scheduler), m_task(task)
+        {
+        }
+
+        void run()
+        {
+            m_scheduler->m_mutex.lock();
+            m_scheduler->m_threadTasks.insert(QThread::currentThread(), m_task);
+            m_scheduler->m_mutex.unlock();
+
+            // a task cancelled after being handed to the pool doesn't start
+            if (!m_task->isCancelled())
+            {
+                m_task->run();
+            }
+            m_scheduler->taskDone(m_task);
+        }
+
+    private:
+        TaskScheduler* m_scheduler;
+        ScheduledTask* m_task;
+    };
+
+    /**
+     * Creates a scheduler.
+     *
+     * @param pool thread pool running the tasks, 0 for the global one; the
+     *        scheduler doesn't take ownership of it
+     * @param parent parent object
+     */
+    TaskScheduler::TaskScheduler(QThreadPool* pool, QObject* parent):
+        QObject(parent), m_pool(pool ? pool : QThreadPool::globalInstance()),
+        m_defaultDeviceLimit(DefaultDeviceLimit), m_nextId(1)
+    {
+        for (int i = 0; i < PriorityCount; ++i)
+        {
+            m_running[i] = 0;
+        }
+    }
+
+    /**
+     * Destroys the scheduler, cancelling all tasks and waiting for the
+     * running ones.
+     */
+    TaskScheduler::~TaskScheduler()
+    {
+        cancelAll();
+        waitForDone();
+    }
+
+    /**
+     * Returns the limit of concurrent tasks for devices without their own.
+     *
+     * @return task count
+     */
+    int TaskScheduler::getDefaultDeviceLimit() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_defaultDeviceLimit;
+    }
+
+    /**
+     * Sets the limit of concurrent tasks for devices without their own.
+     *
+     * @param limit task count
+     */
+    void TaskScheduler::setDefaultDeviceLimit(int limit)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_defaultDeviceLimit = qMax(1, limit);
+        dispatch();
+    }
+
+    /**
+     * Returns the limit of concurrent tasks doing I/O on a device.
+     *
+     * @param device device identifier
+     * @return task count
+     */
+    int TaskScheduler::getDeviceLimit(QString device) const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_deviceLimits.value(device, m_defaultDeviceLimit);
+    }
+
+    /**
+     * Sets the limit of concurrent tasks doing I/O on a device.
+     *
+     * Solid state disks and network shares usually deserve a higher limit
+     * than the default.
+     *
+     * @param device device identifier, see getDevice()
+     * @param limit task count
+     */
+    void TaskScheduler::setDeviceLimit(QString device, int limit)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_deviceLimits.insert(device, qMax(1, limit));
+        dispatch();
+    }
+
+    /**
+     * Returns the number of tasks which haven't finished yet.
+     *
+     * @return number of queued and running tasks
+     */
+    int TaskScheduler::getPendingCount() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_tasks.size();
+    }
+
+    /**
+     * Submits a task.
+     *
+     * The task is started as soon as its priority class and device allow.
+     *
+     * @param task the task; owned by the scheduler if auto-deleted
+     * @return task identifier
+     */
+    int TaskScheduler::schedule(ScheduledTask* task)
+    {
+        QMutexLocker locker(&m_mutex);
+        int id = m_nextId++;
+        task->m_id = id;
+        task->m_scheduler = this;
+        m_tasks.insert(id, task);
+        m_queues[task->m_priority].append(task);
+        dispatch();
+
+        return id;
+    }
+
+    /**
+     * Cancels a task.
+     *
+     * A queued task is dropped right away; a running one is asked to stop
+     * and finishes when its run() returns. Either way finished() reports
+     * the task as cancelled.
+     *
+     * @param id task identifier
+     * @return false if the task has already finished
+     */
+    bool TaskScheduler::cancel(int id)
+    {
+        QMutexLocker locker(&m_mutex);
+        ScheduledTask* task = m_tasks.value(id);
+        if (!task)
+        {
+            return false;
+        }
+
+        task->m_cancelled.store(1);
+        if (m_queues[task->m_priority].removeOne(task))
+        {
+            m_tasks.remove(id);
+            QMetaObject::invokeMethod(this, "onFinished", Qt::QueuedConnection,
+                                      Q_ARG(int, id), Q_ARG(bool, true));
+            m_taskFinished.wakeAll();
+            if (task->m_autoDelete)
+            {
+                locker.unlock();
+                delete task;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Cancels all queued and running tasks.
+     */
+    void TaskScheduler::cancelAll()
+    {
+        m_mutex.lock();
+        QList<int> ids = m_tasks.keys();
+        m_mutex.unlock();
+
+        foreach (int id, ids)
+        {
+            cancel(id);
+        }
+    }
+
+    /**
+     * Checks whether a task has finished, i.e. has run or was cancelled.
+     *
+     * @param id task identifier
+     * @return true if the task is no longer queued or running
+     */
+    bool TaskScheduler::isFinished(int id) const
+    {
+        QMutexLocker locker(&m_mutex);
+        return !m_tasks.contains(id);
+    }
+
+    /**
+     * Blocks until a task has finished.
+     *
+     * May be called from a task of the same scheduler, e.g. one splitting
+     * its work into subtasks. The waiting task then gives up its thread,
+     * its place in its priority class and on its device until the awaited
+     * task has finished, so the subtasks can't starve behind their parent.
+     *
+     * @param id task identifier
+     */
+    void TaskScheduler::waitFor(int id)
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_tasks.contains(id))
+        {
+            return;
+        }
+
+        ScheduledTask* current = m_threadTasks.value(QThread::currentThread());
+        if (current)
+        {
+            vacate(current);
+            m_pool->releaseThread();
+            dispatch();
+        }
+        while (m_tasks.contains(id))
+        {
+            m_taskFinished.wait(&m_mutex);
+        }
+        if (current)
+        {
+            // may briefly exceed the limits, rather than block again
+            m_pool->reserveThread();
+            occupy(current);
+        }
+    }
+
+    /**
+     * Blocks until all tasks have finished.
+     *
+     * The finished() signals are still delivered through the event loop.
+     */
+    void TaskScheduler::waitForDone()
+    {
+        QMutexLocker locker(&m_mutex);
+        while (!m_tasks.isEmpty())
+        {
+            m_taskFinished.wait(&m_mutex);
+        }
+    }
+
+    /**
+     * Returns the scheduler shared by the whole library.
+     *
+     * It runs tasks on the global thread pool. The scheduler is destroyed
+     * when the application object is, before the global thread pool and
+     * while event delivery still works, so its tasks are cancelled and
+     * waited for in time. The first call should come from the main thread,
+     * which then receives its signals.
+     *
+     * @return the default scheduler
+     */
+    TaskScheduler* TaskScheduler::getDefault()
+    {
+        QMutexLocker locker(&defaultSchedulerMutex);
+        if (!defaultScheduler)
+        {
+            defaultScheduler = new TaskScheduler();
+            qAddPostRoutine(destroyDefaultScheduler);
+        }
+        return defaultScheduler;
+    }
+
+    /**
+     * Identifies the device holding a path.
+     *
+     * Paths which don't exist yet are attributed to the device of their
+     * nearest existing parent directory.
+     *
+     * @param path absolute path
+     * @return device identifier, empty if it can't be determined
+     */
+    QString TaskScheduler::getDevice(const QString& path)
+    {
+#if defined(Q_OS_UNIX)
+        QString existing = path;
+        struct stat info;
+        while (::stat(QFile::encodeName(existing).constData(), &info) != 0)
+        {
+            int separator = existing.lastIndexOf('/');
+            if (separator < 0 || existing == "/")
+            {
+                return QString();
+            }
+            existing.truncate(qMax(separator, 1));
+        }
+        return QString::number(quint64(info.st_dev));
+#else
+        // the drive letter, or the server of a UNC path
+        QString absolute = QDir::fromNativeSeparators(QFileInfo(path).absoluteFilePath());
+        int separator = absolute.indexOf('/', absolute.startsWith("//") ? 2 : 0);
+        return separator < 0 ? absolute : absolute.left(separator);
+#endif
+    }
+
+    /**
+     * Delivers pending progress of a task.
+     *
+     * @param id task identifier
+     */
+    void TaskScheduler::onProgress(int id)
+    {
+        m_mutex.lock();
+        if (!m_progress.contains(id))
+        {
+            m_mutex.unlock();
+            return;
+        }
+        QPair<qint64, qint64> report = m_progress.take(id);
+        m_mutex.unlock();
+
+        emit progress(id, report.first, report.second);
+    }
+
+    /**
+     * Delivers completion of a task.
+     *
+     * @param id task identifier
+     * @param cancelled whether the task was cancelled
+     */
+    void TaskScheduler::onFinished(int id, bool cancelled)
+    {
+        m_mutex.lock();
+        m_progress.remove(id);
+        m_mutex.unlock();
+
+        emit finished(id, cancelled);
+    }
+
+    /**
+     * Checks whether the priority class of a task may take another thread.
+     *
+     * Must be called with the mutex locked.
+     *
+     * @param priority priority class
+     * @return true if a task of the class may start
+     */
+    bool TaskScheduler::hasThreadFor(Priority priority) const
+    {
+        int threadCount = qMax(1, m_pool->maxThreadCount());
+        int nonInteractive = m_running[Normal] + m_running[Background];
+        switch (priority)
+        {
+        case Interactive:
+            return true;
+        case Normal:
+            return nonInteractive < qMax(1, threadCount - 1);
+        case Background:
+            return nonInteractive < qMax(1, threadCount - 1) &&
+                   m_running[Background] < qMax(1, threadCount / 2);
+        }
+
+        return false;
+    }
+
+    /**
+     * Checks whether the device of a task allows starting it.
+     *
+     * Must be called with the mutex locked.
+     *
+     * @param task queued task
+     * @return true if the task may start
+     */
+    bool TaskScheduler::canStart(const ScheduledTask* task) const
+    {
+        if (task->m_priority == Interactive || task->m_device.isEmpty())
+        {
+            return true;
+        }
+
+        return m_deviceLoad.value(task->m_device) <
+               m_deviceLimits.value(task->m_device, m_defaultDeviceLimit);
+    }
+
+    /**
+     * Starts queued tasks allowed by their priority classes and devices.
+     *
+     * Tasks of a busy device are passed over in favour of later ones, so
+     * one slow disk doesn't hold up the rest. Must be called with the mutex
+     * locked.
+     */
+    void TaskScheduler::dispatch()
+    {
+        for (int priority = Interactive; priority < PriorityCount; ++priority)
+        {
+            QList<ScheduledTask*>& queue = m_queues[priority];
+            QList<ScheduledTask*>::iterator it = queue.begin();
+            while (it != queue.end() && hasThreadFor(Priority(priority)))
+            {
+                if (canStart(*it))
+                {
+                    start(*it);
+                    it = queue.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    /**
+     * Hands a task over to the thread pool.
+     *
+     * More urgent classes get a higher pool priority, so they also overtake
+     * other work queued in a shared pool. Must be called with the mutex
+     * locked.
+     *
+     * @param task the task
+     */
+    void TaskScheduler::start(ScheduledTask* task)
+    {
+        occupy(task);
+        m_pool->start(new Runner(this, task), PriorityCount - task->m_priority);
+    }
+
+    /**
+     * Counts a task against its priority class and device.
+     *
+     * Must be called with the mutex locked.
+     *
+     * @param task the task
+     */
+    void TaskScheduler::occupy(ScheduledTask* task)
+    {
+        ++m_running[task->m_priority];
+        if (task->m_priority != Interactive && !task->m_device.isEmpty())
+        {
+            ++m_deviceLoad[task->m_device];
+        }
+    }
+
+    /**
+     * Releases the place of a task in its priority class and device.
+     *
+     * Must be called with the mutex locked.
+     *
+     * @param task the task
+     */
+    void TaskScheduler::vacate(ScheduledTask* task)
+    {
+        --m_running[task->m_priority];
+        if (task->m_priority != Interactive && !task->m_device.isEmpty())
+        {
+            if (--m_deviceLoad[task->m_device] <= 0)
+            {
+                m_deviceLoad.remove(task->m_device);
+            }
+        }
+    }
+
+    /**
+     * Accounts for a task which has run, on its pool thread.
+     *
+     * @param task the task
+     */
+    void TaskScheduler::taskDone(ScheduledTask* task)
+    {
+        QMutexLocker locker(&m_mutex);
+        int id = task->m_id;
+        bool cancelled = task->isCancelled();
+        bool autoDelete = task->m_autoDelete;
+
+        vacate(task);
+        m_threadTasks.remove(QThread::currentThread());
+        m_tasks.remove(id);
+
+        // posted under the lock, so the scheduler can't be destroyed first
+        QMetaObject::invokeMethod(this, "onFinished", Qt::QueuedConnection,
+                                  Q_ARG(int, id), Q_ARG(bool, cancelled));
+        dispatch();
+        m_taskFinished.wakeAll();
+        locker.unlock();
+
+        // a task which isn't auto-deleted belongs to its submitter again
+        if (autoDelete)
+        {
+            delete task;
+        }
+    }
+
+    /**
+     * Records progress of a running task and arranges for it to be
+     * signalled.
+     *
+     * Reports arriving before the previous one was delivered replace it,
+     * so a task may report as often as it likes.
+     *
+     * @param id task identifier
+     * @param done amount of work done
+     * @param total total amount of work
+     */
+    void TaskScheduler::reportProgress(int id, qint64 done, qint64 total)
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_tasks.contains(id))
+        {
+            return;
+        }
+
+        bool posted = m_progress.contains(id);
+        m_progress.insert(id, qMakePair(done, total));
+        if (!posted)
+        {
+            QMetaObject::invokeMethod(this, "onProgress", Qt::QueuedConnection,
+                                      Q_ARG(int, id));
+        }
+    }
+
+    /**
+     * Creates a task.
+     *
+     * @param priority priority class
+     * @param device device the task does I/O on, empty if none
+     */
+    ScheduledTask::ScheduledTask(TaskScheduler::Priority priority, QString device):
+        m_id(0), m_priority(priority), m_device(device), m_autoDelete(true),
+        m_cancelled(0), m_scheduler(0)
+    {
+    }
+
+    ScheduledTask::~ScheduledTask()
+    {
+    }
+
+    /**
+     * Reports progress of the task; called from run().
+     *
+     * @param done amount of work done
+     * @param total total amount of work
+     */
+    void ScheduledTask::setProgress(qint64 done, qint64 total)
+    {
+        if (m_scheduler)
+        {
+            m_scheduler->reportProgress(m_id, done, total);
+        }
+    }
+}
@@ -0,0 +1,344 @@
+/**
+ * @file TaskScheduler.h
+ *
+ * A shared scheduler of background work with priorities and I/O limits.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include "../global.h"
+#include <QAtomicInt>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QString>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+namespace Required
+{
+    class ScheduledTask;
+
+    /**
+     * A shared scheduler of background work with priorities and I/O limits.
+     *
+     * Long-running operations (saving, importing, hashing, indexing) don't
+     * spin threads of their own; they submit ScheduledTask objects here. The
+     * tasks run on a QThreadPool, by default the global one, so they share
+     * one thread budget with Qt-side work such as QtConcurrent.
+     *
+     * Every task belongs to a priority class. Interactive tasks are started
+     * right away. Normal and background tasks together may only use all but
+     * one thread of the pool, and background tasks at most half of them, so
+     * an interactive task never waits for a thread taken by indexing.
+     *
+     * A task may name the device it reads or writes. Normal and background
+     * tasks of one device run only up to the limit of that device, since a
+     * disk doesn't get faster with more concurrent requests; tasks for other
+     * devices are started past them. Interactive tasks ignore the limit.
+     *
+     * Tasks can be cancelled and report progress; both progress and
+     * completion are signalled in the thread owning the scheduler.
+     */
+    class REQUIRED_EXPORT TaskScheduler : public QObject
+    {
+        Q_OBJECT
+        Q_ENUMS(Priority)
+
+    public:
+        /**
+         * Priority classes, most urgent first.
+         */
+        enum Priority
+        {
+            Interactive,
+            Normal,
+            Background
+        };
+
+        explicit TaskScheduler(QThreadPool* pool = 0, QObject* parent = 0);
+        ~TaskScheduler();
+
+        /**
+         * Returns the thread pool running the tasks.
+         *
+         * @return thread pool
+         */
+        QThreadPool* getThreadPool() const
+        {
+            return m_pool;
+        }
+
+        int getDefaultDeviceLimit() const;
+        void setDefaultDeviceLimit(int limit);
+        int getDeviceLimit(QString device) const;
+        void setDeviceLimit(QString device, int limit);
+        int getPendingCount() const;
+
+        int schedule(ScheduledTask* task);
+        bool cancel(int id);
+        void cancelAll();
+        bool isFinished(int id) const;
+        void waitFor(int id);
+        void waitForDone();
+
+        static TaskScheduler* getDefault();
+        static QString getDevice(const QString& path);
+
+    signals:
+        void progress(int id, qint64 done, qint64 total);
+        void finished(int id, bool cancelled);
+
+    private slots:
+        void onProgress(int id);
+        void onFinished(int id, bool cancelled);
+
+    private:
+        Q_DISABLE_COPY(TaskScheduler)
+
+        friend class ScheduledTask;
+        class Runner;
+
+        /**
+         * Number of priority classes.
+         */
+        static const int PriorityCount = Background + 1;
+
+        /**
+         * Non-owning pointer to the pool running the tasks.
+         */
+        QThreadPool* m_pool;
+
+        /**
+         * Guards all members below.
+         */
+        mutable QMutex m_mutex;
+
+        /**
+         * Signalled whenever a task finishes.
+         */
+        QWaitCondition m_taskFinished;
+
+        /**
+         * Tasks waiting for a thread, by priority class.
+         */
+        QList<ScheduledTask*> m_queues[PriorityCount];
+
+        /**
+         * Number of running tasks, by priority class.
+         */
+        int m_running[PriorityCount];
+
+        /**
+         * Queued and running tasks, by identifier.
+         */
+        QHash<int, ScheduledTask*> m_tasks;
+
+        /**
+         * Running tasks, by the pool thread running them.
+         */
+        QHash<QThread*, ScheduledTask*> m_threadTasks;
+
+        /**
+         * Number of running normal and background tasks, by device.
+         */
+        QHash<QString, int> m_deviceLoad;
+
+        /**
+         * Limits set for particular devices.
+         */
+        QHash<QString, int> m_deviceLimits;
+
+        /**
+         * Limit of devices without one of their own.
+         */
+        int m_defaultDeviceLimit;
+
+        /**
+         * Progress reported but not yet signalled, by task identifier.
+         */
+        QHash<int, QPair<qint64, qint64> > m_progress;
+
+        /**
+         * Identifier of the next scheduled task.
+         */
+        int m_nextId;
+
+        bool hasThreadFor(Priority priority) const;
+        bool canStart(const ScheduledTask* task) const;
+        void dispatch();
+        void start(ScheduledTask* task);
+        void occupy(ScheduledTask* task);
+        void vacate(ScheduledTask* task);
+        void taskDone(ScheduledTask* task);
+        void reportProgress(int id, qint64 done, qint64 total);
+    };
+
+    /**
+     * A unit of work run by a TaskScheduler.
+     *
+     * Subclasses implement run(), which should check isCancelled() now and
+     * then and may call setProgress(). Like a QRunnable, a task is deleted
+     * by the scheduler once it has run, unless auto-deletion is turned off;
+     * the submitter then owns the task and may read its results after
+     * TaskScheduler::waitFor().
+     */
+    class REQUIRED_EXPORT ScheduledTask
+    {
+    public:
+        explicit ScheduledTask(TaskScheduler::Priority priority = TaskScheduler::Normal,
+                               QString device = "");
+        virtual ~ScheduledTask();
+
+        /**
+         * Does the work, on a thread of the pool.
+         */
+        virtual void run() = 0;
+
+        /**
+         * Returns the identifier given by the scheduler.
+         *
+         * @return task identifier, 0 if not scheduled yet
+         */
+        int getId() const
+        {
+            return m_id;
+        }
+
+        /**
+         * Returns the priority class of the task.
+         *
+         * @return priority
+         */
+        TaskScheduler::Priority getPriority() const
+        {
+            return m_priority;
+        }
+
+        /**
+         * Sets the priority class of the task, before it's scheduled.
+         *
+         * @param priority priority
+         */
+        void setPriority(TaskScheduler::Priority priority)
+        {
+            m_priority = priority;
+        }
+
+        /**
+         * Returns the device the task does I/O on.
+         *
+         * @return device identifier, empty for tasks not limited by a device
+         */
+        QString getDevice() const
+        {
+            return m_device;
+        }
+
+        /**
+         * Sets the device the task does I/O on, before it's scheduled.
+         *
+         * @param device device identifier, see TaskScheduler::getDevice()
+         */
+        void setDevice(QString device)
+        {
+            m_device = device;
+        }
+
+        /**
+         * Checks whether the scheduler deletes the task after running it.
+         *
+         * @return true by default
+         */
+        bool autoDelete() const
+        {
+            return m_autoDelete;
+        }
+
+        /**
+         * Sets whether the scheduler deletes the task after running it.
+         *
+         * @param autoDelete false to keep the task for its submitter
+         */
+        void setAutoDelete(bool autoDelete)
+        {
+            m_autoDelete = autoDelete;
+        }
+
+        /**
+         * Checks whether the task was cancelled.
+         *
+         * @return true if run() should return as soon as possible
+         */
+        bool isCancelled() const
+        {
+            return m_cancelled.load() != 0;
+        }
+
+        /**
+         * Returns the flag set when the task is cancelled, for passing on
+         * to long operations run by the task.
+         *
+         * @return cancellation flag, owned by the task
+         */
+        const QAtomicInt* getCancelledFlag() const
+        {
+            return &m_cancelled;
+        }
+
+    protected:
+        void setProgress(qint64 done, qint64 total);
+
+    private:
+        Q_DISABLE_COPY(ScheduledTask)
+
+        friend class TaskScheduler;
+
+        /**
+         * Identifier given by the scheduler.
+         */
+        int m_id;
+
+        /**
+         * Priority class of the task.
+         */
+        TaskScheduler::Priority m_priority;
+
+        /**
+         * Device the task does I/O on.
+         */
+        QString m_device;
+
+        /**
+         * Whether the scheduler deletes the task after running it.
+         */
+        bool m_autoDelete;
+
+        /**
+         * Set when the task is cancelled.
+         */
+        QAtomicInt m_cancelled;
+
+        /**
+         * Non-owning pointer to the scheduler running the task.
+         */
+        TaskScheduler* m_scheduler;
+    };
+}
+
+#endif // TASKSCHEDULER_H
@@ -0,0 +1,1039 @@
+/**
+ * @file TrigramIndex.cpp
+ *
+ * Persistent trigram index of project file contents.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#include "TrigramIndex.h"
+#include "ContentSearch.h"
+#include <QList>
+#include <QMap>
+#include <QMetaObject>
+#include <QPair>
+#include <QSaveFile>
+#include <QStringList>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace Required
+{
+    namespace
+    {
+        /**
+         * Identifies segment files, "RTG1" in little endian byte order.
+         * Segments are written in native byte order, so a segment from a
+         * machine of the other endianness is rejected and rebuilt.
+         */
+        const quint32 SegmentMagic = 0x31475452;
+
+        /**
+         * Version of the segment layout.
+         */
+        const quint32 SegmentVersion = 1;
+
+        /**
+         * Default size of the largest file indexed.
+         */
+        const qint64 DefaultMaxFileSize = 4 * 1024 * 1024;
+
+        /**
+         * Number of files indexed by a single task.
+         */
+        const int BatchSize = 64;
+
+        /**
+         * Number of leading bytes checked for a NUL byte to detect binary files.
+         */
+        const int BinaryProbeSize = 8192;
+
+        /**
+         * Marks a segment file identifier dropped while merging.
+         */
+        const quint32 NoId = 0xFFFFFFFF;
+
+        /**
+         * Segment layout: the header, file slots, UTF-8 paths, postings
+         * (sorted file identifiers of every trigram, one after another) and
+         * trigram slots sorted by trigram. All offsets are from the start.
+         */
+        struct SegmentHeader
+        {
+            quint32 magic;
+            quint32 version;
+            quint32 fileCount;
+            quint32 trigramCount;
+            quint64 pathsOffset;
+            quint64 postingsOffset;
+            quint64 trigramsOffset;
+            quint64 size;
+        };
+
+        /**
+         * A file in the segment.
+         */
+        struct SegmentFile
+        {
+            qint64 size;
+            qint64 lastModified;
+            quint64 pathOffset;
+            quint32 pathLength;
+            quint32 flags;
+        };
+
+        /**
+         * The file was indexed; otherwise it's always a candidate.
+         */
+        const quint32 FileIndexed = 1;
+
+        /**
+         * A trigram in the segment with the range of its postings, counted
+         * in file identifiers from the start of the postings.
+         */
+        struct SegmentTrigram
+        {
+            quint32 trigram;
+            quint32 count;
+            quint64 offset;
+        };
+
+        bool operator<(const SegmentTrigram& slot, quint32 trigram)
+        {
+            return slot.trigram < trigram;
+        }
+
+        const SegmentHeader* getHeader(const uchar* segment)
+        {
+            return reinterpret_cast<const SegmentHeader*>(segment);
+        }
+
+        const SegmentFile* getFiles(const uchar* segment)
+        {
+            return reinterpret_cast<const SegmentFile*>(segment + sizeof(SegmentHeader));
+        }
+
+        const quint32* getPostings(const uchar* segment)
+        {
+            return reinterpret_cast<const quint32*>(segment + getHeader(segment)->postingsOffset);
+        }
+
+        const SegmentTrigram* getTrigrams(const uchar* segment)
+        {
+            return reinterpret_cast<const SegmentTrigram*>(segment + getHeader(segment)->trigramsOffset);
+        }
+
+        /**
+         * Folds ASCII letters to lower case, so that one index serves both
+         * case sensitive and insensitive searches.
+         */
+        inline uchar fold(uchar c)
+        {
+            return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+        }
+
+        /**
+         * Returns the sorted, unique trigrams of a byte sequence.
+         */
+        QVector<quint32> extractTrigrams(const char* data, int size)
+        {
+            QVector<quint32> trigrams;
+            if (size < 3)
+            {
+                return trigrams;
+            }
+
+            const uchar* bytes = reinterpret_cast<const uchar*>(data);
+            trigrams.reserve(size - 2);
+            quint32 trigram = (fold(bytes[0]) << 8) | fold(bytes[1]);
+            for (int i = 2; i < size; ++i)
+            {
+                trigram = ((trigram << 8) | fold(bytes[i])) & 0xFFFFFF;
+                trigrams.append(trigram);
+            }
+            std::sort(trigrams.begin(), trigrams.end());
+            trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+            return trigrams;
+        }
+
+        /**
+         * Writes the bytes of a plain value.
+         */
+        template <typename T>
+        bool writeValue(QFileDevice& file, const T& value)
+        {
+            return file.write(reinterpret_cast<const char*>(&value), sizeof(T)) == qint64(sizeof(T));
+        }
+
+        /**
+         * Pads the file with zeros up to a multiple of the alignment.
+         */
+        bool writePadding(QFileDevice& file, int alignment)
+        {
+            int padding = (alignment - file.pos() % alignment) % alignment;
+            return file.write(QByteArray(padding, '\0')) == padding;
+        }
+    }
+
+    /**
+     * Indexes a batch of files on a worker thread.
+     *
+     * One read buffer is reused for the whole batch. A cancelled indexer
+     * stops early; its entries then cover only the first of its paths.
+     */
+    class TrigramIndex::Indexer : public ScheduledTask
+    {
+    public:
+        Indexer(FileSystem* fileSystem, QStringList paths, QStringList filenames,
+                FileStatusList statuses, qint64 maxFileSize, QString device):
+            ScheduledTask(TaskScheduler::Background, device),
+            m_fileSystem(fileSystem), m_paths(paths), m_filenames(filenames),
+            m_statuses(statuses), m_maxFileSize(maxFileSize)
+        {
+            setAutoDelete(false);
+        }
+
+        void run()
+        {
+            QByteArray data;
+            m_entries.reserve(m_filenames.size());
+            for (int i = 0; i < m_filenames.size() && !isCancelled(); ++i)
+            {
+                const FileStatus& status = m_statuses.at(i);
+                OverlayEntry entry;
+                entry.size = status.size;
+                entry.lastModified = status.lastModified;
+                // a missing file has no contents to match
+                entry.indexed = !status.exists;
+                if (status.isRegularFile && status.size <= m_maxFileSize &&
+                    m_fileSystem->read(m_filenames.at(i), data))
+                {
+                    entry.indexed = true;
+                    // binary files are skipped by searches, they get no trigrams
+                    if (!std::memchr(data.constData(), '\0', qMin(data.size(), BinaryProbeSize)))
+                    {
+                        entry.trigrams = extractTrigrams(data.constData(), data.size());
+                    }
+                }
+                m_entries.append(entry);
+            }
+        }
+
+        const QStringList& getPaths() const
+        {
+            return m_paths;
+        }
+
+        const QList<OverlayEntry>& getEntries() const
+        {
+            return m_entries;
+        }
+
+    private:
+        FileSystem* m_fileSystem;
+        QStringList m_paths;
+        QStringList m_filenames;
+        FileStatusList m_statuses;
+        qint64 m_maxFileSize;
+        QList<OverlayEntry> m_entries;
+    };
+
+    /**
+     * Creates an empty index of a project.
+     *
+     * All files already in the project are pending; call load() to reuse
+     * a stored index, or update() to index them from scratch.
+     *
+     * @param project the project to index
+     * @param parent parent object
+     */
+    TrigramIndex::TrigramIndex(Project* project, QObject* parent):
+        QObject(parent), m_project(project), m_scheduler(TaskScheduler::getDefault()),
+        m_maxFileSize(DefaultMaxFileSize), m_segment(0)
+    {
+        QString rootPath = project->getRootPath();
+        foreach (QString filename, project->getFiles())
+        {
+            m_pending.insert(Project::toRelativePath(rootPath, filename));
+        }
+
+        connect(project, &Project::fileAdded, this, &TrigramIndex::onFileAdded);
+        connect(project, &Project::fileRemoved, this, &TrigramIndex::onFileRemoved);
+        connect(project, &Project::relocated, this, &TrigramIndex::onRelocated);
+        connect(project, &Project::rootPathChanged, this, &TrigramIndex::onRootPathChanged);
+    }
+
+    /**
+     * Cancels a running update, waits for its tasks to stop and unmaps
+     * the segment.
+     */
+    TrigramIndex::~TrigramIndex()
+    {
+        // the tasks read through the project's file system
+        cancelIndexing();
+        if (m_scheduler)
+        {
+            foreach (int id, m_indexers.keys())
+            {
+                m_scheduler->waitFor(id);
+            }
+        }
+        qDeleteAll(m_indexers);
+        unmapSegment();
+    }
+
+    /**
+     * Returns the number of indexed files.
+     *
+     * @return file count, not counting pending files
+     */
+    int TrigramIndex::getFileCount() const
+    {
+        return m_segmentIds.size() - m_segmentRemoved.count(true) + m_overlay.size();
+    }
+
+    /**
+     * Replaces the index with one stored on disk.
+     *
+     * The stored index is memory mapped, not read. Project files missing
+     * from it become pending, unless they are being indexed. Files modified
+     * since the index was stored are detected by refresh().
+     *
+     * @param indexPath path to the stored index
+     * @return false if the file is missing or not a valid index; the
+     *         index is empty then
+     */
+    bool TrigramIndex::load(QString indexPath)
+    {
+        unmapSegment();
+        m_overlay.clear();
+
+        m_segmentFile.setFileName(indexPath);
+        qint64 size = m_segmentFile.size();
+        const uchar* segment = 0;
+        if (size >= qint64(sizeof(SegmentHeader)) && m_segmentFile.open(QIODevice::ReadOnly))
+        {
+            segment = m_segmentFile.map(0, size);
+        }
+
+        bool valid = segment != 0;
+        if (valid)
+        {
+            const SegmentHeader* header = getHeader(segment);
+            quint64 filesEnd = sizeof(SegmentHeader) + quint64(header->fileCount) * sizeof(SegmentFile);
+            valid = header->magic == SegmentMagic && header->version == SegmentVersion &&
+                    header->size == quint64(size) && filesEnd <= header->pathsOffset &&
+                    header->pathsOffset <= header->postingsOffset &&
+                    header->postingsOffset % sizeof(quint32) == 0 &&
+                    header->postingsOffset <= header->trigramsOffset &&
+                    header->trigramsOffset % sizeof(quint64) == 0 &&
+                    header->trigramsOffset + quint64(header->trigramCount) * sizeof(SegmentTrigram) <= header->size;
+        }
+        if (valid)
+        {
+            const SegmentHeader* header = getHeader(segment);
+            quint64 postingCount = (header->trigramsOffset - header->postingsOffset) / sizeof(quint32);
+            const SegmentTrigram* trigrams = getTrigrams(segment);
+            for (quint32 i = 0; valid && i < header->trigramCount; ++i)
+            {
+                valid = trigrams[i].offset + trigrams[i].count <= postingCount;
+            }
+            const SegmentFile* files = getFiles(segment);
+            for (quint32 id = 0; valid && id < header->fileCount; ++id)
+            {
+                valid = files[id].pathOffset >= header->pathsOffset &&
+                        files[id].pathOffset + files[id].pathLength <= header->postingsOffset;
+            }
+        }
+        if (!valid)
+        {
+            if (segment)
+            {
+                m_segmentFile.unmap(const_cast<uchar*>(segment));
+            }
+            m_segmentFile.close();
+        }
+        else
+        {
+            m_segment = segment;
+            quint32 fileCount = getHeader(m_segment)->fileCount;
+            m_segmentIds.reserve(fileCount);
+            for (quint32 id = 0; id < fileCount; ++id)
+            {
+                m_segmentIds.insert(getSegmentPath(id), id);
+            }
+            m_segmentRemoved.resize(fileCount);
+        }
+
+        m_pending.clear();
+        if (m_project)
+        {
+            QString rootPath = m_project->getRootPath();
+            foreach (QString filename, m_project->getFiles())
+            {
+                QString path = Project::toRelativePath(rootPath, filename);
+                if (!m_segmentIds.contains(path) && !m_indexing.contains(path))
+                {
+                    m_pending.insert(path);
+                }
+            }
+            // files removed from the project since the index was stored
+            QHash<QString, quint32>::const_iterator it;
+            for (it = m_segmentIds.constBegin(); it != m_segmentIds.constEnd(); ++it)
+            {
+                if (!m_project->hasFile(Project::toAbsolutePath(rootPath, it.key())))
+                {
+                    m_segmentRemoved.setBit(it.value());
+                }
+            }
+        }
+
+        return valid;
+    }
+
+    /**
+     * Stores the index on disk.
+     *
+     * The mapped segment and the overlay are merged into a new segment,
+     * which is written next to the old one and then atomically replaces it,
+     * so a crash never leaves a truncated or missing index behind. The new
+     * segment is mapped afterwards. Pending files are not stored.
+     *
+     * @param indexPath path to the stored index
+     * @return true on success
+     */
+    bool TrigramIndex::save(QString indexPath)
+    {
+        QSaveFile file(indexPath);
+        if (!file.open(QIODevice::WriteOnly))
+        {
+            return false;
+        }
+
+        // live segment files keep their order, overlay files follow sorted by
+        // path; outdated entries of pending files and of files being indexed
+        // are dropped
+        quint32 segmentFileCount = m_segment ? getHeader(m_segment)->fileCount : 0;
+        QVector<quint32> newIds(segmentFileCount, NoId);
+        QList<QPair<QString, const SegmentFile*> > keptFiles;
+        for (quint32 id = 0; id < segmentFileCount; ++id)
+        {
+            QString path = getSegmentPath(id);
+            if (!m_segmentRemoved.testBit(id) && !m_pending.contains(path) &&
+                !m_indexing.contains(path))
+            {
+                newIds[id] = quint32(keptFiles.size());
+                keptFiles.append(qMakePair(path, getFiles(m_segment) + id));
+            }
+        }
+        QStringList overlayPaths = m_overlay.keys();
+        overlayPaths.sort();
+
+        SegmentHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = SegmentMagic;
+        header.version = SegmentVersion;
+        header.fileCount = quint32(keptFiles.size() + overlayPaths.size());
+        header.pathsOffset = sizeof(SegmentHeader) + quint64(header.fileCount) * sizeof(SegmentFile);
+        bool ok = writeValue(file, header);
+
+        QByteArray paths;
+        QMap<quint32, QVector<quint32> > overlayPostings;
+        for (int i = 0; ok && i < keptFiles.size() + overlayPaths.size(); ++i)
+        {
+            SegmentFile slot;
+            std::memset(&slot, 0, sizeof(slot));
+            QByteArray path;
+            if (i < keptFiles.size())
+            {
+                slot = *keptFiles.at(i).second;
+                path = keptFiles.at(i).first.toUtf8();
+            }
+            else
+            {
+                const QString& overlayPath = overlayPaths.at(i - keptFiles.size());
+                const OverlayEntry& entry = m_overlay[overlayPath];
+                slot.size = entry.size;
+                slot.lastModified = entry.lastModified;
+                slot.flags = entry.indexed ? FileIndexed : 0;
+                path = overlayPath.toUtf8();
+                foreach (quint32 trigram, entry.trigrams)
+                {
+                    overlayPostings[trigram].append(quint32(i));
+                }
+            }
+            slot.pathOffset = header.pathsOffset + paths.size();
+            slot.pathLength = quint32(path.size());
+            paths.append(path);
+            ok = writeValue(file, slot);
+        }
+        ok = ok && file.write(paths) == paths.size() && writePadding(file, sizeof(quint32));
+        header.postingsOffset = quint64(file.pos());
+
+        // merge the sorted segment trigrams with the sorted overlay trigrams
+        QVector<SegmentTrigram> trigramSlots;
+        const SegmentTrigram* segmentTrigrams = m_segment ? getTrigrams(m_segment) : 0;
+        quint32 segmentTrigramCount = m_segment ? getHeader(m_segment)->trigramCount : 0;
+        quint32 s = 0;
+        QMap<quint32, QVector<quint32> >::const_iterator o = overlayPostings.constBegin();
+        QVector<quint32> postings;
+        quint64 postingOffset = 0;
+        while (ok && (s < segmentTrigramCount || o != overlayPostings.constEnd()))
+        {
+            quint32 trigram;
+            if (s < segmentTrigramCount &&
+                (o == overlayPostings.constEnd() || segmentTrigrams[s].trigram <= o.key()))
+            {
+                trigram = segmentTrigrams[s].trigram;
+            }
+            else
+            {
+                trigram = o.key();
+            }
+
+            postings.clear();
+            if (s < segmentTrigramCount && segmentTrigrams[s].trigram == trigram)
+            {
+                const quint32* ids = getPostings(m_segment) + segmentTrigrams[s].offset;
+                for (quint32 i = 0; i < segmentTrigrams[s].count; ++i)
+                {
+                    if (newIds.at(ids[i]) != NoId)
+                    {
+                        postings.append(newIds.at(ids[i]));
+                    }
+                }
+                ++s;
+            }
+            if (o != overlayPostings.constEnd() && o.key() == trigram)
+            {
+                // overlay identifiers are all larger, so postings stay sorted
+                postings += o.value();
+                ++o;
+            }
+
+            if (!postings.isEmpty())
+            {
+                SegmentTrigram slot;
+                slot.trigram = trigram;
+                slot.count = quint32(postings.size());
+                slot.offset = postingOffset;
+                trigramSlots.append(slot);
+                postingOffset += postings.size();
+                qint64 bytes = qint64(postings.size()) * sizeof(quint32);
+                ok = file.write(reinterpret_cast<const char*>(postings.constData()), bytes) == bytes;
+            }
+        }
+
+        ok = ok && writePadding(file, sizeof(quint64));
+        header.trigramsOffset = quint64(file.pos());
+        header.trigramCount = quint32(trigramSlots.size());
+        qint64 bytes = qint64(trigramSlots.size()) * sizeof(SegmentTrigram);
+        ok = ok && file.write(reinterpret_cast<const char*>(trigramSlots.constData()), bytes) == bytes;
+        header.size = quint64(file.pos());
+        ok = ok && file.seek(0) && writeValue(file, header);
+        if (!ok)
+        {
+            // the unfinished segment is discarded along with the save file
+            return false;
+        }
+
+#if defined(Q_OS_WIN)
+        // a mapped file can't be replaced on Windows
+        unmapSegment();
+#endif
+        if (!file.commit())
+        {
+            return false;
+        }
+
+        // pending files aren't in the new segment, so load() keeps them pending
+        return load(indexPath);
+    }
+
+    /**
+     * Starts indexing pending files.
+     *
+     * Files are read in parallel batches of background tasks, which yield
+     * to other work and respect the I/O limit of the project's disk. The
+     * results are merged as the tasks finish, and updated() is emitted once
+     * all of them have; files changed or removed meanwhile are left to the
+     * next update. Until then, the files being indexed are candidates of
+     * every search. Without pending files, updated() is emitted right away
+     * through the event loop.
+     */
+    void TrigramIndex::update()
+    {
+        if (m_pending.isEmpty() || !m_project)
+        {
+            if (!isUpdating())
+            {
+                QMetaObject::invokeMethod(this, "updated", Qt::QueuedConnection);
+            }
+            return;
+        }
+
+        QStringList paths = m_pending.toList();
+        paths.sort();
+        m_pending.clear();
+
+        QString rootPath = m_project->getRootPath();
+        QStringList filenames;
+        filenames.reserve(paths.size());
+        foreach (const QString& path, paths)
+        {
+            filenames.append(Project::toAbsolutePath(rootPath, path));
+        }
+        FileSystem* fileSystem = m_project->getFileSystem();
+        FileStatusList statuses = fileSystem->statFiles(filenames);
+        QString device;
+        if (fileSystem->isLocal())
+        {
+            device = TaskScheduler::getDevice(rootPath);
+        }
+
+        TaskScheduler* taskScheduler = scheduler();
+        connect(taskScheduler, &TaskScheduler::finished, this, &TrigramIndex::onIndexerFinished,
+                Qt::UniqueConnection);
+        for (int i = 0; i < filenames.size(); i += BatchSize)
+        {
+            QStringList batchPaths = paths.mid(i, BatchSize);
+            Indexer* indexer = new Indexer(fileSystem, batchPaths, filenames.mid(i, BatchSize),
+                                           statuses.mid(i, BatchSize), m_maxFileSize,
+                                           device);
+            int id = taskScheduler->schedule(indexer);
+            m_indexers.insert(id, indexer);
+            foreach (const QString& path, batchPaths)
+            {
+                m_indexing.insert(path, id);
+            }
+        }
+    }
+
+    /**
+     * Blocks until the running update has finished, and merges its results.
+     *
+     * updated() is emitted before returning if an update was running.
+     */
+    void TrigramIndex::waitForUpdated()
+    {
+        foreach (int id, m_indexers.keys())
+        {
+            // a destroyed scheduler has finished all its tasks
+            if (m_scheduler)
+            {
+                m_scheduler->waitFor(id);
+            }
+            onIndexerFinished(id, false);
+        }
+    }
+
+    /**
+     * Re-indexes files modified outside of the project.
+     *
+     * All project files are looked up in the file system with one batched
+     * call; those whose size or modification time differ from the indexed
+     * ones become pending, and an update is started. Files being indexed
+     * are left to their running tasks.
+     */
+    void TrigramIndex::refresh()
+    {
+        if (!m_project)
+        {
+            return;
+        }
+
+        QString rootPath = m_project->getRootPath();
+        QStringList filenames = m_project->getFiles();
+        FileStatusList statuses = m_project->getFileSystem()->statFiles(filenames);
+        for (int i = 0; i < filenames.size(); ++i)
+        {
+            QString path = Project::toRelativePath(rootPath, filenames.at(i));
+            const FileStatus& status = statuses.at(i);
+            bool current = false;
+            QHash<QString, OverlayEntry>::const_iterator entry = m_overlay.constFind(path);
+            if (entry != m_overlay.constEnd())
+            {
+                current = entry->size == status.size && entry->lastModified == status.lastModified;
+            }
+            else
+            {
+                QHash<QString, quint32>::const_iterator id = m_segmentIds.constFind(path);
+                if (id != m_segmentIds.constEnd() && !m_segmentRemoved.testBit(id.value()))
+                {
+                    const SegmentFile& file = getFiles(m_segment)[id.value()];
+                    current = file.size == status.size && file.lastModified == status.lastModified;
+                }
+            }
+            if (!current && !m_indexing.contains(path))
+            {
+                m_pending.insert(path);
+            }
+        }
+
+        update();
+    }
+
+    /**
+     * Checks whether the index can narrow down the files to search.
+     *
+     * This requires the pattern to contain a literal of at least three bytes.
+     *
+     * @param pattern the searched pattern
+     * @return true if getCandidates() returns less than all files
+     */
+    bool TrigramIndex::isSelective(const QRegExp& pattern) const
+    {
+        return getQueryLiteral(pattern).size() >= 3;
+    }
+
+    /**
+     * Returns the files which may contain matches of a pattern.
+     *
+     * Only the mapped postings and the overlay are consulted; no file is
+     * read or looked up. Pending files and files which couldn't be indexed
+     * are always included. Files modified after they were indexed are
+     * judged by their old contents; call refresh() first if that matters.
+     *
+     * @param pattern the searched pattern
+     * @return full paths to the candidate files; all project files if the
+     *         pattern isn't selective
+     */
+    QSet<QString> TrigramIndex::getCandidates(const QRegExp& pattern) const
+    {
+        QSet<QString> candidates;
+        if (!m_project)
+        {
+            return candidates;
+        }
+
+        QByteArray literal = getQueryLiteral(pattern);
+        if (literal.size() < 3)
+        {
+            return m_project->getFiles().toSet();
+        }
+        QVector<quint32> trigrams = extractTrigrams(literal.constData(), literal.size());
+        QString rootPath = m_project->getRootPath();
+
+        if (m_segment)
+        {
+            // intersect posting lists, shortest first
+            const SegmentTrigram* begin = getTrigrams(m_segment);
+            const SegmentTrigram* end = begin + getHeader(m_segment)->trigramCount;
+            QMap<quint32, const SegmentTrigram*> slotsByCount;
+            foreach (quint32 trigram, trigrams)
+            {
+                const SegmentTrigram* slot = std::lower_bound(begin, end, trigram);
+                if (slot == end || slot->trigram != trigram)
+                {
+                    slotsByCount.clear();
+                    break;
+                }
+                slotsByCount.insertMulti(slot->count, slot);
+            }
+
+            QVector<quint32> ids;
+            bool first = true;
+            foreach (const SegmentTrigram* slot, slotsByCount)
+            {
+                const quint32* postings = getPostings(m_segment) + slot->offset;
+                if (first)
+                {
+                    ids.resize(int(slot->count));
+                    std::copy(postings, postings + slot->count, ids.begin());
+                    first = false;
+                    continue;
+                }
+                QVector<quint32> intersection;
+                std::set_intersection(ids.constBegin(), ids.constEnd(), postings,
+                                      postings + slot->count, std::back_inserter(intersection));
+                ids = intersection;
+                if (ids.isEmpty())
+                {
+                    break;
+                }
+            }
+            foreach (quint32 id, ids)
+            {
+                if (!m_segmentRemoved.testBit(id))
+                {
+                    candidates.insert(Project::toAbsolutePath(rootPath, getSegmentPath(id)));
+                }
+            }
+
+            // files the segment couldn't index
+            const SegmentFile* files = getFiles(m_segment);
+            for (quint32 id = 0; id < quint32(m_segmentRemoved.size()); ++id)
+            {
+                if (!(files[id].flags & FileIndexed) && !m_segmentRemoved.testBit(id))
+                {
+                    candidates.insert(Project::toAbsolutePath(rootPath, getSegmentPath(id)));
+                }
+            }
+        }
+
+        QHash<QString, OverlayEntry>::const_iterator it;
+        for (it = m_overlay.constBegin(); it != m_overlay.constEnd(); ++it)
+        {
+            if (!it->indexed || std::includes(it->trigrams.constBegin(), it->trigrams.constEnd(),
+                                              trigrams.constBegin(), trigrams.constEnd()))
+            {
+                candidates.insert(Project::toAbsolutePath(rootPath, it.key()));
+            }
+        }
+        foreach (const QString& path, m_pending)
+        {
+            candidates.insert(Project::toAbsolutePath(rootPath, path));
+        }
+        QHash<QString, int>::const_iterator indexing;
+        for (indexing = m_indexing.constBegin(); indexing != m_indexing.constEnd(); ++indexing)
+        {
+            candidates.insert(Project::toAbsolutePath(rootPath, indexing.key()));
+        }
+
+        return candidates;
+    }
+
+    /**
+     * Returns the path of the index stored with a project file.
+     *
+     * @param projectFilename path to the saved project
+     * @return path to the index file next to it
+     */
+    QString TrigramIndex::getIndexPath(QString projectFilename)
+    {
+        return projectFilename + ".trigrams";
+    }
+
+    /**
+     * Schedules a new file for indexing.
+     *
+     * @param filename full path to the file
+     * @param categoryShortName category identifier
+     */
+    void TrigramIndex::onFileAdded(QString filename, QString categoryShortName)
+    {
+        QString path = Project::toRelativePath(m_project->getRootPath(), filename);
+        m_indexing.remove(path);
+        m_pending.insert(path);
+    }
+
+    /**
+     * Drops a removed file from the index.
+     *
+     * @param filename full path to the file
+     * @param categoryShortName category identifier
+     */
+    void TrigramIndex::onFileRemoved(QString filename, QString categoryShortName)
+    {
+        QString path = Project::toRelativePath(m_project->getRootPath(), filename);
+        m_pending.remove(path);
+        m_indexing.remove(path);
+        m_overlay.remove(path);
+        removeFromSegment(path);
+    }
+
+    /**
+     * Re-keys files which are stored relative to a relocated root now.
+     *
+     * Relative paths move with the root and stay valid. Files stored by
+     * their absolute path which fall under the new root are indexed again
+     * under their relative path.
+     *
+     * @param rootPath new root directory
+     */
+    void TrigramIndex::onRelocated(QString rootPath)
+    {
+        QStringList paths = m_segmentIds.keys() + m_overlay.keys() + m_pending.values() +
+                            m_indexing.keys();
+        foreach (QString path, paths)
+        {
+            QString relativePath = Project::toRelativePath(rootPath, path);
+            if (relativePath != path)
+            {
+                m_pending.remove(path);
+                m_indexing.remove(path);
+                m_overlay.remove(path);
+                removeFromSegment(path);
+                m_pending.insert(relativePath);
+            }
+        }
+    }
+
+    /**
+     * Indexes all files again after the stored paths were re-encoded.
+     *
+     * The segment, the overlay and the running update are keyed by paths
+     * relative to the old root, so they are dropped.
+     *
+     * @param rootPath new root directory
+     */
+    void TrigramIndex::onRootPathChanged(QString rootPath)
+    {
+        cancelIndexing();
+        unmapSegment();
+        m_overlay.clear();
+        m_pending.clear();
+        if (m_project)
+        {
+            foreach (QString filename, m_project->getFiles())
+            {
+                m_pending.insert(Project::toRelativePath(rootPath, filename));
+            }
+        }
+    }
+
+    /**
+     * Merges the results of an indexing task.
+     *
+     * A cancelled task leaves the rest of its batch pending. Results for
+     * files changed or removed since the task was scheduled are dropped.
+     *
+     * @param id task identifier
+     * @param cancelled whether the task was cancelled
+     */
+    void TrigramIndex::onIndexerFinished(int id, bool cancelled)
+    {
+        Indexer* indexer = m_indexers.take(id);
+        if (!indexer)
+        {
+            return;
+        }
+
+        const QStringList& batchPaths = indexer->getPaths();
+        const QList<OverlayEntry>& entries = indexer->getEntries();
+        for (int i = 0; i < batchPaths.size(); ++i)
+        {
+            const QString& path = batchPaths.at(i);
+            if (m_indexing.value(path) != id)
+            {
+                continue;
+            }
+            m_indexing.remove(path);
+            if (i < entries.size())
+            {
+                removeFromSegment(path);
+                m_overlay.insert(path, entries.at(i));
+            }
+            else
+            {
+                m_pending.insert(path);
+            }
+        }
+        delete indexer;
+
+        if (m_indexers.isEmpty())
+        {
+            emit updated();
+        }
+    }
+
+    /**
+     * Returns the scheduler running the indexing tasks.
+     *
+     * @return the scheduler set, or the default one if it was destroyed
+     */
+    TaskScheduler* TrigramIndex::scheduler() const
+    {
+        return m_scheduler ? m_scheduler.data() : TaskScheduler::getDefault();
+    }
+
+    /**
+     * Cancels the running update and drops its results.
+     *
+     * The tasks are deleted once they have finished, or right away if
+     * their scheduler was destroyed and won't report them anymore.
+     */
+    void TrigramIndex::cancelIndexing()
+    {
+        if (m_scheduler)
+        {
+            foreach (int id, m_indexers.keys())
+            {
+                m_scheduler->cancel(id);
+            }
+        }
+        else
+        {
+            qDeleteAll(m_indexers);
+            m_indexers.clear();
+        }
+        m_indexing.clear();
+    }
+
+    /**
+     * Unmaps and closes the segment file.
+     */
+    void TrigramIndex::unmapSegment()
+    {
+        if (m_segment)
+        {
+            m_segmentFile.unmap(const_cast<uchar*>(m_segment));
+            m_segment = 0;
+        }
+        m_segmentFile.close();
+        m_segmentIds.clear();
+        m_segmentRemoved.clear();
+    }
+
+    /**
+     * Marks the segment entry of a file as outdated, if there is one.
+     *
+     * @param path stored path of the file
+     */
+    void TrigramIndex::removeFromSegment(const QString& path)
+    {
+        QHash<QString, quint32>::const_iterator id = m_segmentIds.constFind(path);
+        if (id != m_segmentIds.constEnd())
+        {
+            m_segmentRemoved.setBit(id.value());
+        }
+    }
+
+    /**
+     * Returns the stored path of a segment file.
+     *
+     * @param id identifier of the file in the segment
+     * @return stored path
+     */
+    QString TrigramIndex::getSegmentPath(quint32 id) const
+    {
+        const SegmentFile& file = getFiles(m_segment)[id];
+        return QString::fromUtf8(reinterpret_cast<const char*>(m_segment + file.pathOffset),
+                                 int(file.pathLength));
+    }
+
+    /**
+     * Returns the literal a pattern requires, as it appears in the index.
+     *
+     * @param pattern the searched pattern
+     * @return UTF-8 literal; empty if there is none usable
+     */
+    QByteArray TrigramIndex::getQueryLiteral(const QRegExp& pattern) const
+    {
+        QByteArray literal = ContentSearch::getRequiredLiteral(pattern).toUtf8();
+        // only ASCII letters are case folded in the index
+        if (pattern.caseSensitivity() == Qt::CaseInsensitive)
+        {
+            for (int i = 0; i < literal.size(); ++i)
+            {
+                if (static_cast<uchar>(literal.at(i)) >= 0x80)
+                {
+                    return QByteArray();
+                }
+            }
+        }
+
+        return literal;
+    }
+}
@@ -0,0 +1,245 @@
+/**
+ * @file TrigramIndex.h
+ *
+ * Persistent trigram index of project file contents.
+ *
+ * This file is part of the Required library.
+ * Required is free software, licensed under the MIT/X11 License. A copy of
+ * the license is provided with the library in the LICENSE file.
+ *
+ * @package Required
+ * @version 1.0.0-dev
+ * @author Zbigniew Siciarz
+ * @date 2010-2013
+ * @license http://www.opensource.org/licenses/mit-license.php MIT
+ * @since 1.0.0
+ */
+
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+#include "../global.h"
+#include "Project.h"
+#include "TaskScheduler.h"
+#include <QBitArray>
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QRegExp>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+namespace Required
+{
+    /**
+     * Persistent trigram index of project file contents.
+     *
+     * For every file, the index records the set of three-byte sequences
+     * occurring in it, with ASCII letters folded to lower case. A content
+     * search for a pattern requiring a literal only needs to read the files
+     * containing every trigram of that literal.
+     *
+     * The index consists of a segment stored on disk, memory mapped and
+     * never modified in place, and of an in-memory overlay with files
+     * indexed since the segment was written. save() merges both into a new
+     * segment. Files are tracked by the project's fileAdded() and
+     * fileRemoved() signals and re-indexed by update(), which reads them in
+     * background tasks and emits updated() once their results are merged;
+     * refresh() finds files whose size or modification time changed behind
+     * the project's back, e.g. while the application wasn't running.
+     *
+     * Files which can't be indexed (too large, unreadable) and files not
+     * indexed yet, including those being indexed, are always candidates. Files modified since they were
+     * indexed are not noticed until refresh() is called, so until then
+     * their outdated entries may hide matches.
+     */
+    class REQUIRED_EXPORT TrigramIndex : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        explicit TrigramIndex(Project* project, QObject* parent = 0);
+        ~TrigramIndex();
+
+        /**
+         * Returns the scheduler running the indexing tasks.
+         *
+         * @return task scheduler
+         */
+        TaskScheduler* getScheduler() const
+        {
+            return m_scheduler;
+        }
+
+        /**
+         * Sets the scheduler running the indexing tasks.
+         *
+         * The index doesn't take ownership of the scheduler. Should not be
+         * changed while an update is running.
+         *
+         * @param scheduler task scheduler, 0 for the default one
+         */
+        void setScheduler(TaskScheduler* scheduler)
+        {
+            m_scheduler = scheduler ? scheduler : TaskScheduler::getDefault();
+        }
+
+        /**
+         * Returns the size of the largest file indexed.
+         *
+         * @return size in bytes
+         */
+        qint64 getMaxFileSize() const
+        {
+            return m_maxFileSize;
+        }
+
+        /**
+         * Sets the size of the largest file indexed.
+         *
+         * Larger files are always search candidates.
+         *
+         * @param maxFileSize size in bytes
+         */
+        void setMaxFileSize(qint64 maxFileSize)
+        {
+            m_maxFileSize = maxFileSize;
+        }
+
+        /**
+         * Returns the number of files waiting to be indexed.
+         *
+         * @return pending file count, including files being indexed
+         */
+        int getPendingCount() const
+        {
+            return m_pending.size() + m_indexing.size();
+        }
+
+        /**
+         * Checks whether an update is in progress.
+         *
+         * @return true until updated() is emitted
+         */
+        bool isUpdating() const
+        {
+            return !m_indexers.isEmpty();
+        }
+
+        int getFileCount() const;
+
+        bool load(QString indexPath);
+        bool save(QString indexPath);
+        void update();
+        void refresh();
+        void waitForUpdated();
+
+        bool isSelective(const QRegExp& pattern) const;
+        QSet<QString> getCandidates(const QRegExp& pattern) const;
+
+        static QString getIndexPath(QString projectFilename);
+
+    signals:
+        void updated();
+
+    private slots:
+        void onFileAdded(QString filename, QString categoryShortName);
+        void onFileRemoved(QString filename, QString categoryShortName);
+        void onRelocated(QString rootPath);
+        void onRootPathChanged(QString rootPath);
+        void onIndexerFinished(int id, bool cancelled);
+
+    private:
+        Q_DISABLE_COPY(TrigramIndex)
+
+        class Indexer;
+
+        /**
+         * A file indexed since the segment was written.
+         */
+        struct OverlayEntry
+        {
+            qint64 size;
+            qint64 lastModified;
+
+            /**
+             * False if the file couldn't be indexed.
+             */
+            bool indexed;
+
+            /**
+             * Sorted, unique trigrams of the file.
+             */
+            QVector<quint32> trigrams;
+        };
+
+        /**
+         * Non-owning pointer to the indexed project.
+         */
+        QPointer<Project> m_project;
+
+        /**
+         * Non-owning pointer to the scheduler running the indexing tasks.
+         */
+        QPointer<TaskScheduler> m_scheduler;
+
+        /**
+         * Size of the largest file indexed.
+         */
+        qint64 m_maxFileSize;
+
+        /**
+         * The segment file; its contents are mapped while it's open.
+         */
+        QFile m_segmentFile;
+
+        /**
+         * Mapped segment, 0 if there is none.
+         */
+        const uchar* m_segment;
+
+        /**
+         * Segment file identifiers by stored path.
+         */
+        QHash<QString, quint32> m_segmentIds;
+
+        /**
+         * Segment files which were removed or re-indexed since.
+         */
+        QBitArray m_segmentRemoved;
+
+        /**
+         * Files indexed since the segment was written, by stored path.
+         */
+        QHash<QString, OverlayEntry> m_overlay;
+
+        /**
+         * Stored paths of files waiting to be indexed.
+         */
+        QSet<QString> m_pending;
+
+        /**
+         * Identifiers of the tasks indexing files, by stored path. A file
+         * changed or removed while being indexed is taken out, so the
+         * outdated result is dropped.
+         */
+        QHash<QString, int> m_indexing;
+
+        /**
+         * Scheduled indexing tasks, by identifier.
+         */
+        QHash<int, Indexer*> m_indexers;
+
+        TaskScheduler* scheduler() const;
+        void cancelIndexing();
+        void unmapSegment();
+        void removeFromSegment(const QString& path);
+        QString getSegmentPath(quint32 id) const;
+        QByteArray getQueryLiteral(const QRegExp& pattern) const;
+    };
+}
+
+#endif // TRIGRAMINDEX_H